@@ -16,14 +16,39 @@ const uint32_t CACHE_GEN = 4;
 const uint32_t END_EXP = 5;
 const uint32_t DEAD_SEND = 6;
 const uint32_t DUMMY = 7;
+const uint32_t PATH_SEGMENT = 8;
+const uint32_t CACHE_PREFETCH_REQUEST = 9;
+const uint32_t CACHE_PREFETCH_RESPONSE = 10;
+
+// PATH_SEGMENT_MODE の値
+const uint32_t PATH_SEGMENT_OFF = 0;
+const uint32_t PATH_SEGMENT_GATHER = 1;
+const uint32_t PATH_SEGMENT_LOCAL = 2;
+
+// PPR_COUNT_MODE の値
+const uint32_t PPR_COUNT_OFF = 0;
+const uint32_t PPR_COUNT_ENDPOINT = 1;
+const uint32_t PPR_COUNT_VISIT = 2;
+
+// PPR_TABLE_KIND の値
+const uint32_t PPR_TABLE_EXACT = 0;
+const uint32_t PPR_TABLE_SPACE_SAVING = 1;
+
+// CACHE_POLICY の値
+const uint32_t CACHE_POLICY_NONE = 0;
+const uint32_t CACHE_POLICY_CLOCK = 1;
+const uint32_t CACHE_POLICY_TINYLFU = 2;
+
+// TRANSPORT_ENGINE の値
+const uint32_t UDP_ENGINE = 0;
+const uint32_t IO_URING_ENGINE = 1;
+const uint32_t TCP_ENGINE = 2;
+const uint32_t LOOPBACK_ENGINE = 3;
 
 // ver_id_ のマスク
 const uint32_t MASK_VER = (1<<7) + (1<<6) + (1<<5) + (1<<4);
 const uint32_t MASK_MESSEGEID = (1<<3) + (1<<2) + (1<<1) + (1<<0);
 
-// procMessage の中断用フラグ
-bool PROC_MESSAGE_FLAG = true;
-
 // RW 終了時に checkRWer をするかどうか
 bool CHECK_RWER_FLAG = false;
 
@@ -47,8 +72,66 @@ const double ALPHA = 0.15;
 // その場合 unordered_map 等を使ってグラフデータの管理を行うことになる
 const uint64_t VERTEX_SIZE = 5000000;
 
-// 「cacheエッジ数 + 元々持ってるエッジ数」の最大値
-const uint32_t MAX_CACHE_SIZE = 200;
+// グラフファイルと一緒に分割時に作った ghost 頂点 (持ち主が他サーバの隣接頂点) の表 (.ghost) を読み, 次数と持ち主をキャッシュに入れておく
+// 他サーバの頂点に初めて移った時も次数が分かるので, 遷移先の index を選んでから持ち主に送れる (隣接リストが要る時だけ送る)
+bool GHOST_TABLE_FLAG = true;
+
+// キャッシュ (他サーバの頂点の次数と隣接リストの index) に使うメモリ量 (Byte)
+uint64_t CACHE_MEMORY_BUDGET = 1<<26;
+
+// キャッシュが埋まった時の方針
+// CACHE_POLICY_NONE: 追い出さない (登録できなくなったら cache 補充用の実行を止める)
+// CACHE_POLICY_CLOCK: 参照ビットで最近参照されていないものを追い出す
+// CACHE_POLICY_TINYLFU: CLOCK で選んだものより参照頻度 (Count-Min Sketch で推定) が大きいときだけ追い出して入れる
+uint32_t CACHE_POLICY = CACHE_POLICY_TINYLFU;
+
+// CACHE_POLICY_TINYLFU の参照頻度は参照 CACHE_SKETCH_SAMPLE 回に 1 回だけ数える (2 の冪, 全キー同じ割合なので大小の比較は変わらない)
+// 数えた回数の合計はスレッド毎に CACHE_SKETCH_ADDITION_BATCH 回溜めてから足す (全スレッドで 1 つのカウンタへの RMW を減らす)
+const uint32_t CACHE_SKETCH_SAMPLE = 4;
+const uint32_t CACHE_SKETCH_ADDITION_BATCH = 64;
+
+// キャッシュの表のバケットのスロット数 (追い出すものはバケットの中から選ぶ)
+const uint32_t CACHE_BUCKET_WAYS = 8;
+
+// キャッシュの表の書き込み用のロック数 (バケットで分ける)
+const uint32_t CACHE_LOCK_NUM = 1024;
+
+// cache 補充の方法
+// true: 点数 (自サーバの頂点から一歩で移る確率) の高い他サーバの頂点の隣接リストを持ち主にまとめて要求する (CachePrefetcher)
+// false: cache 補充用の RW を MAX_RWER_NUM_FOR_CACHE 個実行し, 全経路が揃った RWer の経路から登録する
+bool CACHE_PREFETCH_FLAG = true;
+
+// 隣接リストを要求する頂点数の上限
+const uint32_t CACHE_PREFETCH_VERTEX_NUM = 1<<16;
+
+// 1 頂点あたり返す隣接リストの長さの上限 (次数の大きい頂点は先頭から)
+const uint32_t CACHE_PREFETCH_MAX_ROW = 1<<12;
+
+// 1 つの要求レコードに入れる頂点数, 1 つの応答レコードに入れる隣接頂点数 (メッセージに収まる大きさ)
+const uint32_t CACHE_PREFETCH_REQUEST_BATCH = 512;
+const uint32_t CACHE_PREFETCH_RESPONSE_BATCH = 256;
+
+// 全ての応答を待つ時間の上限 (ms)
+const uint32_t CACHE_PREFETCH_TIMEOUT_MS = 10000;
+
+// 補充したキャッシュをスナップショットとして保存し, 次の実行で読み込む (同じグラフファイルと設定なら cache 補充を省く)
+bool CACHE_SNAPSHOT_FLAG = false;
+
+// スナップショットを置くディレクトリ (CACHE_SNAPSHOT_DIR + "cache_" + HostID + ".bin")
+const char* CACHE_SNAPSHOT_DIR = "../output/";
+
+// メインの実験で全経路が揃った RWer (他サーバを通ったもの) の経路も裏の補助スレッドでキャッシュに入れる (CacheLearner)
+// (cache 補充の実行の RWer は常に CacheLearner を通して入れる)
+bool CACHE_LEARN_FLAG = true;
+
+// executor から補助スレッドに RWer を渡すキューの大きさ (満杯なら cache 補充の実行では空くまで待ち, メインの実験では捨てる)
+const uint32_t CACHE_LEARN_QUEUE_SIZE = 1<<14;
+
+// 補助スレッドが一度に取り出して重複を除く RWer 数
+const uint32_t CACHE_LEARN_BATCH = 256;
+
+// 補助スレッドの nice 値 (SCHED_BATCH にした上で下げる, SCHED_IDLE だと RW 実行中はほとんど動けず登録できない)
+const int CACHE_LEARN_NICE = 10;
 
 // cache 用の実行における RWer の最大生成数
 const uint64_t MAX_RWER_NUM_FOR_CACHE = 100000; 
@@ -59,20 +142,199 @@ const uint32_t RW_STEP = 500000; // cache 補充用の実行
 // RWer 生成の sleep 時間 (s)
 const uint32_t GENERATE_SLEEP_TIME = 4; // cache 補充用の実行
 
-// message 処理スレッドの数
-uint32_t PROC_MESSAGE_THREAD_NUM = 15; // メイン実行用
-uint32_t PROC_MESSAGE_CACHE_THREAD_NUM = 10; // cache 補充用の実行
+// message 処理スレッド (executor) の数
+uint32_t PROC_MESSAGE_THREAD_NUM = 15;
 
 // 送信キューの数 (サーバ数、グラフ分割数)
 uint32_t SEND_QUEUE_NUM = 5;
 
-// 受信スレッド数 (実験で使用するポート番号数)
+// 送信スレッドのバッチ方針
+// 送信キューに SEND_BATCH_THRESHOLD 個溜まるか, 最初の RWer が来てから SEND_LATENCY_DEADLINE_US (us) 経ったら送信
+// (閾値を上げるとパケットが大きくなり, 期限を下げると遅延が小さくなる)
+const uint32_t SEND_BATCH_THRESHOLD = 32;
+const uint32_t SEND_LATENCY_DEADLINE_US = 200;
+
+// 受信スレッド数 (実験で使用するポート番号数, USE_SO_REUSEPORT でない場合と io_uring エンジン)
 const uint32_t RECV_PORT = 4;
 
+// UDP エンジンで 1 つのポートに SO_REUSEPORT で受信スレッド毎のソケットを bind するか
+// カーネルが送信元アドレス・ポートのハッシュでソケットに振り分けるので, 受信スレッド数をコア数に合わせて増やせる
+// 受信したバッチは受信スレッド毎に決まった executor スレッドのキューに入れる
+// 同じポートに前の worker のソケットが残っていると受信を分け合ってしまうので, 起動時にポートが空いていなければ止める (既定は使わない)
+bool USE_SO_REUSEPORT = false;
+
+// USE_SO_REUSEPORT の受信スレッド (ソケット) 数 (0 なら RUNTIME_CORE_NUM (0 なら hardware_concurrency) / 4, 最低 1)
+uint32_t REUSEPORT_RECV_THREAD_NUM = 0;
+
+// USE_SO_REUSEPORT で送信先毎に使う送信ソケット数
+// カーネルは送信元ポートも含めたハッシュで受信ソケットを選ぶので, 送信ソケットをバッチ毎に替えて受信スレッドに散らす
+const uint32_t REUSEPORT_SEND_SOCKET_NUM = 4;
+
+// USE_SO_REUSEPORT で, 受信スレッドをコアに固定し, パケットを受け取ったコアに固定した受信スレッドのソケットを選ぶ BPF を付けるか
+// (NIC の受信キューの割り込みをコアに分けておくと, 受信キューから executor まで同じコアの近くで処理される)
+const bool USE_REUSEPORT_CPU_STEERING = false;
+
 // RWer 生成スレッド数
 const uint32_t GENERATE_RWER_THREAD_NUM = 15; // メイン実行用
 const uint32_t GENERATE_RWER_CACHE_THREAD_NUM = 4; // cache 補充用の実行
 
+// スレッドプールが使うコア数 (0 なら hardware_concurrency)
+// generator + executor + 送受信スレッドがこれを超えないように generator, executor を減らす
+uint32_t RUNTIME_CORE_NUM = 0;
+
+// sendmmsg / recvmmsg で 1 回のシステムコールで送受信するデータグラム数
+const uint32_t UDP_BATCH_SIZE = 16;
+
+// UDP GSO (UDP_SEGMENT) / GRO (UDP_GRO) を使うか (カーネルが対応していなければ自動で無効)
+const bool USE_UDP_GSO = false;
+const bool USE_UDP_GRO = false;
+
+// RWer のメッセージを運ぶ通信エンジン (UDP_ENGINE / IO_URING_ENGINE / TCP_ENGINE / LOOPBACK_ENGINE)
+// io_uring が使えない環境では UDP_ENGINE に戻す
+uint32_t TRANSPORT_ENGINE = UDP_ENGINE;
+
+// io_uring エンジンの受信スレッド数 (全 RECV_PORT のソケットをこのスレッド数で分担)
+const uint32_t IO_URING_RECV_THREAD_NUM = 1;
+
+// io_uring エンジンの受信用 provided buffer の数 (2 の冪)
+const uint32_t IO_URING_RECV_BUFFER_NUM = 256;
+
+// TCP エンジンのポート番号 (ホストの組毎に 1 本の接続)
+const uint16_t TCP_DATA_PORT = 10100;
+
+// TCP エンジンで TCP_NODELAY を付けるか (メッセージは UDP_BATCH_SIZE 個ずつ writev でまとめて書く)
+const bool TCP_NODELAY_FLAG = true;
+
+// TCP エンジンの接続毎の受信バッファ (Byte, MESSAGE_MAX_LENGTH_SEND + 4 以上)
+const uint32_t TCP_RECV_BUFFER_SIZE = 1<<20;
+
+// LOOPBACK_ENGINE (1 プロセス内の worker 間) の疑似ネットワーク
+// 送信元と送信先の組毎の遅延 (us), 帯域 (Mbps, 0 なら制限なし), メッセージのロス率
+uint32_t LOOPBACK_LATENCY_US = 0;
+uint32_t LOOPBACK_BANDWIDTH_MBPS = 0;
+double LOOPBACK_LOSS_RATE = 0;
+
+// 1 台に複数の worker を置く場合 (server.txt に同じ IP アドレスを複数行書く),
+// 同じ IP アドレスの k 番目の worker は使うポート番号を全て k * HOST_PORT_STRIDE ずらす
+const uint16_t HOST_PORT_STRIDE = 1000;
+
+// 同じ IP アドレスの worker へは通信エンジンに関わらず共有メモリのリング (SPSC) で送る
+const bool USE_SHM_TRANSPORT = true;
+
+// 共有メモリのリングの大きさ (Byte, 2 の冪, 送信元と送信先の組毎に 1 つ)
+const uint32_t SHM_RING_SIZE = 1<<23;
+
+// 共有メモリの受信待ちのスピン回数 (この回数スピンしても届かなければ SHM_POLL_SLEEP_US (us) スリープ)
+const uint32_t SHM_POLL_SPIN_COUNT = 1<<12;
+const uint32_t SHM_POLL_SLEEP_US = 20;
+
 // メッセージ長
 const uint32_t MESSAGE_MAX_LENGTH_SEND = 8950;
-const uint32_t MESSAGE_MAX_LENGTH_RECV = 8950;
\ No newline at end of file
+const uint32_t MESSAGE_MAX_LENGTH_RECV = 8950;
+
+// メッセージキュー (リングバッファ) の容量 (2 の冪に切り上げ)
+const uint32_t MESSAGE_QUEUE_CAPACITY = 1<<18;
+
+// キュー待機時のスピン回数 (この回数スピンしても進めなければスリープ)
+const uint32_t QUEUE_SPIN_COUNT = 1<<12;
+
+// 送信先毎の「送信キュー長 + 未返却 credit (送信済みで送信先がまだ処理していない RWer 数)」の上限
+// どれかの送信先がこれを超えると RWer の生成を止める
+const uint32_t MAX_IN_FLIGHT_RWER = 1<<17;
+
+// 返却する credit がこれ以上溜まったら RWer がなくても返却用メッセージを送る
+const uint32_t CREDIT_RETURN_THRESHOLD = 1<<10;
+
+// credit が返ってこない時に未返却分を破棄するまでの時間 (ms) (送信先が応答しなくなった場合の保険)
+const uint32_t CREDIT_TIMEOUT_MS = 1000;
+
+// credit 待ちの sleep 時間 (us)
+const uint32_t CREDIT_WAIT_SLEEP_US = 50;
+
+// 送受信のパケットバッファのプール (BufferPool) の空きリストの分割数 (ロックの粒度)
+const uint32_t BUFFER_POOL_SHARD_NUM = 16;
+
+// 再送制御
+// 送信先毎に ack 待ちのメッセージを保持する再送バッファのメッセージ数 (2 の冪, 受信側の重複検出の窓も同じ大きさ)
+const uint32_t RETRANSMIT_BUFFER_NUM = 256;
+
+// ack が返ってこないメッセージを再送するまでの時間 (us)
+const uint32_t RETRANSMIT_TIMEOUT_US = 5000;
+
+// 再送 / ack が必要な送信先を確認する間隔 (us)
+const uint32_t RETRANSMIT_CHECK_US = 1000;
+
+// 返していない ack がこれだけ溜まったら, 逆向きの RWer がなくても ack だけを送る
+const uint32_t ACK_EAGER_THRESHOLD = 16;
+
+// ack を返さずにおく最大時間 (us)
+const uint32_t ACK_DELAY_US = 500;
+
+// 再送バッファの空き待ちの sleep 時間 (us)
+const uint32_t RETRANSMIT_WAIT_SLEEP_US = 50;
+
+// 経路の持ち方
+// PATH_SEGMENT_OFF: RWer が全経路を持って移動する
+// PATH_SEGMENT_GATHER: 送信時に一歩前と現在の頂点より前の経路 (セグメント) を切り離して起点サーバに別に送り, 終了時に組み立てる
+// PATH_SEGMENT_LOCAL: 切り離したセグメントは作ったサーバに残し, 実験終了の合図で各サーバが PATH_SEGMENT_OUTPUT_DIR に書き出す
+//                     (cache 補充の実行では起点サーバで全経路が要るので切り離さない)
+// どちらも RWer が運ぶ経路は歩数に関わらず一定になる
+uint32_t PATH_SEGMENT_MODE = PATH_SEGMENT_OFF;
+
+// PATH_SEGMENT_LOCAL の書き出し先 (segments_<HostID>.bin)
+const char* PATH_SEGMENT_OUTPUT_DIR = "../output/";
+
+// セグメントを置いておく表の分割数 (ロックの粒度)
+const uint32_t PATH_SEGMENT_SHARD_NUM = 64;
+
+// 終了した RWer の経路 (頂点列) の書き出し (WalkOutputSink)
+// 起点サーバで全経路が揃った RWer を WALK_OUTPUT_DIR の walks_<HostID>_<書き込みスレッド>_<通し番号>.bin に追記する
+// (PATH_SEGMENT_LOCAL では全経路が揃わないので segments_<HostID>.bin を使う)
+bool WALK_OUTPUT_FLAG = false;
+
+// 書き出し先
+const char* WALK_OUTPUT_DIR = "../output/";
+
+// 1 ファイル (mmap するセグメント) の大きさ (Byte), 使い切ったら次のファイルにする
+const uint64_t WALK_OUTPUT_SEGMENT_SIZE = 1ULL<<28;
+
+// 書き込みスレッド数の上限 (executor + generator スレッドが 1 つずつ使う)
+const uint32_t WALK_OUTPUT_MAX_WRITER_NUM = 256;
+
+// Personalized PageRank 推定のための (起点頂点, 頂点) 毎の回数の集計 (PprAggregator)
+// PPR_COUNT_ENDPOINT: RWer の終点を数える (終了確率 ALPHA の RW の終点の分布が PPR)
+// PPR_COUNT_VISIT: 経路上の全頂点を数える (全経路が要るので PATH_SEGMENT_LOCAL では使えない)
+// 起点頂点の持ち主 (= RWer の起点サーバ) で数え, 実験終了の合図で PPR_OUTPUT_DIR の ppr_<HostID>.txt に起点頂点毎の上位 PPR_TOP_K 個を書き出す
+uint32_t PPR_COUNT_MODE = PPR_COUNT_OFF;
+
+// 集計の表
+// PPR_TABLE_EXACT: 起点頂点毎に全頂点の回数を持つ (正確, メモリは訪れた頂点数に比例)
+// PPR_TABLE_SPACE_SAVING: 起点頂点毎に PPR_SPACE_SAVING_SIZE 個の Space-Saving カウンタ (メモリは起点頂点数 * PPR_SPACE_SAVING_SIZE で抑えられる)
+uint32_t PPR_TABLE_KIND = PPR_TABLE_EXACT;
+
+// 起点頂点毎の Space-Saving カウンタ数 (PPR_TOP_K より十分大きくする)
+const uint32_t PPR_SPACE_SAVING_SIZE = 64;
+
+// 書き出す起点頂点毎の上位の数
+const uint32_t PPR_TOP_K = 10;
+
+// スレッド毎に溜めておく回数 (これを超えたら表にまとめる)
+const uint32_t PPR_LOCAL_BUFFER_NUM = 1<<12;
+
+// 表の分割数 (起点頂点で分ける, ロックの粒度)
+const uint32_t PPR_SHARD_NUM = 64;
+
+// 数えるスレッド数の上限 (executor + generator スレッドが 1 つずつ使う)
+const uint32_t PPR_MAX_THREAD_NUM = 256;
+
+// 書き出し先 (ppr_<HostID>.txt)
+const char* PPR_OUTPUT_DIR = "../output/";
+
+// RWer の終了数と latency を記録するスレッド数の上限 (RandomWalkerManager, executor + generator スレッドが 1 つずつ使う)
+const uint32_t RW_MANAGER_MAX_THREAD_NUM = 256;
+
+// 実行中のカウンタとキューの長さを 127.0.0.1:METRICS_PORT (+ 同じマシンの worker 毎のずれ) の HTTP で Prometheus 形式で返すか (Metrics)
+bool METRICS_FLAG = false;
+
+// 待ち受けるポート番号
+uint16_t METRICS_PORT = 9300;
@@ -18,7 +18,7 @@ int main() {
 
     FILE *f = fopen(input_path.c_str(), "r");
     assert(f != NULL);
-    vertex_id_t src, dst;
+    uint64_t src, dst; // VERTEX_ID_32 でも %lu で読む
     while (2 == fscanf(f, "%lu %lu", &src, &dst))
     {
         edges.push_back(Edge<EmptyData>(src, dst));
@@ -2,9 +2,11 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include "../include/type.hpp"
 #include "../include/storage.hpp"
+#include "../include/ownership.hpp"
 
 using namespace std;
 
@@ -40,7 +42,7 @@ int main() {
     vector<vector<Edge_dstIp>> edges(split_num);
     FILE *in_f = fopen(input_path.c_str(), "r");
     assert(in_f != NULL);
-    vertex_id_t src, dst;
+    uint64_t src, dst; // VERTEX_ID_32 でも %lu で読む
     while (2 == fscanf(in_f, "%lu %lu", &src, &dst))
     {
         if (ans == "Yes") {
@@ -53,15 +55,37 @@ int main() {
     }
     fclose(in_f);
 
+    // ghost 頂点 (持ち主が他サーバの隣接頂点) の次数と持ち主
+    vector<vector<GhostVertex>> ghosts;
+    build_ghost_table(edges, ghosts);
+
+    // 頂点 ID % split_num で分けたので持ち主は計算できる
+    Ownership ownership;
+    ownership.initHash(split_num);
+
     for (int i = 0; i < split_num; i++) {
         auto es = edges[i].data();
         auto e_num = edges[i].size();
-        string output_path = "./split_graph/" + str + "/" + to_string(split_num) + "/" + server_id[i] + ".data";
+        // 同じ IP アドレスに複数の worker を置く場合は "IP アドレス_HostID.data"
+        string file_name = server_id[i];
+        if (count(server_id.begin(), server_id.end(), server_id[i]) > 1) file_name += "_" + to_string(i);
+        string output_path = "./split_graph/" + str + "/" + to_string(split_num) + "/" + file_name + ".data";
         FILE *out_f = fopen(output_path.c_str(), "w");
         assert(out_f != NULL);
         auto ret = fwrite(es, sizeof(Edge_dstIp), e_num, out_f);
         assert(ret == e_num);
         fclose(out_f);
+
+        // グラフファイルと同じ名前の .ghost
+        string ghost_path = "./split_graph/" + str + "/" + to_string(split_num) + "/" + file_name + ".ghost";
+        FILE *ghost_f = fopen(ghost_path.c_str(), "w");
+        assert(ghost_f != NULL);
+        ret = fwrite(ghosts[i].data(), sizeof(GhostVertex), ghosts[i].size(), ghost_f);
+        assert(ret == ghosts[i].size());
+        fclose(ghost_f);
+
+        // 分割の情報 (グラフファイルと同じ名前の .owner)
+        ownership.write("./split_graph/" + str + "/" + to_string(split_num) + "/" + file_name + ".owner");
     }
 
     // // test
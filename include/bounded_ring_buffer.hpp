@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// スピン待機中に CPU を少し休ませる
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// 固定長の lock-free リングバッファ (MPMC)
+// 各スロットに sequence 番号を持たせ, producer / consumer はそれぞれ CAS で位置を確保する
+// (Dmitry Vyukov の bounded MPMC queue)
+// capacity は 2 の冪
+template <typename T>
+class BoundedRingBuffer {
+
+public :
+
+    // コンストラクタ (capacity は 2 の冪に切り上げ)
+    BoundedRingBuffer(const uint32_t& capacity);
+
+    // 1 要素を push (満杯なら false)
+    bool tryPush(const T& data);
+
+    // 1 要素を pop (空なら false)
+    bool tryPop(T& data);
+
+    // 容量を入手
+    uint32_t getCapacity();
+
+private :
+
+    struct Cell {
+        std::atomic<uint64_t> sequence_;
+        T data_;
+    };
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    std::unique_ptr<Cell[]> buffer_;
+    uint64_t buffer_mask_;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> enqueue_pos_;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> dequeue_pos_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+inline BoundedRingBuffer<T>::BoundedRingBuffer(const uint32_t& capacity) {
+    uint64_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    buffer_.reset(new Cell[size]);
+    buffer_mask_ = size - 1;
+    for (uint64_t i = 0; i < size; i++) {
+        buffer_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+inline bool BoundedRingBuffer<T>::tryPush(const T& data) {
+    Cell* cell;
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (1) {
+        cell = &buffer_[pos & buffer_mask_];
+        uint64_t seq = cell->sequence_.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) { // 空きスロット, 位置を確保
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) { // 満杯
+            return false;
+        } else { // 他の producer に先を越された
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    cell->data_ = data;
+    cell->sequence_.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline bool BoundedRingBuffer<T>::tryPop(T& data) {
+    Cell* cell;
+    uint64_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (1) {
+        cell = &buffer_[pos & buffer_mask_];
+        uint64_t seq = cell->sequence_.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+        if (diff == 0) { // 書き込み済みスロット, 位置を確保
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) { // 空
+            return false;
+        } else { // 他の consumer に先を越された
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    data = cell->data_;
+    cell->sequence_.store(pos + buffer_mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline uint32_t BoundedRingBuffer<T>::getCapacity() {
+    return buffer_mask_ + 1;
+}
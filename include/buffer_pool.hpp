@@ -0,0 +1,243 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <new>
+#include <iostream>
+
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+class BufferPool;
+
+// プールのバッファ 1 つ (キャッシュライン境界のヘッダの後ろにデータ)
+// 参照数が 0 になったらプールに戻る, 中身はゼロ初期化しない
+
+struct PooledBuffer {
+    BufferPool* pool_;
+    std::atomic<uint32_t> ref_count_;
+
+    static constexpr uint32_t HEADER_SIZE = 64;
+
+    char* data() { return (char*)this + HEADER_SIZE; }
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// プールのバッファへの参照 (コピーで参照数 +1, 破棄で -1)
+
+class BufferRef {
+
+public :
+
+    BufferRef() = default;
+    explicit BufferRef(PooledBuffer* buffer);
+    BufferRef(const BufferRef& other);
+    BufferRef(BufferRef&& other) noexcept;
+    BufferRef& operator=(BufferRef other) noexcept;
+    ~BufferRef();
+
+    // データの先頭 (BufferPool の buffer_size Byte)
+    char* data() const;
+
+    // バッファを持っているか
+    explicit operator bool() const;
+
+    // 参照を手放す
+    void reset();
+
+private :
+
+    PooledBuffer* buffer_ = nullptr;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 大きさの決まったバッファのプール
+// 空きバッファは BUFFER_POOL_SHARD_NUM 個のリストに分けて持ち, スレッド毎に決まったリストから取る (空なら他のリストから取る)
+// どのリストにもなければ新しく確保する (miss), プールに戻ったバッファは解放しない
+
+class BufferPool {
+
+public :
+
+    // 初期化 (バッファ 1 つの大きさ)
+    void init(const uint32_t& buffer_size);
+
+    // バッファを 1 つ入手 (参照数 1)
+    BufferRef acquire();
+
+    // 空きバッファを再利用した回数
+    uint64_t getHitCount();
+
+    // 新しく確保した回数 (= 確保済みのバッファ数)
+    uint64_t getMissCount();
+
+    // 使用中のバッファ数
+    uint64_t getInUseCount();
+
+    // バッファの大きさ
+    uint32_t getBufferSize();
+
+private :
+
+    friend class BufferRef;
+
+    struct alignas(64) Shard {
+        std::mutex mtx_;
+        std::vector<PooledBuffer*> free_;
+    };
+
+    uint32_t buffer_size_ = 0;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> hit_count_ = 0;
+    std::atomic<uint64_t> miss_count_ = 0;
+    std::atomic<uint64_t> in_use_count_ = 0;
+
+    // 参照数が 0 になったバッファを戻す
+    void release(PooledBuffer* buffer);
+
+    // 呼び出したスレッドが使うリスト
+    Shard& getShard();
+
+};
+
+// 送受信のパケット用のプール (プロセスで 1 つ, バッファは MESSAGE_MAX_LENGTH_SEND と MESSAGE_MAX_LENGTH_RECV の大きい方)
+BufferPool& getPacketBufferPool();
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline BufferRef::BufferRef(PooledBuffer* buffer) : buffer_(buffer) {}
+
+inline BufferRef::BufferRef(const BufferRef& other) : buffer_(other.buffer_) {
+    if (buffer_ != nullptr) buffer_->ref_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline BufferRef::BufferRef(BufferRef&& other) noexcept : buffer_(other.buffer_) {
+    other.buffer_ = nullptr;
+}
+
+inline BufferRef& BufferRef::operator=(BufferRef other) noexcept {
+    std::swap(buffer_, other.buffer_);
+    return *this;
+}
+
+inline BufferRef::~BufferRef() {
+    reset();
+}
+
+inline char* BufferRef::data() const {
+    return buffer_->data();
+}
+
+inline BufferRef::operator bool() const {
+    return buffer_ != nullptr;
+}
+
+inline void BufferRef::reset() {
+    if (buffer_ == nullptr) return;
+    if (buffer_->ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) buffer_->pool_->release(buffer_);
+    buffer_ = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void BufferPool::init(const uint32_t& buffer_size) {
+    buffer_size_ = buffer_size;
+    shards_ = std::vector<Shard>(BUFFER_POOL_SHARD_NUM);
+}
+
+inline BufferRef BufferPool::acquire() {
+    PooledBuffer* buffer = nullptr;
+
+    // 自分のリスト, なければ他のリストの空きを使う
+    Shard& own_shard = getShard();
+    {
+        std::lock_guard<std::mutex> lk(own_shard.mtx_);
+        if (!own_shard.free_.empty()) {
+            buffer = own_shard.free_.back();
+            own_shard.free_.pop_back();
+        }
+    }
+    for (uint32_t i = 0; buffer == nullptr && i < shards_.size(); i++) {
+        Shard& shard = shards_[i];
+        std::unique_lock<std::mutex> lk(shard.mtx_, std::try_to_lock);
+        if (!lk.owns_lock() || shard.free_.empty()) continue;
+        buffer = shard.free_.back();
+        shard.free_.pop_back();
+    }
+
+    if (buffer != nullptr) {
+        hit_count_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // キャッシュライン境界に確保 (中身は初期化しない)
+        size_t size = (PooledBuffer::HEADER_SIZE + buffer_size_ + 63) / 64 * 64;
+        void* ptr = std::aligned_alloc(64, size);
+        if (ptr == nullptr) {
+            perror("aligned_alloc");
+            exit(1);
+        }
+        buffer = new (ptr) PooledBuffer();
+        buffer->pool_ = this;
+        miss_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    buffer->ref_count_.store(1, std::memory_order_relaxed);
+    in_use_count_.fetch_add(1, std::memory_order_relaxed);
+    return BufferRef(buffer);
+}
+
+inline uint64_t BufferPool::getHitCount() {
+    return hit_count_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t BufferPool::getMissCount() {
+    return miss_count_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t BufferPool::getInUseCount() {
+    return in_use_count_.load(std::memory_order_relaxed);
+}
+
+inline uint32_t BufferPool::getBufferSize() {
+    return buffer_size_;
+}
+
+inline void BufferPool::release(PooledBuffer* buffer) {
+    in_use_count_.fetch_sub(1, std::memory_order_relaxed);
+    Shard& shard = getShard();
+    std::lock_guard<std::mutex> lk(shard.mtx_);
+    shard.free_.push_back(buffer);
+}
+
+inline BufferPool::Shard& BufferPool::getShard() {
+    static std::atomic<uint32_t> thread_count = 0;
+    thread_local uint32_t shard_id = thread_count.fetch_add(1) % BUFFER_POOL_SHARD_NUM;
+    return shards_[shard_id];
+}
+
+inline BufferPool& getPacketBufferPool() {
+    static BufferPool& pool = []() -> BufferPool& {
+        static BufferPool instance;
+        instance.init(std::max(MESSAGE_MAX_LENGTH_SEND, MESSAGE_MAX_LENGTH_RECV));
+        return instance;
+    }();
+    return pool;
+}
@@ -1,12 +1,57 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "type.hpp"
 #include "../config/param.hpp"
 #include "cache_helper.hpp"
 #include "random_walker.hpp"
 #include "graph.hpp"
+#include "util.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// キャッシュのスナップショットの形式 (CACHE_SNAPSHOT_FLAG)
+//
+// ヘッダ (64 Byte):
+// マジック, グラフファイルのチェックサム, CACHE_MEMORY_BUDGET, CACHE_POLICY (32bit) + HostID (32bit),
+// 持ち主のレコード数, エントリのレコード数, レコード部分のチェックサム, あまり
+//
+// レコード (16 Byte):
+// 持ち主: 頂点 ID, HostID (持ち主のレコード数だけ)
+// エントリ: 頂点 ID (上位 32bit) + index (下位 32bit, 次数は SimpleCache::DEGREE_INDEX), 値 (エントリのレコード数だけ)
+//
+// グラフファイルかキャッシュの設定が変わっていたら読み込まない (古いスナップショット)
+// 読み込みは全レコードを表に登録し直すので, 時間はレコード数に比例する (cache 補充の RW / 隣接リストの要求よりは十分速い)
+
+struct CacheSnapshotHeader {
+    uint64_t magic_;
+    uint64_t partition_checksum_;
+    uint64_t memory_budget_;
+    uint32_t policy_;
+    uint32_t hostid_;
+    uint64_t host_record_num_;
+    uint64_t entry_record_num_;
+    uint64_t record_checksum_;
+    uint64_t reserved_;
+};
+
+struct CacheSnapshotRecord {
+    uint64_t first_;
+    uint64_t second_;
+};
+
+const uint64_t CACHE_SNAPSHOT_MAGIC = 0x3145484341435752; // "RWCACHE1"
 
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -16,27 +61,22 @@ class Cache {
 
 public :
 
-    void init();
+    // 頂点の持ち主を計算できる分割 (Ownership::isComputed) なら持ち主の表を持たずに ownership に聞く
+    void init(const Ownership& ownership);
 
-    // 頂点に対するキャッシュの次数情報を入手
+    // 頂点に対するキャッシュの次数情報を入手 (なければ INF)
     index_t getDegree(const vertex_id_t& node_id);
 
-    // 頂点の持ち主の ホストIDを入手
+    // 頂点の持ち主の ホストIDを入手 (登録していなければ INF, 持ち主を計算できる分割では常に分かる)
     host_id_t getHostId(const vertex_id_t& node_id);
 
-    // キャッシュの次数存在確認
-    bool hasDegree(const vertex_id_t& node_id);
-
     // 隣接リスト情報内の index 存在確認
     // 存在したら next node ID を返す
     // 存在しなかったら INF を返す
     vertex_id_t getNextNodeID(const vertex_id_t& node_id, const index_t& index_num);
 
-    // RWer の経路情報からグラフデータをキャッシュとして保存
-    void addRWer(std::unique_ptr<RandomWalker>&& RWer_ptr, Graph& graph);
-
-    // エッジをキャッシュに登録
-    void addEdge(const std::vector<vertex_id_t>& path, const index_t& node_u_idx, const index_t& node_v_idx, Graph& graph);
+    // (頂点, index) が登録されているか (参照した回数には数えない, 次数は index を SimpleCache::DEGREE_INDEX とする)
+    bool hasEntry(const vertex_id_t& node_id, const index_t& index_num);
 
     // ホストID 情報を登録
     void registerHostId(const vertex_id_t& node_id, const host_id_t& host_id);
@@ -50,13 +90,37 @@ public :
     // キャッシュのエッジカウント 
     edge_id_t getEdgeCount();
 
+    // 参照した回数と当たった回数, 容量, 追い出した数を出力
+    void printStats();
+
+    // 参照した回数と当たった回数の数え始めを今にする (メインの実験の開始時, 累計は戻さない)
+    void resetStats();
+
+    // 次数と index を参照した回数, 当たった回数 (全スレッドの合計, resetStats から)
+    uint64_t getDegreeLookupCount();
+    uint64_t getDegreeHitCount();
+    uint64_t getIndexLookupCount();
+    uint64_t getIndexHitCount();
+
+    // 次数と index が当たった回数, 外れた回数 (全スレッドの合計, 起動からの累計で減らない)
+    uint64_t getTotalDegreeHitCount();
+    uint64_t getTotalDegreeMissCount();
+    uint64_t getTotalIndexHitCount();
+    uint64_t getTotalIndexMissCount();
+
+    // キャッシュをスナップショットとして file_path に書き出す (一時ファイルに書いてから置き換える, 書いている間に登録されたものは入らないことがある)
+    void writeSnapshot(const std::string& file_path, const host_id_t& hostid, const uint64_t& partition_checksum);
+
+    // file_path のスナップショットが同じグラフファイルと設定で書かれたものなら, レコードを 1 つずつキャッシュに登録し直す (登録したら true)
+    // (ファイルは読むために mmap するだけで, キャッシュの表がファイルを指すわけではない, 読み終えたら閉じる)
+    bool readSnapshot(const std::string& file_path, const host_id_t& hostid, const uint64_t& partition_checksum);
+
 private :
 
     // キャッシュ情報
-    std::vector<index_t> degree_; // 他サーバが持ち主となるノードの次数
-    std::vector<host_id_t> host_id_; // 持ち主が他サーバの頂点に関する, 持ち主のホストID {ノード ID : ホストID (ノードの持ち主)}
-    SimpleCache adjacency_list_;
-    std::vector<bool> has_v_;
+    std::vector<host_id_t> host_id_; // 持ち主が他サーバの頂点に関する, 持ち主のホストID {ノード ID : ホストID (ノードの持ち主)} (持ち主を計算できなければ)
+    const Ownership* ownership_ = nullptr; // 持ち主を計算できる分割なら使う
+    SimpleCache adjacency_list_; // 他サーバが持ち主となるノードの次数と隣接リストの index
 
 };
 
@@ -65,92 +129,176 @@ private :
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-inline void Cache::init() {
-    degree_.resize(VERTEX_SIZE);
-    host_id_.resize(VERTEX_SIZE);
-    has_v_.resize(VERTEX_SIZE);
+inline void Cache::init(const Ownership& ownership) {
+    if (ownership.isComputed()) {
+        ownership_ = &ownership;
+        host_id_.clear();
+    } else {
+        ownership_ = nullptr;
+        host_id_.assign(VERTEX_SIZE, INF);
+    }
     adjacency_list_.init();
 }
 
 inline index_t Cache::getDegree(const vertex_id_t& node_id) {
-    return degree_[node_id];
+    return adjacency_list_.getDegree(node_id);
 }
 
 inline host_id_t Cache::getHostId(const vertex_id_t& node_id) {
+    if (ownership_ != nullptr) return ownership_->getOwner(node_id);
     return host_id_[node_id];
 }
 
-inline bool Cache::hasDegree(const vertex_id_t& node_id) {
-    return has_v_[node_id];
-}
-
 inline vertex_id_t Cache::getNextNodeID(const vertex_id_t& node_id, const index_t& index_num) {
     return adjacency_list_.getNextNodeID(node_id, index_num);
 }
 
-inline void Cache::addRWer(std::unique_ptr<RandomWalker>&& RWer_ptr, Graph& graph) {
-    // debug
-    // std::cout << "addRWer" << std::endl;
+inline bool Cache::hasEntry(const vertex_id_t& node_id, const index_t& index_num) {
+    return adjacency_list_.getTable().contains(node_id, index_num);
+}
 
-    uint16_t path_length = 0;
-    std::vector<uint64_t> path; // path: (頂点, ホストID, 次数, indexuv, indexvu), (), (), ... 
-    RWer_ptr->getPath(path_length, path);
+inline void Cache::registerHostId(const vertex_id_t& node_id, const host_id_t& host_id) {
+    if (ownership_ != nullptr) return;
+    host_id_[node_id] = host_id;
+}
 
-    // debug
-    // std::cout << "path_length: " << path_length << std::endl;
-    // std::cout << "path size: " << path.size() << std::endl;
+inline void Cache::registerDegree(const vertex_id_t& node_id, const index_t& degree) {
+    adjacency_list_.setDegree(node_id, degree);
+}
 
-    for (int i = 0; i < path_length-1; i++) {
-        // エッジをキャッシュに追加 (無向グラフ)
-        addEdge(path, i*5, (i+1)*5, graph);
+inline void Cache::registerIndex(const vertex_id_t& node_id_u, const vertex_id_t& node_id_v, const index_t& index_num) {
+    adjacency_list_.setIndex(node_id_u, index_num, node_id_v);
+}
 
-        // debug 
-        // std::cout << i << std::endl;
-    }
+inline edge_id_t Cache::getEdgeCount() {
+    return adjacency_list_.getSize();
+}
 
-    // debug 
-    // std::cout << "addRWer ok" << std::endl;
+inline void Cache::printStats() {
+    uint64_t index_lookup = adjacency_list_.getIndexLookupCount();
+    uint64_t index_hit = adjacency_list_.getIndexHitCount();
+    uint64_t degree_lookup = adjacency_list_.getDegreeLookupCount();
+    uint64_t degree_hit = adjacency_list_.getDegreeHitCount();
+    ConcurrentIndexTable& table = adjacency_list_.getTable();
+
+    std::cout << "cache degree lookup: " << degree_lookup << ", hit: " << degree_hit << ", hit rate: " << (degree_lookup > 0 ? (double)degree_hit / degree_lookup : 0) << std::endl;
+    std::cout << "cache index lookup: " << index_lookup << ", hit: " << index_hit << ", hit rate: " << (index_lookup > 0 ? (double)index_hit / index_lookup : 0) << std::endl;
+    std::cout << "cache entries: " << table.getSize() << " (degree: " << adjacency_list_.getDegreeNum() << ", index: " << adjacency_list_.getSize() << ")"
+              << ", capacity: " << table.getCapacity() << ", memory: " << table.getMemorySize()
+              << ", evicted: " << table.getEvictCount() << ", rejected: " << table.getRejectCount() << std::endl;
 }
 
-inline void Cache::addEdge(const std::vector<vertex_id_t>& path, const index_t& node_u_idx, const index_t& node_v_idx, Graph& graph) {
-    // debug
-    // std::cout << "AddEdge" << std::endl;
+inline void Cache::resetStats() {
+    adjacency_list_.resetStats();
+}
 
-    uint32_t node_id_u = path[node_u_idx];
-    uint32_t node_id_v = path[node_v_idx];
-    uint32_t host_id_u = path[node_u_idx + 1];
-    uint32_t host_id_v = path[node_v_idx + 1];
-    uint32_t degree_u = path[node_u_idx + 2];
-    uint32_t degree_v = path[node_v_idx + 2];
-    uint32_t index_uv = path[node_v_idx + 3];
-    uint32_t index_vu = path[node_v_idx + 4];
+inline uint64_t Cache::getDegreeLookupCount() {
+    return adjacency_list_.getDegreeLookupCount();
+}
 
-    if (!graph.hasVertex(node_id_u)) {
-        registerHostId(node_id_u, host_id_u);
-        if (degree_u != INF) registerDegree(node_id_u, degree_u);
-        if (index_uv != INF) registerIndex(node_id_u, node_id_v, index_uv);
-    }
+inline uint64_t Cache::getDegreeHitCount() {
+    return adjacency_list_.getDegreeHitCount();
+}
 
-    if (!graph.hasVertex(node_id_v)) {
-        registerHostId(node_id_v, host_id_v);
-        if (degree_v != INF) registerDegree(node_id_v, degree_v);
-        if (index_vu != INF) registerIndex(node_id_v, node_id_u, index_vu);
-    }
+inline uint64_t Cache::getIndexLookupCount() {
+    return adjacency_list_.getIndexLookupCount();
 }
 
-inline void Cache::registerHostId(const vertex_id_t& node_id, const host_id_t& host_id) {
-    host_id_[node_id] = host_id;
+inline uint64_t Cache::getIndexHitCount() {
+    return adjacency_list_.getIndexHitCount();
 }
 
-inline void Cache::registerDegree(const vertex_id_t& node_id, const index_t& degree) {
-    degree_[node_id] = degree;
-    has_v_[node_id] = true;
+inline uint64_t Cache::getTotalDegreeHitCount() {
+    return adjacency_list_.getTotalDegreeHitCount();
 }
 
-inline void Cache::registerIndex(const vertex_id_t& node_id_u, const vertex_id_t& node_id_v, const index_t& index_num) {
-    adjacency_list_.setIndex(node_id_u, index_num, node_id_v);
+inline uint64_t Cache::getTotalDegreeMissCount() {
+    return adjacency_list_.getTotalDegreeMissCount();
 }
 
-inline edge_id_t Cache::getEdgeCount() {
-    return adjacency_list_.getSize();
-}
\ No newline at end of file
+inline uint64_t Cache::getTotalIndexHitCount() {
+    return adjacency_list_.getTotalIndexHitCount();
+}
+
+inline uint64_t Cache::getTotalIndexMissCount() {
+    return adjacency_list_.getTotalIndexMissCount();
+}
+
+inline void Cache::writeSnapshot(const std::string& file_path, const host_id_t& hostid, const uint64_t& partition_checksum) {
+    std::vector<CacheSnapshotRecord> host_records;
+    for (vertex_id_t node_id = 0; node_id < host_id_.size(); node_id++) {
+        if (host_id_[node_id] != INF) host_records.push_back({node_id, host_id_[node_id]});
+    }
+    std::vector<CacheSnapshotRecord> entry_records;
+    adjacency_list_.getTable().forEach([&](const vertex_id_t& node_id, const index_t& index_num, const vertex_id_t& value) {
+        entry_records.push_back({((uint64_t)node_id << 32) | index_num, value});
+    });
+
+    CacheSnapshotHeader header = {};
+    header.magic_ = CACHE_SNAPSHOT_MAGIC;
+    header.partition_checksum_ = partition_checksum;
+    header.memory_budget_ = CACHE_MEMORY_BUDGET;
+    header.policy_ = CACHE_POLICY;
+    header.hostid_ = hostid;
+    header.host_record_num_ = host_records.size();
+    header.entry_record_num_ = entry_records.size();
+    header.record_checksum_ = hashBytes(host_records.data(), host_records.size() * sizeof(CacheSnapshotRecord));
+    header.record_checksum_ = hashBytes(entry_records.data(), entry_records.size() * sizeof(CacheSnapshotRecord), header.record_checksum_);
+
+    std::string tmp_path = file_path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path, std::ios::trunc | std::ios::binary);
+        ofs.write((const char*)&header, sizeof(header));
+        ofs.write((const char*)host_records.data(), host_records.size() * sizeof(CacheSnapshotRecord));
+        ofs.write((const char*)entry_records.data(), entry_records.size() * sizeof(CacheSnapshotRecord));
+        ofs.close(); // 書き込みの失敗は閉じる (書き出す) までに分かる
+        if (!ofs) {
+            std::cerr << "cache snapshot write failed: " << tmp_path << std::endl;
+            remove(tmp_path.c_str());
+            return;
+        }
+    }
+    if (rename(tmp_path.c_str(), file_path.c_str()) < 0) perror("rename");
+}
+
+inline bool Cache::readSnapshot(const std::string& file_path, const host_id_t& hostid, const uint64_t& partition_checksum) {
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    fstat(fd, &st);
+    if ((uint64_t)st.st_size < sizeof(CacheSnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    const CacheSnapshotHeader* header = (const CacheSnapshotHeader*)addr;
+    const CacheSnapshotRecord* records = (const CacheSnapshotRecord*)((const char*)addr + sizeof(CacheSnapshotHeader));
+    uint64_t record_num = header->host_record_num_ + header->entry_record_num_;
+
+    // 違うグラフファイル, 設定, 途中で切れたファイルは使わない
+    bool valid = header->magic_ == CACHE_SNAPSHOT_MAGIC && header->partition_checksum_ == partition_checksum
+              && header->memory_budget_ == CACHE_MEMORY_BUDGET && header->policy_ == CACHE_POLICY && header->hostid_ == hostid
+              && (uint64_t)st.st_size == sizeof(CacheSnapshotHeader) + record_num * sizeof(CacheSnapshotRecord)
+              && header->record_checksum_ == hashBytes(records, record_num * sizeof(CacheSnapshotRecord));
+
+    if (valid) {
+        for (uint64_t i = 0; i < header->host_record_num_; i++) registerHostId(records[i].first_, records[i].second_);
+        for (uint64_t i = header->host_record_num_; i < record_num; i++) {
+            vertex_id_t node_id = records[i].first_ >> 32;
+            index_t index_num = records[i].first_ & UINT32_MAX;
+            if (index_num == SimpleCache::DEGREE_INDEX) adjacency_list_.setDegree(node_id, records[i].second_);
+            else adjacency_list_.setIndex(node_id, index_num, records[i].second_);
+        }
+    }
+
+    munmap(addr, st.st_size);
+    return valid;
+}
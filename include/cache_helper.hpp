@@ -1,8 +1,9 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
-#include <shared_mutex>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 #include "type.hpp"
 #include "../config/param.hpp"
@@ -11,10 +12,146 @@
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+// キーの参照頻度の推定 (Count-Min Sketch, 4 行, 8bit の飽和カウンタ)
+// 足した回数がカウンタ数の 10 倍になったら全カウンタを半分にする (古い頻度を忘れる)
+// カウンタの更新はロックも CAS もしないので, 競合すると数え落とすことがある (推定なので許容)
+// 参照毎に数えると全スレッドが同じカウンタと足した回数に書き込むので, CACHE_SKETCH_SAMPLE 回に 1 回だけ数え,
+// 足した回数はスレッド毎に CACHE_SKETCH_ADDITION_BATCH 回溜めてから足す
+
+class FrequencySketch {
+
+public :
+
+    // 初期化 (カウンタ数, 2 の冪に切り上げ)
+    void init(const uint64_t& counter_num);
+
+    // ハッシュ値 hash のキーの回数を 1 増やす (CACHE_SKETCH_SAMPLE 回に 1 回だけ)
+    void increment(const uint64_t& hash);
+
+    // ハッシュ値 hash のキーの回数の推定値
+    uint32_t estimate(const uint64_t& hash);
+
+    // メモリサイズ (Byte)
+    uint64_t getMemorySize();
+
+private :
+
+    static constexpr uint32_t ROW_NUM = 4;
+
+    std::unique_ptr<std::atomic<uint8_t>[]> counters_; // ROW_NUM 行 * width_
+    uint64_t width_mask_ = 0;
+    uint64_t reset_threshold_ = 0;
+    std::atomic<uint64_t> addition_num_ = 0;
+
+    // row 行目のカウンタ
+    std::atomic<uint8_t>& getCounter(const uint32_t& row, const uint64_t& hash);
+
+    // 全カウンタを半分にする
+    void reset();
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// (頂点, index) -> 値 の表 (CACHE_BUCKET_WAYS 個のスロットのバケットに分けたセットアソシアティブ, 容量はメモリ量で決める)
+// 読み込みはロックなし, 書き込み (登録と追い出し) はバケットで分けたロック (CACHE_LOCK_NUM 個) を取る
+// 書き込み側は 値を INF にする -> キー -> 値 の順に書くので, 途中で読んだ側は INF (キャッシュなし) を返す
+// 読む側は値を読んだ後にキーを読み直し, 追い出されて別のキーになっていたら INF を返す
+//
+// バケットが埋まっていたら CACHE_POLICY で追い出す:
+// CACHE_POLICY_NONE: 追い出さずに登録を断る
+// CACHE_POLICY_CLOCK: バケット内で CLOCK (参照ビットが立っていれば下ろして次へ, 立っていないスロットを追い出す)
+// CACHE_POLICY_TINYLFU: CLOCK で選んだスロットより参照頻度の推定値が大きいときだけ追い出して登録する
+//
+// キー: 頂点 ID (上位 32bit) + index (下位 32bit)
+
+class ConcurrentIndexTable {
+
+public :
+
+    // 登録の結果
+    enum InsertResult { INSERTED, EXISTS, REJECTED };
+
+    // 初期化 (使うメモリ量 (Byte))
+    void init(const uint64_t& memory_budget);
+
+    // 値を入手 (なければ INF)
+    vertex_id_t find(const vertex_id_t& node_ID, const index_t& index_num);
+
+    // 入っているか (参照ビットと参照頻度は変えない)
+    bool contains(const vertex_id_t& node_ID, const index_t& index_num);
+
+    // 値を登録 (追い出したら evicted_index に追い出したキーの index, 追い出さなければ INF)
+    InsertResult insert(const vertex_id_t& node_ID, const index_t& index_num, const vertex_id_t& value, index_t& evicted_index);
+
+    // 入っている数
+    uint64_t getSize();
+
+    // 容量 (スロット数)
+    uint64_t getCapacity();
+
+    // 追い出した数
+    uint64_t getEvictCount();
+
+    // 登録を断った数
+    uint64_t getRejectCount();
+
+    // 表のメモリサイズ (Byte)
+    uint64_t getMemorySize();
+
+    // 入っている全ての (頂点, index, 値) について func を呼ぶ (書き込みと同時に呼ばない)
+    template <typename Func>
+    void forEach(Func func);
+
+private :
+
+    struct Slot {
+        std::atomic<uint64_t> key_;
+        std::atomic<vertex_id_t> value_;
+    };
+
+    std::unique_ptr<Slot[]> slots_; // バケット数 * CACHE_BUCKET_WAYS
+    std::unique_ptr<std::atomic<uint8_t>[]> referenced_; // スロット毎の参照ビット (CLOCK)
+    std::unique_ptr<uint8_t[]> hands_; // バケット毎の CLOCK の針 (バケットのロックを取って使う)
+    std::unique_ptr<std::mutex[]> mtx_; // CACHE_LOCK_NUM
+    FrequencySketch sketch_; // CACHE_POLICY_TINYLFU
+    uint64_t bucket_mask_ = 0;
+
+    std::atomic<uint64_t> size_ = 0;
+    std::atomic<uint64_t> evict_count_ = 0;
+    std::atomic<uint64_t> reject_count_ = 0;
+
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+
+    // キーを作る
+    uint64_t makeKey(const vertex_id_t& node_ID, const index_t& index_num);
+
+    // キーのハッシュ
+    uint64_t hash(uint64_t key);
+
+    // 満杯のバケットから追い出すスロットを CLOCK で選ぶ (バケットのロックを取ってから呼ぶ)
+    uint64_t selectVictim(const uint64_t& bucket);
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 他サーバの頂点の次数と隣接リストの index を 1 つの ConcurrentIndexTable (CACHE_MEMORY_BUDGET Byte) に入れる
+// 次数は index を DEGREE_INDEX としたキーで持つ
+// 当たった回数と外れた回数を次数, index 別に数える (スレッドで分けたカウンタ)
+// カウンタは 0 に戻さない (resetStats はその時の累計を覚え, 以後の回数はそこからの差)
+
 class SimpleCache {
 
 public :
 
+    // 次数を入れるキーの index
+    static constexpr index_t DEGREE_INDEX = UINT32_MAX;
+
     void init();
 
     // 隣接リスト情報内の index 存在確認
@@ -23,19 +160,65 @@ public :
     vertex_id_t getNextNodeID(const vertex_id_t& node_ID, const index_t& index_num);
 
     // index を登録
-    // 
+    //
     void setIndex(const vertex_id_t& node_ID_u, const index_t& index_num, const vertex_id_t& node_ID_v);
 
+    // 次数を入手 (なければ INF)
+    index_t getDegree(const vertex_id_t& node_ID);
+
+    // 次数を登録
+    void setDegree(const vertex_id_t& node_ID, const index_t& degree);
+
     // debug 用
     // void printList();
     uint32_t getSize();
 
-private : 
+    // 入っている次数の数
+    uint64_t getDegreeNum();
+
+    // 参照した回数, 当たった回数 (resetStats から)
+    uint64_t getIndexLookupCount();
+    uint64_t getIndexHitCount();
+    uint64_t getDegreeLookupCount();
+    uint64_t getDegreeHitCount();
+
+    // 当たった回数, 外れた回数 (init からの累計, resetStats で戻らない)
+    uint64_t getTotalIndexHitCount();
+    uint64_t getTotalIndexMissCount();
+    uint64_t getTotalDegreeHitCount();
+    uint64_t getTotalDegreeMissCount();
+
+    // 参照した回数, 当たった回数の数え始めを今にする (累計はそのまま)
+    void resetStats();
+
+    // 表
+    ConcurrentIndexTable& getTable();
 
-    std::vector<std::unordered_map<index_t, vertex_id_t>> cache_;
-    std::atomic<uint64_t> cache_size_ = 0;
+private :
 
-    std::shared_mutex* mtx_cache_;
+    static constexpr uint32_t STATS_SHARD_NUM = 16;
+
+    struct alignas(64) Stats {
+        std::atomic<uint64_t> index_hit_ = 0;
+        std::atomic<uint64_t> index_miss_ = 0;
+        std::atomic<uint64_t> degree_hit_ = 0;
+        std::atomic<uint64_t> degree_miss_ = 0;
+    };
+
+    ConcurrentIndexTable cache_; // CACHE_MEMORY_BUDGET Byte 分
+    std::atomic<uint64_t> cache_size_ = 0; // index の数
+    std::atomic<uint64_t> degree_num_ = 0; // 次数の数
+    Stats stats_[STATS_SHARD_NUM];
+    Stats reset_base_; // resetStats した時の累計
+
+    // 全スレッドの counter の累計
+    uint64_t sumStats(std::atomic<uint64_t> Stats::* counter);
+
+    // 登録 (入っている数を更新し, CACHE_POLICY_NONE で断られたら cache 補充用の実行を止める)
+    void insert(const vertex_id_t& node_ID, const index_t& index_num, const vertex_id_t& value);
+
+    // 呼び出したスレッドが使うカウンタ
+    Stats& getStats();
 
 };
 
@@ -43,53 +226,352 @@ private :
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-inline void SimpleCache::init() {
-    cache_.resize(VERTEX_SIZE);
-    mtx_cache_ = new std::shared_mutex[VERTEX_SIZE];
+inline void FrequencySketch::init(const uint64_t& counter_num) {
+    uint64_t width = 16;
+    while (width * ROW_NUM < counter_num) width <<= 1;
+    width_mask_ = width - 1;
+    reset_threshold_ = 10 * width * ROW_NUM;
+    addition_num_ = 0;
+
+    counters_.reset(new std::atomic<uint8_t>[width * ROW_NUM]);
+    for (uint64_t i = 0; i < width * ROW_NUM; i++) counters_[i].store(0, std::memory_order_relaxed);
 }
 
-inline vertex_id_t SimpleCache::getNextNodeID(const vertex_id_t& node_ID, const index_t& index_num) {
-    {
-        std::shared_lock<std::shared_mutex> lock(mtx_cache_[node_ID]);
+inline void FrequencySketch::increment(const uint64_t& hash) {
+    // 数えるかどうかはスレッド毎の xorshift で決める (参照の並びと同期しないように)
+    thread_local uint32_t rand_state = 0x9e3779b9 ^ (uint32_t)(uintptr_t)&rand_state;
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    if ((rand_state & (CACHE_SKETCH_SAMPLE - 1)) != 0) return;
 
-        // if (!cache_.contains(node_ID)) return INF;
-        if (!cache_[node_ID].contains(index_num)) return INF;
+    for (uint32_t row = 0; row < ROW_NUM; row++) {
+        std::atomic<uint8_t>& counter = getCounter(row, hash);
+        uint8_t count = counter.load(std::memory_order_relaxed);
+        if (count < UINT8_MAX) counter.store(count + 1, std::memory_order_relaxed);
+    }
 
-        return cache_[node_ID][index_num];
+    // 1 プロセスで複数の worker を動かすこともあるので, どの推定の分を溜めているかも覚えておく (替わったら溜めた分は捨てる)
+    thread_local FrequencySketch* owner = nullptr;
+    thread_local uint32_t pending = 0;
+    if (owner != this) {
+        owner = this;
+        pending = 0;
     }
+    if (++pending < CACHE_SKETCH_ADDITION_BATCH) return;
+    pending = 0;
+
+    uint64_t before = addition_num_.fetch_add(CACHE_SKETCH_ADDITION_BATCH, std::memory_order_relaxed);
+    if (before < reset_threshold_ && before + CACHE_SKETCH_ADDITION_BATCH >= reset_threshold_) reset();
 }
 
-inline void SimpleCache::setIndex(const vertex_id_t& node_ID_u, const index_t& index_num, const vertex_id_t& node_ID_v) {
-    // if (cache_size_ >= MAX_CACHE_SIZE) return;
-    if (cache_size_ + MY_EDGE_NUM >= MAX_CACHE_SIZE) {
-        CHECK_RWER_FLAG = false;
-        CACHE_GEN_FLAG = false;
-        return;
+inline uint32_t FrequencySketch::estimate(const uint64_t& hash) {
+    uint32_t count = UINT8_MAX;
+    for (uint32_t row = 0; row < ROW_NUM; row++) {
+        count = std::min<uint32_t>(count, getCounter(row, hash).load(std::memory_order_relaxed));
     }
+    return count;
+}
+
+inline uint64_t FrequencySketch::getMemorySize() {
+    return (width_mask_ + 1) * ROW_NUM;
+}
+
+inline std::atomic<uint8_t>& FrequencySketch::getCounter(const uint32_t& row, const uint64_t& hash) {
+    // 行毎にハッシュ値の別の 16bit を使う
+    uint64_t idx = (hash >> (16 * row)) * 0x9e3779b97f4a7c15ULL;
+    return counters_[row * (width_mask_ + 1) + ((idx >> 32) & width_mask_)];
+}
+
+inline void FrequencySketch::reset() {
+    uint64_t counter_num = (width_mask_ + 1) * ROW_NUM;
+    for (uint64_t i = 0; i < counter_num; i++) {
+        counters_[i].store(counters_[i].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+    }
+    addition_num_.fetch_sub(reset_threshold_ / 2, std::memory_order_relaxed);
+}
 
-    bool exist_edge = false;
-    {
-        std::shared_lock<std::shared_mutex> lock(mtx_cache_[node_ID_u]);
-        if (cache_[node_ID_u].contains(index_num)) exist_edge = true;
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void ConcurrentIndexTable::init(const uint64_t& memory_budget) {
+    // スロット 1 つあたり: キーと値, 参照ビット, 推定のカウンタ 1 つ
+    uint64_t slot_bytes = sizeof(Slot) + 1 + (CACHE_POLICY == CACHE_POLICY_TINYLFU ? 1 : 0);
+    uint64_t bucket_num = 1;
+    while (bucket_num * 2 * CACHE_BUCKET_WAYS * slot_bytes <= memory_budget) bucket_num <<= 1;
+    bucket_mask_ = bucket_num - 1;
+    uint64_t capacity = bucket_num * CACHE_BUCKET_WAYS;
+
+    slots_.reset(new Slot[capacity]);
+    referenced_.reset(new std::atomic<uint8_t>[capacity]);
+    for (uint64_t i = 0; i < capacity; i++) {
+        slots_[i].key_.store(EMPTY, std::memory_order_relaxed);
+        slots_[i].value_.store(INF, std::memory_order_relaxed);
+        referenced_[i].store(0, std::memory_order_relaxed);
     }
+    hands_.reset(new uint8_t[bucket_num]());
+    mtx_.reset(new std::mutex[CACHE_LOCK_NUM]);
+    if (CACHE_POLICY == CACHE_POLICY_TINYLFU) sketch_.init(capacity);
 
-    if (!exist_edge) {
-        {
-            std::lock_guard<std::shared_mutex> lock(mtx_cache_[node_ID_u]);
-
-            if (!cache_[node_ID_u].contains(index_num)) {
-                cache_[node_ID_u][index_num] = node_ID_v;
-                cache_size_++;
-                // if (cache_size_ >= MAX_CACHE_SIZE) {
-                if (cache_size_ + MY_EDGE_NUM >= MAX_CACHE_SIZE) {
-                    CHECK_RWER_FLAG = false;
-                    CACHE_GEN_FLAG = false;
-                }
+    size_ = 0;
+    evict_count_ = 0;
+    reject_count_ = 0;
+}
+
+inline vertex_id_t ConcurrentIndexTable::find(const vertex_id_t& node_ID, const index_t& index_num) {
+    uint64_t key = makeKey(node_ID, index_num);
+    uint64_t key_hash = hash(key);
+    if (CACHE_POLICY == CACHE_POLICY_TINYLFU) sketch_.increment(key_hash);
+
+    uint64_t first = (key_hash & bucket_mask_) * CACHE_BUCKET_WAYS;
+    for (uint64_t i = first; i < first + CACHE_BUCKET_WAYS; i++) {
+        Slot& slot = slots_[i];
+        if (slot.key_.load(std::memory_order_acquire) != key) continue;
+
+        vertex_id_t value = slot.value_.load(std::memory_order_acquire);
+        // 値を読んでいる間に追い出されていないか
+        if (value == INF || slot.key_.load(std::memory_order_relaxed) != key) return INF;
+        if (referenced_[i].load(std::memory_order_relaxed) == 0) referenced_[i].store(1, std::memory_order_relaxed);
+        return value;
+    }
+    return INF;
+}
+
+inline bool ConcurrentIndexTable::contains(const vertex_id_t& node_ID, const index_t& index_num) {
+    uint64_t key = makeKey(node_ID, index_num);
+    uint64_t first = (hash(key) & bucket_mask_) * CACHE_BUCKET_WAYS;
+    for (uint64_t i = first; i < first + CACHE_BUCKET_WAYS; i++) {
+        if (slots_[i].key_.load(std::memory_order_acquire) == key) return slots_[i].value_.load(std::memory_order_acquire) != INF;
+    }
+    return false;
+}
+
+inline ConcurrentIndexTable::InsertResult ConcurrentIndexTable::insert(const vertex_id_t& node_ID, const index_t& index_num, const vertex_id_t& value, index_t& evicted_index) {
+    evicted_index = INF;
+    uint64_t key = makeKey(node_ID, index_num);
+    uint64_t key_hash = hash(key);
+    uint64_t bucket = key_hash & bucket_mask_;
+    uint64_t first = bucket * CACHE_BUCKET_WAYS;
+
+    std::lock_guard<std::mutex> lk(mtx_[bucket % CACHE_LOCK_NUM]);
+
+    uint64_t target = EMPTY;
+    for (uint64_t i = first; i < first + CACHE_BUCKET_WAYS; i++) {
+        uint64_t slot_key = slots_[i].key_.load(std::memory_order_relaxed);
+        if (slot_key == key) return EXISTS;
+        if (slot_key == EMPTY && target == EMPTY) target = i;
+    }
+
+    if (target == EMPTY) { // バケットが埋まっている
+        if (CACHE_POLICY == CACHE_POLICY_NONE) {
+            reject_count_.fetch_add(1, std::memory_order_relaxed);
+            return REJECTED;
+        }
+
+        target = selectVictim(bucket);
+        uint64_t victim_key = slots_[target].key_.load(std::memory_order_relaxed);
+
+        // TinyLFU: 参照頻度が追い出す方より大きいときだけ入れる
+        if (CACHE_POLICY == CACHE_POLICY_TINYLFU) {
+            sketch_.increment(key_hash);
+            if (sketch_.estimate(key_hash) <= sketch_.estimate(hash(victim_key))) {
+                reject_count_.fetch_add(1, std::memory_order_relaxed);
+                return REJECTED;
             }
         }
+
+        evicted_index = victim_key & UINT32_MAX;
+        evict_count_.fetch_add(1, std::memory_order_relaxed);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    Slot& slot = slots_[target];
+    slot.value_.store(INF, std::memory_order_relaxed);
+    slot.key_.store(key, std::memory_order_release);
+    slot.value_.store(value, std::memory_order_release);
+    referenced_[target].store(0, std::memory_order_relaxed);
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return INSERTED;
+}
+
+inline uint64_t ConcurrentIndexTable::getSize() {
+    return size_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t ConcurrentIndexTable::getCapacity() {
+    return (bucket_mask_ + 1) * CACHE_BUCKET_WAYS;
+}
+
+inline uint64_t ConcurrentIndexTable::getEvictCount() {
+    return evict_count_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t ConcurrentIndexTable::getRejectCount() {
+    return reject_count_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t ConcurrentIndexTable::getMemorySize() {
+    uint64_t capacity = getCapacity();
+    uint64_t sketch_size = CACHE_POLICY == CACHE_POLICY_TINYLFU ? sketch_.getMemorySize() : 0;
+    return capacity * (sizeof(Slot) + 1) + (bucket_mask_ + 1) + sketch_size;
+}
+
+template <typename Func>
+inline void ConcurrentIndexTable::forEach(Func func) {
+    uint64_t capacity = getCapacity();
+    for (uint64_t i = 0; i < capacity; i++) {
+        uint64_t key = slots_[i].key_.load(std::memory_order_acquire);
+        vertex_id_t value = slots_[i].value_.load(std::memory_order_acquire);
+        if (key == EMPTY || value == INF) continue;
+        func(key >> 32, key & UINT32_MAX, value);
+    }
+}
+
+inline uint64_t ConcurrentIndexTable::makeKey(const vertex_id_t& node_ID, const index_t& index_num) {
+    return ((uint64_t)node_ID << 32) | (index_num & UINT32_MAX);
+}
+
+inline uint64_t ConcurrentIndexTable::hash(uint64_t key) {
+    // splitmix64 の最後の混ぜ合わせ
+    key ^= key >> 30; key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27; key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+inline uint64_t ConcurrentIndexTable::selectVictim(const uint64_t& bucket) {
+    uint64_t first = bucket * CACHE_BUCKET_WAYS;
+    uint8_t& hand = hands_[bucket];
+
+    // 全スロットの参照ビットが立っていても, 1 周で下ろすので 2 周目で必ず見つかる
+    while (true) {
+        uint64_t i = first + hand;
+        hand = (hand + 1) % CACHE_BUCKET_WAYS;
+        if (referenced_[i].load(std::memory_order_relaxed) == 0) return i;
+        referenced_[i].store(0, std::memory_order_relaxed);
     }
 }
 
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void SimpleCache::init() {
+    cache_.init(CACHE_MEMORY_BUDGET);
+    cache_size_ = 0;
+    degree_num_ = 0;
+    for (Stats& stats : stats_) {
+        stats.index_hit_ = 0;
+        stats.index_miss_ = 0;
+        stats.degree_hit_ = 0;
+        stats.degree_miss_ = 0;
+    }
+    resetStats();
+}
+
+inline vertex_id_t SimpleCache::getNextNodeID(const vertex_id_t& node_ID, const index_t& index_num) {
+    vertex_id_t next_node = cache_.find(node_ID, index_num);
+    Stats& stats = getStats();
+    if (next_node != INF) stats.index_hit_.fetch_add(1, std::memory_order_relaxed);
+    else stats.index_miss_.fetch_add(1, std::memory_order_relaxed);
+    return next_node;
+}
+
+inline void SimpleCache::setIndex(const vertex_id_t& node_ID_u, const index_t& index_num, const vertex_id_t& node_ID_v) {
+    insert(node_ID_u, index_num, node_ID_v);
+}
+
+inline index_t SimpleCache::getDegree(const vertex_id_t& node_ID) {
+    index_t degree = cache_.find(node_ID, DEGREE_INDEX);
+    Stats& stats = getStats();
+    if (degree != INF) stats.degree_hit_.fetch_add(1, std::memory_order_relaxed);
+    else stats.degree_miss_.fetch_add(1, std::memory_order_relaxed);
+    return degree;
+}
+
+inline void SimpleCache::setDegree(const vertex_id_t& node_ID, const index_t& degree) {
+    insert(node_ID, DEGREE_INDEX, degree);
+}
+
 inline uint32_t SimpleCache::getSize() {
     return cache_size_;
-}
\ No newline at end of file
+}
+
+inline uint64_t SimpleCache::getDegreeNum() {
+    return degree_num_;
+}
+
+inline uint64_t SimpleCache::getIndexLookupCount() {
+    return getIndexHitCount() + getTotalIndexMissCount() - reset_base_.index_miss_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t SimpleCache::getIndexHitCount() {
+    return getTotalIndexHitCount() - reset_base_.index_hit_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t SimpleCache::getDegreeLookupCount() {
+    return getDegreeHitCount() + getTotalDegreeMissCount() - reset_base_.degree_miss_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t SimpleCache::getDegreeHitCount() {
+    return getTotalDegreeHitCount() - reset_base_.degree_hit_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t SimpleCache::getTotalIndexHitCount() {
+    return sumStats(&Stats::index_hit_);
+}
+
+inline uint64_t SimpleCache::getTotalIndexMissCount() {
+    return sumStats(&Stats::index_miss_);
+}
+
+inline uint64_t SimpleCache::getTotalDegreeHitCount() {
+    return sumStats(&Stats::degree_hit_);
+}
+
+inline uint64_t SimpleCache::getTotalDegreeMissCount() {
+    return sumStats(&Stats::degree_miss_);
+}
+
+inline void SimpleCache::resetStats() {
+    reset_base_.index_hit_ = getTotalIndexHitCount();
+    reset_base_.index_miss_ = getTotalIndexMissCount();
+    reset_base_.degree_hit_ = getTotalDegreeHitCount();
+    reset_base_.degree_miss_ = getTotalDegreeMissCount();
+}
+
+inline uint64_t SimpleCache::sumStats(std::atomic<uint64_t> Stats::* counter) {
+    uint64_t count = 0;
+    for (Stats& stats : stats_) count += (stats.*counter).load(std::memory_order_relaxed);
+    return count;
+}
+
+inline ConcurrentIndexTable& SimpleCache::getTable() {
+    return cache_;
+}
+
+inline void SimpleCache::insert(const vertex_id_t& node_ID, const index_t& index_num, const vertex_id_t& value) {
+    index_t evicted_index;
+    ConcurrentIndexTable::InsertResult result = cache_.insert(node_ID, index_num, value, evicted_index);
+
+    if (result == ConcurrentIndexTable::REJECTED && CACHE_POLICY == CACHE_POLICY_NONE) {
+        // 追い出さないので, 埋まったら cache 補充用の実行を止める
+        CHECK_RWER_FLAG = false;
+        CACHE_GEN_FLAG = false;
+        return;
+    }
+    if (result != ConcurrentIndexTable::INSERTED) return;
+
+    if (index_num == DEGREE_INDEX) degree_num_++;
+    else cache_size_++;
+
+    if (evicted_index == DEGREE_INDEX) degree_num_--;
+    else if (evicted_index != INF) cache_size_--;
+}
+
+inline SimpleCache::Stats& SimpleCache::getStats() {
+    static std::atomic<uint32_t> thread_count = 0;
+    thread_local uint32_t shard_id = thread_count.fetch_add(1) % STATS_SHARD_NUM;
+    return stats_[shard_id];
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "type.hpp"
+#include "graph.hpp"
+#include "cache.hpp"
+#include "random_walker.hpp"
+#include "message_queue.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 全経路が揃った RWer の経路から他サーバの頂点の次数と隣接リストの index を裏でキャッシュに入れる (CACHE_LEARN_FLAG)
+//
+// executor は RWer を有界のキュー (CACHE_LEARN_QUEUE_SIZE) に渡すだけで, 経路の展開と登録は補助スレッド (run) が行う
+// キューが満杯なら, cache 補充の実行では空くまで待ち (経路を全て入れるのが目的なので捨てない),
+// メインの実験では executor を止めないように捨てる (捨てた割合は getDropRatio)
+// 補助スレッドは SCHED_BATCH + CACHE_LEARN_NICE で動かし, worker はこのスレッドの分のコアを空けておく (仕事がある時だけ起動する)
+// 補助スレッドはキューが空なら sleep せずに待機し, 取り出した RWer を CACHE_LEARN_BATCH 個ずつ (頂点, index) の重複と既にキャッシュにあるものを除いてから登録する
+// (キャッシュに入るかどうかは CACHE_POLICY と CACHE_MEMORY_BUDGET で決まる)
+
+class CacheLearner {
+
+public :
+
+    CacheLearner();
+
+    // RWer をキューに渡す (満杯なら wait_if_full で空くまで待ち, そうでなければ捨てて false, RWer_ptr はそのまま)
+    bool push(std::unique_ptr<RandomWalker>& RWer_ptr, const bool& wait_if_full);
+
+    // キューから取り出してキャッシュに登録し続ける (補助スレッド, SCHED_BATCH で nice を CACHE_LEARN_NICE に下げる)
+    void run(Cache& cache, Graph& graph);
+
+    // それまでに渡した RWer を全て登録し終わるまで待つ
+    void flush();
+
+    // 登録した RWer 数, 捨てた RWer 数, 登録した (頂点, index) 数, 重複か既にあって省いた数
+    uint64_t getLearnedRWerNum();
+    uint64_t getDroppedRWerNum();
+    uint64_t getEntryNum();
+    uint64_t getDuplicateNum();
+
+    // 渡された RWer のうち捨てた割合
+    double getDropRatio();
+
+private :
+
+    // (キー (頂点 ID << 32 | index, 次数は SimpleCache::DEGREE_INDEX), 値)
+    typedef std::pair<uint64_t, uint64_t> Entry;
+
+    // 経路の u -> v の辺から他サーバの頂点の持ち主を登録し, 次数と index を entries に集める
+    void collectEdge(Cache& cache, Graph& graph, const std::vector<uint64_t>& path, const uint32_t& node_u_idx, const uint32_t& node_v_idx, std::vector<Entry>& entries);
+
+    MessageQueue<RandomWalker> queue_;
+    std::mutex mtx_flush_;
+    std::condition_variable cv_flush_; // 登録が渡された数に追いついたことを flush() に通知
+
+    std::atomic<uint64_t> pushed_RWer_num_ = 0;
+    std::atomic<uint64_t> learned_RWer_num_ = 0;
+    std::atomic<uint64_t> dropped_RWer_num_ = 0;
+    std::atomic<uint64_t> entry_num_ = 0;
+    std::atomic<uint64_t> duplicate_num_ = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline CacheLearner::CacheLearner() : queue_(CACHE_LEARN_QUEUE_SIZE) {}
+
+inline bool CacheLearner::push(std::unique_ptr<RandomWalker>& RWer_ptr, const bool& wait_if_full) {
+    // 登録し終わった数と比べるので, キューに入れる前に数える
+    pushed_RWer_num_++;
+    if (wait_if_full) {
+        queue_.push(std::move(RWer_ptr));
+        return true;
+    }
+    if (!queue_.tryPush(RWer_ptr)) {
+        pushed_RWer_num_--;
+        dropped_RWer_num_++;
+        return false;
+    }
+    return true;
+}
+
+inline void CacheLearner::run(Cache& cache, Graph& graph) {
+    // RW の実行より後回しにするが, 止まらない程度には動かす (nice はスレッド毎にかかる)
+    sched_param param = {};
+    if (pthread_setschedparam(pthread_self(), SCHED_BATCH, &param) != 0) {
+        perror("pthread_setschedparam");
+    }
+    if (setpriority(PRIO_PROCESS, gettid(), CACHE_LEARN_NICE) != 0) {
+        perror("setpriority");
+    }
+
+    std::vector<uint64_t> path; // path: (頂点, ホストID, 次数, indexuv, indexvu), (), (), ...
+    std::vector<Entry> entries;
+    std::vector<std::unique_ptr<RandomWalker>> RWer_ptr_vec;
+    uint32_t RWer_idx = 0;
+
+    while (1) {
+        // 手元の RWer を使い切ったら, 空でなくなるまで待って取り出す
+        if (RWer_idx == RWer_ptr_vec.size()) {
+            RWer_ptr_vec.clear();
+            RWer_idx = 0;
+            queue_.pop(RWer_ptr_vec);
+        }
+
+        entries.clear();
+        uint32_t RWer_num = 0;
+        for (; RWer_num < CACHE_LEARN_BATCH && RWer_idx < RWer_ptr_vec.size(); RWer_num++, RWer_idx++) {
+            uint16_t path_length = 0;
+            path.clear();
+            RWer_ptr_vec[RWer_idx]->getPath(path_length, path);
+            RWer_ptr_vec[RWer_idx].reset();
+            for (uint32_t i = 0; i + 1 < path_length; i++) {
+                collectEdge(cache, graph, path, i * 5, (i + 1) * 5, entries);
+            }
+        }
+
+        // 同じキーは最初のものだけ残す
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.first < b.first; });
+        auto last = std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.first == b.first; });
+        uint64_t duplicate_num = entries.end() - last;
+        entries.erase(last, entries.end());
+
+        uint64_t entry_num = 0;
+        for (const Entry& entry : entries) {
+            vertex_id_t node_id = entry.first >> 32;
+            index_t index_num = entry.first & UINT32_MAX;
+            if (cache.hasEntry(node_id, index_num)) {
+                duplicate_num++;
+                continue;
+            }
+            if (index_num == SimpleCache::DEGREE_INDEX) cache.registerDegree(node_id, entry.second);
+            else cache.registerIndex(node_id, entry.second, index_num);
+            entry_num++;
+        }
+
+        entry_num_ += entry_num;
+        duplicate_num_ += duplicate_num;
+        if (learned_RWer_num_.fetch_add(RWer_num) + RWer_num >= pushed_RWer_num_) {
+            std::lock_guard<std::mutex> lk(mtx_flush_);
+            cv_flush_.notify_all();
+        }
+    }
+}
+
+inline void CacheLearner::flush() {
+    std::unique_lock<std::mutex> lk(mtx_flush_);
+    cv_flush_.wait(lk, [&]{ return learned_RWer_num_ >= pushed_RWer_num_; });
+}
+
+inline void CacheLearner::collectEdge(Cache& cache, Graph& graph, const std::vector<uint64_t>& path, const uint32_t& node_u_idx, const uint32_t& node_v_idx, std::vector<Entry>& entries) {
+    vertex_id_t node_id_u = path[node_u_idx];
+    vertex_id_t node_id_v = path[node_v_idx];
+    host_id_t host_id_u = path[node_u_idx + 1];
+    host_id_t host_id_v = path[node_v_idx + 1];
+    index_t degree_u = path[node_u_idx + 2];
+    index_t degree_v = path[node_v_idx + 2];
+    index_t index_uv = path[node_v_idx + 3];
+    index_t index_vu = path[node_v_idx + 4];
+
+    if (!graph.hasVertex(node_id_u)) {
+        if (cache.getHostId(node_id_u) != host_id_u) cache.registerHostId(node_id_u, host_id_u);
+        if (degree_u != INF) entries.push_back({((uint64_t)node_id_u << 32) | SimpleCache::DEGREE_INDEX, degree_u});
+        if (index_uv != INF) entries.push_back({((uint64_t)node_id_u << 32) | index_uv, node_id_v});
+    }
+
+    if (!graph.hasVertex(node_id_v)) {
+        if (cache.getHostId(node_id_v) != host_id_v) cache.registerHostId(node_id_v, host_id_v);
+        if (degree_v != INF) entries.push_back({((uint64_t)node_id_v << 32) | SimpleCache::DEGREE_INDEX, degree_v});
+        if (index_vu != INF) entries.push_back({((uint64_t)node_id_v << 32) | index_vu, node_id_u});
+    }
+}
+
+inline uint64_t CacheLearner::getLearnedRWerNum() {
+    return learned_RWer_num_;
+}
+
+inline uint64_t CacheLearner::getDroppedRWerNum() {
+    return dropped_RWer_num_;
+}
+
+inline uint64_t CacheLearner::getEntryNum() {
+    return entry_num_;
+}
+
+inline uint64_t CacheLearner::getDuplicateNum() {
+    return duplicate_num_;
+}
+
+inline double CacheLearner::getDropRatio() {
+    uint64_t dropped = dropped_RWer_num_;
+    uint64_t all = pushed_RWer_num_ + dropped;
+    return all > 0 ? (double)dropped / all : 0;
+}
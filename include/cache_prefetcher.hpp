@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "type.hpp"
+#include "graph.hpp"
+#include "cache.hpp"
+#include "util.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 他サーバの頂点 (ghost 頂点) の隣接リストを持ち主にまとめて要求してキャッシュに入れる (CACHE_PREFETCH_FLAG)
+//
+// 要求 (CACHE_PREFETCH_REQUEST のレコード): 頂点 ID の列 (CACHE_PREFETCH_REQUEST_BATCH 個まで)
+// 応答 (CACHE_PREFETCH_RESPONSE のレコード): 頂点 ID, 次数, 先頭の index, {隣接頂点, 隣接頂点の HostID} * (CACHE_PREFETCH_RESPONSE_BATCH 個まで)
+// 持ち主は隣接リストを先頭から CACHE_PREFETCH_MAX_ROW 個までに切って返す (持っていない頂点は次数 INF)
+//
+// ghost 頂点 v の点数は自サーバの頂点 u からの辺 u -> v 毎の 1 / deg(u) の和 (一歩で v に移る確率の和) で,
+// 点数の高い順に CACHE_PREFETCH_VERTEX_NUM 個まで要求する
+// キャッシュには点数の高い順に入るので, 埋まったら CACHE_POLICY で後から来た点数の低いものが断られるか古いものが追い出される
+
+class CachePrefetcher {
+
+public :
+
+    // 要求する ghost 頂点を持ち主毎に点数の高い順に選ぶ (requests[HostID])
+    void selectVertices(Graph& graph, const uint32_t& host_num, std::vector<std::vector<vertex_id_t>>& requests);
+
+    // 要求のレコード (頂点 ID の列) に対する応答のレコードを作る (持ち主側)
+    void buildResponse(Graph& graph, const std::vector<uint64_t>& request, std::vector<std::vector<uint64_t>>& responses);
+
+    // 応答のレコードをキャッシュに入れる (要求側)
+    void addResponse(Cache& cache, Graph& graph, const host_id_t& owner, const std::vector<uint64_t>& response);
+
+    // 要求した全頂点の応答が揃うか timeout_ms (ms) 経つまで待つ (揃ったら true)
+    bool waitForRows(const uint32_t& timeout_ms);
+
+    // 要求した頂点数, 揃った頂点数, キャッシュに入れた index 数
+    uint64_t getRequestedRowNum();
+    uint64_t getReceivedRowNum();
+    uint64_t getEntryNum();
+
+private :
+
+    std::atomic<uint64_t> requested_row_num_ = 0;
+    std::atomic<uint64_t> received_row_num_ = 0;
+    std::atomic<uint64_t> entry_num_ = 0;
+
+    // 応答レコードの先頭の数 (頂点 ID, 次数, 先頭の index)
+    static constexpr uint32_t RESPONSE_HEADER_NUM = 3;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void CachePrefetcher::selectVertices(Graph& graph, const uint32_t& host_num, std::vector<std::vector<vertex_id_t>>& requests) {
+    // ghost 頂点毎の点数
+    std::unordered_map<vertex_id_t, double> score;
+    for (const vertex_id_t& u : graph.getMyVertices()) {
+        const std::vector<vertex_id_t>& neighbors = graph.getNeighbors(u);
+        double weight = 1.0 / neighbors.size();
+        for (const vertex_id_t& v : neighbors) {
+            if (!graph.hasVertex(v)) score[v] += weight;
+        }
+    }
+
+    std::vector<std::pair<double, vertex_id_t>> ranking;
+    ranking.reserve(score.size());
+    for (const auto& [v, s] : score) ranking.push_back({s, v});
+    uint64_t num = std::min<uint64_t>(CACHE_PREFETCH_VERTEX_NUM, ranking.size());
+    std::partial_sort(ranking.begin(), ranking.begin() + num, ranking.end(), [](const std::pair<double, vertex_id_t>& a, const std::pair<double, vertex_id_t>& b) {
+        if (a.first != b.first) return a.first > b.first;
+        return a.second < b.second;
+    });
+
+    requests.assign(host_num, {});
+    for (uint64_t i = 0; i < num; i++) {
+        vertex_id_t v = ranking[i].second;
+        requests[graph.getHostId(v)].push_back(v);
+    }
+
+    requested_row_num_ += num;
+}
+
+inline void CachePrefetcher::buildResponse(Graph& graph, const std::vector<uint64_t>& request, std::vector<std::vector<uint64_t>>& responses) {
+    for (const vertex_id_t v : request) {
+        if (!graph.hasVertex(v)) {
+            responses.push_back({v, INF, 0});
+            continue;
+        }
+
+        const std::vector<vertex_id_t>& neighbors = graph.getNeighbors(v);
+        uint64_t row_size = std::min<uint64_t>(neighbors.size(), CACHE_PREFETCH_MAX_ROW);
+        uint64_t start = 0;
+        do {
+            uint64_t end = std::min<uint64_t>(start + CACHE_PREFETCH_RESPONSE_BATCH, row_size);
+            std::vector<uint64_t> response = {v, neighbors.size(), start};
+            response.reserve(RESPONSE_HEADER_NUM + (end - start) * 2);
+            for (uint64_t i = start; i < end; i++) {
+                response.push_back(neighbors[i]);
+                response.push_back(graph.getHostId(neighbors[i]));
+            }
+            responses.push_back(std::move(response));
+            start = end;
+        } while (start < row_size);
+    }
+}
+
+inline void CachePrefetcher::addResponse(Cache& cache, Graph& graph, const host_id_t& owner, const std::vector<uint64_t>& response) {
+    vertex_id_t v = response[0];
+    index_t degree = response[1];
+    index_t start = response[2];
+    uint64_t entry_num = (response.size() - RESPONSE_HEADER_NUM) / 2;
+
+    if (degree != INF) {
+        cache.registerHostId(v, owner);
+        cache.registerDegree(v, degree);
+        for (uint64_t i = 0; i < entry_num; i++) {
+            vertex_id_t w = response[RESPONSE_HEADER_NUM + i * 2];
+            if (!graph.hasVertex(w)) cache.registerHostId(w, response[RESPONSE_HEADER_NUM + i * 2 + 1]);
+            cache.registerIndex(v, w, start + i);
+        }
+        entry_num_ += entry_num;
+    }
+
+    // 隣接リストの最後のレコードで揃う
+    if (degree == INF || start + entry_num >= std::min<uint64_t>(degree, CACHE_PREFETCH_MAX_ROW)) received_row_num_++;
+}
+
+inline bool CachePrefetcher::waitForRows(const uint32_t& timeout_ms) {
+    Timer timer;
+    while (received_row_num_ < requested_row_num_) {
+        if (timer.duration() * 1000 > timeout_ms) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+inline uint64_t CachePrefetcher::getRequestedRowNum() {
+    return requested_row_num_;
+}
+
+inline uint64_t CachePrefetcher::getReceivedRowNum() {
+    return received_row_num_;
+}
+
+inline uint64_t CachePrefetcher::getEntryNum() {
+    return entry_num_;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "type.hpp"
+#include "message_queue.hpp"
+#include "random_walker.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 送信先毎の credit による流量制御
+// 送信側: 送信した RWer の数だけ credit を消費し (in_flight), 受信側から返ってきた分を戻す
+// 受信側: executor が処理し終えた RWer の数を送信元毎に貯め, 送信時にヘッダに乗せて返す
+// (CREDIT_RETURN_THRESHOLD まで貯まったら送る RWer がなくても返す)
+// 「送信キュー長 + in_flight」が MAX_IN_FLIGHT_RWER を超えた送信先があれば RWer の生成を止める
+// (転送中の RWer は止めないのでデッドロックしない)
+
+class FlowControl {
+
+public :
+
+    // 初期化 (送信先数, 送信キュー, 自サーバの HostID)
+    void init(const uint32_t& host_num, MessageQueue<RandomWalker>* send_queue, const host_id_t& hostid);
+
+    // 送信先 dst に RWer_num 個送った (credit を消費)
+    void consumeCredit(const host_id_t& dst, const uint32_t& RWer_num);
+
+    // 送信先 dst から credit が返ってきた
+    void returnCredit(const host_id_t& dst, const uint32_t& credit);
+
+    // 送信元 src から来た RWer を 1 つ処理し終えた (返却する credit を貯める, 貯まった数を返す)
+    uint32_t addPendingReturn(const host_id_t& src);
+
+    // 送信元 src に返却する credit を入手
+    uint32_t getPendingReturn(const host_id_t& src);
+
+    // 送信元 src に返却する credit を取り出す (0 に戻す)
+    uint32_t takePendingReturn(const host_id_t& src);
+
+    // RWer の生成を止めるべきか
+    bool isThrottled();
+
+    // RWer の生成を再開できるまで待機
+    void waitForCredit();
+
+    // 送信先 dst の未返却 credit (全 RWer が終わって credit が返りきれば 0)
+    int64_t getInFlight(const host_id_t& dst);
+
+    // CREDIT_TIMEOUT_MS で未返却分を破棄した回数と, 破棄した credit の合計 (0 でなければ credit の返し忘れか送信先の停止)
+    uint64_t getCreditTimeoutCount();
+    uint64_t getDiscardedCredit();
+
+private :
+
+    // 現在時刻 (ms)
+    int64_t nowMs();
+
+    uint32_t host_num_ = 0;
+    host_id_t hostid_ = 0;
+    MessageQueue<RandomWalker>* send_queue_ = nullptr;
+    std::unique_ptr<std::atomic<int64_t>[]> in_flight_; // 送信先毎の未返却 credit
+    std::unique_ptr<std::atomic<uint32_t>[]> pending_return_; // 送信元毎の返却待ち credit
+    std::unique_ptr<std::atomic<int64_t>[]> last_progress_time_; // 送信先毎に最後に credit が動いた時刻 (ms)
+    std::atomic<uint64_t> credit_timeout_count_ = 0; // 未返却分を破棄した回数
+    std::atomic<uint64_t> discarded_credit_ = 0; // 破棄した credit の合計
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void FlowControl::init(const uint32_t& host_num, MessageQueue<RandomWalker>* send_queue, const host_id_t& hostid) {
+    host_num_ = host_num;
+    hostid_ = hostid;
+    send_queue_ = send_queue;
+    in_flight_.reset(new std::atomic<int64_t>[host_num]);
+    pending_return_.reset(new std::atomic<uint32_t>[host_num]);
+    last_progress_time_.reset(new std::atomic<int64_t>[host_num]);
+    for (uint32_t i = 0; i < host_num; i++) {
+        in_flight_[i] = 0;
+        pending_return_[i] = 0;
+        last_progress_time_[i] = nowMs();
+    }
+}
+
+inline void FlowControl::consumeCredit(const host_id_t& dst, const uint32_t& RWer_num) {
+    if (in_flight_[dst].fetch_add(RWer_num) <= 0) last_progress_time_[dst] = nowMs();
+}
+
+inline void FlowControl::returnCredit(const host_id_t& dst, const uint32_t& credit) {
+    if (credit == 0) return;
+    in_flight_[dst].fetch_sub(credit);
+    last_progress_time_[dst] = nowMs();
+}
+
+inline uint32_t FlowControl::addPendingReturn(const host_id_t& src) {
+    return pending_return_[src].fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+inline uint32_t FlowControl::getPendingReturn(const host_id_t& src) {
+    return pending_return_[src].load(std::memory_order_relaxed);
+}
+
+inline uint32_t FlowControl::takePendingReturn(const host_id_t& src) {
+    return pending_return_[src].exchange(0);
+}
+
+inline int64_t FlowControl::getInFlight(const host_id_t& dst) {
+    return in_flight_[dst].load(std::memory_order_relaxed);
+}
+
+inline bool FlowControl::isThrottled() {
+    for (host_id_t dst = 0; dst < host_num_; dst++) {
+        if (dst == hostid_) continue;
+
+        int64_t in_flight = in_flight_[dst].load(std::memory_order_relaxed);
+        if (send_queue_[dst].getSize() + std::max<int64_t>(in_flight, 0) < MAX_IN_FLIGHT_RWER) continue;
+
+        // 長い間 credit が返ってこない場合は送信先が応答しなくなったとみなして未返却分を破棄
+        int64_t now = nowMs();
+        if (in_flight > 0 && now - last_progress_time_[dst] > CREDIT_TIMEOUT_MS) {
+            std::cerr << "credit timeout: " << dst << ", discarded in_flight: " << in_flight << std::endl;
+            in_flight_[dst].fetch_sub(in_flight);
+            credit_timeout_count_++;
+            discarded_credit_ += in_flight;
+            last_progress_time_[dst] = now;
+            continue;
+        }
+
+        return true;
+    }
+    return false;
+}
+
+inline void FlowControl::waitForCredit() {
+    while (isThrottled()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(CREDIT_WAIT_SLEEP_US));
+    }
+}
+
+inline int64_t FlowControl::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t FlowControl::getCreditTimeoutCount() {
+    return credit_timeout_count_;
+}
+
+inline uint64_t FlowControl::getDiscardedCredit() {
+    return discarded_credit_;
+}
@@ -3,10 +3,12 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <unordered_set>
 
 #include "type.hpp"
 #include "storage.hpp"
+#include "ownership.hpp"
 #include "util.hpp"
 #include "../config/param.hpp"
 
@@ -26,12 +28,21 @@ class Graph {
     // 自サーバが持ち主となる頂点集合を入手
     std::vector<vertex_id_t> getMyVertices();
 
-    // 頂点の持ち主の HostID を入手
+    // 自サーバが持ち主となる頂点集合の idx 番目を入手
+    vertex_id_t getMyVertex(const vertex_id_t& idx);
+
+    // 頂点の持ち主の HostID を入手 (.owner のない分割で分からない頂点は 0)
     host_id_t getHostId(const vertex_id_t& node_id);
 
+    // 頂点の持ち主の決め方 (.owner があればその通り, なければ辺の dst_ip から作った表)
+    const Ownership& getOwnership();
+
     // 頂点の次数を入手
     index_t getDegree(const vertex_id_t& node_id);
 
+    // 自サーバが持ち主となる頂点の隣接リストを入手
+    const std::vector<vertex_id_t>& getNeighbors(const vertex_id_t& node_id);
+
     // 頂点の持ち主が自サーバであるか確認
     bool hasVertex(const vertex_id_t& node_id);
 
@@ -45,14 +56,22 @@ class Graph {
     // グラフのエッジカウント 
     edge_id_t getEdgeCount();
 
+    // グラフファイル (分割したグラフ) の中身のハッシュ値 (ghost 頂点の表も含む)
+    uint64_t getChecksum();
+
+    // ghost 頂点 (持ち主が他サーバの隣接頂点) の次数と持ち主 (.ghost がなければ空)
+    const std::vector<GhostVertex>& getGhostVertices();
+
     private:
 
     std::vector<vertex_id_t> my_vertices_vector_; // 自サーバが持ち主となる頂点集合 (配列)
-    std::vector<host_id_t> vertices_host_id_; // 自サーバが保持している頂点の持ち主の IP アドレス {頂点 ID : IP アドレス (頂点の持ち主)}
+    Ownership ownership_; // 頂点の持ち主
     std::vector<std::vector<vertex_id_t>> adjacency_list_; // 自サーバの隣接リスト {頂点 ID : 隣接リスト}
     std::vector<index_t> degree_; // 自サーバが持ち主となる頂点の次数
     std::vector<bool> has_v_;
     edge_id_t edge_count_;
+    uint64_t checksum_;
+    std::vector<GhostVertex> ghost_vertices_;
 
 };
 
@@ -67,17 +86,34 @@ inline void Graph::init(const std::string& dir_path, const std::string& host_id_
     edge_id_t read_e_num;
     read_graph(graph_file_path.c_str(), read_edges, read_e_num);
     edge_count_ = read_e_num;
+    checksum_ = hashBytes(read_edges, read_e_num * sizeof(Edge_dstIp));
     MY_EDGE_NUM = edge_count_;
     std::cout << "MY_EDGE_NUM: " << MY_EDGE_NUM << std::endl;
 
+    // ghost 頂点の表 (分割時に作った場合)
+    std::string ghost_file_path = dir_path + host_id_str + ".ghost";
+    GhostVertex *read_ghosts;
+    size_t read_g_num;
+    if (GHOST_TABLE_FLAG && read_table_if_exists(ghost_file_path.c_str(), read_ghosts, read_g_num)) {
+        ghost_vertices_.assign(read_ghosts, read_ghosts + read_g_num);
+        checksum_ = hashBytes(read_ghosts, read_g_num * sizeof(GhostVertex), checksum_);
+        delete[] read_ghosts;
+        std::cout << "ghost vertices: " << ghost_vertices_.size() << std::endl;
+    }
+
     // node_id の最大値を確認
     vertex_id_t mx_id = 0;
     for (int e_i = 0; e_i < read_e_num; e_i++) {
         mx_id = std::max((vertex_id_t)read_edges[e_i].src, mx_id);
     }
 
+    // 頂点の持ち主 (.owner がなければ自サーバの頂点と隣接頂点の表を作る)
+    std::string owner_file_path = dir_path + host_id_str + ".owner";
+    bool has_owner_file = ownership_.load(owner_file_path);
+    if (!has_owner_file) ownership_.initTable(SEND_QUEUE_NUM);
+    std::cout << "ownership: " << ownership_.getKind() << std::endl;
+
     // データ構造のサイズ指定
-    vertices_host_id_.resize(VERTEX_SIZE);
     adjacency_list_.resize(mx_id+1);
     degree_.resize(mx_id+1);
     has_v_.resize(VERTEX_SIZE);
@@ -87,8 +123,10 @@ inline void Graph::init(const std::string& dir_path, const std::string& host_id_
     for (int e_i = 0; e_i < read_e_num; e_i++) {
         auto e = read_edges[e_i];
         v_st.insert(e.src);
-        vertices_host_id_[e.src] = hostid;
-        vertices_host_id_[e.dst] = e.dst_ip;
+        if (!has_owner_file) {
+            ownership_.setOwner(e.src, hostid);
+            ownership_.setOwner(e.dst, e.dst_ip);
+        }
         adjacency_list_[e.src].push_back(e.dst);
         has_v_[e.src] = true;
     }
@@ -108,13 +146,17 @@ inline std::vector<vertex_id_t> Graph::getMyVertices() {
     return my_vertices_vector_;
 }
 
+inline vertex_id_t Graph::getMyVertex(const vertex_id_t& idx) {
+    return my_vertices_vector_[idx];
+}
+
 inline host_id_t Graph::getHostId(const vertex_id_t& node_id) {
-    try {
-        return vertices_host_id_[node_id];
-    } catch (std::out_of_range& oor) {
-        std::cerr << "graph getHostId node_id: " << node_id << std::endl;
-        exit(1);
-    }
+    host_id_t host_id = ownership_.getOwner(node_id);
+    return host_id == INF ? 0 : host_id;
+}
+
+inline const Ownership& Graph::getOwnership() {
+    return ownership_;
 }
 
 inline index_t Graph::getDegree(const vertex_id_t& node_id) {
@@ -126,6 +168,10 @@ inline index_t Graph::getDegree(const vertex_id_t& node_id) {
     }
 }
 
+inline const std::vector<vertex_id_t>& Graph::getNeighbors(const vertex_id_t& node_id) {
+    return adjacency_list_[node_id];
+}
+
 inline bool Graph::hasVertex(const vertex_id_t& node_id) {
     assert(node_id < VERTEX_SIZE);
     return has_v_[node_id];
@@ -157,4 +203,12 @@ inline index_t Graph::indexOfUV(const vertex_id_t& node_id_u, const vertex_id_t&
 
 inline edge_id_t Graph::getEdgeCount() {
     return edge_count_;
+}
+
+inline uint64_t Graph::getChecksum() {
+    return checksum_;
+}
+
+inline const std::vector<GhostVertex>& Graph::getGhostVertices() {
+    return ghost_vertices_;
 }
\ No newline at end of file
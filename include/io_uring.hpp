@@ -0,0 +1,310 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// io_uring の最小限のラッパ (liburing を使わずにシステムコールを直接呼ぶ)
+// 1 つのリングは 1 つのスレッドだけが使う
+//
+// SQ / CQ はカーネルと mmap で共有しており,
+// head / tail の読み書きは acquire / release で行う
+//
+// provided buffer ring (IORING_REGISTER_PBUF_RING) を登録すると,
+// IOSQE_BUFFER_SELECT を付けた受信はカーネルがそこからバッファを選んで書き込む
+
+class IoUring {
+
+public :
+
+    // デストラクタ (リングを閉じる)
+    ~IoUring();
+
+    // この環境で io_uring の受信に使う機能が全て使えるか
+    // (リングの作成, provided buffer ring の登録, UDP ソケットでの multishot recv)
+    static bool isSupported();
+
+    // 初期化 (SQ のエントリ数, CQ のエントリ数) (失敗したら false)
+    bool init(const uint32_t& sq_entries, const uint32_t& cq_entries);
+
+    // 空いている SQE を入手 (SQ が満杯なら nullptr)
+    struct io_uring_sqe* getSqe();
+
+    // 溜めた SQE を 1 回のシステムコールでまとめて投入し, CQE が wait_num 個以上になるまで待つ
+    // (シグナルで待機が中断されると wait_num 個に満たないまま返ることがある)
+    int submit(const uint32_t& wait_num);
+
+    // 届いている CQE を 1 つずつ func(cqe) に渡して消費 (消費した数を返す)
+    template <typename Func>
+    uint32_t forEachCqe(Func func);
+
+    // provided buffer ring を登録 (group_id, buffer_num (2 の冪), buffer_size)
+    bool registerBufferRing(const uint16_t& group_id, const uint32_t& buffer_num, const uint32_t& buffer_size);
+
+    // provided buffer を返却 (publishBuffers() でカーネルに見える)
+    void recycleBuffer(const uint16_t& buffer_id);
+
+    // 返却した provided buffer をカーネルに公開
+    void publishBuffers();
+
+    // provided buffer の先頭
+    char* getBuffer(const uint16_t& buffer_id);
+
+private :
+
+    int ring_fd_ = -1;
+
+    // SQ
+    void* sq_ptr_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    uint32_t* sq_head_ = nullptr;
+    uint32_t* sq_tail_ = nullptr;
+    uint32_t* sq_array_ = nullptr;
+    uint32_t sq_mask_ = 0;
+    uint32_t sq_entries_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    uint32_t sqe_tail_ = 0; // getSqe() で渡した SQE の数
+    uint32_t sqe_flushed_ = 0; // カーネルに公開した SQE の数
+
+    // CQ
+    void* cq_ptr_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    uint32_t* cq_head_ = nullptr;
+    uint32_t* cq_tail_ = nullptr;
+    uint32_t cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+
+    // provided buffer ring
+    struct io_uring_buf_ring* buf_ring_ = nullptr;
+    size_t buf_ring_size_ = 0;
+    uint32_t buf_mask_ = 0;
+    uint16_t buf_tail_ = 0;
+    uint32_t buffer_size_ = 0;
+    std::vector<char> buffers_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline IoUring::~IoUring() {
+    if (buf_ring_ != nullptr) munmap(buf_ring_, buf_ring_size_);
+    if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_ring_size_);
+    if (sq_ptr_ != nullptr) munmap(sq_ptr_, sq_ring_size_);
+    if (ring_fd_ >= 0) close(ring_fd_);
+}
+
+inline bool IoUring::isSupported() {
+    // リングを作れるか
+    IoUring ring;
+    if (!ring.init(1, 2)) return false;
+
+    // provided buffer ring を登録できるか (IORING_REGISTER_PBUF_RING, 5.19 以降)
+    const uint16_t group_id = 0;
+    if (!ring.registerBufferRing(group_id, 1, 64)) return false;
+
+    // multishot recv (6.0 以降) を使えるか: 自分宛てに 1 つ送って受け取れるかを確かめる
+    // (使えないカーネルでは投入した時点で -EINVAL の CQE が返る)
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) return false;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(struct sockaddr_in);
+    bool ok = bind(sockfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == 0
+        && getsockname(sockfd, (struct sockaddr *)&addr, &addr_len) == 0;
+
+    struct io_uring_sqe* sqe = ok ? ring.getSqe() : nullptr;
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sockfd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = group_id;
+
+        char probe = 0;
+        ok = ring.submit(0) >= 0
+            && sendto(sockfd, &probe, 1, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == 1
+            && ring.submit(1) >= 0;
+    }
+
+    bool received = false;
+    if (ok && sqe != nullptr) {
+        ring.forEachCqe([&](const struct io_uring_cqe& cqe) {
+            if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) received = true;
+        });
+    }
+
+    close(sockfd);
+    return received;
+}
+
+inline bool IoUring::init(const uint32_t& sq_entries, const uint32_t& cq_entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cq_entries;
+
+    ring_fd_ = syscall(__NR_io_uring_setup, sq_entries, &params);
+    if (ring_fd_ < 0) {
+        perror("io_uring_setup");
+        return false;
+    }
+
+    // SQ / CQ のリングを mmap
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ptr_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        perror("mmap (IORING_OFF_SQ_RING)");
+        sq_ptr_ = nullptr;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            perror("mmap (IORING_OFF_CQ_RING)");
+            cq_ptr_ = nullptr;
+            return false;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = (struct io_uring_sqe*)mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        perror("mmap (IORING_OFF_SQES)");
+        sqes_ = nullptr;
+        return false;
+    }
+
+    char* sq = (char*)sq_ptr_;
+    sq_head_ = (uint32_t*)(sq + params.sq_off.head);
+    sq_tail_ = (uint32_t*)(sq + params.sq_off.tail);
+    sq_array_ = (uint32_t*)(sq + params.sq_off.array);
+    sq_mask_ = *(uint32_t*)(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+
+    char* cq = (char*)cq_ptr_;
+    cq_head_ = (uint32_t*)(cq + params.cq_off.head);
+    cq_tail_ = (uint32_t*)(cq + params.cq_off.tail);
+    cq_mask_ = *(uint32_t*)(cq + params.cq_off.ring_mask);
+    cqes_ = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    sqe_tail_ = sqe_flushed_ = *sq_tail_;
+
+    return true;
+}
+
+inline struct io_uring_sqe* IoUring::getSqe() {
+    uint32_t head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_) return nullptr;
+
+    struct io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    sqe_tail_++;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+inline int IoUring::submit(const uint32_t& wait_num) {
+    // 溜めた SQE をカーネルに公開
+    uint32_t to_submit = sqe_tail_ - sqe_flushed_;
+    for (; sqe_flushed_ != sqe_tail_; sqe_flushed_++) {
+        sq_array_[sqe_flushed_ & sq_mask_] = sqe_flushed_ & sq_mask_;
+    }
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+    if (to_submit == 0 && wait_num == 0) return 0;
+
+    uint32_t flags = wait_num > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (1) {
+        int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_num, flags, nullptr, 0);
+        if (ret >= 0) return ret;
+        if (errno == EINTR) continue; // 何も投入されていないのでやり直す
+        perror("io_uring_enter");
+        return ret;
+    }
+}
+
+template <typename Func>
+inline uint32_t IoUring::forEachCqe(Func func) {
+    uint32_t head = *cq_head_;
+    uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    uint32_t count = 0;
+
+    for (; head != tail; head++) {
+        func(cqes_[head & cq_mask_]);
+        count++;
+    }
+
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+inline bool IoUring::registerBufferRing(const uint16_t& group_id, const uint32_t& buffer_num, const uint32_t& buffer_size) {
+    // リングはページ境界に置く必要がある
+    buf_ring_size_ = buffer_num * sizeof(struct io_uring_buf);
+    void* ptr = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap (buffer ring)");
+        return false;
+    }
+    buf_ring_ = (struct io_uring_buf_ring*)ptr;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)buf_ring_;
+    reg.ring_entries = buffer_num;
+    reg.bgid = group_id;
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring_register (IORING_REGISTER_PBUF_RING)");
+        return false;
+    }
+
+    buf_mask_ = buffer_num - 1;
+    buffer_size_ = buffer_size;
+    buffers_.resize((size_t)buffer_num * buffer_size);
+
+    // 全てのバッファをカーネルに渡す
+    for (uint32_t i = 0; i < buffer_num; i++) recycleBuffer(i);
+    publishBuffers();
+
+    return true;
+}
+
+inline void IoUring::recycleBuffer(const uint16_t& buffer_id) {
+    // C++ では __DECLARE_FLEX_ARRAY の空 struct が 1 Byte になり bufs がずれるので, 先頭から io_uring_buf の配列として扱う
+    struct io_uring_buf* buf = (struct io_uring_buf*)buf_ring_ + (buf_tail_ & buf_mask_);
+    buf->addr = (uint64_t)getBuffer(buffer_id);
+    buf->len = buffer_size_;
+    buf->bid = buffer_id;
+    buf_tail_++;
+}
+
+inline void IoUring::publishBuffers() {
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+inline char* IoUring::getBuffer(const uint16_t& buffer_id) {
+    return buffers_.data() + (size_t)buffer_id * buffer_size_;
+}
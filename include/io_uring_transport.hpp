@@ -0,0 +1,337 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "type.hpp"
+#include "util.hpp"
+#include "io_uring.hpp"
+#include "transport.hpp"
+#include "udp_transport.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// io_uring で送信する
+// UDP_BATCH_SIZE 個のメッセージを sendmsg の SQE にして 1 回の io_uring_enter でまとめて投入
+
+class IoUringTransportSender : public TransportSender {
+
+public :
+
+    // コンストラクタ (送信先の IP アドレス, 受信ポートの先頭番号)
+    IoUringTransportSender(const host_id_t& dst_ip, const uint16_t& port_base);
+
+    // デストラクタ (ソケットを閉じる)
+    ~IoUringTransportSender();
+
+    char* getBuffer() override;
+
+    void commit(const uint32_t& length) override;
+
+    void commitExternal(const char* message, const uint32_t& length) override;
+
+    void flush() override;
+
+private :
+
+    int sockfd_;
+    IoUring ring_;
+    uint32_t count_ = 0; // 溜まっているメッセージ数
+
+    std::vector<char> buffer_; // UDP_BATCH_SIZE * MESSAGE_MAX_LENGTH_SEND
+    std::vector<struct msghdr> msgs_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct sockaddr_in> addrs_;
+    struct sockaddr_in addr_;
+    uint16_t port_base_;
+    StdRandNumGenerator gen_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// io_uring で受信する
+// 担当する全ポートのソケットに multishot recv を 1 つずつ仕掛け, 1 つのリングで待つ
+// 受信バッファは provided buffer ring としてカーネルに登録しておき, 受信の度にカーネルが選ぶ
+// (受信したバッファは次の receive() で返却する)
+// リングの作成や登録に失敗した場合は終了せず, 全ポートを poll して recv で受信する
+
+class IoUringTransportReceiver : public TransportReceiver {
+
+public :
+
+    // コンストラクタ (bind する IP アドレス, 担当するポート番号)
+    IoUringTransportReceiver(const host_id_t& ip, const std::vector<uint16_t>& port_nums);
+
+    // デストラクタ (ソケットを閉じる)
+    ~IoUringTransportReceiver();
+
+    uint32_t receive(std::vector<Datagram>& datagrams) override;
+
+private :
+
+    // sockfds_[socket_idx] に multishot recv を仕掛ける
+    void armRecv(const uint32_t& socket_idx);
+
+    // io_uring を使えなかった場合の受信 (poll + recv)
+    uint32_t receiveFallback(std::vector<Datagram>& datagrams);
+
+    std::vector<int> sockfds_;
+    IoUring ring_;
+    bool ring_ready_ = false; // リングと provided buffer ring を用意できたか
+    std::vector<uint16_t> lent_buffer_ids_; // 前回の receive() で渡したバッファ
+    std::vector<struct pollfd> fallback_fds_; // !ring_ready_ の時に poll するソケット
+    std::vector<char> fallback_buffer_; // !ring_ready_ の時の受信バッファ (ソケット毎に MESSAGE_MAX_LENGTH_RECV)
+
+    static constexpr uint16_t BUFFER_GROUP_ID = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// io_uring エンジン (IO_URING_RECV_THREAD_NUM 個の受信スレッドが全ポートを分担)
+
+class IoUringTransport : public Transport {
+
+public :
+
+    void init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) override;
+
+    bool isReliable() override;
+
+    std::unique_ptr<TransportSender> createSender(const host_id_t& dst_id) override;
+
+    uint32_t getReceiverNum() override;
+
+    std::unique_ptr<TransportReceiver> createReceiver(const uint32_t& receiver_id) override;
+
+private :
+
+    host_id_t hostid_;
+    host_id_t hostip_;
+    std::vector<host_id_t> worker_ip_all_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline IoUringTransportSender::IoUringTransportSender(const host_id_t& dst_ip, const uint16_t& port_base) : port_base_(port_base) {
+    // ソケットの生成
+    sockfd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd_ < 0) { // エラー処理
+        perror("socket");
+        exit(1); // 異常終了
+    }
+
+    if (!ring_.init(UDP_BATCH_SIZE, UDP_BATCH_SIZE * 2)) exit(1);
+
+    // アドレスの生成
+    memset(&addr_, 0, sizeof(struct sockaddr_in));
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = dst_ip;
+
+    buffer_.resize(UDP_BATCH_SIZE * MESSAGE_MAX_LENGTH_SEND);
+    msgs_.resize(UDP_BATCH_SIZE);
+    iovecs_.resize(UDP_BATCH_SIZE);
+    addrs_.resize(UDP_BATCH_SIZE);
+    memset(msgs_.data(), 0, sizeof(struct msghdr) * UDP_BATCH_SIZE);
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++) {
+        iovecs_[i].iov_base = buffer_.data() + i * MESSAGE_MAX_LENGTH_SEND;
+        msgs_[i].msg_iov = &iovecs_[i];
+        msgs_[i].msg_iovlen = 1;
+        msgs_[i].msg_name = &addrs_[i];
+        msgs_[i].msg_namelen = sizeof(struct sockaddr_in);
+    }
+}
+
+inline IoUringTransportSender::~IoUringTransportSender() {
+    flush();
+    close(sockfd_);
+}
+
+inline char* IoUringTransportSender::getBuffer() {
+    return buffer_.data() + count_ * MESSAGE_MAX_LENGTH_SEND;
+}
+
+inline void IoUringTransportSender::commit(const uint32_t& length) {
+    // 自分のバッファを指して追加 (前のバッチで外のバッファを指していた場所も戻る)
+    commitExternal(getBuffer(), length);
+}
+
+inline void IoUringTransportSender::commitExternal(const char* message, const uint32_t& length) {
+    // ポート番号指定
+    addr_.sin_port = htons(gen_.genRandHostId(port_base_, port_base_+RECV_PORT-1));
+
+    iovecs_[count_].iov_base = const_cast<char*>(message);
+    iovecs_[count_].iov_len = length;
+    addrs_[count_] = addr_;
+    count_++;
+
+    if (count_ == UDP_BATCH_SIZE) flush();
+}
+
+inline void IoUringTransportSender::flush() {
+    if (count_ == 0) return;
+
+    for (uint32_t i = 0; i < count_; i++) {
+        struct io_uring_sqe* sqe = ring_.getSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sockfd_;
+        sqe->addr = (uint64_t)&msgs_[i];
+        sqe->len = 1;
+        sqe->user_data = i;
+    }
+
+    // 全て投入して完了を待つ (完了するまでバッファは書き換えられない)
+    uint32_t completed = 0;
+    while (completed < count_) {
+        if (ring_.submit(count_ - completed) < 0) break;
+        completed += ring_.forEachCqe([&](const struct io_uring_cqe& cqe) {
+            if (cqe.res < 0) {
+                errno = -cqe.res;
+                perror("io_uring sendmsg");
+            }
+        });
+    }
+
+    count_ = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline IoUringTransportReceiver::IoUringTransportReceiver(const host_id_t& ip, const std::vector<uint16_t>& port_nums) {
+    for (uint16_t port_num : port_nums) sockfds_.push_back(createUdpServerSocket(ip, port_num));
+
+    // IoUring::isSupported() で確かめてあるが, それでも用意できなければ (メモリの上限等) poll + recv で受信する
+    ring_ready_ = ring_.init(std::max<uint32_t>(port_nums.size(), 1), IO_URING_RECV_BUFFER_NUM * 2)
+        && ring_.registerBufferRing(BUFFER_GROUP_ID, IO_URING_RECV_BUFFER_NUM, MESSAGE_MAX_LENGTH_RECV);
+    if (!ring_ready_) {
+        std::cerr << "io_uring receiver is not available, fall back to poll + recv" << std::endl;
+        for (int sockfd : sockfds_) fallback_fds_.push_back({sockfd, POLLIN, 0});
+        fallback_buffer_.resize(sockfds_.size() * MESSAGE_MAX_LENGTH_RECV);
+        return;
+    }
+
+    for (uint32_t i = 0; i < sockfds_.size(); i++) armRecv(i);
+}
+
+inline IoUringTransportReceiver::~IoUringTransportReceiver() {
+    for (int sockfd : sockfds_) close(sockfd);
+}
+
+inline uint32_t IoUringTransportReceiver::receive(std::vector<Datagram>& datagrams) {
+    if (!ring_ready_) return receiveFallback(datagrams);
+
+    datagrams.clear();
+
+    // 前回渡したバッファをカーネルに返却
+    for (uint16_t buffer_id : lent_buffer_ids_) ring_.recycleBuffer(buffer_id);
+    ring_.publishBuffers();
+    lent_buffer_ids_.clear();
+
+    while (datagrams.empty()) {
+        // 仕掛け直しの SQE を投入し, 1 つ以上届くまで待つ
+        if (ring_.submit(1) < 0) return 0;
+
+        ring_.forEachCqe([&](const struct io_uring_cqe& cqe) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                uint16_t buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe.res > 0) {
+                    datagrams.push_back({ring_.getBuffer(buffer_id), (uint32_t)cqe.res});
+                    lent_buffer_ids_.push_back(buffer_id);
+                } else {
+                    ring_.recycleBuffer(buffer_id);
+                }
+            } else if (cqe.res < 0 && cqe.res != -ENOBUFS) {
+                errno = -cqe.res;
+                perror("io_uring recv");
+            }
+
+            // multishot が止まったら (バッファ切れ等) 仕掛け直す
+            if (!(cqe.flags & IORING_CQE_F_MORE)) armRecv(cqe.user_data);
+        });
+        ring_.publishBuffers();
+    }
+
+    return datagrams.size();
+}
+
+inline uint32_t IoUringTransportReceiver::receiveFallback(std::vector<Datagram>& datagrams) {
+    datagrams.clear();
+
+    while (datagrams.empty()) {
+        if (poll(fallback_fds_.data(), fallback_fds_.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 0;
+        }
+
+        for (uint32_t i = 0; i < fallback_fds_.size(); i++) {
+            if (!(fallback_fds_[i].revents & POLLIN)) continue;
+            char* buffer = fallback_buffer_.data() + (size_t)i * MESSAGE_MAX_LENGTH_RECV;
+            ssize_t length = recv(sockfds_[i], buffer, MESSAGE_MAX_LENGTH_RECV, MSG_DONTWAIT);
+            if (length > 0) datagrams.push_back({buffer, (uint32_t)length});
+        }
+    }
+
+    return datagrams.size();
+}
+
+inline void IoUringTransportReceiver::armRecv(const uint32_t& socket_idx) {
+    struct io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sockfds_[socket_idx];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP_ID;
+    sqe->user_data = socket_idx;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void IoUringTransport::init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    hostid_ = hostid;
+    hostip_ = worker_ip_all[hostid];
+    worker_ip_all_ = worker_ip_all;
+}
+
+inline bool IoUringTransport::isReliable() {
+    return false;
+}
+
+inline std::unique_ptr<TransportSender> IoUringTransport::createSender(const host_id_t& dst_id) {
+    return std::make_unique<IoUringTransportSender>(worker_ip_all_[dst_id], 10000 + getPortOffset(dst_id, worker_ip_all_));
+}
+
+inline uint32_t IoUringTransport::getReceiverNum() {
+    return std::min(IO_URING_RECV_THREAD_NUM, RECV_PORT);
+}
+
+inline std::unique_ptr<TransportReceiver> IoUringTransport::createReceiver(const uint32_t& receiver_id) {
+    // ポートを受信スレッドに振り分ける
+    std::vector<uint16_t> port_nums;
+    for (uint32_t i = receiver_id; i < RECV_PORT; i += getReceiverNum()) {
+        port_nums.push_back(10000 + getPortOffset(hostid_, worker_ip_all_) + i);
+    }
+    return std::make_unique<IoUringTransportReceiver>(hostip_, port_nums);
+}
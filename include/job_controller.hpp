@@ -0,0 +1,94 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+#include "type.hpp"
+
+// ジョブの種類
+const uint32_t MAIN_JOB = 0; // メインの実験
+const uint32_t CACHE_JOB = 1; // cache 補充用の実行
+
+// generator スレッドに配るジョブ
+struct RandomWalkJob {
+    uint32_t kind_ = MAIN_JOB; // ジョブの種類
+    uint32_t thread_num_ = 0; // このジョブで RWer を生成するスレッド数 (worker_id < thread_num_ のスレッドが担当)
+    walker_id_t RWer_num_ = 0; // 生成する RWer の総数
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 常駐している generator スレッドへのジョブ配布と終了待ち
+// ジョブは 1 つずつ実行され, 全 generator スレッドが finishJob を呼んだら終了
+
+class JobController {
+
+public :
+
+    // 常駐している generator スレッド数を設定 (スレッド開始前に呼ぶ)
+    void setWorkerNum(const uint32_t& worker_num);
+
+    // ジョブを投入し, 全 generator スレッドが終了するまで待機
+    void run(const RandomWalkJob& job);
+
+    // 次のジョブが来るまで待機 (epoch: 最後に実行したジョブの番号, 更新される)
+    RandomWalkJob waitJob(uint64_t& epoch);
+
+    // generator スレッドがジョブを終えたことを通知
+    void finishJob();
+
+private :
+
+    RandomWalkJob job_; // 実行中のジョブ
+    uint64_t epoch_ = 0; // ジョブ番号
+    uint32_t worker_num_ = 0; // generator スレッド数
+    uint32_t running_num_ = 0; // ジョブ実行中の generator スレッド数
+    bool busy_ = false; // ジョブ実行中かどうか
+    std::mutex mtx_job_;
+    std::condition_variable cv_job_; // ジョブ開始用
+    std::condition_variable cv_end_; // ジョブ終了用
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void JobController::setWorkerNum(const uint32_t& worker_num) {
+    std::lock_guard<std::mutex> lk(mtx_job_);
+    worker_num_ = worker_num;
+}
+
+inline void JobController::run(const RandomWalkJob& job) {
+    std::unique_lock<std::mutex> lk(mtx_job_);
+
+    // 他のジョブが終わるまで待機
+    cv_end_.wait(lk, [&]{ return !busy_; });
+
+    job_ = job;
+    epoch_++;
+    running_num_ = worker_num_;
+    busy_ = true;
+    cv_job_.notify_all();
+
+    // 全 generator スレッドが終わるまで待機
+    cv_end_.wait(lk, [&]{ return running_num_ == 0; });
+
+    busy_ = false;
+    cv_end_.notify_all();
+}
+
+inline RandomWalkJob JobController::waitJob(uint64_t& epoch) {
+    std::unique_lock<std::mutex> lk(mtx_job_);
+    cv_job_.wait(lk, [&]{ return epoch_ != epoch; });
+    epoch = epoch_;
+    return job_;
+}
+
+inline void JobController::finishJob() {
+    std::lock_guard<std::mutex> lk(mtx_job_);
+    running_num_--;
+    if (running_num_ == 0) cv_end_.notify_all();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <algorithm>
+
+#include "type.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 対数 + 線形のバケットのヒストグラム (HDR Histogram と同じ形, 値は 32bit まで)
+// (UINT32_MAX (µs なら約 71 分) を超えた値は最後のバケットに入れる, getMax は超えた値のまま)
+//
+// 値 < 2^(SUB_BITS+1) はそのまま 1 つずつのバケット, それより大きい値は 2 のべき乗の区間毎に 2^SUB_BITS 個に等分する
+// (バケット内の誤差は 1/2^SUB_BITS 以下, バケット数は値の個数によらず BUCKET_NUM 個で一定)
+// 書き込むのは 1 スレッドだけ (スレッド毎に持つ) で, 読むのは他のスレッドからでもよい (atomic を relaxed で読み書きするだけ, ロックも RMW もなし)
+
+class LatencyHistogram {
+
+public :
+
+    // 全バケットを 0 にする
+    void clear();
+
+    // 値を 1 つ記録 (書き込むスレッドからのみ)
+    void record(const uint64_t& value);
+
+    // other の回数を足す (全スレッド分を合わせる時に使う)
+    void add(const LatencyHistogram& other);
+
+    // 記録した値の数
+    uint64_t getCount() const;
+
+    // 記録した値の最大
+    uint64_t getMax() const;
+
+    // q (0 - 1) 分位点 (q 番目の値が入っているバケットの上端, 何も記録していなければ 0)
+    uint64_t getPercentile(const double& q) const;
+
+    static constexpr uint32_t SUB_BITS = 5;
+    static constexpr uint32_t SUB_BUCKET_NUM = 1<<SUB_BITS;
+    static constexpr uint32_t BUCKET_NUM = (33 - SUB_BITS) * SUB_BUCKET_NUM;
+
+    // 値の入るバケット
+    static uint32_t getBucketIndex(const uint64_t& value);
+
+    // バケットに入る値の上端
+    static uint64_t getBucketMax(const uint32_t& bucket_idx);
+
+private :
+
+    std::atomic<uint64_t> counts_[BUCKET_NUM] = {};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void LatencyHistogram::clear() {
+    for (std::atomic<uint64_t>& count : counts_) count.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+inline void LatencyHistogram::record(const uint64_t& value) {
+    std::atomic<uint64_t>& count = counts_[getBucketIndex(value)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (value > max_.load(std::memory_order_relaxed)) max_.store(value, std::memory_order_relaxed);
+}
+
+inline void LatencyHistogram::add(const LatencyHistogram& other) {
+    for (uint32_t i = 0; i < BUCKET_NUM; i++) {
+        counts_[i].store(counts_[i].load(std::memory_order_relaxed) + other.counts_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    count_.store(count_.load(std::memory_order_relaxed) + other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    max_.store(std::max(max_.load(std::memory_order_relaxed), other.max_.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+}
+
+inline uint64_t LatencyHistogram::getCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t LatencyHistogram::getMax() const {
+    return max_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t LatencyHistogram::getPercentile(const double& q) const {
+    // 読んでいる間にも記録されるので, 合計はバケットを足したものを使う
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t>& count : counts_) total += count.load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, std::min<uint64_t>(total, (uint64_t)std::ceil(q * total)));
+    uint64_t cumulative = 0;
+    for (uint32_t i = 0; i < BUCKET_NUM; i++) {
+        cumulative += counts_[i].load(std::memory_order_relaxed);
+        if (cumulative >= rank) return std::min(getBucketMax(i), getMax());
+    }
+    return getMax();
+}
+
+inline uint32_t LatencyHistogram::getBucketIndex(const uint64_t& value) {
+    uint64_t v = std::min<uint64_t>(value, UINT32_MAX);
+    if (v < 2 * SUB_BUCKET_NUM) return v;
+
+    // 上から SUB_BITS + 1 bit だけ残す
+    uint32_t shift = std::bit_width(v) - SUB_BITS - 1;
+    return (shift + 1) * SUB_BUCKET_NUM + (v >> shift) - SUB_BUCKET_NUM;
+}
+
+inline uint64_t LatencyHistogram::getBucketMax(const uint32_t& bucket_idx) {
+    if (bucket_idx < 2 * SUB_BUCKET_NUM) return bucket_idx;
+
+    uint32_t shift = bucket_idx / SUB_BUCKET_NUM - 1;
+    uint64_t sub = bucket_idx % SUB_BUCKET_NUM + SUB_BUCKET_NUM;
+    return ((sub + 1) << shift) - 1;
+}
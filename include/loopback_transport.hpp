@@ -0,0 +1,309 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <string>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstring>
+
+#include "type.hpp"
+#include "transport.hpp"
+#include "udp_transport.hpp"
+#include "buffer_pool.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 1 プロセス内で動かす全 worker が共有する疑似的なネットワーク
+// 送信元と送信先の組毎に LOOPBACK_LATENCY_US の遅延, LOOPBACK_BANDWIDTH_MBPS の帯域, LOOPBACK_LOSS_RATE のロスを与える
+// メッセージはパケットバッファのプールのバッファごと受け渡す (コピーしない)
+
+class LoopbackNetwork {
+
+public :
+
+    // 初期化 (worker 数, LOOPBACK_* を読む)
+    void init(const uint32_t& host_num);
+
+    // src から dst へ message (length Byte) を送る (ロスしたら false), 帯域による送信完了時刻を返す
+    bool send(const host_id_t& src, const host_id_t& dst, BufferRef&& message, const uint32_t& length, std::chrono::steady_clock::time_point& sent_time);
+
+    // dst 宛てで届く時刻を過ぎたメッセージを 1 つ以上待って, max_num 個まで (メッセージ, 長さ) を messages に移す
+    void receive(const host_id_t& dst, std::vector<std::pair<BufferRef, uint32_t>>& messages, const uint32_t& max_num);
+
+    // ロスした数
+    uint64_t getLossCount();
+
+private :
+
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    struct Packet {
+        time_point deliver_time_; // 届く時刻
+        uint64_t order_; // 同じ時刻なら送った順
+        BufferRef message_;
+        uint32_t length_;
+
+        bool operator>(const Packet& other) const {
+            if (deliver_time_ != other.deliver_time_) return deliver_time_ > other.deliver_time_;
+            return order_ > other.order_;
+        }
+    };
+
+    struct Inbox {
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::priority_queue<Packet, std::vector<Packet>, std::greater<Packet>> packets_;
+        uint64_t order_ = 0;
+    };
+
+    struct Link {
+        std::mutex mtx_;
+        time_point free_time_; // 前のメッセージを送り終える時刻 (帯域)
+        std::mt19937 mt_;
+    };
+
+    std::vector<std::unique_ptr<Inbox>> inboxes_; // 送信先毎
+    std::vector<std::unique_ptr<Link>> links_; // 送信元 * host_num_ + 送信先
+    uint32_t host_num_ = 0;
+    std::chrono::microseconds latency_;
+    double ns_per_byte_ = 0; // 0 なら帯域制限なし
+    double loss_rate_ = 0;
+    std::mutex loss_mtx_;
+    uint64_t loss_count_ = 0;
+
+};
+
+// プロセスで 1 つの疑似ネットワーク
+LoopbackNetwork& getLoopbackNetwork();
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 疑似ネットワークに送る
+// flush 時に帯域で決まる送信完了時刻まで待つ (NIC が送り終えるまで次を送れないのと同じ)
+
+class LoopbackTransportSender : public TransportSender {
+
+public :
+
+    // コンストラクタ (送信元, 送信先の HostID)
+    LoopbackTransportSender(const host_id_t& src, const host_id_t& dst);
+
+    char* getBuffer() override;
+
+    void commit(const uint32_t& length) override;
+
+    void flush() override;
+
+private :
+
+    host_id_t src_;
+    host_id_t dst_;
+    BufferRef buffer_; // 組み立て中のメッセージ (commit で疑似ネットワークに渡す)
+    std::chrono::steady_clock::time_point sent_time_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 疑似ネットワークから自分宛てのメッセージを受け取る
+
+class LoopbackTransportReceiver : public TransportReceiver {
+
+public :
+
+    // コンストラクタ (自分の HostID)
+    LoopbackTransportReceiver(const host_id_t& hostid);
+
+    uint32_t receive(std::vector<Datagram>& datagrams) override;
+
+private :
+
+    host_id_t hostid_;
+    std::vector<std::pair<BufferRef, uint32_t>> messages_; // 次の receive() まで datagrams が指す (中の RWer を全て処理し終えてからプールに返る)
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 1 プロセス内の worker 間の通信エンジン (LOOPBACK_ENGINE)
+// 受信スレッドは 2 つ: 0 は StartManager からの合図 (UDP), 1 は疑似ネットワーク
+// ロスさせなければ再送制御は不要
+
+class LoopbackTransport : public Transport {
+
+public :
+
+    void init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) override;
+
+    bool isReliable() override;
+
+    std::unique_ptr<TransportSender> createSender(const host_id_t& dst_id) override;
+
+    uint32_t getReceiverNum() override;
+
+    std::unique_ptr<TransportReceiver> createReceiver(const uint32_t& receiver_id) override;
+
+private :
+
+    host_id_t hostid_;
+    host_id_t hostip_;
+    std::vector<host_id_t> worker_ip_all_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void LoopbackNetwork::init(const uint32_t& host_num) {
+    host_num_ = host_num;
+    inboxes_.clear();
+    links_.clear();
+    for (uint32_t i = 0; i < host_num; i++) inboxes_.push_back(std::make_unique<Inbox>());
+    for (uint32_t i = 0; i < host_num * host_num; i++) {
+        links_.push_back(std::make_unique<Link>());
+        links_.back()->mt_.seed(i);
+    }
+
+    latency_ = std::chrono::microseconds(LOOPBACK_LATENCY_US);
+    ns_per_byte_ = LOOPBACK_BANDWIDTH_MBPS > 0 ? 8.0 * 1000 / LOOPBACK_BANDWIDTH_MBPS : 0;
+    loss_rate_ = LOOPBACK_LOSS_RATE;
+}
+
+inline bool LoopbackNetwork::send(const host_id_t& src, const host_id_t& dst, BufferRef&& message, const uint32_t& length, std::chrono::steady_clock::time_point& sent_time) {
+    time_point now = std::chrono::steady_clock::now();
+    Link& link = *links_[src * host_num_ + dst];
+    bool lost;
+    {
+        std::lock_guard<std::mutex> lk(link.mtx_);
+        link.free_time_ = std::max(link.free_time_, now) + std::chrono::nanoseconds((int64_t)(ns_per_byte_ * length));
+        sent_time = link.free_time_;
+        lost = loss_rate_ > 0 && std::uniform_real_distribution<double>(0, 1)(link.mt_) < loss_rate_;
+    }
+
+    if (lost) {
+        std::lock_guard<std::mutex> lk(loss_mtx_);
+        loss_count_++;
+        return false;
+    }
+
+    Inbox& inbox = *inboxes_[dst];
+    {
+        std::lock_guard<std::mutex> lk(inbox.mtx_);
+        inbox.packets_.push({sent_time + latency_, inbox.order_++, std::move(message), length});
+    }
+    inbox.cv_.notify_one();
+    return true;
+}
+
+inline void LoopbackNetwork::receive(const host_id_t& dst, std::vector<std::pair<BufferRef, uint32_t>>& messages, const uint32_t& max_num) {
+    Inbox& inbox = *inboxes_[dst];
+    std::unique_lock<std::mutex> lk(inbox.mtx_);
+
+    // 先頭が届く時刻まで待つ (待っている間に早く届くものが来たら起きる)
+    while (1) {
+        if (inbox.packets_.empty()) {
+            inbox.cv_.wait(lk);
+            continue;
+        }
+        time_point deliver_time = inbox.packets_.top().deliver_time_;
+        if (deliver_time <= std::chrono::steady_clock::now()) break;
+        inbox.cv_.wait_until(lk, deliver_time);
+    }
+
+    time_point now = std::chrono::steady_clock::now();
+    while (messages.size() < max_num && !inbox.packets_.empty() && inbox.packets_.top().deliver_time_ <= now) {
+        Packet& packet = const_cast<Packet&>(inbox.packets_.top());
+        messages.push_back({std::move(packet.message_), packet.length_});
+        inbox.packets_.pop();
+    }
+}
+
+inline uint64_t LoopbackNetwork::getLossCount() {
+    std::lock_guard<std::mutex> lk(loss_mtx_);
+    return loss_count_;
+}
+
+inline LoopbackNetwork& getLoopbackNetwork() {
+    static LoopbackNetwork network;
+    return network;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline LoopbackTransportSender::LoopbackTransportSender(const host_id_t& src, const host_id_t& dst) : src_(src), dst_(dst) {}
+
+inline char* LoopbackTransportSender::getBuffer() {
+    if (!buffer_) buffer_ = getPacketBufferPool().acquire();
+    return buffer_.data();
+}
+
+inline void LoopbackTransportSender::commit(const uint32_t& length) {
+    getBuffer();
+    getLoopbackNetwork().send(src_, dst_, std::move(buffer_), length, sent_time_);
+    buffer_.reset();
+}
+
+inline void LoopbackTransportSender::flush() {
+    if (LOOPBACK_BANDWIDTH_MBPS > 0) std::this_thread::sleep_until(sent_time_);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline LoopbackTransportReceiver::LoopbackTransportReceiver(const host_id_t& hostid) : hostid_(hostid) {}
+
+inline uint32_t LoopbackTransportReceiver::receive(std::vector<Datagram>& datagrams) {
+    messages_.clear();
+    datagrams.clear();
+    getLoopbackNetwork().receive(hostid_, messages_, UDP_BATCH_SIZE);
+
+    for (const auto& [message, length] : messages_) {
+        datagrams.push_back({message.data(), length});
+    }
+    return datagrams.size();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void LoopbackTransport::init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    hostid_ = hostid;
+    hostip_ = worker_ip_all[hostid];
+    worker_ip_all_ = worker_ip_all;
+}
+
+inline bool LoopbackTransport::isReliable() {
+    return LOOPBACK_LOSS_RATE == 0;
+}
+
+inline std::unique_ptr<TransportSender> LoopbackTransport::createSender(const host_id_t& dst_id) {
+    return std::make_unique<LoopbackTransportSender>(hostid_, dst_id);
+}
+
+inline uint32_t LoopbackTransport::getReceiverNum() {
+    return 2;
+}
+
+inline std::unique_ptr<TransportReceiver> LoopbackTransport::createReceiver(const uint32_t& receiver_id) {
+    if (receiver_id == 0) return std::make_unique<UdpTransportReceiver>(hostip_, 10000 + getPortOffset(hostid_, worker_ip_all_));
+    return std::make_unique<LoopbackTransportReceiver>(hostid_);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstring>
+
+#include "type.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// RWer をまとめて送るメッセージ (message ID: RWERS) のヘッダ
+//
+// ver_id_ (8bit):
+// バージョン: 4bit, メッセージID: 4bit
+//
+// RWer_count_ (16bit):
+// メッセージに含まれる RWer の個数
+//
+// src_host_id_ (16bit):
+// 送信元の HostID
+//
+// credit_ (32bit):
+// 送信先に返却する credit (送信先から受け取った RWer のうち処理し終えた数)
+//
+// seq_ (32bit):
+// 送信先毎のシーケンス番号 (1 から, 0 は再送しない ack だけのメッセージ)
+//
+// ack_ (32bit):
+// 送信先から次に受け取りたい seq (これより前は全て受信済み)
+//
+// sack_ (64bit):
+// 送信先から受け取った ack_+1 ~ ack_+64 の seq の受信済みビット
+
+struct MessageHeader {
+
+public :
+
+    // message にヘッダを書き込む
+    void writeHeader(char* message);
+
+    // message からヘッダを読み込む
+    void readHeader(const char* message);
+
+    // ヘッダ長 (Byte)
+    static constexpr uint32_t LENGTH = 1 + 2 + 2 + 4 + 4 + 4 + 8;
+
+    uint8_t ver_id_ = RWERS;
+    uint16_t RWer_count_ = 0;
+    uint16_t src_host_id_ = 0;
+    uint32_t credit_ = 0;
+    uint32_t seq_ = 0;
+    uint32_t ack_ = 0;
+    uint64_t sack_ = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void MessageHeader::writeHeader(char* message) {
+    int idx = 0;
+    memcpy(message + idx, &ver_id_, sizeof(uint8_t)); idx += sizeof(uint8_t);
+    memcpy(message + idx, &RWer_count_, sizeof(uint16_t)); idx += sizeof(uint16_t);
+    memcpy(message + idx, &src_host_id_, sizeof(uint16_t)); idx += sizeof(uint16_t);
+    memcpy(message + idx, &credit_, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(message + idx, &seq_, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(message + idx, &ack_, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(message + idx, &sack_, sizeof(uint64_t)); idx += sizeof(uint64_t);
+}
+
+inline void MessageHeader::readHeader(const char* message) {
+    int idx = 0;
+    memcpy(&ver_id_, message + idx, sizeof(uint8_t)); idx += sizeof(uint8_t);
+    memcpy(&RWer_count_, message + idx, sizeof(uint16_t)); idx += sizeof(uint16_t);
+    memcpy(&src_host_id_, message + idx, sizeof(uint16_t)); idx += sizeof(uint16_t);
+    memcpy(&credit_, message + idx, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(&seq_, message + idx, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(&ack_, message + idx, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(&sack_, message + idx, sizeof(uint64_t)); idx += sizeof(uint64_t);
+}
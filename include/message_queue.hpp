@@ -1,99 +1,254 @@
 #pragma once
 
-#include <queue>
 #include <string>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 #include <utility>
+#include <atomic>
+#include <chrono>
 
-#include "random_walker.hpp"
-#include "graph.hpp"
+#include "bounded_ring_buffer.hpp"
+#include "../config/param.hpp"
 
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+// lock-free リングバッファ上のメッセージキュー
+// push / pop の通常経路ではロックを取らない
+// 待機は QUEUE_SPIN_COUNT 回スピンした後に condition_variable でスリープ (spin-then-park)
+// キューの長さは atomic で保持する
+// popBatch は「閾値以上溜まる」か「期限が来る」まで待ってからまとめて取り出す (consumer は 1 つ)
+// push は満杯なら空くまで待つ (受信スレッドが待つと, その間 ack と credit の処理も止まる)
+// RWer の生成は送信先毎の in_flight を MAX_IN_FLIGHT_RWER までに抑えるので, 容量 MESSAGE_QUEUE_CAPACITY はそれより大きくしておく
+// 待てない呼び出し元は tryPush で満杯を受け取って自分で扱う
+
 template <typename T>
 struct MessageQueue {
 
 public :
 
-    void push(std::unique_ptr<T>&& message) {
-        { // 排他制御
-            std::lock_guard<std::mutex> lk(mtx_message_queue_);
+    // コンストラクタ
+    MessageQueue(const uint32_t& capacity = MESSAGE_QUEUE_CAPACITY);
 
-            bool queue_empty = message_queue_.empty();
+    // デストラクタ (残っている message を解放)
+    ~MessageQueue();
 
-            message_queue_.push(std::move(message));
+    // 満杯なら空くまで待機
+    void push(std::unique_ptr<T>&& message);
 
-            if (queue_empty) { // 空キューでなくなった通知
-                cv_message_queue_.notify_all();
-            }
+    void push(std::vector<std::unique_ptr<T>>& ptr_vec);
 
-        }
-    }
+    // 満杯なら待たずに false (message はそのまま)
+    bool tryPush(std::unique_ptr<T>& message);
 
-    void push(std::vector<std::unique_ptr<RandomWalker>>& RWer_ptr_vec) {
-        { // 排他制御
-            std::lock_guard<std::mutex> lk(mtx_message_queue_);
+    // message_queue_ から message をまとめて取り出す
+    // vector に格納
+    // 入れた数を返す
+    uint32_t pop(std::vector<std::unique_ptr<T>>& ptr_vec);
 
-            bool queue_empty = message_queue_.empty();
+    // 空でなくなった後, batch_threshold 個溜まるか deadline_us (us) 経つまで待ってからまとめて取り出す
+    // notify() で起こされた場合は空のまま 0 を返す
+    uint32_t popBatch(std::vector<std::unique_ptr<T>>& ptr_vec, const uint32_t& batch_threshold, const uint32_t& deadline_us);
 
-            uint32_t vec_size = RWer_ptr_vec.size();
-            for (int i = 0; i < vec_size; i++) {
-                message_queue_.push(std::move(RWer_ptr_vec[i]));
-            }
+    // 待機中の consumer を (空でも) 起こす
+    void notify();
 
-            if (queue_empty) { // 空キューでなくなった通知
-                cv_message_queue_.notify_all();
-            }
+    // message_queue_ のサイズを入手
+    uint32_t getSize();
 
-        }
+private :
+
+    // リングバッファに 1 つ入れる (満杯なら空くまで待機)
+    void pushOne(T* message);
+
+    // キュー長が threshold 以上になるまで待機 (deadline を過ぎるか notify() されたら false)
+    bool waitForSize(const uint32_t& threshold, const std::chrono::steady_clock::time_point* deadline);
+
+    // リングバッファから取り出せる分をまとめて取り出す
+    uint32_t drain(std::vector<std::unique_ptr<T>>& ptr_vec);
+
+    // 空キューでなくなったことを待機中の consumer に通知
+    void notifyConsumer();
+
+    // 空きができたことを待機中の producer に通知
+    void notifyProducer();
+
+    BoundedRingBuffer<T*> ring_buffer_;
+    std::atomic<int64_t> size_ = 0; // キュー長 (push 完了前に pop されると一時的に負になる)
+
+    // park 用
+    std::atomic<uint32_t> consumer_waiting_ = 0;
+    std::atomic<uint32_t> producer_waiting_ = 0;
+    std::atomic<int64_t> wake_threshold_ = 1; // consumer を起こすキュー長
+    std::atomic<bool> kicked_ = false; // notify() されたか
+    std::mutex mtx_park_;
+    std::condition_variable cv_consumer_;
+    std::condition_variable cv_producer_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+inline MessageQueue<T>::MessageQueue(const uint32_t& capacity) : ring_buffer_(capacity) {}
+
+template <typename T>
+inline MessageQueue<T>::~MessageQueue() {
+    T* message;
+    while (ring_buffer_.tryPop(message)) delete message;
+}
+
+template <typename T>
+inline void MessageQueue<T>::push(std::unique_ptr<T>&& message) {
+    pushOne(message.release());
+    size_.fetch_add(1);
+    notifyConsumer();
+}
+
+template <typename T>
+inline void MessageQueue<T>::push(std::vector<std::unique_ptr<T>>& ptr_vec) {
+    uint32_t vec_size = ptr_vec.size();
+    for (uint32_t i = 0; i < vec_size; i++) {
+        pushOne(ptr_vec[i].release());
     }
+    size_.fetch_add(vec_size);
+    notifyConsumer();
+}
 
-    // message_queue_ から message をまとめて取り出す
-    // vector に格納
-    // 入れた数を返す
-    uint32_t pop(std::vector<std::unique_ptr<T>>& ptr_vec) {
-        { // 排他制御
-            std::unique_lock<std::mutex> lk(mtx_message_queue_);
+template <typename T>
+inline bool MessageQueue<T>::tryPush(std::unique_ptr<T>& message) {
+    if (!ring_buffer_.tryPush(message.get())) return false;
+    message.release();
+    size_.fetch_add(1);
+    notifyConsumer();
+    return true;
+}
+
+template <typename T>
+inline uint32_t MessageQueue<T>::pop(std::vector<std::unique_ptr<T>>& ptr_vec) {
+    // 空じゃなくなるまで待機
+    while (1) {
+        uint32_t vec_size = drain(ptr_vec);
+        if (vec_size > 0) return vec_size;
+        waitForSize(1, nullptr);
+    }
+}
+
+template <typename T>
+inline uint32_t MessageQueue<T>::popBatch(std::vector<std::unique_ptr<T>>& ptr_vec, const uint32_t& batch_threshold, const uint32_t& deadline_us) {
+    // 空じゃなくなるまで待機 (notify() されたら空のまま返す)
+    if (!waitForSize(1, nullptr)) return 0;
+
+    // 閾値まで溜まるか期限が来るまで待機
+    if (batch_threshold > 1) {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(deadline_us);
+        waitForSize(batch_threshold, &deadline);
+    }
 
-            // RWer_Queue が空じゃなくなるまで待機
-            cv_message_queue_.wait(lk, [&]{ return !message_queue_.empty(); });
+    return drain(ptr_vec);
+}
 
-            uint32_t vec_size = message_queue_.size();
-            ptr_vec.reserve(vec_size);
+template <typename T>
+inline void MessageQueue<T>::notify() {
+    kicked_.store(true);
+    std::lock_guard<std::mutex> lk(mtx_park_);
+    cv_consumer_.notify_all();
+}
+
+template <typename T>
+inline uint32_t MessageQueue<T>::getSize() {
+    int64_t size = size_.load(std::memory_order_relaxed);
+    return size > 0 ? size : 0;
+}
 
-            while (message_queue_.size()) {
-                std::unique_ptr<T> ptr = std::move(message_queue_.front());
-                message_queue_.pop();
-                ptr_vec.push_back(std::move(ptr));
-            }
+template <typename T>
+inline void MessageQueue<T>::pushOne(T* message) {
+    uint32_t spin = 0;
+
+    // 満杯なら空くまで待機 (spin -> park)
+    while (!ring_buffer_.tryPush(message)) {
+        if (spin < QUEUE_SPIN_COUNT) {
+            spin++;
+            cpuRelax();
+            continue;
+        }
 
-            return vec_size;
+        producer_waiting_.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lk(mtx_park_);
+            cv_producer_.wait(lk, [&]{ return size_.load() < ring_buffer_.getCapacity(); });
         }
+        producer_waiting_.fetch_sub(1);
     }
+}
 
-    // message_queue_ のサイズを入手
-    uint32_t getSize() {
-        { // 排他制御
-            std::lock_guard<std::mutex> lk(mtx_message_queue_);
+template <typename T>
+inline bool MessageQueue<T>::waitForSize(const uint32_t& threshold, const std::chrono::steady_clock::time_point* deadline) {
+    auto reached = [&]{ return size_.load() >= threshold || kicked_.load(); };
 
-            return message_queue_.size();
-        }        
+    // spin
+    for (uint32_t spin = 0; spin < QUEUE_SPIN_COUNT; spin++) {
+        if (reached()) break;
+        cpuRelax();
     }
 
-private :
+    // park
+    if (!reached()) {
+        wake_threshold_.store(threshold);
+        consumer_waiting_.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lk(mtx_park_);
+            if (deadline == nullptr) cv_consumer_.wait(lk, reached);
+            else cv_consumer_.wait_until(lk, *deadline, reached);
+        }
+        consumer_waiting_.fetch_sub(1);
+        wake_threshold_.store(1);
+    }
 
-    std::queue<std::unique_ptr<T>> message_queue_;
-    std::mutex mtx_message_queue_;
-    std::condition_variable cv_message_queue_; 
+    if (kicked_.exchange(false)) return false;
+    return size_.load() >= threshold;
+}
 
-};
+template <typename T>
+inline uint32_t MessageQueue<T>::drain(std::vector<std::unique_ptr<T>>& ptr_vec) {
+    T* message;
+    uint32_t vec_size = 0;
+    while (ring_buffer_.tryPop(message)) {
+        ptr_vec.emplace_back(message);
+        vec_size++;
+    }
+
+    if (vec_size > 0) {
+        size_.fetch_sub(vec_size);
+        notifyProducer();
+    }
+
+    return vec_size;
+}
 
+template <typename T>
+inline void MessageQueue<T>::notifyConsumer() {
+    // size_ の更新の後に確認するので, park しようとしている consumer を取りこぼさない
+    // (閾値待ちの consumer は閾値に達した時だけ起こす)
+    if (consumer_waiting_.load() > 0 && size_.load() >= wake_threshold_.load()) {
+        std::lock_guard<std::mutex> lk(mtx_park_);
+        cv_consumer_.notify_all();
+    }
+}
+
+template <typename T>
+inline void MessageQueue<T>::notifyProducer() {
+    if (producer_waiting_.load() > 0) {
+        std::lock_guard<std::mutex> lk(mtx_park_);
+        cv_producer_.notify_all();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <functional>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "type.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 実行中に数えるカウンタの種類 (Metrics::add の kind)
+const uint32_t METRIC_LOCAL_STEP = 0; // 自サーバのグラフで進めた歩数
+const uint32_t METRIC_CACHE_STEP = 1; // キャッシュした他サーバの隣接リストで進めた歩数
+const uint32_t METRIC_REMOTE_HOP = 2; // 続きを他サーバに送った回数
+const uint32_t METRIC_RWER_END = 3; // このサーバで終了した RWer 数
+const uint32_t METRIC_PACKET_SENT = 4; // 送信したメッセージ数 (再送, ack だけのものも含む)
+const uint32_t METRIC_BYTE_SENT = 5; // 送信した Byte 数
+const uint32_t METRIC_PACKET_RESENT = 6; // 再送したメッセージ数
+const uint32_t METRIC_PACKET_RECEIVED = 7; // 受信したメッセージ数
+const uint32_t METRIC_BYTE_RECEIVED = 8; // 受信した Byte 数
+const uint32_t METRIC_NUM = 9;
+
+// 実行中の状態の集計と, 実行中に外から読むための Prometheus 形式のテキストを返す HTTP (METRICS_FLAG)
+//
+// カウンタはスレッド毎の分割 (SHARD_NUM 個, キャッシュラインを分ける) に relaxed で足すだけで, 読む時に全分割を足し合わせる
+// キューの長さなど読む時に決まる値は, serve に渡した collect で書き足す
+// curl http://127.0.0.1:<METRICS_PORT + ポートのずれ>/metrics で読める
+
+class Metrics {
+
+public :
+
+    // 呼び出したスレッドの分割の kind のカウンタに count を足す
+    void add(const uint32_t& kind, const uint64_t& count);
+
+    // kind のカウンタの値 (全スレッドの合計)
+    uint64_t get(const uint32_t& kind);
+
+    // 全カウンタを Prometheus のテキスト形式で書く (labels は {} の中身, 例: host="0")
+    void writeText(std::ostream& os, const std::string& labels);
+
+    // 127.0.0.1:port で HTTP を待ち受け, 要求毎にカウンタと collect で書いた値を返す (常駐, bind できなければ何もせずに戻る)
+    void serve(const uint16_t& port, const std::string& labels, const std::function<void(std::ostream&)>& collect);
+
+private :
+
+    static constexpr uint32_t SHARD_NUM = 16;
+
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> counts_[METRIC_NUM] = {};
+    };
+
+    Counters shards_[SHARD_NUM];
+
+    // 呼び出したスレッドが使う分割
+    Counters& getCounters();
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void Metrics::add(const uint32_t& kind, const uint64_t& count) {
+    getCounters().counts_[kind].fetch_add(count, std::memory_order_relaxed);
+}
+
+inline uint64_t Metrics::get(const uint32_t& kind) {
+    uint64_t count = 0;
+    for (Counters& counters : shards_) count += counters.counts_[kind].load(std::memory_order_relaxed);
+    return count;
+}
+
+inline void Metrics::writeText(std::ostream& os, const std::string& labels) {
+    // {メトリクス名, 説明} (METRIC_* の順)
+    static const char* names[METRIC_NUM][2] = {
+        {"rw_local_steps_total", "Steps taken on the local partition."},
+        {"rw_cache_steps_total", "Steps taken on cached remote adjacency."},
+        {"rw_remote_hops_total", "Walkers forwarded to another host to continue."},
+        {"rw_walkers_ended_total", "Walkers that ended on this host."},
+        {"rw_packets_sent_total", "Messages sent, including retransmissions and ack-only messages."},
+        {"rw_bytes_sent_total", "Bytes sent."},
+        {"rw_packets_resent_total", "Messages retransmitted."},
+        {"rw_packets_received_total", "Messages received."},
+        {"rw_bytes_received_total", "Bytes received."},
+    };
+
+    for (uint32_t kind = 0; kind < METRIC_NUM; kind++) {
+        os << "# HELP " << names[kind][0] << " " << names[kind][1] << "\n";
+        os << "# TYPE " << names[kind][0] << " counter\n";
+        os << names[kind][0] << "{" << labels << "} " << get(kind) << "\n";
+    }
+}
+
+inline void Metrics::serve(const uint16_t& port, const std::string& labels, const std::function<void(std::ostream&)>& collect) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return;
+    }
+
+    int yes = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+
+    // 外には出さないので loopback だけで待ち受ける
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sockfd, SOMAXCONN) < 0) {
+        perror("metrics bind");
+        close(sockfd);
+        return;
+    }
+    std::cout << "metrics: http://127.0.0.1:" << port << "/metrics" << std::endl;
+
+    while (1) {
+        int connect = accept(sockfd, NULL, NULL);
+        if (connect < 0) {
+            perror("accept");
+            continue;
+        }
+
+        // 要求の中身 (パス) は見ずに, どの要求にも同じものを返す (何も送ってこない接続で止まらないように待つのは 1 秒まで)
+        struct timeval timeout = {1, 0};
+        setsockopt(connect, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        recv(connect, request, sizeof(request), 0);
+
+        std::ostringstream body;
+        writeText(body, labels);
+        collect(body);
+        std::string body_str = body.str();
+
+        std::ostringstream response;
+        response << "HTTP/1.0 200 OK\r\n"
+                 << "Content-Type: text/plain; version=0.0.4\r\n"
+                 << "Content-Length: " << body_str.size() << "\r\n"
+                 << "Connection: close\r\n\r\n"
+                 << body_str;
+        std::string response_str = response.str();
+
+        size_t sent = 0;
+        while (sent < response_str.size()) {
+            ssize_t n = send(connect, response_str.data() + sent, response_str.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(connect);
+    }
+}
+
+inline Metrics::Counters& Metrics::getCounters() {
+    static std::atomic<uint32_t> thread_count = 0;
+    thread_local uint32_t shard_id = thread_count.fetch_add(1) % SHARD_NUM;
+    return shards_[shard_id];
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "type.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 頂点の持ち主 (HostID) の決め方
+// OWNERSHIP_HASH: 頂点 ID % サーバ数 (split_graph の分割, 表を持たない)
+// OWNERSHIP_RANGE: 頂点 ID の区間毎 (サーバ i は [bounds[i-1], bounds[i]), 区間の境目だけ持つ)
+// OWNERSHIP_TABLE: 頂点毎の表 (任意の分割, 分からない頂点は INF)
+const uint32_t OWNERSHIP_HASH = 0;
+const uint32_t OWNERSHIP_RANGE = 1;
+const uint32_t OWNERSHIP_TABLE = 2;
+
+// 分割の情報 (グラフファイルと同じ名前の .owner)
+//
+// ヘッダ (24 Byte): マジック, 持ち主の決め方 (32bit) + サーバ数 (32bit), レコード数
+// レコード (OWNERSHIP_RANGE): サーバ 0 .. サーバ数 - 2 の区間の終わり (64bit)
+// レコード (OWNERSHIP_TABLE): 頂点 ID (64bit), HostID (64bit)
+struct PartitionHeader {
+    uint64_t magic_;
+    uint32_t kind_;
+    uint32_t host_num_;
+    uint64_t record_num_;
+};
+
+const uint64_t PARTITION_HEADER_MAGIC = 0x3152454e574f5752; // "RWOWNER1"
+
+// 頂点の持ち主を返す (HASH / RANGE は計算するだけで, 頂点毎の表を持たない)
+
+class Ownership {
+
+public :
+
+    // OWNERSHIP_HASH で初期化
+    void initHash(const uint32_t& host_num);
+
+    // OWNERSHIP_RANGE で初期化 (bounds[i] はサーバ i の区間の終わり, サーバ数 - 1 個)
+    void initRange(const uint32_t& host_num, const std::vector<vertex_id_t>& bounds);
+
+    // OWNERSHIP_TABLE で初期化 (表は setOwner で埋める)
+    void initTable(const uint32_t& host_num);
+
+    // .owner を読み込む (なければ false)
+    bool load(const std::string& file_path);
+
+    // .owner を書き出す
+    void write(const std::string& file_path);
+
+    // 頂点の持ち主を入手 (OWNERSHIP_TABLE で分からなければ INF)
+    host_id_t getOwner(const vertex_id_t& node_id) const;
+
+    // 表に頂点の持ち主を登録 (OWNERSHIP_TABLE のみ)
+    void setOwner(const vertex_id_t& node_id, const host_id_t& host_id);
+
+    // 全頂点の持ち主を表なしで計算できるか (HASH / RANGE)
+    bool isComputed() const;
+
+    uint32_t getKind() const;
+
+private :
+
+    uint32_t kind_ = OWNERSHIP_TABLE;
+    uint32_t host_num_ = 1;
+    std::vector<vertex_id_t> bounds_; // OWNERSHIP_RANGE
+    std::vector<host_id_t> table_; // OWNERSHIP_TABLE {頂点 ID : HostID}
+
+    // 区間の境目がこれ以下なら分岐なしで全部と比べる (コンパイラがベクトル化する), 多ければ二分探索
+    static constexpr uint32_t RANGE_LINEAR_MAX = 64;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void Ownership::initHash(const uint32_t& host_num) {
+    kind_ = OWNERSHIP_HASH;
+    host_num_ = host_num;
+    bounds_.clear();
+    table_.clear();
+}
+
+inline void Ownership::initRange(const uint32_t& host_num, const std::vector<vertex_id_t>& bounds) {
+    kind_ = OWNERSHIP_RANGE;
+    host_num_ = host_num;
+    bounds_ = bounds;
+    table_.clear();
+}
+
+inline void Ownership::initTable(const uint32_t& host_num) {
+    kind_ = OWNERSHIP_TABLE;
+    host_num_ = host_num;
+    bounds_.clear();
+    table_.clear();
+}
+
+inline bool Ownership::load(const std::string& file_path) {
+    FILE *f = fopen(file_path.c_str(), "r");
+    if (f == NULL) return false;
+
+    PartitionHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic_ != PARTITION_HEADER_MAGIC) {
+        std::cerr << "ownership: bad header " << file_path << std::endl;
+        exit(1);
+    }
+
+    std::vector<uint64_t> records(header.kind_ == OWNERSHIP_TABLE ? header.record_num_ * 2 : header.record_num_);
+    if (fread(records.data(), sizeof(uint64_t), records.size(), f) != records.size()) {
+        std::cerr << "ownership: truncated " << file_path << std::endl;
+        exit(1);
+    }
+    fclose(f);
+
+    if (header.kind_ == OWNERSHIP_HASH) {
+        initHash(header.host_num_);
+    } else if (header.kind_ == OWNERSHIP_RANGE) {
+        initRange(header.host_num_, std::vector<vertex_id_t>(records.begin(), records.end()));
+    } else {
+        initTable(header.host_num_);
+        for (uint64_t i = 0; i < header.record_num_; i++) setOwner(records[i * 2], records[i * 2 + 1]);
+    }
+    return true;
+}
+
+inline void Ownership::write(const std::string& file_path) {
+    std::vector<uint64_t> records;
+    if (kind_ == OWNERSHIP_RANGE) {
+        records.assign(bounds_.begin(), bounds_.end());
+    } else if (kind_ == OWNERSHIP_TABLE) {
+        for (vertex_id_t node_id = 0; node_id < table_.size(); node_id++) {
+            if (table_[node_id] == INF) continue;
+            records.push_back(node_id);
+            records.push_back(table_[node_id]);
+        }
+    }
+
+    PartitionHeader header;
+    header.magic_ = PARTITION_HEADER_MAGIC;
+    header.kind_ = kind_;
+    header.host_num_ = host_num_;
+    header.record_num_ = kind_ == OWNERSHIP_TABLE ? records.size() / 2 : records.size();
+
+    FILE *f = fopen(file_path.c_str(), "w");
+    if (f == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(records.data(), sizeof(uint64_t), records.size(), f);
+    fclose(f);
+}
+
+inline host_id_t Ownership::getOwner(const vertex_id_t& node_id) const {
+    if (kind_ == OWNERSHIP_HASH) return node_id % host_num_;
+
+    if (kind_ == OWNERSHIP_RANGE) {
+        if (bounds_.size() <= RANGE_LINEAR_MAX) {
+            // 区間の終わりが node_id 以下のサーバの数 = 持ち主
+            host_id_t host_id = 0;
+            for (const vertex_id_t& bound : bounds_) host_id += node_id >= bound;
+            return host_id;
+        }
+        return std::upper_bound(bounds_.begin(), bounds_.end(), node_id) - bounds_.begin();
+    }
+
+    if (node_id >= table_.size()) return INF;
+    return table_[node_id];
+}
+
+inline void Ownership::setOwner(const vertex_id_t& node_id, const host_id_t& host_id) {
+    if (kind_ != OWNERSHIP_TABLE) return;
+    if (node_id >= table_.size()) table_.resize(node_id + 1, INF);
+    table_[node_id] = host_id;
+}
+
+inline bool Ownership::isComputed() const {
+    return kind_ != OWNERSHIP_TABLE;
+}
+
+inline uint32_t Ownership::getKind() const {
+    return kind_;
+}
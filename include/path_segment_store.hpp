@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+
+#include "type.hpp"
+#include "random_walker.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// RWer から切り離した経路のセグメントを (起点サーバ, RWer ID, セグメント番号) で置いておく表
+// PATH_SEGMENT_SHARD_NUM 個に分けてそれぞれロックする
+//
+// PATH_SEGMENT_LOCAL: put() で溜めて, write() で書き出す
+// PATH_SEGMENT_GATHER: 起点サーバで gather() / complete() に全セグメントと最後の RWer が揃ったら, 全経路に戻した RWer を返す
+//
+// write() のファイル形式 (セグメント毎):
+// 起点サーバの HostID (32bit), RWer ID (32bit), セグメント番号 (32bit), 長さ (32bit), path_ と同じ形式の経路 (64bit * 長さ)
+
+class PathSegmentStore {
+
+public :
+
+    // 初期化
+    void init();
+
+    // セグメントを置く
+    void put(const host_id_t& origin, const uint32_t& RWer_id, const uint16_t& segment_index, std::vector<uint64_t>&& segment);
+
+    // 起点サーバに届いたセグメントを置く (最後の RWer が既に届いていて全て揃ったら RWer を返す)
+    std::unique_ptr<RandomWalker> gather(const uint32_t& RWer_id, const uint16_t& segment_index, std::vector<uint64_t>&& segment);
+
+    // 起点サーバに戻ってきた最後の RWer を置く (全て揃っていたら全経路に戻して返す, 揃っていなければ nullptr)
+    std::unique_ptr<RandomWalker> complete(std::unique_ptr<RandomWalker>&& RWer_ptr);
+
+    // 置いてある全てのセグメントを file_path に追記して消す
+    void write(const std::string& file_path);
+
+    // 置いてあるセグメント数
+    uint64_t getSegmentCount();
+
+private :
+
+    struct Entry {
+        std::vector<std::vector<uint64_t>> segments_; // セグメント番号順
+        uint32_t segment_num_ = 0; // 届いたセグメント数
+        std::unique_ptr<RandomWalker> RWer_ptr_; // 最後の RWer (GATHER)
+    };
+
+    struct Shard {
+        std::mutex mtx_;
+        std::unordered_map<uint64_t, Entry> entries_;
+    };
+
+    std::vector<Shard> shards_;
+
+    // 表のキー
+    uint64_t getKey(const host_id_t& origin, const uint32_t& RWer_id);
+
+    // 最後の RWer と全セグメントが揃っていれば全経路に戻して返し, 表から消す
+    std::unique_ptr<RandomWalker> takeIfComplete(Shard& shard, const uint64_t& key);
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void PathSegmentStore::init() {
+    shards_ = std::vector<Shard>(PATH_SEGMENT_SHARD_NUM);
+}
+
+inline void PathSegmentStore::put(const host_id_t& origin, const uint32_t& RWer_id, const uint16_t& segment_index, std::vector<uint64_t>&& segment) {
+    uint64_t key = getKey(origin, RWer_id);
+    Shard& shard = shards_[key % shards_.size()];
+    std::lock_guard<std::mutex> lk(shard.mtx_);
+
+    Entry& entry = shard.entries_[key];
+    if (entry.segments_.size() <= segment_index) entry.segments_.resize(segment_index + 1);
+    entry.segments_[segment_index] = std::move(segment);
+    entry.segment_num_++;
+}
+
+inline std::unique_ptr<RandomWalker> PathSegmentStore::gather(const uint32_t& RWer_id, const uint16_t& segment_index, std::vector<uint64_t>&& segment) {
+    uint64_t key = getKey(0, RWer_id);
+    Shard& shard = shards_[key % shards_.size()];
+    std::lock_guard<std::mutex> lk(shard.mtx_);
+
+    Entry& entry = shard.entries_[key];
+    if (entry.segments_.size() <= segment_index) entry.segments_.resize(segment_index + 1);
+    entry.segments_[segment_index] = std::move(segment);
+    entry.segment_num_++;
+
+    return takeIfComplete(shard, key);
+}
+
+inline std::unique_ptr<RandomWalker> PathSegmentStore::complete(std::unique_ptr<RandomWalker>&& RWer_ptr) {
+    if (RWer_ptr->getSegmentCount() == 0) return std::move(RWer_ptr);
+
+    uint64_t key = getKey(0, RWer_ptr->getRWerID());
+    Shard& shard = shards_[key % shards_.size()];
+    std::lock_guard<std::mutex> lk(shard.mtx_);
+
+    shard.entries_[key].RWer_ptr_ = std::move(RWer_ptr);
+    return takeIfComplete(shard, key);
+}
+
+inline void PathSegmentStore::write(const std::string& file_path) {
+    std::ofstream ofs(file_path, std::ios::app | std::ios::binary);
+
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx_);
+        for (auto& [key, entry] : shard.entries_) {
+            uint32_t origin = key >> 32;
+            uint32_t RWer_id = key & UINT32_MAX;
+            for (uint32_t i = 0; i < entry.segments_.size(); i++) {
+                uint32_t length = entry.segments_[i].size();
+                if (length == 0) continue;
+                ofs.write((const char*)&origin, sizeof(uint32_t));
+                ofs.write((const char*)&RWer_id, sizeof(uint32_t));
+                ofs.write((const char*)&i, sizeof(uint32_t));
+                ofs.write((const char*)&length, sizeof(uint32_t));
+                ofs.write((const char*)entry.segments_[i].data(), sizeof(uint64_t) * length);
+            }
+        }
+        shard.entries_.clear();
+    }
+}
+
+inline uint64_t PathSegmentStore::getSegmentCount() {
+    uint64_t count = 0;
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx_);
+        for (auto& [key, entry] : shard.entries_) count += entry.segment_num_;
+    }
+    return count;
+}
+
+inline uint64_t PathSegmentStore::getKey(const host_id_t& origin, const uint32_t& RWer_id) {
+    return ((uint64_t)origin << 32) | RWer_id;
+}
+
+inline std::unique_ptr<RandomWalker> PathSegmentStore::takeIfComplete(Shard& shard, const uint64_t& key) {
+    Entry& entry = shard.entries_[key];
+    if (entry.RWer_ptr_ == nullptr || entry.segment_num_ < entry.RWer_ptr_->getSegmentCount()) return nullptr;
+
+    std::unique_ptr<RandomWalker> RWer_ptr = std::move(entry.RWer_ptr_);
+    RWer_ptr->restorePath(entry.segments_);
+    shard.entries_.erase(key);
+    return RWer_ptr;
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "type.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 1 つの起点頂点についての頂点毎の回数
+// PPR_TABLE_EXACT: 頂点 -> 回数の表
+// PPR_TABLE_SPACE_SAVING: PPR_SPACE_SAVING_SIZE 個のカウンタ, 溢れたら最小のカウンタを置き換える (回数は最大で error_ だけ多めに出る)
+//   カウンタは回数の最小ヒープに並べ, 頂点 -> ヒープ上の位置の表で探すので, 1 回の add は O(log PPR_SPACE_SAVING_SIZE)
+
+class PprCounter {
+
+public :
+
+    // 頂点 node_id の回数に count を足す
+    void add(const vertex_id_t& node_id, const uint64_t& count);
+
+    // 全体の回数
+    uint64_t getTotal();
+
+    // 回数の多い順に k 個 (頂点, 回数)
+    std::vector<std::pair<vertex_id_t, uint64_t>> getTopK(const uint32_t& k);
+
+private :
+
+    struct Entry {
+        vertex_id_t node_id_;
+        uint64_t count_;
+        uint64_t error_;
+    };
+
+    // 回数が増えた (入れ替わった) entries_[pos] をヒープの下へ動かす
+    void siftDown(uint32_t pos);
+
+    // 新しく入れた entries_[pos] をヒープの上へ動かす
+    void siftUp(uint32_t pos);
+
+    // entries_ の a と b を入れ替える (位置の表も直す)
+    void swapEntry(const uint32_t& a, const uint32_t& b);
+
+    uint64_t total_ = 0;
+    std::unordered_map<vertex_id_t, uint64_t> exact_; // PPR_TABLE_EXACT
+    std::vector<Entry> entries_; // PPR_TABLE_SPACE_SAVING (回数の最小ヒープ)
+    std::unordered_map<vertex_id_t, uint32_t> position_; // PPR_TABLE_SPACE_SAVING (頂点 -> entries_ 上の位置)
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// (起点頂点, 頂点) 毎の回数の集計 (PPR_COUNT_MODE)
+// 数えるスレッド毎のバッファに (起点頂点, 頂点) を溜め, PPR_LOCAL_BUFFER_NUM 個溜まったらまとめて起点頂点で分割した表に足す
+// バッファのロックは持ち主のスレッドと書き出し時にしか取らないので, RW 実行中は競合しない
+
+class PprAggregator {
+
+public :
+
+    // 初期化
+    void init();
+
+    // 起点頂点 source の RWer が頂点 node_id を訪れた (終わった) ことを数える
+    void add(const vertex_id_t& source, const vertex_id_t& node_id);
+
+    // 全スレッドのバッファを表にまとめる
+    void merge();
+
+    // まとめた上で, 起点頂点毎に上位 k 個の PPR の推定値を file_path に書き出す (1 行: 起点頂点 頂点 推定値 回数)
+    void write(const std::string& file_path, const uint32_t& k);
+
+    // 集計している起点頂点数
+    uint64_t getSourceNum();
+
+private :
+
+    struct Buffer {
+        std::mutex mtx_;
+        std::vector<std::pair<vertex_id_t, vertex_id_t>> pairs_; // (起点頂点, 頂点)
+    };
+
+    struct Shard {
+        std::mutex mtx_;
+        std::unordered_map<vertex_id_t, PprCounter> counters_; // 起点頂点 -> 回数
+    };
+
+    std::vector<std::unique_ptr<Buffer>> buffers_; // PPR_MAX_THREAD_NUM
+    std::atomic<uint32_t> buffer_num_ = 0; // 割り当て済みのバッファ数
+    std::vector<Shard> shards_;
+
+    // 呼び出したスレッドのバッファを入手
+    Buffer& getBuffer();
+
+    // バッファの中身を表に足して空にする (バッファのロックを取ってから呼ぶ)
+    void flushBuffer(Buffer& buffer);
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void PprCounter::add(const vertex_id_t& node_id, const uint64_t& count) {
+    total_ += count;
+
+    if (PPR_TABLE_KIND == PPR_TABLE_EXACT) {
+        exact_[node_id] += count;
+        return;
+    }
+
+    auto it = position_.find(node_id);
+    if (it != position_.end()) {
+        uint32_t pos = it->second;
+        entries_[pos].count_ += count;
+        siftDown(pos);
+        return;
+    }
+    if (entries_.size() < PPR_SPACE_SAVING_SIZE) {
+        uint32_t pos = entries_.size();
+        entries_.push_back({node_id, count, 0});
+        position_[node_id] = pos;
+        siftUp(pos);
+        return;
+    }
+
+    // 最小のカウンタ (ヒープの先頭) を置き換え, その回数を誤差として引き継ぐ
+    Entry& min_entry = entries_[0];
+    position_.erase(min_entry.node_id_);
+    min_entry.error_ = min_entry.count_;
+    min_entry.count_ += count;
+    min_entry.node_id_ = node_id;
+    position_[node_id] = 0;
+    siftDown(0);
+}
+
+inline uint64_t PprCounter::getTotal() {
+    return total_;
+}
+
+inline std::vector<std::pair<vertex_id_t, uint64_t>> PprCounter::getTopK(const uint32_t& k) {
+    std::vector<std::pair<vertex_id_t, uint64_t>> top;
+    if (PPR_TABLE_KIND == PPR_TABLE_EXACT) {
+        top.assign(exact_.begin(), exact_.end());
+    } else {
+        for (const Entry& entry : entries_) top.push_back({entry.node_id_, entry.count_});
+    }
+
+    uint32_t num = std::min<uint64_t>(k, top.size());
+    std::partial_sort(top.begin(), top.begin() + num, top.end(), [](const std::pair<vertex_id_t, uint64_t>& a, const std::pair<vertex_id_t, uint64_t>& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return a.first < b.first;
+    });
+    top.resize(num);
+    return top;
+}
+
+inline void PprCounter::siftDown(uint32_t pos) {
+    uint32_t size = entries_.size();
+    while (1) {
+        uint32_t min_pos = pos;
+        uint32_t left = 2 * pos + 1, right = 2 * pos + 2;
+        if (left < size && entries_[left].count_ < entries_[min_pos].count_) min_pos = left;
+        if (right < size && entries_[right].count_ < entries_[min_pos].count_) min_pos = right;
+        if (min_pos == pos) return;
+        swapEntry(pos, min_pos);
+        pos = min_pos;
+    }
+}
+
+inline void PprCounter::siftUp(uint32_t pos) {
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (entries_[parent].count_ <= entries_[pos].count_) return;
+        swapEntry(pos, parent);
+        pos = parent;
+    }
+}
+
+inline void PprCounter::swapEntry(const uint32_t& a, const uint32_t& b) {
+    std::swap(entries_[a], entries_[b]);
+    position_[entries_[a].node_id_] = a;
+    position_[entries_[b].node_id_] = b;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void PprAggregator::init() {
+    buffers_.clear();
+    for (uint32_t i = 0; i < PPR_MAX_THREAD_NUM; i++) {
+        buffers_.push_back(std::make_unique<Buffer>());
+        buffers_.back()->pairs_.reserve(PPR_LOCAL_BUFFER_NUM);
+    }
+    buffer_num_ = 0;
+    shards_ = std::vector<Shard>(PPR_SHARD_NUM);
+}
+
+inline void PprAggregator::add(const vertex_id_t& source, const vertex_id_t& node_id) {
+    Buffer& buffer = getBuffer();
+    std::lock_guard<std::mutex> lk(buffer.mtx_);
+    buffer.pairs_.push_back({source, node_id});
+    if (buffer.pairs_.size() >= PPR_LOCAL_BUFFER_NUM) flushBuffer(buffer);
+}
+
+inline void PprAggregator::merge() {
+    uint32_t buffer_num = std::min(buffer_num_.load(), PPR_MAX_THREAD_NUM);
+    for (uint32_t i = 0; i < buffer_num; i++) {
+        std::lock_guard<std::mutex> lk(buffers_[i]->mtx_);
+        flushBuffer(*buffers_[i]);
+    }
+}
+
+inline void PprAggregator::write(const std::string& file_path, const uint32_t& k) {
+    merge();
+
+    std::ofstream ofs(file_path);
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx_);
+        for (auto& [source, counter] : shard.counters_) {
+            double total = counter.getTotal();
+            for (const auto& [node_id, count] : counter.getTopK(k)) {
+                ofs << source << " " << node_id << " " << count / total << " " << count << "\n";
+            }
+        }
+    }
+}
+
+inline uint64_t PprAggregator::getSourceNum() {
+    uint64_t source_num = 0;
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lk(shard.mtx_);
+        source_num += shard.counters_.size();
+    }
+    return source_num;
+}
+
+inline PprAggregator::Buffer& PprAggregator::getBuffer() {
+    // 1 プロセスで複数の worker を動かすこともあるので, どの集計のバッファかも覚えておく
+    thread_local PprAggregator* owner = nullptr;
+    thread_local Buffer* buffer = nullptr;
+
+    if (owner != this) {
+        uint32_t buffer_id = buffer_num_.fetch_add(1);
+        if (buffer_id >= PPR_MAX_THREAD_NUM) {
+            std::cerr << "PprAggregator: more than PPR_MAX_THREAD_NUM (" << PPR_MAX_THREAD_NUM << ") threads" << std::endl;
+            exit(1);
+        }
+        owner = this;
+        buffer = buffers_[buffer_id].get();
+    }
+    return *buffer;
+}
+
+inline void PprAggregator::flushBuffer(Buffer& buffer) {
+    std::vector<std::pair<vertex_id_t, vertex_id_t>>& pairs = buffer.pairs_;
+    if (pairs.empty()) return;
+
+    // 表の分割毎, 同じ (起点頂点, 頂点) が並ぶように並べ替えて, 分割毎に 1 回だけロックを取る
+    std::sort(pairs.begin(), pairs.end(), [](const std::pair<vertex_id_t, vertex_id_t>& a, const std::pair<vertex_id_t, vertex_id_t>& b) {
+        uint32_t shard_a = a.first % PPR_SHARD_NUM, shard_b = b.first % PPR_SHARD_NUM;
+        if (shard_a != shard_b) return shard_a < shard_b;
+        return a < b;
+    });
+
+    uint64_t idx = 0;
+    while (idx < pairs.size()) {
+        Shard& shard = shards_[pairs[idx].first % PPR_SHARD_NUM];
+        std::lock_guard<std::mutex> lk(shard.mtx_);
+        uint32_t shard_id = pairs[idx].first % PPR_SHARD_NUM;
+        while (idx < pairs.size() && pairs[idx].first % PPR_SHARD_NUM == shard_id) {
+            uint64_t count = 1;
+            while (idx + count < pairs.size() && pairs[idx + count] == pairs[idx]) count++;
+            shard.counters_[pairs[idx].first].add(pairs[idx].second, count);
+            idx += count;
+        }
+    }
+    pairs.clear();
+}
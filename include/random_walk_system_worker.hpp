@@ -12,7 +12,6 @@
 #include <arpa/inet.h>
 #include <fstream>
 #include <iostream>
-#include <omp.h>
 #include <chrono>
 #include <thread>
 #include <memory>
@@ -20,6 +19,7 @@
 #include <mutex>
 #include <atomic>
 #include <unordered_map>
+#include <algorithm>
 
 #include "type.hpp"
 #include "graph.hpp"
@@ -30,6 +30,17 @@
 #include "start_flag.hpp"
 #include "random_walk_config.hpp"
 #include "random_walker_manager.hpp"
+#include "job_controller.hpp"
+#include "flow_control.hpp"
+#include "message_header.hpp"
+#include "reliable_channel.hpp"
+#include "transport_factory.hpp"
+#include "path_segment_store.hpp"
+#include "walk_output_sink.hpp"
+#include "ppr_aggregator.hpp"
+#include "cache_prefetcher.hpp"
+#include "cache_learner.hpp"
+#include "metrics.hpp"
 
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -39,38 +50,75 @@ class RandomWalkSystemWorker {
 
 public :
 
-    // コンストラクタ
-    RandomWalkSystemWorker(const std::string& dir_path);
+    // コンストラクタ (hostid: 1 台に複数の worker を置く場合に server.txt の何行目かを指定, 負なら IP アドレスから決める)
+    RandomWalkSystemWorker(const std::string& dir_path, const int32_t& hostid = -1);
 
-    // thread を開始させる関数
+    // コンストラクタ (1 プロセス内で複数の worker を動かす場合, config/ を読まずに HostID と全 worker の IP アドレスを指定)
+    // グラフファイルは dir_path + graph_name + ".data"
+    RandomWalkSystemWorker(const std::string& dir_path, const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all, const std::string& graph_name);
+
+    // グラフ, キャッシュ, 通信エンジン, キューを初期化して全スレッドを開始させる関数 (コンストラクタから呼ぶ)
+    void init(const std::string& dir_path, const std::string& graph_name);
+
+    // thread を開始させる関数 (全スレッドはここで生成し, 以降は常駐)
     void start();
 
-    // RWer 生成 & 処理をする関数
+    // メインの実験のジョブを generator スレッドに配る関数
     void generateRWerForMain();
 
-    // cache 補充用 RWer 生成
+    // cache 補充用のジョブを generator スレッドに配る関数
     void generateRWerForCache();
 
+    // RWer を生成する関数 (generator スレッド, 常駐してジョブを待つ)
+    void generateRWer(const worker_id_t& worker_id);
+
+    // メインの実験の RWer 生成 & 実行 (worker_id の担当分)
+    void generateMainRWer(const worker_id_t& worker_id, const RandomWalkJob& job, StdRandNumGenerator& gen);
+
+    // 他サーバの頂点の隣接リストを持ち主に要求してキャッシュに入れる関数 (CACHE_PREFETCH_FLAG, 応答が揃うまで待つ)
+    void prefetchCache();
+
+    // キャッシュのスナップショットのパス (CACHE_SNAPSHOT_FLAG)
+    std::string getCacheSnapshotPath();
+
+    // cache 補充用の RWer 生成 & 実行 (worker_id の担当分)
+    void generateCacheRWer(const worker_id_t& worker_id, const RandomWalkJob& job, StdRandNumGenerator& gen);
+
     // RW を実行する関数
     void executeRandomWalk(std::unique_ptr<RandomWalker>&& RWer_ptr, StdRandNumGenerator& gen);
 
     // executeRandomWalk で終了した RWer を処理する関数
     void endRandomWalk(std::unique_ptr<RandomWalker>&& RWer_ptr);
 
-    // 終了した RWer について, 経路情報からグラフデータにキャッシュを登録する関数
+    // 起点サーバで RWer の終了を記録し, 経路を処理する関数 (PATH_SEGMENT_GATHER なら経路が揃ってから書き出し / checkRWer)
+    void finishRandomWalk(std::unique_ptr<RandomWalker>&& RWer_ptr);
+
+    // 全経路が揃った RWer の経路を書き出し, 訪問回数を数える関数 (WALK_OUTPUT_FLAG, PPR_COUNT_VISIT)
+    void recordPath(RandomWalker& RWer);
+
+    // 起点サーバで RWer の起点頂点を入手する関数 (RWer_id から決まる, generateMainRWer と同じ)
+    vertex_id_t getSourceNode(RandomWalker& RWer);
+
+    // 全経路が揃った RWer の経路情報をキャッシュに登録する CacheLearner に渡す関数 (cache 補充の実行, CACHE_LEARN_FLAG ならメインの実験も)
     void checkRWer(std::unique_ptr<RandomWalker>&& RWer_ptr);
 
-    // メッセージ処理用の関数
+    // 送信する RWer の経路を切り離して, このサーバに残すか起点サーバに送る関数 (PATH_SEGMENT_MODE)
+    void cutPathSegment(std::unique_ptr<RandomWalker>& RWer_ptr);
+
+    // メッセージ処理用の関数 (executor スレッド, 常駐)
     void procMessage(const uint16_t& proc_id);
 
-    // send_queue から RWer を取ってきて他サーバへ送信する関数 (スレッド数固定)
-    void sendMessage();
+    // send_queue から RWer を取ってきて他サーバへ送信する関数 (送信先毎に 1 スレッド)
+    void sendMessage(const host_id_t& send_id);
 
-    // 他サーバからメッセージを受信し, message_queue に push する関数 (ポート番号毎)
-    void receiveMessage(const uint16_t& port_num);
+    // 他サーバからメッセージを受信し, message_queue に push する関数 (受信スレッド毎)
+    void receiveMessage(const uint32_t& receiver_id);
 
-    // IPv4 サーバソケットを生成 (UDP)
-    int createUdpServerSocket(const uint16_t& port_num);
+    // 受信したデータグラム 1 つを処理する関数 (RWer は executor_id の executor スレッドに渡す, INF ならランダム)
+    void receiveDatagram(const char* message, const uint32_t& length, const uint32_t& executor_id, StdRandNumGenerator& gen);
+
+    // 再送 / ack が必要な送信先の送信スレッドを定期的に起こす関数
+    void checkRetransmit();
 
     // IPv4 サーバソケットを生成 (TCP)
     int createTcpServerSocket(const uint16_t& port_num);
@@ -78,16 +126,20 @@ public :
     // 実験結果を start_manager に送信する関数
     void sendToStartManager();
 
+    // 実行中のキューの長さとキャッシュの参照回数を Prometheus のテキスト形式で書く関数 (Metrics の collect)
+    void writeMetrics(std::ostream& os);
+
 private :
 
     std::string hostname_; // 自サーバのホスト名
     host_id_t hostip_; // 自サーバの IP アドレス
     host_id_t hostid_;
+    uint16_t port_offset_; // 同じマシンの他の worker とぶつからないようにずらすポート番号
     std::string hostip_str_; // IP アドレスの文字列
     std::vector<host_id_t> worker_ip_all_;
     Graph graph_; // グラフデータ
     Cache cache_; // 他サーバのグラフ情報
-    MessageQueue<RandomWalker>* RWer_queue_; // ポート番号毎の receive キュー
+    MessageQueue<RandomWalker>* RWer_queue_; // executor スレッド毎の receive キュー
     MessageQueue<RandomWalker>* send_queue_; // 送信先毎の send キュー
     StartFlag start_flag_; // 実験開始の合図に関する情報
     StartFlag start_cache_flag_; // cache 実行開始の合図に関する情報
@@ -95,14 +147,43 @@ private :
     RandomWalkerManager RW_manager_; // RWer に関する情報
     host_id_t startmanagerip_; // StartManager の IP アドレス
 
-    // 送信スレッドの送信先決定用
-    host_id_t id_num_ = 0;
-    std::mutex mtx_id_num_;
-    std::atomic_bool* watching_queue_flag_;
+    // スレッドプール
+    uint32_t generator_thread_num_; // generator スレッド数
+    uint32_t executor_thread_num_; // executor (procMessage) スレッド数
+    std::vector<std::thread> threads_; // start() で生成した全スレッド
+    JobController job_controller_; // generator スレッドへのジョブ配布
+    std::atomic<uint32_t> cache_RWer_id_all_ = 0; // cache 補充用の実行で生成した RWer_id
+
+    // 送信先毎の credit による流量制御
+    FlowControl flow_control_;
+
+    // RWer から切り離した経路のセグメント (PATH_SEGMENT_MODE)
+    PathSegmentStore segment_store_;
+
+    // 全経路が揃った RWer の書き出し先 (WALK_OUTPUT_FLAG)
+    WalkOutputSink walk_output_;
+
+    // (起点頂点, 頂点) 毎の回数の集計 (PPR_COUNT_MODE)
+    PprAggregator ppr_;
 
-    // 再送制御用 
-    std::vector<std::thread> re_send_threads_;
-    uint32_t re_send_count = 0;
+    // 他サーバの頂点の隣接リストの要求と応答 (CACHE_PREFETCH_FLAG)
+    CachePrefetcher prefetcher_;
+
+    // 全経路が揃った RWer の経路を裏でキャッシュに入れる補助スレッドとキュー
+    CacheLearner cache_learner_;
+    bool cache_learner_flag_ = false; // 補助スレッドを起動したか (RW で cache 補充するか, CACHE_LEARN_FLAG)
+
+    // 起動時にキャッシュのスナップショットを読み込んだか (cache 補充を省く)
+    bool cache_snapshot_loaded_ = false;
+
+    // RWer のメッセージを運ぶ通信エンジン (UDP / io_uring / TCP)
+    std::unique_ptr<Transport> transport_;
+
+    // 送信先 / 送信元毎の再送制御
+    ReliableChannel reliable_;
+
+    // 実行中の歩数, 通信量などのカウンタ (METRICS_FLAG なら HTTP で読める)
+    Metrics metrics_;
 
 };
 
@@ -110,7 +191,7 @@ private :
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-inline RandomWalkSystemWorker::RandomWalkSystemWorker(const std::string& dir_path) {
+inline RandomWalkSystemWorker::RandomWalkSystemWorker(const std::string& dir_path, const int32_t& hostid) {
     // 自サーバ のホスト名
     char hostname_c[128]; // ホスト名
     gethostname(hostname_c, sizeof(hostname_c)); // ホスト名を取得
@@ -160,55 +241,151 @@ inline RandomWalkSystemWorker::RandomWalkSystemWorker(const std::string& dir_pat
         for (int i = 0; i < worker_ip_all_.size(); i++) {
             if (hostip_ == worker_ip_all_[i]) hostid_ = i;
         }
+        if (hostid >= 0) hostid_ = hostid;
+        port_offset_ = getPortOffset(hostid_, worker_ip_all_);
         // debug
         std::cout << hostid_ << std::endl;
     }
 
+    // グラフファイル名 (同じマシンに複数の worker がいる場合は "IP アドレス_HostID")
+    std::string graph_name = hostip_str_;
+    if (std::count(worker_ip_all_.begin(), worker_ip_all_.end(), hostip_) > 1) graph_name += "_" + std::to_string(hostid_);
+
+    init(dir_path, graph_name);
+}
+
+inline RandomWalkSystemWorker::RandomWalkSystemWorker(const std::string& dir_path, const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all, const std::string& graph_name) {
+    hostname_ = "localhost";
+    worker_ip_all_ = worker_ip_all;
+    hostid_ = hostid;
+    hostip_ = worker_ip_all_[hostid_];
+    struct in_addr addr;
+    addr.s_addr = hostip_;
+    hostip_str_ = inet_ntoa(addr);
+    port_offset_ = getPortOffset(hostid_, worker_ip_all_);
+
+    init(dir_path, graph_name);
+}
+
+inline void RandomWalkSystemWorker::init(const std::string& dir_path, const std::string& graph_name) {
     // グラフファイル読み込み
-    graph_.init(dir_path, hostip_str_, hostid_);
+    graph_.init(dir_path, graph_name, hostid_);
 
     // キャッシュの初期化
-    cache_.init();
+    cache_.init(graph_.getOwnership());
+
+    // ghost 頂点の次数と持ち主を入れておく
+    for (const GhostVertex& ghost : graph_.getGhostVertices()) {
+        cache_.registerHostId(ghost.vertex, ghost.owner);
+        cache_.registerDegree(ghost.vertex, ghost.degree);
+    }
+
+    // 同じグラフファイルと設定で保存したスナップショットがあれば読み込む
+    if (CACHE_SNAPSHOT_FLAG) {
+        Timer timer;
+        cache_snapshot_loaded_ = cache_.readSnapshot(getCacheSnapshotPath(), hostid_, graph_.getChecksum());
+        if (cache_snapshot_loaded_) std::cout << "cache snapshot loaded: " << cache_.getEdgeCount() << ", time: " << timer.duration() << std::endl;
+        else std::cout << "cache snapshot not used" << std::endl;
+    }
+
+    // 経路のセグメントの表の初期化
+    segment_store_.init();
+
+    // 経路の書き出し先の初期化
+    if (WALK_OUTPUT_FLAG) walk_output_.init(WALK_OUTPUT_DIR, hostid_);
+
+    // PPR の集計の初期化
+    if (PPR_COUNT_MODE != PPR_COUNT_OFF) ppr_.init();
+
+    // 通信エンジンの初期化
+    transport_ = createTransport(TRANSPORT_ENGINE);
+    transport_->init(hostid_, worker_ip_all_);
+
+    // スレッド数の決定 (コア数を超えないように generator, executor を減らす)
+    {
+        uint32_t core_num = RUNTIME_CORE_NUM > 0 ? RUNTIME_CORE_NUM : std::thread::hardware_concurrency();
+        uint32_t network_thread_num = (SEND_QUEUE_NUM - 1) + transport_->getReceiverNum() + 1; // + 再送チェック
+        // 経路をキャッシュに入れる補助スレッドに仕事がある (RW で cache 補充するか, メインの実験の経路も入れる) ならその分も空ける
+        cache_learner_flag_ = CACHE_LEARN_FLAG || !CACHE_PREFETCH_FLAG;
+        uint32_t learner_thread_num = cache_learner_flag_ ? 1 : 0;
+        uint32_t helper_thread_num = network_thread_num + learner_thread_num;
+        uint32_t compute_core_num = core_num > helper_thread_num + 2 ? core_num - helper_thread_num : 2;
+
+        generator_thread_num_ = GENERATE_RWER_THREAD_NUM;
+        executor_thread_num_ = PROC_MESSAGE_THREAD_NUM;
+        if (generator_thread_num_ + executor_thread_num_ > compute_core_num) {
+            generator_thread_num_ = std::max<uint32_t>(1, compute_core_num * GENERATE_RWER_THREAD_NUM / (GENERATE_RWER_THREAD_NUM + PROC_MESSAGE_THREAD_NUM));
+            executor_thread_num_ = std::max<uint32_t>(1, compute_core_num - generator_thread_num_);
+        }
+        // debug
+        std::cout << "generator: " << generator_thread_num_ << ", executor: " << executor_thread_num_ << std::endl;
+    }
 
     // 受信キューの初期化
-    RWer_queue_ = new MessageQueue<RandomWalker>[PROC_MESSAGE_THREAD_NUM];
+    RWer_queue_ = new MessageQueue<RandomWalker>[executor_thread_num_];
 
     // 送信キューの初期化
-    watching_queue_flag_ = new std::atomic<bool>[SEND_QUEUE_NUM];
-    for (int i = 0; i < SEND_QUEUE_NUM; i++) {
-        watching_queue_flag_[i] = false;
-    }
     send_queue_ = new MessageQueue<RandomWalker>[SEND_QUEUE_NUM];
 
+    // 流量制御の初期化
+    flow_control_.init(SEND_QUEUE_NUM, send_queue_, hostid_);
+
+    // 再送制御の初期化 (通信エンジンが取りこぼさないなら再送はしない)
+    reliable_.init(SEND_QUEUE_NUM, !transport_->isReliable());
+
     // 全てのスレッドを開始させる 
     start();
 }
 
 inline void RandomWalkSystemWorker::start() {
-    std::thread thread_generateRWer(&RandomWalkSystemWorker::generateRWerForMain, this);
-    std::thread thread_generateRWerCache(&RandomWalkSystemWorker::generateRWerForCache, this);
+    // executor スレッド
+    for (uint32_t i = 0; i < executor_thread_num_; i++) {
+        threads_.emplace_back(std::thread(&RandomWalkSystemWorker::procMessage, this, i));
+    }
+
+    // generator スレッド
+    job_controller_.setWorkerNum(generator_thread_num_);
+    for (uint32_t i = 0; i < generator_thread_num_; i++) {
+        threads_.emplace_back(std::thread(&RandomWalkSystemWorker::generateRWer, this, i));
+    }
 
-    std::vector<std::thread> threads_sendMessage;
+    // 送信スレッド (送信先毎)
     for (int i = 0; i < SEND_QUEUE_NUM; i++) {
         if (i == hostid_) continue;
-        threads_sendMessage.emplace_back(std::thread(&RandomWalkSystemWorker::sendMessage, this));
+        threads_.emplace_back(std::thread(&RandomWalkSystemWorker::sendMessage, this, i));
+    }
+
+    // 受信スレッド
+    for (uint32_t i = 0; i < transport_->getReceiverNum(); i++) {
+        threads_.emplace_back(std::thread(&RandomWalkSystemWorker::receiveMessage, this, i));
     }
 
-    std::vector<std::thread> threads_receiveMessage;
-    for (int i = 0; i < RECV_PORT; i++) {
-        threads_receiveMessage.emplace_back(std::thread(&RandomWalkSystemWorker::receiveMessage, this, 10000+i));
+    // 再送チェックスレッド
+    threads_.emplace_back(std::thread(&RandomWalkSystemWorker::checkRetransmit, this));
+
+    // キャッシュに経路を入れる補助スレッド (仕事がある時だけ)
+    if (cache_learner_flag_) threads_.emplace_back(std::thread(&CacheLearner::run, &cache_learner_, std::ref(cache_), std::ref(graph_)));
+
+    // 実行中のカウンタを返す HTTP
+    if (METRICS_FLAG) {
+        std::string labels = "host=\"" + std::to_string(hostid_) + "\"";
+        threads_.emplace_back(std::thread(&Metrics::serve, &metrics_, METRICS_PORT + port_offset_, labels,
+                                          [this](std::ostream& os) { writeMetrics(os); }));
     }
 
+    // ジョブを配るスレッド
+    threads_.emplace_back(std::thread(&RandomWalkSystemWorker::generateRWerForMain, this));
+    threads_.emplace_back(std::thread(&RandomWalkSystemWorker::generateRWerForCache, this));
+
     // プログラムを終了させないようにする
-    thread_generateRWer.join();
+    for (std::thread& th : threads_) {
+        th.join();
+    }
 }
 
 inline void RandomWalkSystemWorker::generateRWerForMain() {
     std::cout << "generateRWerForMain" << std::endl;
 
-    // スレッドごとの乱数生成器
-    StdRandNumGenerator* randgen = new StdRandNumGenerator[GENERATE_RWER_THREAD_NUM];
-
     while (1) {
         // 開始通知を受けるまでロック
         start_flag_.lockWhileFalse();
@@ -216,193 +393,231 @@ inline void RandomWalkSystemWorker::generateRWerForMain() {
         // debug
         std::cout << "start" << std::endl;
 
-        uint64_t number_of_RW_execution = RW_config_.getNumberOfRWExecution();
-        uint64_t number_of_my_vertices = graph_.getMyVerticesNum();
-        std::vector<vertex_id_t> my_vertices = graph_.getMyVertices();
-        walker_id_t RWer_num_all = number_of_my_vertices * number_of_RW_execution;
+        RandomWalkJob job;
+        job.kind_ = MAIN_JOB;
+        job.thread_num_ = generator_thread_num_;
+        job.RWer_num_ = graph_.getMyVerticesNum() * RW_config_.getNumberOfRWExecution();
 
-        RW_manager_.init(RWer_num_all);
+        RW_manager_.init(job.RWer_num_);
 
         // debug
-        std::cout << "GENERATE_RWER_THREAD_NUM: " << GENERATE_RWER_THREAD_NUM << std::endl;
+        std::cout << "generator_thread_num_: " << generator_thread_num_ << std::endl;
 
         Timer timer;
-        #pragma omp parallel num_threads(GENERATE_RWER_THREAD_NUM)
-        {
-            worker_id_t worker_id = omp_get_thread_num();
-            StdRandNumGenerator gen = randgen[worker_id];
-            walker_id_t RWer_id = worker_id;
-            bool sleep_flag = false;
+        job_controller_.run(job);
 
-            while (1) {
-                vertex_id_t node_id = my_vertices[RWer_id % number_of_my_vertices];
+        std::cout << "generate end: " << timer.duration() << std::endl;
+    }
+}
 
-                // 歩数を生成
-                uint16_t life = RW_config_.getRWerLife(gen);
+inline void RandomWalkSystemWorker::generateRWerForCache() {
+    std::cout << "generateRWerForCache" << std::endl;
 
-                // RWer を生成
-                std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(node_id, graph_.getDegree(node_id), RWer_id, hostid_, life));
+    while (1) {
+        start_cache_flag_.lockWhileFalse();
 
-                // 生成時刻を記録
-                RW_manager_.setStartTime(RWer_id);
+        Timer timer;
+        if (cache_snapshot_loaded_) {
+            // スナップショットで埋まっているので補充しない (他サーバからの要求には応答する)
+        } else if (CACHE_PREFETCH_FLAG) {
+            prefetchCache();
+        } else {
+            RandomWalkJob job;
+            job.kind_ = CACHE_JOB;
+            job.thread_num_ = std::min(GENERATE_RWER_CACHE_THREAD_NUM, generator_thread_num_);
+            job.RWer_num_ = MAX_RWER_NUM_FOR_CACHE;
 
-                // 歩数を記録
-                RW_manager_.setRWerLife(RWer_id, life);
+            job_controller_.run(job);
+        }
 
-                // node_id を記録
-                RW_manager_.setNodeId(RWer_id, node_id);
+        // 戻ってきた RWer の経路をキャッシュに入れ終わるまで待つ
+        cache_learner_.flush();
 
-                // RW を実行 
-                executeRandomWalk(std::move(RWer_ptr), gen);
+        uint32_t RWer_id_all = cache_RWer_id_all_;
+        double execution_time = timer.duration();
+        std::cout << "ex_time: " << execution_time << ", cache_size: " << cache_.getEdgeCount() << ", RWer_id_all: " << RWer_id_all
+                  << ", learn dropped: " << cache_learner_.getDroppedRWerNum() << " (ratio: " << cache_learner_.getDropRatio() << ")" << std::endl;
 
-                RWer_id += GENERATE_RWER_THREAD_NUM;
-                if (RWer_id >= RWer_num_all) break;
-            }
-        }
+        // 補充したキャッシュを次の実行のために保存 (まだ戻っていない cache 補充用の RWer の経路は入らない)
+        if (CACHE_SNAPSHOT_FLAG && !cache_snapshot_loaded_) cache_.writeSnapshot(getCacheSnapshotPath(), hostid_, graph_.getChecksum());
 
-        std::cout << "generate end: " << timer.duration() << std::endl;
+        StdRandNumGenerator gen;
+        std::this_thread::sleep_for(std::chrono::seconds(gen.gen(5)));
 
-        PROC_MESSAGE_FLAG = true;
-        std::vector<std::thread> threads_procMessage;
-        for (int i = 0; i < PROC_MESSAGE_THREAD_NUM; i++) {
-            threads_procMessage.emplace_back(std::thread(&RandomWalkSystemWorker::procMessage, this, i));
+        // startmanager に結果送信
+        {
+            // ソケットの生成
+            int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+            if (sockfd < 0) { // エラー処理
+                perror("socket");
+                exit(1); // 異常終了
+            }
+            std::cout << sockfd << std::endl;
+
+            // アドレスの生成
+            struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
+            memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
+            addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
+            addr.sin_port = htons(9999); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
+            addr.sin_addr.s_addr = startmanagerip_; // IPアドレス, inet_addr()関数はアドレスの翻訳
+
+            // ソケット接続要求
+            connect(sockfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)); // ソケット, アドレスポインタ, アドレスサイズ
+            std::cout << "connect" << std::endl;
+
+            // データ送信 (hostip: 4B, execution_time: 8B)
+            char message[MESSAGE_MAX_LENGTH_SEND];
+            int idx = 0;
+            memcpy(message + idx, &hostip_, sizeof(uint32_t)); idx += sizeof(uint32_t);
+            // memcpy(message + idx, &execution_time, sizeof(double)); idx += sizeof(double);
+            memcpy(message + idx, &RWer_id_all, sizeof(uint32_t)); idx += sizeof(uint32_t);
+            send(sockfd, message, sizeof(message), 0); // 送信
+            std::cout << "send" << std::endl;
+
+            // ソケットクローズ
+            close(sockfd); 
         }
 
-        threads_procMessage[0].join();
+        // 全てのサーバで終了した確認
+        {
+            int sockfd = createTcpServerSocket(9999 + port_offset_); // サーバソケットを生成 (TCP)
+
+            struct sockaddr_in get_addr; // 接続相手のソケットアドレス
+            socklen_t len = sizeof(struct sockaddr_in); // 接続相手のアドレスサイズ
+            int connect = accept(sockfd, (struct sockaddr *)&get_addr, &len); // 接続待ちソケット, 接続相手のソケットアドレスポインタ, 接続相手のアドレスサイズ
+            if (connect < 0) { // エラー処理
+                perror("accept");
+                exit(1); // 異常終了
+            }       
+
+            char message[1024]; // 受信バッファ
+            memset(message, 0, sizeof(message)); // 受信バッファ初期化
+            recv(connect, message, sizeof(message), 0); // 受信 
+
+            close(connect);
+            close(sockfd);
+        }
     }
-
-    delete[] randgen;
 }
 
-inline void RandomWalkSystemWorker::generateRWerForCache() {
-    std::cout << "generateRWerForCache" << std::endl;
+inline void RandomWalkSystemWorker::generateRWer(const worker_id_t& worker_id) {
+    // スレッドごとの乱数生成器
+    StdRandNumGenerator gen;
+    uint64_t epoch = 0;
 
-    uint64_t number_of_my_vertices = graph_.getMyVerticesNum();
-    std::vector<vertex_id_t> my_vertices = graph_.getMyVertices();
+    while (1) {
+        // ジョブが来るまで待機
+        RandomWalkJob job = job_controller_.waitJob(epoch);
 
-    // procMessage スレッドを生成
-    PROC_MESSAGE_FLAG = true;
-    std::vector<std::thread> threads_procMessage;
-    for (int i = 0; i < PROC_MESSAGE_CACHE_THREAD_NUM; i++) {
-        threads_procMessage.emplace_back(std::thread(&RandomWalkSystemWorker::procMessage, this, i));
-    }
+        if (worker_id < job.thread_num_) {
+            if (job.kind_ == MAIN_JOB) generateMainRWer(worker_id, job, gen);
+            else generateCacheRWer(worker_id, job, gen);
+        }
 
-    start_cache_flag_.lockWhileFalse();
+        job_controller_.finishJob();
+    }
+}
 
-    Timer timer;
-    uint32_t RWer_id_all;
-    #pragma omp parallel num_threads(GENERATE_RWER_CACHE_THREAD_NUM)
-    {
-        worker_id_t worker_id = omp_get_thread_num();
-        StdRandNumGenerator gen;
-        walker_id_t RWer_id = worker_id;
-        walker_id_t sleep_threashold = RW_STEP;
+inline void RandomWalkSystemWorker::generateMainRWer(const worker_id_t& worker_id, const RandomWalkJob& job, StdRandNumGenerator& gen) {
+    uint64_t number_of_my_vertices = graph_.getMyVerticesNum();
+    std::vector<vertex_id_t> my_vertices = graph_.getMyVertices();
+    walker_id_t RWer_id = worker_id;
 
-        while (CACHE_GEN_FLAG) {
+    while (RWer_id < job.RWer_num_) {
+        // 送信先の credit が足りなければ待機
+        flow_control_.waitForCredit();
 
-            vertex_id_t node_id = my_vertices[RWer_id % number_of_my_vertices];
+        vertex_id_t node_id = my_vertices[RWer_id % number_of_my_vertices];
 
-            // 歩数を生成
-            uint16_t life = RW_config_.getRWerLife(gen);
+        // 歩数を生成
+        uint16_t life = RW_config_.getRWerLife(gen);
 
-            // RWer を生成
-            std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(node_id, graph_.getDegree(node_id), RWer_id, hostid_, life));
+        // RWer を生成
+        std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(node_id, graph_.getDegree(node_id), RWer_id, hostid_, life));
 
-            // RW を実行 
-            executeRandomWalk(std::move(RWer_ptr), gen);
+        // 生成時刻を記録
+        RW_manager_.setStartTime(*RWer_ptr);
 
-            RWer_id += GENERATE_RWER_CACHE_THREAD_NUM;
-            if (RWer_id >= MAX_RWER_NUM_FOR_CACHE) break;
-            if (RWer_id >= sleep_threashold) {
-                // debug
-                std::cout << "RWer_id: " << RWer_id << ", sleep" << std::endl;
+        // RW を実行 
+        executeRandomWalk(std::move(RWer_ptr), gen);
 
-                std::this_thread::sleep_for(std::chrono::seconds(GENERATE_SLEEP_TIME));
+        RWer_id += job.thread_num_;
+    }
+}
 
-                sleep_threashold += RW_STEP;
+inline void RandomWalkSystemWorker::prefetchCache() {
+    Timer timer;
 
-                // debug
-                std::cout << "start" << std::endl;
-                std::cout << "cache count: " << cache_.getEdgeCount() << std::endl;
-            }
+    // 持ち主毎に点数の高い順に要求をまとめて送る
+    std::vector<std::vector<vertex_id_t>> requests;
+    prefetcher_.selectVertices(graph_, SEND_QUEUE_NUM, requests);
+    for (host_id_t host_id = 0; host_id < SEND_QUEUE_NUM; host_id++) {
+        const std::vector<vertex_id_t>& request = requests[host_id];
+        for (uint64_t start = 0; start < request.size(); start += CACHE_PREFETCH_REQUEST_BATCH) {
+            uint64_t end = std::min<uint64_t>(start + CACHE_PREFETCH_REQUEST_BATCH, request.size());
+            std::vector<uint64_t> words(request.begin() + start, request.begin() + end);
+            send_queue_[host_id].push(std::make_unique<RandomWalker>(CACHE_PREFETCH_REQUEST, words));
         }
-
-        // debug 
-        std::cout << RWer_id << std::endl;
-        RWer_id_all = RWer_id;
     }
 
-    double execution_time = timer.duration();
-    std::cout << "ex_time: " << execution_time << ", cache_size: " << cache_.getEdgeCount() << ", RWer_id_all: " << RWer_id_all << std::endl;
+    bool completed = prefetcher_.waitForRows(CACHE_PREFETCH_TIMEOUT_MS);
+    std::cout << "prefetch rows: " << prefetcher_.getReceivedRowNum() << " / " << prefetcher_.getRequestedRowNum() << ", entries: " << prefetcher_.getEntryNum()
+              << ", time: " << timer.duration() << (completed ? "" : " (timeout)") << std::endl;
+}
 
-    StdRandNumGenerator gen;
-    std::this_thread::sleep_for(std::chrono::seconds(gen.gen(5)));
+inline std::string RandomWalkSystemWorker::getCacheSnapshotPath() {
+    return std::string(CACHE_SNAPSHOT_DIR) + "cache_" + std::to_string(hostid_) + ".bin";
+}
 
-    // startmanager に結果送信
-    {
-        // ソケットの生成
-        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) { // エラー処理
-            perror("socket");
-            exit(1); // 異常終了
-        }
-        std::cout << sockfd << std::endl;
+inline void RandomWalkSystemWorker::generateCacheRWer(const worker_id_t& worker_id, const RandomWalkJob& job, StdRandNumGenerator& gen) {
+    uint64_t number_of_my_vertices = graph_.getMyVerticesNum();
+    std::vector<vertex_id_t> my_vertices = graph_.getMyVertices();
+    walker_id_t RWer_id = worker_id;
+    walker_id_t sleep_threashold = RW_STEP;
 
-        // アドレスの生成
-        struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
-        memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
-        addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-        addr.sin_port = htons(9999); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
-        addr.sin_addr.s_addr = startmanagerip_; // IPアドレス, inet_addr()関数はアドレスの翻訳
+    while (CACHE_GEN_FLAG) {
+        // 送信先の credit が足りなければ待機
+        flow_control_.waitForCredit();
 
-        // ソケット接続要求
-        connect(sockfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)); // ソケット, アドレスポインタ, アドレスサイズ
-        std::cout << "connect" << std::endl;
+        vertex_id_t node_id = my_vertices[RWer_id % number_of_my_vertices];
 
-        // データ送信 (hostip: 4B, execution_time: 8B)
-        char message[MESSAGE_MAX_LENGTH_SEND];
-        int idx = 0;
-        memcpy(message + idx, &hostip_, sizeof(uint32_t)); idx += sizeof(uint32_t);
-        // memcpy(message + idx, &execution_time, sizeof(double)); idx += sizeof(double);
-        memcpy(message + idx, &RWer_id_all, sizeof(uint32_t)); idx += sizeof(uint32_t);
-        send(sockfd, message, sizeof(message), 0); // 送信
-        std::cout << "send" << std::endl;
+        // 歩数を生成
+        uint16_t life = RW_config_.getRWerLife(gen);
 
-        // ソケットクローズ
-        close(sockfd); 
-    }
+        // RWer を生成
+        std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(node_id, graph_.getDegree(node_id), RWer_id, hostid_, life));
 
-    // 全てのサーバで終了した確認
-    {
-        int sockfd = createTcpServerSocket(9999); // サーバソケットを生成 (TCP)
+        // RW を実行 
+        executeRandomWalk(std::move(RWer_ptr), gen);
 
-        struct sockaddr_in get_addr; // 接続相手のソケットアドレス
-        socklen_t len = sizeof(struct sockaddr_in); // 接続相手のアドレスサイズ
-        int connect = accept(sockfd, (struct sockaddr *)&get_addr, &len); // 接続待ちソケット, 接続相手のソケットアドレスポインタ, 接続相手のアドレスサイズ
-        if (connect < 0) { // エラー処理
-            perror("accept");
-            exit(1); // 異常終了
-        }       
+        RWer_id += job.thread_num_;
+        if (RWer_id >= job.RWer_num_) break;
+        if (RWer_id >= sleep_threashold) {
+            // debug
+            std::cout << "RWer_id: " << RWer_id << ", sleep" << std::endl;
 
-        char message[1024]; // 受信バッファ
-        memset(message, 0, sizeof(message)); // 受信バッファ初期化
-        recv(connect, message, sizeof(message), 0); // 受信 
+            std::this_thread::sleep_for(std::chrono::seconds(GENERATE_SLEEP_TIME));
 
-        close(sockfd);
-    }
+            sleep_threashold += RW_STEP;
 
-    // procMessageスレッドを終了させる
-    PROC_MESSAGE_FLAG = false;
-    for (int i = 0; i < PROC_MESSAGE_CACHE_THREAD_NUM; i++) {
-        std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(DUMMY));
-        RWer_queue_[i].push(std::move(RWer_ptr));
-        threads_procMessage[i].join();
+            // debug
+            std::cout << "start" << std::endl;
+            std::cout << "cache count: " << cache_.getEdgeCount() << std::endl;
+        }
     }
-    std::cout << "PROC_MESSAGE join !" << std::endl;
+
+    // debug 
+    std::cout << RWer_id << std::endl;
+    cache_RWer_id_all_ = RWer_id;
 }
 
 inline void RandomWalkSystemWorker::executeRandomWalk(std::unique_ptr<RandomWalker>&& RWer_ptr, StdRandNumGenerator& gen) {
 
+    // このサーバで進めた歩数 (抜ける時にまとめて足す)
+    uint64_t local_step_num = 0;
+    uint64_t cache_step_num = 0;
+    uint64_t remote_hop_num = 0;
+
     while (1) {
 
         vertex_id_t current_node = RWer_ptr->getCurrentNodeID(); // 現在頂点
@@ -425,6 +640,7 @@ inline void RandomWalkSystemWorker::executeRandomWalk(std::unique_ptr<RandomWalk
                 vertex_id_t next_node = graph_.getNextNodeID(current_node, next_index, gen);
 
                 RWer_ptr->updateRWer(next_node, graph_.getHostId(next_node), INF, next_index, INF);
+                local_step_num++;
 
             } else if (RWer_ptr->isEnd() || degree == 0) { // 寿命切れ もしくは次数 0 なら終了
                 
@@ -439,22 +655,28 @@ inline void RandomWalkSystemWorker::executeRandomWalk(std::unique_ptr<RandomWalk
                 vertex_id_t next_node = graph_.getNextNodeID(current_node, next_index, gen);
 
                 RWer_ptr->updateRWer(next_node, graph_.getHostId(next_node), 0, next_index, INF);
+                local_step_num++;
             }
 
         } else { // キャッシュデータを参照して RW
 
+            // 次数をキャッシュからコピーして取ってくる
+            index_t degree = cache_.getDegree(current_node);
+
             // 現在頂点の次数情報があるか確認
-            if (!cache_.hasDegree(current_node)) { // 次数情報がない (元グラフの他サーバ隣接ノードの初期状態)
+            if (degree == INF) { // 次数情報がない (元グラフの他サーバ隣接ノードの初期状態, もしくは追い出された)
+
+                // キャッシュを辿って来た頂点は元グラフでは持ち主が分からないので, キャッシュに登録した持ち主を使う
+                host_id_t host_id = cache_.getHostId(current_node);
+                if (host_id == INF) host_id = graph_.getHostId(current_node);
 
                 RWer_ptr->setSendFlag(true);
-                send_queue_[graph_.getHostId(current_node)].push(std::move(RWer_ptr));
+                send_queue_[host_id].push(std::move(RWer_ptr));
+                remote_hop_num++;
 
                 break;
             }
 
-            // 次数をキャッシュからコピーして取ってくる
-            index_t degree = cache_.getDegree(current_node);
-
             // 現在頂点の次数情報を RWer に入力
             RWer_ptr->setCurrentDegree(degree);
 
@@ -478,6 +700,7 @@ inline void RandomWalkSystemWorker::executeRandomWalk(std::unique_ptr<RandomWalk
                     RWer_ptr->setNextIndex(rand_idx);
                     RWer_ptr->setSendFlag(true);
                     send_queue_[cache_.getHostId(current_node)].push(std::move(RWer_ptr));
+                    remote_hop_num++;
 
                     break;
 
@@ -485,39 +708,101 @@ inline void RandomWalkSystemWorker::executeRandomWalk(std::unique_ptr<RandomWalk
 
                 if (graph_.hasVertex(next_node)) RWer_ptr->updateRWer(next_node, graph_.getHostId(next_node), INF, rand_idx, INF);
                 else RWer_ptr->updateRWer(next_node, cache_.getHostId(next_node), INF, rand_idx, INF);
+                cache_step_num++;
             }
             
         }
     }
+
+    if (local_step_num > 0) metrics_.add(METRIC_LOCAL_STEP, local_step_num);
+    if (cache_step_num > 0) metrics_.add(METRIC_CACHE_STEP, cache_step_num);
+    if (remote_hop_num > 0) metrics_.add(METRIC_REMOTE_HOP, remote_hop_num);
 }
 
 inline void RandomWalkSystemWorker::endRandomWalk(std::unique_ptr<RandomWalker>&& RWer_ptr) {
     // RWer の message_id に DEAD_SEND フラグを入れる
     RWer_ptr->setMessageID(DEAD_SEND);
+    metrics_.add(METRIC_RWER_END, 1);
 
     if (RWer_ptr->getHostID() == hostid_) {
-        if (CHECK_RWER_FLAG && RWer_ptr->isSendedAll()) checkRWer(std::move(RWer_ptr));
-        else if (MAIN_EX) RW_manager_.setEndTime(RWer_ptr->getRWerID());
+        finishRandomWalk(std::move(RWer_ptr));
     } else {
         send_queue_[RWer_ptr->getHostID()].push(std::move(RWer_ptr));
     }
 }
 
+inline void RandomWalkSystemWorker::finishRandomWalk(std::unique_ptr<RandomWalker>&& RWer_ptr) {
+    // RWer の起点サーバはここなので終了時間記録
+    if (MAIN_EX) RW_manager_.setEndTime(*RWer_ptr);
+
+    // 終点は経路が揃っていなくても分かる
+    if (PPR_COUNT_MODE == PPR_COUNT_ENDPOINT && MAIN_EX) ppr_.add(getSourceNode(*RWer_ptr), RWer_ptr->getCurrentNodeID());
+
+    if (PATH_SEGMENT_MODE == PATH_SEGMENT_LOCAL && MAIN_EX) {
+        // 残りの経路も最後のセグメントとしてこのサーバに残す
+        std::vector<uint64_t> segment;
+        RWer_ptr->getPathWords(segment);
+        segment_store_.put(hostid_, RWer_ptr->getRWerID(), RWer_ptr->getSegmentCount(), std::move(segment));
+        return;
+    }
+
+    if (PATH_SEGMENT_MODE == PATH_SEGMENT_GATHER) {
+        // 途中のサーバから届くセグメントが揃うまで待つ (揃ったら最後に届いた方で処理)
+        RWer_ptr = segment_store_.complete(std::move(RWer_ptr));
+        if (RWer_ptr == nullptr) return;
+    }
+
+    if (MAIN_EX) recordPath(*RWer_ptr);
+
+    if (RWer_ptr->isSendedAll()) checkRWer(std::move(RWer_ptr));
+}
+
+inline void RandomWalkSystemWorker::recordPath(RandomWalker& RWer) {
+    if (WALK_OUTPUT_FLAG) walk_output_.write(RWer);
+
+    if (PPR_COUNT_MODE == PPR_COUNT_VISIT) {
+        vertex_id_t source = getSourceNode(RWer);
+        std::vector<uint64_t> nodes(RWer.getNodeNum());
+        RWer.writeNodes(nodes.data());
+        for (const vertex_id_t node_id : nodes) ppr_.add(source, node_id);
+    }
+}
+
+inline vertex_id_t RandomWalkSystemWorker::getSourceNode(RandomWalker& RWer) {
+    return graph_.getMyVertex(RWer.getRWerID() % graph_.getMyVerticesNum());
+}
+
 inline void RandomWalkSystemWorker::checkRWer(std::unique_ptr<RandomWalker>&& RWer_ptr) {
     // debug
     // std::cout << "checkRWer" << std::endl;
 
-    // RWer の起点サーバがここだったら終了時間記録
-    if (RWer_ptr->getHostID() == hostid_) {
-        // std::cout << "endatstartserver" << std::endl;
-        if (MAIN_EX) RW_manager_.setEndTime(RWer_ptr->getRWerID());
-    }
+    if (!cache_learner_flag_) return;
 
-    // debug 
-    // std::cout << "not host server of RWer" << std::endl;
+    // cache 補充の実行では全ての経路を入れるので, 補助スレッドが追いつかずキューが満杯なら空くまで待つ
+    // メインの実験では executor を止めないように捨てる (捨てた割合は統計に出す)
+    if (CHECK_RWER_FLAG || (CACHE_LEARN_FLAG && MAIN_EX)) cache_learner_.push(RWer_ptr, !MAIN_EX);
+}
+
+inline void RandomWalkSystemWorker::cutPathSegment(std::unique_ptr<RandomWalker>& RWer_ptr) {
+    uint8_t message_id = RWer_ptr->getMessageID();
+    if (message_id == PATH_SEGMENT || message_id == DUMMY || message_id == CACHE_PREFETCH_REQUEST || message_id == CACHE_PREFETCH_RESPONSE) return;
 
-    // RWer の経路情報をキャッシュに登録
-    cache_.addRWer(std::move(RWer_ptr), graph_);
+    // cache 補充の実行では起点サーバで全経路を使うので, このサーバに残す方式では切り離さない
+    if (PATH_SEGMENT_MODE == PATH_SEGMENT_LOCAL && CHECK_RWER_FLAG) return;
+
+    uint16_t segment_index = RWer_ptr->getSegmentCount();
+    std::vector<uint64_t> segment;
+    if (!RWer_ptr->cutSegment(segment)) return;
+
+    host_id_t origin = RWer_ptr->getHostID();
+    if (PATH_SEGMENT_MODE == PATH_SEGMENT_LOCAL) {
+        segment_store_.put(origin, RWer_ptr->getRWerID(), segment_index, std::move(segment));
+    } else if (origin == hostid_) {
+        // RWer はまだ生存しているので揃うことはない
+        segment_store_.gather(RWer_ptr->getRWerID(), segment_index, std::move(segment));
+    } else {
+        send_queue_[origin].push(std::make_unique<RandomWalker>(RWer_ptr->getRWerID(), segment_index, segment));
+    }
 }
 
 inline void RandomWalkSystemWorker::procMessage(const uint16_t& proc_id) {
@@ -525,7 +810,7 @@ inline void RandomWalkSystemWorker::procMessage(const uint16_t& proc_id) {
 
     StdRandNumGenerator randgen;
 
-    while (PROC_MESSAGE_FLAG) {
+    while (1) {
         // メッセージキューからメッセージを取得
         std::vector<std::unique_ptr<RandomWalker>> RWer_ptr_vec;
         uint32_t vec_size = RWer_queue_[proc_id].pop(RWer_ptr_vec);
@@ -536,10 +821,37 @@ inline void RandomWalkSystemWorker::procMessage(const uint16_t& proc_id) {
 
         for (int i = 0; i < vec_size; i++) {
             uint8_t message_id = RWer_ptr_vec[i]->getMessageID();
+            host_id_t received_from = RWer_ptr_vec[i]->getReceivedFrom();
             if (message_id == DEAD_SEND) { // 終了して送られてきた RWer の処理
 
-                if (CHECK_RWER_FLAG) checkRWer(std::move(RWer_ptr_vec[i]));
-                else if (MAIN_EX) RW_manager_.setEndTime(RWer_ptr_vec[i]->getRWerID());
+                finishRandomWalk(std::move(RWer_ptr_vec[i]));
+
+            } else if (message_id == PATH_SEGMENT) { // 途中のサーバから送られてきた経路のセグメント (PATH_SEGMENT_GATHER)
+
+                std::vector<uint64_t> segment;
+                RWer_ptr_vec[i]->getPathWords(segment);
+                // 揃っていなければ RWer は返らない (送信元には credit を返すので continue しない)
+                std::unique_ptr<RandomWalker> RWer_ptr = segment_store_.gather(RWer_ptr_vec[i]->getRWerID(), RWer_ptr_vec[i]->getSegmentCount(), std::move(segment));
+                if (RWer_ptr != nullptr) {
+                    if (MAIN_EX) recordPath(*RWer_ptr);
+                    if (RWer_ptr->isSendedAll()) checkRWer(std::move(RWer_ptr));
+                }
+
+            } else if (message_id == CACHE_PREFETCH_REQUEST) { // 隣接リストの要求 (CACHE_PREFETCH_FLAG)
+
+                std::vector<uint64_t> request;
+                std::vector<std::vector<uint64_t>> responses;
+                RWer_ptr_vec[i]->getPathWords(request);
+                prefetcher_.buildResponse(graph_, request, responses);
+                for (const std::vector<uint64_t>& response : responses) {
+                    send_queue_[received_from].push(std::make_unique<RandomWalker>(CACHE_PREFETCH_RESPONSE, response));
+                }
+
+            } else if (message_id == CACHE_PREFETCH_RESPONSE) { // 隣接リストの応答 (CACHE_PREFETCH_FLAG)
+
+                std::vector<uint64_t> response;
+                RWer_ptr_vec[i]->getPathWords(response);
+                prefetcher_.addResponse(cache_, graph_, received_from, response);
 
             } else if (message_id == DUMMY) {
 
@@ -551,102 +863,138 @@ inline void RandomWalkSystemWorker::procMessage(const uint16_t& proc_id) {
                 executeRandomWalk(std::move(RWer_ptr_vec[i]), randgen);
 
             }            
+
+            // 処理し終えたので送信元に返す credit を貯める
+            // 閾値に達したら送信元への送信スレッドを起こして返却させる
+            if (flow_control_.addPendingReturn(received_from) == CREDIT_RETURN_THRESHOLD) {
+                send_queue_[received_from].notify();
+            }
+        }
+
+        // 処理するものがなくなったら閾値に達していない credit も返させる (全 RWer が終わった後に残らないように)
+        // 送る RWer がある送信先はそのヘッダで返るので, 送信キューが空の送信先だけ起こす
+        if (vec_size > 0 && RWer_queue_[proc_id].getSize() == 0) {
+            for (host_id_t src = 0; src < SEND_QUEUE_NUM; src++) {
+                if (src == hostid_ || flow_control_.getPendingReturn(src) == 0 || send_queue_[src].getSize() > 0) continue;
+                send_queue_[src].notify();
+            }
         }
 
     }  
 
 }
 
-void RandomWalkSystemWorker::sendMessage() {
-    std::cout << "sendMessage" << std::endl;
+inline void RandomWalkSystemWorker::sendMessage(const host_id_t& send_id) {
+    std::cout << "sendMessage: " << send_id << std::endl;
 
-    // ソケットの生成
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    // debug 
-    // std::cout << sockfd << std::endl;
-    if (sockfd < 0) { // エラー処理
-        perror("socket");
-        exit(1); // 異常終了
-    } 
+    // 送信先への送信口 (まとめて送信)
+    std::unique_ptr<TransportSender> sender = transport_->createSender(send_id);
 
-    StdRandNumGenerator gen;
-    char message[MESSAGE_MAX_LENGTH_SEND];
-    memset(message, 0, MESSAGE_MAX_LENGTH_SEND);
-    uint8_t ver_id = RWERS;
+    char* message = nullptr; // 組み立て中のメッセージ (再送バッファの空き)
+    MessageHeader header;
+    header.src_host_id_ = hostid_;
     uint16_t RWer_count = 0;
     uint32_t now_length = 0;
 
-    // アドレスの生成
-    struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
-    memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
-    addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-
     // 送信関数
     auto send_func = [&]() {
-        // メッセージのヘッダ情報を書き込む
-        // バージョン: 4bit (0), 
-        // メッセージID: 4bit (2),
-        // メッセージに含まれるRWerの個数: 16bit
-        memcpy(message, &ver_id, sizeof(ver_id));
-        memcpy(message + sizeof(ver_id), &RWer_count, sizeof(RWer_count));
-        now_length += sizeof(ver_id) + sizeof(RWer_count);
-
-        // ポート番号指定
-        addr.sin_port = htons(gen.genRandHostId(10000, 10000+RECV_PORT-1)); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
-
-        // データ送信
-        sendto(sockfd, message, now_length, 0, (struct sockaddr *)&addr, sizeof(addr)); 
+        // メッセージのヘッダ情報を書き込む (送信先から受け取った RWer の分の credit と ack を返却)
+        header.RWer_count_ = RWer_count;
+        header.credit_ = flow_control_.takePendingReturn(send_id);
+        header.seq_ = reliable_.getNextSeq(send_id);
+        reliable_.fillAck(send_id, header);
+        header.writeHeader(message);
+        now_length += MessageHeader::LENGTH;
+
+        // ack されるまで再送バッファに残して送信待ちに追加 (UDP_BATCH_SIZE 個溜まったらまとめて送信)
+        // 送信待ちは再送バッファのメッセージをそのまま指す (ack が返るのは送り終えた後なので, それまで再送バッファは返らない)
+        reliable_.commitSlot(send_id, now_length);
+        sender->commitExternal(message, now_length);
+        metrics_.add(METRIC_PACKET_SENT, 1);
+        metrics_.add(METRIC_BYTE_SENT, now_length);
+
+        // 送った RWer の分の credit を消費
+        flow_control_.consumeCredit(send_id, RWer_count);
 
         // debug
         // std::cout << "send" << std::endl;
 
         // 変数初期化
-        memset(message, 0, MESSAGE_MAX_LENGTH_SEND);
+        message = nullptr;
         RWer_count = 0;
         now_length = 0;
     };
 
-    while (1) {
-        // 送信先id取得
-        host_id_t send_id = 0;
-        {
-            std::lock_guard<std::mutex> lk(mtx_id_num_);
-            while (id_num_ == hostid_ || watching_queue_flag_[id_num_]) {
-                id_num_ = (id_num_ + 1) % SEND_QUEUE_NUM;
-            }
-            send_id = id_num_;
-            // debug
-            // std::cout << "send_id: " << send_id << std::endl;
-            watching_queue_flag_[send_id] = true;
-            id_num_ = (id_num_ + 1) % SEND_QUEUE_NUM;
+    // 再送期限の切れたメッセージの再送と, 返していない ack の送信
+    auto service_func = [&]() {
+        reliable_.forEachExpired(send_id, [&](const char* resend_message, const uint32_t& length) {
+            // ack は最新のものに書き換える
+            char* buffer = sender->getBuffer();
+            memcpy(buffer, resend_message, length);
+            MessageHeader resend_header;
+            resend_header.readHeader(buffer);
+            reliable_.fillAck(send_id, resend_header);
+            resend_header.writeHeader(buffer);
+            sender->commit(length);
+            metrics_.add(METRIC_PACKET_SENT, 1);
+            metrics_.add(METRIC_PACKET_RESENT, 1);
+            metrics_.add(METRIC_BYTE_SENT, length);
+        });
+
+        if (reliable_.getAckOwed(send_id) > 0) { // ack だけのメッセージ (再送しない)
+            MessageHeader ack_header;
+            ack_header.src_host_id_ = hostid_;
+            reliable_.fillAck(send_id, ack_header);
+            ack_header.writeHeader(sender->getBuffer());
+            sender->commit(MessageHeader::LENGTH);
+            metrics_.add(METRIC_PACKET_SENT, 1);
+            metrics_.add(METRIC_BYTE_SENT, MessageHeader::LENGTH);
         }
-        addr.sin_addr.s_addr = worker_ip_all_[send_id];
 
-        // send_queue_ から RWer をまとめて取得
-        if (send_queue_[send_id].getSize() == 0) {
-            watching_queue_flag_[send_id] = false;
-            continue;
+        sender->flush();
+    };
+
+    // 再送バッファが空くまで待って, 次のメッセージを組み立てる場所を入手
+    // (待っている間も再送と ack は続けるので, 互いに空き待ちになってもデッドロックしない)
+    auto acquire_func = [&]() {
+        while (!reliable_.hasWindow(send_id)) {
+            service_func();
+            std::this_thread::sleep_for(std::chrono::microseconds(RETRANSMIT_WAIT_SLEEP_US));
         }
-        std::vector<std::unique_ptr<RandomWalker>> RWer_ptr_vec;
-        uint32_t vec_size = send_queue_[send_id].pop(RWer_ptr_vec);
+        message = reliable_.getSlot(send_id);
+    };
 
-        watching_queue_flag_[send_id] = false;
+    while (1) {
+        // send_queue_ から RWer をまとめて取得
+        // SEND_BATCH_THRESHOLD 個溜まるか SEND_LATENCY_DEADLINE_US 経つまでスリープ
+        std::vector<std::unique_ptr<RandomWalker>> RWer_ptr_vec;
+        uint32_t vec_size = send_queue_[send_id].popBatch(RWer_ptr_vec, SEND_BATCH_THRESHOLD, SEND_LATENCY_DEADLINE_US);
 
         // debug 
         // std::cout << "vec_size: " << vec_size << std::endl;
 
+        if (vec_size == 0 && flow_control_.getPendingReturn(send_id) > 0) { // credit 返却のために起こされた
+            // 送る RWer がなくてもヘッダだけ送る
+            acquire_func();
+            send_func();
+        }
+
         int idx = 0;
         while (idx < vec_size) {
+            // 経路を切り離して, 一歩前と現在の頂点だけを送る
+            if (PATH_SEGMENT_MODE != PATH_SEGMENT_OFF) cutPathSegment(RWer_ptr_vec[idx]);
+
             // RWer データサイズ
             uint32_t RWer_data_length = RWer_ptr_vec[idx]->getRWerSize();
 
-            if (now_length + RWer_data_length >= MESSAGE_MAX_LENGTH_SEND - sizeof(ver_id) - sizeof(RWer_count)) { // メッセージに収まりきらなくなったら送信
+            if (message != nullptr && now_length + RWer_data_length >= MESSAGE_MAX_LENGTH_SEND - MessageHeader::LENGTH) { // メッセージに収まりきらなくなったら送信
                 send_func();
             }
+            if (message == nullptr) acquire_func();
 
             // RWerの中身をメッセージに詰める
             // memcpy(message + now_length, &RWer, RWer_data_length);
-            RWer_ptr_vec[idx]->writeMessage(message + sizeof(ver_id) + sizeof(RWer_count) + now_length);
+            RWer_ptr_vec[idx]->writeMessage(message + MessageHeader::LENGTH + now_length);
             now_length += RWer_data_length;
             RWer_count++;
             idx++;
@@ -654,101 +1002,158 @@ void RandomWalkSystemWorker::sendMessage() {
 
         // 残りを送信
         if (RWer_count > 0) send_func();
+
+        // 再送と ack (RWer に乗せきれなかった分) もまとめて送信
+        service_func();
     }
 }
 
-inline void RandomWalkSystemWorker::receiveMessage(const uint16_t& port_num) {
-    std::cout << "receiveMessage: " << port_num << std::endl;
+inline void RandomWalkSystemWorker::receiveMessage(const uint32_t& receiver_id) {
+    std::cout << "receiveMessage: " << receiver_id << std::endl;
 
-    int sockfd = createUdpServerSocket(port_num);
+    // 受信口 (まとめて受信)
+    std::unique_ptr<TransportReceiver> receiver = transport_->createReceiver(receiver_id);
 
     StdRandNumGenerator gen;
+    std::vector<Datagram> datagrams;
+
+    // SO_REUSEPORT で受信スレッドをコア毎に置く場合は, 受信スレッド毎に決まった executor スレッドに渡す
+    // (executor の方が多ければ receiver_id, receiver_id + 受信スレッド数, ... の executor に分ける, 空ならランダム)
+    std::vector<uint32_t> executor_ids;
+    if (USE_SO_REUSEPORT && TRANSPORT_ENGINE == UDP_ENGINE) {
+        for (uint32_t j = receiver_id % executor_thread_num_; j < executor_thread_num_; j += transport_->getReceiverNum()) executor_ids.push_back(j);
+    }
 
     while (1) {
-        // messageを受信
-        char message[MESSAGE_MAX_LENGTH_RECV];
-        memset(message, 0, MESSAGE_MAX_LENGTH_RECV);
-        recv(sockfd, message, MESSAGE_MAX_LENGTH_RECV, 0);
+        // message をまとめて受信
+        uint32_t datagram_num = receiver->receive(datagrams);
+
+        uint64_t byte_num = 0;
+        for (uint32_t i = 0; i < datagram_num; i++) {
+            uint32_t executor_id = executor_ids.empty() ? INF : executor_ids[executor_ids.size() == 1 ? 0 : gen.gen(executor_ids.size())];
+            byte_num += datagrams[i].length_;
+            receiveDatagram(datagrams[i].message_, datagrams[i].length_, executor_id, gen);
+        }
+        if (datagram_num > 0) {
+            metrics_.add(METRIC_PACKET_RECEIVED, datagram_num);
+            metrics_.add(METRIC_BYTE_RECEIVED, byte_num);
+        }
+    }
+}
 
-        uint8_t ver_id = *(uint8_t*)message;
+inline void RandomWalkSystemWorker::receiveDatagram(const char* message, const uint32_t& length, const uint32_t& executor_id, StdRandNumGenerator& gen) {
+    if (length == 0) return;
+    uint8_t ver_id = *(uint8_t*)message;
 
-        if ((ver_id & MASK_MESSEGEID) == START_EXP) { // 実験開始の合図
+    if ((ver_id & MASK_MESSEGEID) == START_EXP) { // 実験開始の合図
 
-            uint32_t startmanager_ip = *(uint32_t*)(message + sizeof(ver_id));
-            uint32_t num_RWer = *(uint32_t*)(message + sizeof(ver_id) + sizeof(startmanager_ip));
+        uint32_t startmanager_ip = *(uint32_t*)(message + sizeof(ver_id));
+        uint32_t num_RWer = *(uint32_t*)(message + sizeof(ver_id) + sizeof(startmanager_ip));
 
-            startmanagerip_ = startmanager_ip;
-            RW_config_.setNumberOfRWExecution(num_RWer);
+        startmanagerip_ = startmanager_ip;
+        RW_config_.setNumberOfRWExecution(num_RWer);
 
-            // debug
-            std::cout << "num_RWer = " << num_RWer << std::endl;
+        // debug
+        std::cout << "num_RWer = " << num_RWer << std::endl;
+
+        MAIN_EX = true;
+        CHECK_RWER_FLAG = false;
+        cache_.resetStats();
+
+        // 実験開始のフラグを立てる
+        start_flag_.writeReady(true);
+
+    } else if ((ver_id & MASK_MESSEGEID) == RWERS) { // RWer のメッセージ
+        // message に入っている RWer の数を確認
+        if (length < MessageHeader::LENGTH) {
+            std::cerr << "RWer message too short: " << length << " Byte" << std::endl;
+            return;
+        }
+        MessageHeader header;
+        header.readHeader(message);
+        if (header.src_host_id_ >= SEND_QUEUE_NUM) {
+            std::cerr << "RWer message from unknown host: " << header.src_host_id_ << std::endl;
+            return;
+        }
+        uint32_t idx = MessageHeader::LENGTH;
+        uint16_t RWer_count = header.RWer_count_;
+
+        // 送信元に送ったメッセージの ack
+        reliable_.processAck(header.src_host_id_, header.ack_, header.sack_);
 
-            MAIN_EX = true;
-            CHECK_RWER_FLAG = false;
+        // 重複して届いたメッセージ (再送) は捨てる
+        if (!reliable_.accept(header.src_host_id_, header.seq_)) return;
 
-            // 実験開始のフラグを立てる
-            start_flag_.writeReady(true);
+        // ack が溜まったら送信元への送信スレッドを起こして返させる
+        if (header.seq_ != 0 && reliable_.getAckOwed(header.src_host_id_) == ACK_EAGER_THRESHOLD) {
+            send_queue_[header.src_host_id_].notify();
+        }
 
-        } else if ((ver_id & MASK_MESSEGEID) == RWERS) { // RWer のメッセージ
-            // message に入っている RWer の数を確認
-            int idx = sizeof(uint8_t);
-            uint16_t RWer_count = *(uint16_t*)(message + idx); idx += sizeof(uint16_t);
+        // 送信元から返ってきた credit
+        flow_control_.returnCredit(header.src_host_id_, header.credit_);
 
-            std::vector<std::unique_ptr<RandomWalker>> RWer_ptr_vec(RWer_count);
+        if (RWer_count == 0) return; // credit / ack の返却のみ
+
+        std::vector<std::unique_ptr<RandomWalker>> RWer_ptr_vec;
+        RWer_ptr_vec.reserve(RWer_count);
 
-            for (int i = 0; i < RWer_count; i++) {
-                // std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(message + idx));
-                RWer_ptr_vec[i] = std::make_unique<RandomWalker>(message + idx);
-                idx += RWer_ptr_vec[i]->getRWerSize();
+        for (uint32_t i = 0; i < RWer_count; i++) {
+            // 途中で切れた (壊れた) メッセージはデータグラムの外を読まないように, そこから先を捨てる
+            if (!RandomWalker::isValidMessage(message + idx, length - idx)) {
+                std::cerr << "malformed RWer message from host " << header.src_host_id_ << ": record " << i << " of " << RWer_count
+                          << " at " << idx << " Byte, length " << length << " Byte" << std::endl;
+                break;
             }
+            // std::unique_ptr<RandomWalker> RWer_ptr(new RandomWalker(message + idx));
+            RWer_ptr_vec.push_back(std::make_unique<RandomWalker>(message + idx));
+            RWer_ptr_vec[i]->setReceivedFrom(header.src_host_id_);
+            idx += RWer_ptr_vec[i]->getRWerSize();
+        }
+        if (RWer_ptr_vec.empty()) return;
 
-            // まとめて RWer キューに push
-            if (MAIN_EX) RWer_queue_[gen.gen(PROC_MESSAGE_THREAD_NUM)].push(RWer_ptr_vec);
-            else RWer_queue_[gen.gen(PROC_MESSAGE_CACHE_THREAD_NUM)].push(RWer_ptr_vec);
+        // まとめて RWer キューに push
+        RWer_queue_[executor_id != INF ? executor_id : gen.gen(executor_thread_num_)].push(RWer_ptr_vec);
 
-        } else if ((ver_id & MASK_MESSEGEID) == CACHE_GEN) { // キャッシュ生成用の RW 実行
+    } else if ((ver_id & MASK_MESSEGEID) == CACHE_GEN) { // キャッシュ生成用の RW 実行
 
-            startmanagerip_ = *(uint32_t*)(message + sizeof(ver_id));
-            MAIN_EX = false;
-            CHECK_RWER_FLAG = true;
-            CACHE_GEN_FLAG = true;
-            start_cache_flag_.writeReady(true);
+        startmanagerip_ = *(uint32_t*)(message + sizeof(ver_id));
+        MAIN_EX = false;
+        CHECK_RWER_FLAG = true;
+        CACHE_GEN_FLAG = true;
+        start_cache_flag_.writeReady(true);
 
-        } else if ((ver_id & MASK_MESSEGEID) == END_EXP) { // 実験結果を送信
+    } else if ((ver_id & MASK_MESSEGEID) == END_EXP) { // 実験結果を送信
 
-            sendToStartManager();
+        // このサーバに残した経路のセグメントを書き出す
+        if (PATH_SEGMENT_MODE == PATH_SEGMENT_LOCAL) {
+            segment_store_.write(std::string(PATH_SEGMENT_OUTPUT_DIR) + "segments_" + std::to_string(hostid_) + ".bin");
+        }
 
-        } else {
-            perror("wrong id");
-            exit(1); // 異常終了
+        // 書き込み中の経路のファイルを書き込み済みの大きさに切り詰める
+        if (WALK_OUTPUT_FLAG) walk_output_.close();
+
+        // 起点頂点毎の PPR の推定値を書き出す
+        if (PPR_COUNT_MODE != PPR_COUNT_OFF) {
+            ppr_.write(std::string(PPR_OUTPUT_DIR) + "ppr_" + std::to_string(hostid_) + ".txt", PPR_TOP_K);
         }
-    }
-}
 
-inline int RandomWalkSystemWorker::createUdpServerSocket(const uint16_t& port_num) {
-    // ソケットの生成
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    // debug
-    // std::cout << sockfd << std::endl;
-    if (sockfd < 0) { // エラー処理
-        perror("socket");
+        sendToStartManager();
+
+    } else {
+        perror("wrong id");
         exit(1); // 異常終了
     }
+}
 
-    // アドレスの生成
-    struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
-    memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
-    addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-    addr.sin_port = htons(port_num); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
-    addr.sin_addr.s_addr = hostip_; // IPアドレス, inet_addr()関数はアドレスの翻訳
+inline void RandomWalkSystemWorker::checkRetransmit() {
+    while (1) {
+        std::this_thread::sleep_for(std::chrono::microseconds(RETRANSMIT_CHECK_US));
 
-    // ソケット登録
-    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) { // ソケット, アドレスポインタ, アドレスサイズ // エラー処理
-        perror("bind");
-        exit(1); // 異常終了
+        for (host_id_t i = 0; i < SEND_QUEUE_NUM; i++) {
+            if (i == hostid_) continue;
+            if (reliable_.needsService(i)) send_queue_[i].notify();
+        }
     }
-
-    return sockfd;
 }
 
 inline int RandomWalkSystemWorker::createTcpServerSocket(const uint16_t& port_num) {
@@ -766,6 +1171,13 @@ inline int RandomWalkSystemWorker::createTcpServerSocket(const uint16_t& port_nu
     addr.sin_port = htons(port_num); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
     addr.sin_addr.s_addr = hostip_; // IPアドレス, inet_addr()関数はアドレスの翻訳
 
+    // ジョブ毎に作り直すので TIME_WAIT 中でも bind できるようにする
+    int yes = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes)) < 0) {
+        perror("ERROR on setsockopt");
+        exit(1);
+    }
+
     // ソケット登録
     if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) { // ソケット, アドレスポインタ, アドレスサイズ // エラー処理
         perror("bind");
@@ -790,24 +1202,42 @@ inline void RandomWalkSystemWorker::sendToStartManager() {
     // start manager に送信するのは, RW 終了数, 実行時間
     uint32_t end_count = RW_manager_.getEndcnt();
     double execution_time = RW_manager_.getExecutionTime();
-    std::cout << "end_count : " << end_count << std::endl;
-    std::cout << "execution_time : " << execution_time << std::endl;
+    RW_manager_.printStats();
 
     // debug
-    std::cout << "RWer_queue_size: " << PROC_MESSAGE_THREAD_NUM << std::endl;
-    for (int i = 0; i < PROC_MESSAGE_THREAD_NUM; i++) {
+    std::cout << "RWer_queue_size: " << executor_thread_num_ << std::endl;
+    for (uint32_t i = 0; i < executor_thread_num_; i++) {
         std::cout << i << ": " << RWer_queue_[i].getSize() << std::endl;
     }
     std::cout << "send_queue_size: " << SEND_QUEUE_NUM << std::endl;
     for (int i = 0; i < SEND_QUEUE_NUM; i++) {
         std::cout << i << ": " << send_queue_[i].getSize() << std::endl;
     }
+    uint32_t re_send_count = reliable_.getRetransmitCount();
     std::cout << "re_send_count: " << re_send_count << std::endl;
+    std::cout << "credit timeouts: " << flow_control_.getCreditTimeoutCount() << ", discarded credit: " << flow_control_.getDiscardedCredit() << std::endl;
+    if (WALK_OUTPUT_FLAG) std::cout << "written walks: " << walk_output_.getWalkNum() << std::endl;
+    std::cout << "packet buffer pool hit: " << getPacketBufferPool().getHitCount() << ", miss: " << getPacketBufferPool().getMissCount() << ", in use: " << getPacketBufferPool().getInUseCount() << std::endl;
     std::cout << "my edges num: " << graph_.getEdgeCount() << std::endl;
     std::cout << "cache edges num: " << cache_.getEdgeCount() << std::endl;
     std::cout << "all edges: " << graph_.getEdgeCount() + cache_.getEdgeCount() << std::endl;
+    cache_.printStats();
+    std::cout << "cache learn RWers: " << cache_learner_.getLearnedRWerNum() << ", dropped: " << cache_learner_.getDroppedRWerNum()
+              << " (ratio: " << cache_learner_.getDropRatio() << "), entries: " << cache_learner_.getEntryNum() << ", duplicates: " << cache_learner_.getDuplicateNum() << std::endl;
+    std::cout << "steps local: " << metrics_.get(METRIC_LOCAL_STEP) << ", cache: " << metrics_.get(METRIC_CACHE_STEP) << ", remote hops: " << metrics_.get(METRIC_REMOTE_HOP) << std::endl;
+    std::cout << "packets sent: " << metrics_.get(METRIC_PACKET_SENT) << " (" << metrics_.get(METRIC_BYTE_SENT) << " Byte), resent: " << metrics_.get(METRIC_PACKET_RESENT)
+              << ", received: " << metrics_.get(METRIC_PACKET_RECEIVED) << " (" << metrics_.get(METRIC_BYTE_RECEIVED) << " Byte)" << std::endl;
 
     std::this_thread::sleep_for(std::chrono::seconds(5));
+
+    // 待っている間に credit は返りきるはずなので, 残っていれば返し忘れ
+    int64_t in_flight = 0;
+    for (host_id_t dst = 0; dst < SEND_QUEUE_NUM; dst++) {
+        if (dst == hostid_) continue;
+        std::cout << "in_flight " << dst << ": " << flow_control_.getInFlight(dst) << std::endl;
+        in_flight += flow_control_.getInFlight(dst);
+    }
+
     {
         // ソケットの生成
         int sockfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -826,24 +1256,79 @@ inline void RandomWalkSystemWorker::sendToStartManager() {
         // ソケット接続要求
         connect(sockfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)); // ソケット, アドレスポインタ, アドレスサイズ
 
-        // データ送信 (hostip: 4B, end_count: 4B, all_execution_time: 8B)
+        // データ送信 (hostip: 4B, end_count: 4B, all_execution_time: 8B, re_send_count: 4B, in_flight: 8B)
         char message[MESSAGE_MAX_LENGTH_SEND];
         int idx = 0;
         memcpy(message + idx, &hostip_, sizeof(uint32_t)); idx += sizeof(uint32_t);
         memcpy(message + idx, &end_count, sizeof(uint32_t)); idx += sizeof(uint32_t);
         memcpy(message + idx, &execution_time, sizeof(double)); idx += sizeof(double);
         memcpy(message + idx, &re_send_count, sizeof(uint32_t)); idx += sizeof(uint32_t);
+        memcpy(message + idx, &in_flight, sizeof(int64_t)); idx += sizeof(int64_t);
         send(sockfd, message, sizeof(message), 0); // 送信
 
         // ソケットクローズ
         close(sockfd); 
     }
 
-    // // 再送用スレッドを停止させる
-    // for (std::thread& th : re_send_threads_) {
-    //     th.join();
-    // }
-    // re_send_threads_.clear();
-
 }
 
+
+inline void RandomWalkSystemWorker::writeMetrics(std::ostream& os) {
+    std::string host = "host=\"" + std::to_string(hostid_) + "\"";
+
+    os << "# HELP rw_receive_queue_depth RWers waiting in each executor queue.\n";
+    os << "# TYPE rw_receive_queue_depth gauge\n";
+    for (uint32_t i = 0; i < executor_thread_num_; i++) {
+        os << "rw_receive_queue_depth{" << host << ",executor=\"" << i << "\"} " << RWer_queue_[i].getSize() << "\n";
+    }
+
+    os << "# HELP rw_send_queue_depth RWers waiting to be sent to each host.\n";
+    os << "# TYPE rw_send_queue_depth gauge\n";
+    for (uint32_t i = 0; i < SEND_QUEUE_NUM; i++) {
+        if (i == hostid_) continue;
+        os << "rw_send_queue_depth{" << host << ",dst=\"" << i << "\"} " << send_queue_[i].getSize() << "\n";
+    }
+    os << "# HELP rw_in_flight_rwers RWers sent to each host whose credit has not been returned yet.\n";
+    os << "# TYPE rw_in_flight_rwers gauge\n";
+    for (uint32_t i = 0; i < SEND_QUEUE_NUM; i++) {
+        if (i == hostid_) continue;
+        os << "rw_in_flight_rwers{" << host << ",dst=\"" << i << "\"} " << flow_control_.getInFlight(i) << "\n";
+    }
+
+    os << "# HELP rw_cache_hits_total Cache lookups that found the degree or neighbour index.\n";
+    os << "# TYPE rw_cache_hits_total counter\n";
+    os << "rw_cache_hits_total{" << host << ",kind=\"degree\"} " << cache_.getTotalDegreeHitCount() << "\n";
+    os << "rw_cache_hits_total{" << host << ",kind=\"index\"} " << cache_.getTotalIndexHitCount() << "\n";
+    os << "# HELP rw_cache_misses_total Cache lookups that did not find the degree or neighbour index.\n";
+    os << "# TYPE rw_cache_misses_total counter\n";
+    os << "rw_cache_misses_total{" << host << ",kind=\"degree\"} " << cache_.getTotalDegreeMissCount() << "\n";
+    os << "rw_cache_misses_total{" << host << ",kind=\"index\"} " << cache_.getTotalIndexMissCount() << "\n";
+
+    // 実験毎の hit 率は gauge (START_EXP で数え直す)
+    uint64_t degree_lookup = cache_.getDegreeLookupCount();
+    uint64_t degree_hit = cache_.getDegreeHitCount();
+    uint64_t index_lookup = cache_.getIndexLookupCount();
+    uint64_t index_hit = cache_.getIndexHitCount();
+    os << "# HELP rw_cache_hit_ratio Cache hit ratio since the current experiment started.\n";
+    os << "# TYPE rw_cache_hit_ratio gauge\n";
+    os << "rw_cache_hit_ratio{" << host << ",kind=\"degree\"} " << (degree_lookup == 0 ? 0.0 : (double)std::min(degree_hit, degree_lookup) / degree_lookup) << "\n";
+    os << "rw_cache_hit_ratio{" << host << ",kind=\"index\"} " << (index_lookup == 0 ? 0.0 : (double)std::min(index_hit, index_lookup) / index_lookup) << "\n";
+
+    os << "# HELP rw_credit_timeouts_total Times unreturned credit was discarded after CREDIT_TIMEOUT_MS.\n";
+    os << "# TYPE rw_credit_timeouts_total counter\n";
+    os << "rw_credit_timeouts_total{" << host << "} " << flow_control_.getCreditTimeoutCount() << "\n";
+    os << "# HELP rw_credit_discarded_total Credit discarded by credit timeouts.\n";
+    os << "# TYPE rw_credit_discarded_total counter\n";
+    os << "rw_credit_discarded_total{" << host << "} " << flow_control_.getDiscardedCredit() << "\n";
+
+    os << "# HELP rw_cache_learn_rwers_total RWers whose paths the cache learner inserted.\n";
+    os << "# TYPE rw_cache_learn_rwers_total counter\n";
+    os << "rw_cache_learn_rwers_total{" << host << "} " << cache_learner_.getLearnedRWerNum() << "\n";
+    os << "# HELP rw_cache_learn_dropped_total RWers dropped because the cache learner queue was full.\n";
+    os << "# TYPE rw_cache_learn_dropped_total counter\n";
+    os << "rw_cache_learn_dropped_total{" << host << "} " << cache_learner_.getDroppedRWerNum() << "\n";
+
+    os << "# HELP rw_walkers_completed RWers started on this host that have returned, in the current run.\n";
+    os << "# TYPE rw_walkers_completed gauge\n";
+    os << "rw_walkers_completed{" << host << "} " << RW_manager_.getEndcnt() << "\n";
+}
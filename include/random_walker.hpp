@@ -7,7 +7,9 @@
 #include <iostream>
 #include <bitset>
 #include <cstring>
+#include <algorithm>
 
+#include "type.hpp"
 #include "../config/param.hpp"
 
 //////////////////////////////////////////////////////////////////////////
@@ -17,6 +19,7 @@
 // ver_id_ (8bit): 
 // バージョン: 4bit, メッセージID: 4bit
 // メッセージ ID について, 0 -> 生存した RWer, 1 -> 終了した RWer, 2 -> 複数の RWer が入っているパケット, 3 -> 実験開始の合図, 4 -> 実験終了の合図
+// (RWer 以外のレコードも同じ形で運ぶ, param.hpp の message_id_ の値)
 // 
 // flag_ (8bit): 
 // 一歩前で通信が発生したか: 1bit, next_index に値が入っているか: 1bit, 全体を通して通信が発生したか: 1bit, あまり : 5bit
@@ -32,15 +35,22 @@
 // path_length_at_current_host_ (16bit):
 // RWer の現在の同一ホスト内の経路長
 //
-// reserved_ (32bit):
-// 予備
+// received_from_ (16bit):
+// 直前に RWer を送ってきたサーバの HostID (受信時に入れる, credit 返却用)
+//
+// segment_count_ (16bit):
+// 経路を切り離して途中のサーバに残してきた回数 (PATH_SEGMENT_MODE, 次に切り離すセグメントの番号)
 // 
 // next_index_ (64bit):
 // 通信が発生した時の次の遷移先 index
 //
-// path_ (64bit の可変長配列):
+// start_time_ (64bit):
+// 起点サーバでの生成時刻 (起点サーバの RandomWalkerManager の時刻の起点からの µs, latency の計測用)
+//
+// path_ (path_word_t (64bit, VERTEX_ID_32 なら 32bit) の可変長配列):
 // 経路情報
-// {HostID(48bit) + 同HostID内の経路長(15bit) + 通信が発生したか(1bit)}, {頂点(64bit), 次数(64bit), u->v の index(64bit), v->u の index(64bit), 頂点, 次数, ...}, {HostID(48bit) + 同HostID内の経路長(15bit) + 通信が発生したか(1bit)}, ...
+// {HostID(48bit, 32bit なら 16bit) + 同HostID内の経路長(15bit) + 通信が発生したか(1bit)}, {頂点(64bit), 次数(64bit), u->v の index(64bit), v->u の index(64bit), 頂点, 次数, ...}, {HostID(48bit) + 同HostID内の経路長(15bit) + 通信が発生したか(1bit)}, ...
+// 経路を切り離した後は, 先頭に起点サーバの {HostID + 経路長 0} を残し, 一歩前と現在の頂点だけを持つ
 
 
 struct RandomWalker {
@@ -50,8 +60,13 @@ public :
     // コンストラクタ
     RandomWalker();
     RandomWalker(const uint64_t& source_node, const uint64_t& node_degree, const uint32_t& RWer_id, const uint64_t& HostID, const uint32_t& RWer_life);
-    RandomWalker(const char* message); // メッセージから RWer 復元
+    RandomWalker(const char* message); // メッセージから RWer 復元 (isValidMessage で確かめてから)
     RandomWalker(const uint32_t dummy); // ダミー RWer
+    RandomWalker(const uint32_t& RWer_id, const uint16_t& segment_index, const std::vector<uint64_t>& segment); // 起点サーバに送る経路のセグメント
+    RandomWalker(const uint8_t& message_id, const std::vector<uint64_t>& words); // RWer 以外のレコード (path_ に words を入れて運ぶ)
+
+    // message の先頭 length Byte に RWer 1 つ分が収まっていて, 大きさが正しいか
+    static bool isValidMessage(const char* message, const uint32_t& length);
 
     // メッセージIDを入れる
     void setMessageID(const uint8_t& id);
@@ -122,6 +137,18 @@ public :
     // 起点サーバの HostIDを入手
     uint64_t getHostID();
 
+    // 直前に RWer を送ってきたサーバの HostID を入力
+    void setReceivedFrom(const uint32_t& host_id);
+
+    // 直前に RWer を送ってきたサーバの HostID を入手
+    uint32_t getReceivedFrom();
+
+    // 起点サーバでの生成時刻 (µs) を入力
+    void setStartTime(const uint64_t& start_time);
+
+    // 起点サーバでの生成時刻 (µs) を入手
+    uint64_t getStartTime();
+
     // RWer の現在頂点を更新
     void updateRWer(const uint64_t& next_node, const uint64_t& host_id, const uint64_t& node_degree, const uint64_t& index_uv, const uint64_t& index_vu);
 
@@ -140,21 +167,48 @@ public :
     // 引数の path に path_ の情報を書き込む (各頂点にホストIDもつける), path_length に全経路長を書きこむ
     void getPath(uint16_t& path_length, std::vector<uint64_t>& path);
 
+    // 切り離して途中のサーバに残してきた経路のセグメント数を入手
+    uint16_t getSegmentCount();
+
+    // 一歩前と現在の頂点より前の経路をセグメントとして segment に切り離す (切り離すほど長くなければ false)
+    bool cutSegment(std::vector<uint64_t>& segment);
+
+    // path_ のうち使っている部分を words にコピー
+    void getPathWords(std::vector<uint64_t>& words);
+
+    // 切り離したセグメント (番号順) を path_ の前に戻して全経路にする
+    void restorePath(const std::vector<std::vector<uint64_t>>& segments);
+
+    // path_ の {HostID + 同HostID内の経路長 + 通信が発生したか} の経路長を length に置き換えたものを返す
+    uint64_t setLengthInPath(const uint64_t& data, const uint16_t& length);
+
+    // path_ の頂点数 (全経路長) を入手
+    uint32_t getNodeNum();
+
+    // path_ の頂点だけを順に nodes に書き込む (nodes は getNodeNum() 個分)
+    void writeNodes(uint64_t* nodes);
+
     // デバッグ用, RWer の出力
     void printRWer();
 
 
 private :
 
+    // path_ より前 (ver_id_ から start_time_ まで) の大きさと path_ の 1 語の大きさ (Byte)
+    static constexpr uint32_t HEADER_SIZE = 8 + 8 + 8 + 8;
+    static constexpr uint32_t PATH_WORD_SIZE = sizeof(path_word_t);
+
     uint8_t ver_id_ = 0; 
     uint8_t flag_ = 0;
     uint16_t RWer_size_ = 0;
     uint32_t RWer_id_ = 0;    
     uint16_t RWer_life_ = 0; 
     uint16_t path_length_at_current_host_ = 0; 
-    uint32_t reserved_ = 0; 
+    uint16_t received_from_ = 0; 
+    uint16_t segment_count_ = 0;
     uint64_t next_index_ = 0;
-    std::vector<uint64_t> path_;
+    uint64_t start_time_ = 0;
+    std::vector<path_word_t> path_;
 
 };
 
@@ -172,16 +226,16 @@ inline RandomWalker::RandomWalker(const uint64_t& source_node, const uint64_t& n
         exit(1); // 異常終了
     }
     setMessageID(ALIVE);
-    RWer_size_ = 8 + 8 + 8;
+    RWer_size_ = HEADER_SIZE;
     path_length_at_current_host_ = 1;
     RWer_id_ = RWer_id;
     RWer_life_ = RWer_life;
     path_.resize(getRequiredPathSize());
-    path_[0] = (HostID<<16) + (1<<1) + 1; RWer_size_ += 8; // HostID, 同HostID内の経路長入力 (終了した後最初のホストには送信するので, 送信フラグを入れておく)
-    path_[1] = source_node; RWer_size_ += 8;
-    path_[2] = node_degree; RWer_size_ += 8;
-    path_[3] = 0; RWer_size_ += 8;
-    path_[4] = 0; RWer_size_ += 8;
+    path_[0] = (HostID<<16) + (1<<1) + 1; RWer_size_ += PATH_WORD_SIZE; // HostID, 同HostID内の経路長入力 (終了した後最初のホストには送信するので, 送信フラグを入れておく)
+    path_[1] = source_node; RWer_size_ += PATH_WORD_SIZE;
+    path_[2] = node_degree; RWer_size_ += PATH_WORD_SIZE;
+    path_[3] = 0; RWer_size_ += PATH_WORD_SIZE;
+    path_[4] = 0; RWer_size_ += PATH_WORD_SIZE;
 
     decrementRWerLife();
 }
@@ -194,23 +248,44 @@ inline RandomWalker::RandomWalker(const char* message) {
     RWer_id_ = *(uint32_t*)(message + idx); idx += 4;
     RWer_life_ = *(uint16_t*)(message + idx); idx += 2;
     path_length_at_current_host_ = *(uint16_t*)(message + idx); idx += 2;
-    reserved_ = *(uint32_t*)(message + idx); idx += 4;
+    received_from_ = *(uint16_t*)(message + idx); idx += 2;
+    segment_count_ = *(uint16_t*)(message + idx); idx += 2;
     next_index_ = *(uint64_t*)(message + idx); idx += 8;
+    start_time_ = *(uint64_t*)(message + idx); idx += 8;
 
     // debug
     // std::cout << "getRequiredPathSize() = " << getRequiredPathSize() << std::endl;
 
     path_.resize(getRequiredPathSize());
-    int last_idx = getNextIndexOfPath() - 1;
-    for (int i = 0; i <= last_idx; i++) {
-        path_[i] = *(uint64_t*)(message + idx); idx += 8;
-    }
+    memcpy(path_.data(), message + idx, getNextIndexOfPath() * PATH_WORD_SIZE);
+}
+
+inline bool RandomWalker::isValidMessage(const char* message, const uint32_t& length) {
+    if (length < HEADER_SIZE) return false;
+
+    uint16_t RWer_size;
+    memcpy(&RWer_size, message + 2, sizeof(uint16_t));
+    return RWer_size >= HEADER_SIZE && RWer_size <= length && (RWer_size - HEADER_SIZE) % PATH_WORD_SIZE == 0;
 }
 
 inline RandomWalker::RandomWalker(const uint32_t dummy) {
     setMessageID(DUMMY);
 }
 
+inline RandomWalker::RandomWalker(const uint32_t& RWer_id, const uint16_t& segment_index, const std::vector<uint64_t>& segment) {
+    setMessageID(PATH_SEGMENT);
+    RWer_id_ = RWer_id;
+    segment_count_ = segment_index;
+    RWer_size_ = HEADER_SIZE + segment.size() * PATH_WORD_SIZE;
+    path_.assign(segment.begin(), segment.end());
+}
+
+inline RandomWalker::RandomWalker(const uint8_t& message_id, const std::vector<uint64_t>& words) {
+    setMessageID(message_id);
+    RWer_size_ = HEADER_SIZE + words.size() * PATH_WORD_SIZE;
+    path_.assign(words.begin(), words.end());
+}
+
 inline void RandomWalker::setMessageID(const uint8_t& id) {
     ver_id_ &= ~MASK_MESSEGEID;
     ver_id_ |= id;
@@ -283,7 +358,7 @@ inline void RandomWalker::decrementRWerLife() {
 
 inline uint32_t RandomWalker::getNextIndexOfPath() {
     // RWer_size_ から逆算
-    return (RWer_size_ - 8 - 8 - 8) / 8;
+    return (RWer_size_ - HEADER_SIZE) / PATH_WORD_SIZE;
 }
 
 inline uint32_t RandomWalker::getCurrentIndexOfPath() {
@@ -330,6 +405,22 @@ inline uint64_t RandomWalker::getHostID() {
     return (path_[0]>>16);
 }
 
+inline void RandomWalker::setReceivedFrom(const uint32_t& host_id) {
+    received_from_ = host_id;
+}
+
+inline uint32_t RandomWalker::getReceivedFrom() {
+    return received_from_;
+}
+
+inline void RandomWalker::setStartTime(const uint64_t& start_time) {
+    start_time_ = start_time;
+}
+
+inline uint64_t RandomWalker::getStartTime() {
+    return start_time_;
+}
+
 inline void RandomWalker::updateRWer(const uint64_t& next_node, const uint64_t& host_id, const uint64_t& node_degree, const uint64_t& index_uv, const uint64_t& index_vu) {
     uint32_t start_index = getNextIndexOfPath();
 
@@ -342,7 +433,7 @@ inline void RandomWalker::updateRWer(const uint64_t& next_node, const uint64_t&
     } 
 
     if (getCurrentNodeHostID() != host_id) { // 次の頂点のホスト ID が現在と異なっていたら path_ 上にホスト情報を追加
-        path_[start_index++] = (host_id<<16); RWer_size_ += 8; // HostID 入力
+        path_[start_index++] = (host_id<<16); RWer_size_ += PATH_WORD_SIZE; // HostID 入力
         path_length_at_current_host_ = 0;
     }
     
@@ -350,10 +441,10 @@ inline void RandomWalker::updateRWer(const uint64_t& next_node, const uint64_t&
     // debug
     // std::cout << "getCurrentNodeHostID() = " << getCurrentNodeHostID() << std::endl;
 
-    path_[start_index++] = next_node; RWer_size_ += 8;
-    path_[start_index++] = node_degree; RWer_size_ += 8;
-    path_[start_index++] = index_uv; RWer_size_ += 8;
-    path_[start_index++] = index_vu; RWer_size_ += 8;
+    path_[start_index++] = next_node; RWer_size_ += PATH_WORD_SIZE;
+    path_[start_index++] = node_degree; RWer_size_ += PATH_WORD_SIZE;
+    path_[start_index++] = index_uv; RWer_size_ += PATH_WORD_SIZE;
+    path_[start_index++] = index_vu; RWer_size_ += PATH_WORD_SIZE;
     
     path_length_at_current_host_++;
     path_[getCurrentHostIndex()] += (1<<1);
@@ -362,7 +453,7 @@ inline void RandomWalker::updateRWer(const uint64_t& next_node, const uint64_t&
 }
 
 inline uint16_t RandomWalker::getRequiredPathSize() {
-    return (RWer_size_ - 8 - 8 - 8)/8 + RWer_life_*5;
+    return (RWer_size_ - HEADER_SIZE) / PATH_WORD_SIZE + RWer_life_*5;
 }
 
 inline void RandomWalker::endRWer() {
@@ -377,14 +468,12 @@ inline void RandomWalker::writeMessage(char* message) {
     memcpy(message + idx, &RWer_id_, sizeof(uint32_t)); idx += sizeof(uint32_t);
     memcpy(message + idx, &RWer_life_, sizeof(uint16_t)); idx += sizeof(uint16_t);
     memcpy(message + idx, &path_length_at_current_host_, sizeof(uint16_t)); idx += sizeof(uint16_t);
-    memcpy(message + idx, &reserved_, sizeof(uint32_t)); idx += sizeof(uint32_t);
+    memcpy(message + idx, &received_from_, sizeof(uint16_t)); idx += sizeof(uint16_t);
+    memcpy(message + idx, &segment_count_, sizeof(uint16_t)); idx += sizeof(uint16_t);
     memcpy(message + idx, &next_index_, sizeof(uint64_t)); idx += sizeof(uint64_t);
+    memcpy(message + idx, &start_time_, sizeof(uint64_t)); idx += sizeof(uint64_t);
     
-    int i = 0;
-    while (idx < RWer_size_) {
-        memcpy(message + idx, &path_[i], sizeof(uint64_t)); idx += sizeof(uint64_t);
-        i++;
-    }
+    memcpy(message + idx, path_.data(), RWer_size_ - idx);
 }
 
 inline void RandomWalker::getHostIDAndLengthInPath(const uint64_t& data, uint64_t& host_id, uint16_t& length) {
@@ -395,7 +484,7 @@ inline void RandomWalker::getHostIDAndLengthInPath(const uint64_t& data, uint64_
 inline void RandomWalker::getPath(uint16_t& path_length, std::vector<uint64_t>& path) {
     // path: (頂点, ホストID, 次数, indexuv, indexvu), (), (), ... のようにする
 
-    uint16_t path__length = (RWer_size_ - 8 - 8 - 8) / 8; // path_ の長さ
+    uint16_t path__length = (RWer_size_ - HEADER_SIZE) / PATH_WORD_SIZE; // path_ の長さ
     int idx = 0;
     while (idx < path__length) {
         // HostID, 同一ホスト内の歩長を抜き出す
@@ -412,6 +501,115 @@ inline void RandomWalker::getPath(uint16_t& path_length, std::vector<uint64_t>&
     }
 }
 
+inline uint16_t RandomWalker::getSegmentCount() {
+    return segment_count_;
+}
+
+inline bool RandomWalker::cutSegment(std::vector<uint64_t>& segment) {
+    // 各頂点の path_ 上の位置と, その頂点のホスト情報の位置
+    uint32_t path__length = getNextIndexOfPath();
+    std::vector<uint32_t> node_index, host_index;
+    uint32_t idx = 0;
+    while (idx < path__length) {
+        uint64_t host_id; uint16_t length;
+        getHostIDAndLengthInPath(path_[idx], host_id, length);
+        uint32_t current_host_index = idx++;
+        for (int i = 0; i < length; i++) {
+            node_index.push_back(idx);
+            host_index.push_back(current_host_index);
+            idx += 4;
+        }
+    }
+
+    // 一歩前と現在の頂点は残す (getPrevNodeID, setPrevIndex に使う)
+    uint32_t node_num = node_index.size();
+    if (node_num <= 2) return false;
+    uint32_t cut_num = node_num - 2;
+
+    // 前から cut_num 頂点分をホスト情報ごと切り離す
+    segment.clear();
+    uint32_t node_count = 0;
+    idx = 0;
+    while (idx < path__length && node_count < cut_num) {
+        uint64_t host_id; uint16_t length;
+        getHostIDAndLengthInPath(path_[idx], host_id, length);
+        uint16_t cut_length = std::min<uint32_t>(length, cut_num - node_count);
+        segment.push_back(setLengthInPath(path_[idx], cut_length));
+        segment.insert(segment.end(), path_.begin() + idx + 1, path_.begin() + idx + 1 + 4 * cut_length);
+        node_count += cut_length;
+        idx += 1 + 4 * length;
+    }
+
+    // 残す経路: 起点サーバ (getHostID 用), 一歩前と現在の頂点 (ホスト情報つき)
+    std::vector<uint64_t> rest;
+    rest.push_back(setLengthInPath(path_[0], 0));
+    uint32_t rest_host_index = 0;
+    for (uint32_t i = cut_num; i < node_num; i++) {
+        if (i == cut_num || host_index[i] != host_index[i - 1]) {
+            rest_host_index = rest.size();
+            rest.push_back(setLengthInPath(path_[host_index[i]], 0));
+        }
+        rest[rest_host_index] += (1<<1);
+        rest.insert(rest.end(), path_.begin() + node_index[i], path_.begin() + node_index[i] + 4);
+    }
+    uint64_t host_id;
+    getHostIDAndLengthInPath(rest[rest_host_index], host_id, path_length_at_current_host_);
+
+    RWer_size_ = HEADER_SIZE + rest.size() * PATH_WORD_SIZE;
+    path_.assign(rest.begin(), rest.end());
+    path_.resize(getRequiredPathSize());
+    segment_count_++;
+
+    return true;
+}
+
+inline void RandomWalker::getPathWords(std::vector<uint64_t>& words) {
+    words.assign(path_.begin(), path_.begin() + getNextIndexOfPath());
+}
+
+inline void RandomWalker::restorePath(const std::vector<std::vector<uint64_t>>& segments) {
+    std::vector<uint64_t> path;
+    for (const std::vector<uint64_t>& segment : segments) {
+        path.insert(path.end(), segment.begin(), segment.end());
+    }
+    path.insert(path.end(), path_.begin(), path_.begin() + getNextIndexOfPath());
+
+    RWer_size_ = HEADER_SIZE + path.size() * PATH_WORD_SIZE;
+    path_.assign(path.begin(), path.end());
+    path_.resize(getRequiredPathSize());
+    segment_count_ = 0;
+}
+
+inline uint64_t RandomWalker::setLengthInPath(const uint64_t& data, const uint16_t& length) {
+    return (data & ~((uint64_t)0x7FFF<<1)) | ((uint64_t)length<<1);
+}
+
+inline uint32_t RandomWalker::getNodeNum() {
+    uint32_t path__length = getNextIndexOfPath();
+    uint32_t node_num = 0;
+    uint32_t idx = 0;
+    while (idx < path__length) {
+        uint64_t host_id; uint16_t length;
+        getHostIDAndLengthInPath(path_[idx], host_id, length);
+        node_num += length;
+        idx += 1 + 4 * length;
+    }
+    return node_num;
+}
+
+inline void RandomWalker::writeNodes(uint64_t* nodes) {
+    uint32_t path__length = getNextIndexOfPath();
+    uint32_t idx = 0;
+    while (idx < path__length) {
+        uint64_t host_id; uint16_t length;
+        getHostIDAndLengthInPath(path_[idx++], host_id, length);
+        for (int i = 0; i < length; i++) {
+            *nodes++ = path_[idx];
+            idx += 4;
+        }
+    }
+}
+
 inline void RandomWalker::printRWer() {
     std::cout << "ver_id_: " << std::bitset<8>(ver_id_) << std::endl;
     std::cout << "flag_: " << std::bitset<8>(flag_) << std::endl;
@@ -419,9 +617,11 @@ inline void RandomWalker::printRWer() {
     std::cout << "RWer_id_: " << RWer_id_ << std::endl;
     std::cout << "RWer_life_: " << RWer_life_ << std::endl;
     std::cout << "path_length_at_current_host_: " << path_length_at_current_host_ << std::endl;
-    std::cout << "reserved_: " << reserved_ << std::endl;
+    std::cout << "received_from_: " << received_from_ << std::endl;
+    std::cout << "segment_count_: " << segment_count_ << std::endl;
     std::cout << "next_index_: " << next_index_ << std::endl;
-    uint16_t path__length = (RWer_size_ - 8 - 8 - 8) / 8;
+    std::cout << "start_time_: " << start_time_ << std::endl;
+    uint16_t path__length = (RWer_size_ - HEADER_SIZE) / PATH_WORD_SIZE;
     std::cout << "path__length: " << path__length << std::endl;
     int idx = 0;
     while (idx < path__length) {
@@ -432,7 +632,7 @@ inline void RandomWalker::printRWer() {
         printf("{%ld, %d, %d}, ", host_id, length, send_flag);
         for (int i = 0; i < length; i++) {
             // printf("(%ld, %ld, %ld, %ld), ", path_[idx++], path_[idx++], path_[idx++], path_[idx++]);
-            printf("(%ld, %ld, %ld, %ld), ", path_[idx+0], path_[idx+1], path_[idx+2], path_[idx+3]);
+            printf("(%ld, %ld, %ld, %ld), ", (long)path_[idx+0], (long)path_[idx+1], (long)path_[idx+2], (long)path_[idx+3]);
             idx += 4;
         }
         std::cout << std::endl;
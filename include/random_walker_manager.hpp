@@ -2,36 +2,39 @@
 
 #include <chrono>
 #include <algorithm>
-#include <mutex>
-#include <condition_variable>
 #include <iostream>
 #include <atomic>
 
 #include "../config/param.hpp"
 #include "type.hpp"
+#include "random_walker.hpp"
+#include "latency_histogram.hpp"
 
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+// このサーバが起点の RWer の終了数, 実行時間, 生成から終了までの時間 (latency) の集計
+//
+// RWer 毎の配列は持たず, 生成時刻は RWer 自身が持って回る (RandomWalker の start_time_, init からの µs を 64bit のまま)
+// 時刻の起点は init が書き換え, 他のスレッドが getTime で読むので atomic に持つ
+// 記録するスレッド毎に終了数, 最初の生成時刻, 最後の終了時刻, latency のヒストグラムを持ち, 読む時に全スレッド分を合わせる
+// (メモリは RWer 数によらず スレッド数 * LatencyHistogram の大きさ)
+
 class RandomWalkerManager {
 
 public :
-    
-    // RWer の総数を入力し, 配列を new
-    void init(const walker_id_t& RWer_all);
 
-    // RWer 生成時間の記録
-    void setStartTime(const walker_id_t& RWer_id);
+    ~RandomWalkerManager();
 
-    // RWer 終了時間の記録
-    void setEndTime(const walker_id_t& RWer_id);
+    // RWer の総数を入力し, 集計と時刻の起点をリセット
+    void init(const walker_id_t& RWer_all);
 
-    // RWer の歩数を入力
-    void setRWerLife(const walker_id_t& RWer_id, const uint16_t& life);
+    // RWer 生成時間の記録 (RWer に生成時刻を入れる)
+    void setStartTime(RandomWalker& RWer);
 
-    // node_id を入力
-    void setNodeId(const walker_id_t& RWer_id, const vertex_id_t& node_id);
+    // RWer 終了時間の記録
+    void setEndTime(RandomWalker& RWer);
 
     // RWer 終了数の入手
     walker_id_t getEndcnt();
@@ -39,18 +42,35 @@ public :
     // 実行時間 (s) を入手 (一番遅い RWer の終了時間 - 一番早く生成された RWer の生成時間)
     double getExecutionTime();
 
+    // 全スレッド分の latency (µs) のヒストグラムを latency に足す
+    void getLatency(LatencyHistogram& latency);
+
+    // 終了数, 実行時間, 終了した RWer/s, latency の p50, p99, p999 を出力
+    void printStats();
+
 private :
 
+    // 記録するスレッド毎の集計 (書き込むのはそのスレッドだけ)
+    struct alignas(64) ThreadStat {
+        LatencyHistogram latency_;
+        std::atomic<uint64_t> first_start_time_ = UINT64_MAX;
+        std::atomic<uint64_t> last_end_time_ = 0;
+    };
+
+    // 呼び出したスレッドの集計を入手 (初めてなら確保する)
+    ThreadStat& getThreadStat();
+
+    // init からの時間 (µs)
+    uint64_t getTime();
+
+    // steady_clock の µs
+    static int64_t nowUs();
+
     walker_id_t RWer_all_num_ = 0; // RWer の総数
-    bool* start_flag_per_RWer_id_ = nullptr; // RWer_id に対する終了判定
-    bool* end_flag_per_RWer_id_ = nullptr; // RWer_id に対する終了判定
-    std::chrono::system_clock::time_point* start_time_per_RWer_id_ = nullptr; // RWer_id に対する開始時刻
-    std::chrono::system_clock::time_point* end_time_per_RWer_id_ = nullptr; // RWer_id に対する終了時刻
-    uint16_t* RWer_life_per_RWer_id_ = nullptr; // RWer_id に対する設定歩数
-    vertex_id_t* node_id_per_RWer_id_ = nullptr; // RWer_id に対する node_id
+    std::atomic<int64_t> base_time_us_ = nowUs(); // 時刻の起点 (steady_clock の µs)
 
-    walker_id_t start_count_ = 0;
-    std::atomic<walker_id_t> end_count_ = 0;
+    std::atomic<ThreadStat*> thread_stats_[RW_MANAGER_MAX_THREAD_NUM] = {};
+    std::atomic<uint32_t> thread_stat_num_ = 0;
 
 };
 
@@ -58,58 +78,117 @@ private :
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+inline RandomWalkerManager::~RandomWalkerManager() {
+    for (std::atomic<ThreadStat*>& thread_stat : thread_stats_) delete thread_stat.load();
+}
+
 inline void RandomWalkerManager::init(const walker_id_t& RWer_all) {
     RWer_all_num_ = RWer_all;
-    start_flag_per_RWer_id_ = new bool[RWer_all];
-    end_flag_per_RWer_id_ = new bool[RWer_all];
-    start_time_per_RWer_id_ = new std::chrono::system_clock::time_point[RWer_all];
-    end_time_per_RWer_id_ = new std::chrono::system_clock::time_point[RWer_all];
-    RWer_life_per_RWer_id_ = new uint16_t[RWer_all];
-    node_id_per_RWer_id_ = new uint64_t[RWer_all];
+    base_time_us_.store(nowUs(), std::memory_order_relaxed);
+
+    uint32_t thread_stat_num = std::min(thread_stat_num_.load(), RW_MANAGER_MAX_THREAD_NUM);
+    for (uint32_t i = 0; i < thread_stat_num; i++) {
+        ThreadStat* thread_stat = thread_stats_[i].load();
+        if (thread_stat == nullptr) continue;
+        thread_stat->latency_.clear();
+        thread_stat->first_start_time_.store(UINT64_MAX, std::memory_order_relaxed);
+        thread_stat->last_end_time_.store(0, std::memory_order_relaxed);
+    }
 }
 
-inline void RandomWalkerManager::setStartTime(const walker_id_t& RWer_id) {
-    start_flag_per_RWer_id_[RWer_id] = true;
-    start_time_per_RWer_id_[RWer_id] = std::chrono::system_clock::now();
+inline void RandomWalkerManager::setStartTime(RandomWalker& RWer) {
+    uint64_t now = getTime();
+    RWer.setStartTime(now);
+
+    ThreadStat& thread_stat = getThreadStat();
+    if (now < thread_stat.first_start_time_.load(std::memory_order_relaxed)) thread_stat.first_start_time_.store(now, std::memory_order_relaxed);
 }
 
-inline void RandomWalkerManager::setEndTime(const walker_id_t& RWer_id) {
-    // debug
-    // std::cout << "SetEndTime" << std::endl;
+inline void RandomWalkerManager::setEndTime(RandomWalker& RWer) {
+    // cache 補充の実行の RWer (RWer_id が RWer の総数以上) は数えない
+    if (RWer.getRWerID() >= RWer_all_num_) return;
 
-    if (end_flag_per_RWer_id_[RWer_id] == true) {
-        return;
-    }
+    uint64_t now = getTime();
+    // init より前に生成された RWer (起点が進んで生成時刻の方が後になる) は 0 にする
+    uint64_t latency = now > RWer.getStartTime() ? now - RWer.getStartTime() : 0;
 
-    end_flag_per_RWer_id_[RWer_id] = true;
-    end_time_per_RWer_id_[RWer_id] = std::chrono::system_clock::now();
+    ThreadStat& thread_stat = getThreadStat();
+    thread_stat.latency_.record(latency);
+    if (now > thread_stat.last_end_time_.load(std::memory_order_relaxed)) thread_stat.last_end_time_.store(now, std::memory_order_relaxed);
+}
 
-    // addEndCount();
-    end_count_++;
+inline walker_id_t RandomWalkerManager::getEndcnt() {
+    uint64_t end_count = 0;
+    uint32_t thread_stat_num = std::min(thread_stat_num_.load(), RW_MANAGER_MAX_THREAD_NUM);
+    for (uint32_t i = 0; i < thread_stat_num; i++) {
+        ThreadStat* thread_stat = thread_stats_[i].load();
+        if (thread_stat != nullptr) end_count += thread_stat->latency_.getCount();
+    }
+    return end_count;
 }
 
-inline void RandomWalkerManager::setRWerLife(const walker_id_t& RWer_id, const uint16_t& life) {
-    RWer_life_per_RWer_id_[RWer_id] = life;
+inline double RandomWalkerManager::getExecutionTime() {
+    uint64_t min_start_time = UINT64_MAX;
+    uint64_t max_end_time = 0;
+    uint32_t thread_stat_num = std::min(thread_stat_num_.load(), RW_MANAGER_MAX_THREAD_NUM);
+    for (uint32_t i = 0; i < thread_stat_num; i++) {
+        ThreadStat* thread_stat = thread_stats_[i].load();
+        if (thread_stat == nullptr) continue;
+        min_start_time = std::min(min_start_time, thread_stat->first_start_time_.load(std::memory_order_relaxed));
+        max_end_time = std::max(max_end_time, thread_stat->last_end_time_.load(std::memory_order_relaxed));
+    }
+    if (max_end_time < min_start_time) return 0; // 1 つも終了していない
+
+    double execution_time = max_end_time - min_start_time;
+    execution_time /= 1000000;
+    return execution_time;
 }
 
-inline void RandomWalkerManager::setNodeId(const walker_id_t& RWer_id, const uint64_t& node_id) {
-    node_id_per_RWer_id_[RWer_id] = node_id;
+inline void RandomWalkerManager::getLatency(LatencyHistogram& latency) {
+    uint32_t thread_stat_num = std::min(thread_stat_num_.load(), RW_MANAGER_MAX_THREAD_NUM);
+    for (uint32_t i = 0; i < thread_stat_num; i++) {
+        ThreadStat* thread_stat = thread_stats_[i].load();
+        if (thread_stat != nullptr) latency.add(thread_stat->latency_);
+    }
 }
 
-inline walker_id_t RandomWalkerManager::getEndcnt() {
-    return end_count_;
+inline void RandomWalkerManager::printStats() {
+    LatencyHistogram latency;
+    getLatency(latency);
+    double execution_time = getExecutionTime();
+
+    std::cout << "end_count : " << latency.getCount() << std::endl;
+    std::cout << "execution_time : " << execution_time << std::endl;
+    std::cout << "RWers/s : " << (execution_time > 0 ? latency.getCount() / execution_time : 0) << std::endl;
+    std::cout << "latency (ms) p50: " << latency.getPercentile(0.5) / 1000.0
+              << ", p99: " << latency.getPercentile(0.99) / 1000.0
+              << ", p999: " << latency.getPercentile(0.999) / 1000.0
+              << ", max: " << latency.getMax() / 1000.0 << std::endl;
 }
 
-inline double RandomWalkerManager::getExecutionTime() {
-    std::chrono::system_clock::time_point min_start_time = start_time_per_RWer_id_[0];
-    std::chrono::system_clock::time_point max_end_time = start_time_per_RWer_id_[0];
-    for (int32_t id = 0; id < RWer_all_num_; id++) {
-        min_start_time = std::min(min_start_time, start_time_per_RWer_id_[id]);
-        if (end_flag_per_RWer_id_[id]) { // 終了しているもののみ
-            max_end_time = std::max(max_end_time, end_time_per_RWer_id_[id]);
+inline RandomWalkerManager::ThreadStat& RandomWalkerManager::getThreadStat() {
+    // 1 プロセスで複数の worker を動かすこともあるので, どの集計のものかも覚えておく
+    thread_local RandomWalkerManager* owner = nullptr;
+    thread_local ThreadStat* thread_stat = nullptr;
+
+    if (owner != this) {
+        uint32_t thread_stat_id = thread_stat_num_.fetch_add(1);
+        if (thread_stat_id >= RW_MANAGER_MAX_THREAD_NUM) {
+            std::cerr << "RandomWalkerManager: more than RW_MANAGER_MAX_THREAD_NUM (" << RW_MANAGER_MAX_THREAD_NUM << ") threads" << std::endl;
+            exit(1);
         }
+        owner = this;
+        thread_stat = new ThreadStat();
+        thread_stats_[thread_stat_id].store(thread_stat);
     }
-    double execution_time = std::chrono::duration_cast<std::chrono::milliseconds>(max_end_time - min_start_time).count();
-    execution_time /= 1000;
-    return execution_time;
-}
\ No newline at end of file
+    return *thread_stat;
+}
+
+inline uint64_t RandomWalkerManager::getTime() {
+    int64_t time = nowUs() - base_time_us_.load(std::memory_order_relaxed);
+    return time > 0 ? time : 0;
+}
+
+inline int64_t RandomWalkerManager::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
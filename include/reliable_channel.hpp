@@ -0,0 +1,272 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "type.hpp"
+#include "message_header.hpp"
+#include "buffer_pool.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// UDP 上の軽量な再送制御 (送信先 / 送信元毎)
+//
+// 送信側:
+// RWer か credit を運ぶメッセージには 1 から順に seq を振り, ack されるまで再送バッファに保持する
+// RETRANSMIT_TIMEOUT_US 経っても ack されなければ再送する
+// 再送バッファ (RETRANSMIT_BUFFER_NUM 個) が埋まったら空くまで新しいメッセージを作らない
+// 再送バッファの各メッセージはパケットバッファのプールから借り, ack されたら返す (送信中のメッセージ数分しかメモリを使わない)
+//
+// 受信側:
+// 送信元毎に受信済みの seq を記録し, 重複して届いたメッセージを捨てる
+// ack (次に欲しい seq) と sack (ack+1 ~ ack+64 の受信済みビット) は逆向きのメッセージのヘッダに乗せて返す
+// 逆向きの RWer がない場合は ack だけのメッセージ (seq 0, 再送しない) を送る
+//
+// 送信側の状態は送信スレッドと受信スレッド (ack の処理), 受信側の状態は受信スレッドと送信スレッド (ack の書き込み) が触るので mutex で守る
+
+class ReliableChannel {
+
+public :
+
+    // 初期化 (ホスト数, 再送するか)
+    // 再送しない場合も seq / ack による重複検出と再送バッファの窓は使う (TCP 等の取りこぼさない通信エンジン向け)
+    void init(const uint32_t& host_num, const bool& retransmit = true);
+
+    // 送信先 dst の再送バッファに空きがあるか
+    bool hasWindow(const host_id_t& dst);
+
+    // 送信先 dst への次のメッセージを組み立てる場所 (再送バッファの空き) を入手 (MESSAGE_MAX_LENGTH_SEND Byte)
+    char* getSlot(const host_id_t& dst);
+
+    // 次のメッセージに振る seq
+    uint32_t getNextSeq(const host_id_t& dst);
+
+    // getSlot() に組み立てたメッセージを再送バッファに登録 (seq を進める)
+    void commitSlot(const host_id_t& dst, const uint32_t& length);
+
+    // 送信先 dst への再送期限が切れたメッセージを 1 つずつ func(message, length) に渡す (渡した数を返す)
+    template <typename Func>
+    uint32_t forEachExpired(const host_id_t& dst, Func func);
+
+    // 相手 peer からの受信状況 (ack, sack) をヘッダに書き込む
+    void fillAck(const host_id_t& peer, MessageHeader& header);
+
+    // 相手 peer に返していない ack の数
+    uint32_t getAckOwed(const host_id_t& peer);
+
+    // 送信元 src から seq のメッセージが届いた (初めて届いたなら true, 重複なら false)
+    bool accept(const host_id_t& src, const uint32_t& seq);
+
+    // 送信先 dst から ack が返ってきた
+    void processAck(const host_id_t& dst, const uint32_t& ack, const uint64_t& sack);
+
+    // 相手 peer への送信スレッドを起こして再送 / ack をさせるべきか
+    bool needsService(const host_id_t& peer);
+
+    // 再送したメッセージ数
+    uint64_t getRetransmitCount();
+
+private :
+
+    // 現在時刻 (us)
+    int64_t nowUs();
+
+    // 送信先毎の再送バッファ
+    struct SendState {
+        std::mutex mtx_;
+        uint32_t base_ = 1; // 最も古い未 ack の seq
+        uint32_t next_seq_ = 1; // 次に振る seq
+        std::vector<BufferRef> buffer_; // RETRANSMIT_BUFFER_NUM 個 (組み立て中と ack 待ちのものだけ持つ)
+        std::vector<uint32_t> length_;
+        std::vector<uint8_t> acked_;
+        std::vector<int64_t> send_time_; // 最後に送った時刻 (us)
+    };
+
+    // 送信元毎の受信状況
+    struct RecvState {
+        std::mutex mtx_;
+        uint32_t next_expected_ = 1; // これより前の seq は全て受信済み
+        std::vector<uint8_t> received_; // next_expected_ 以降の受信済みフラグ (RETRANSMIT_BUFFER_NUM 個の循環)
+        uint32_t ack_owed_ = 0; // 返していない ack の数
+        int64_t first_owed_time_ = 0; // ack を返さなくなった時刻 (us)
+    };
+
+    uint32_t host_num_ = 0;
+    bool retransmit_ = true;
+    uint32_t mask_ = 0;
+    std::unique_ptr<SendState[]> send_state_;
+    std::unique_ptr<RecvState[]> recv_state_;
+    std::atomic<uint64_t> retransmit_count_ = 0;
+
+    static constexpr uint32_t SACK_BITS = 64;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void ReliableChannel::init(const uint32_t& host_num, const bool& retransmit) {
+    host_num_ = host_num;
+    retransmit_ = retransmit;
+    mask_ = RETRANSMIT_BUFFER_NUM - 1;
+    send_state_.reset(new SendState[host_num]);
+    recv_state_.reset(new RecvState[host_num]);
+    for (uint32_t i = 0; i < host_num; i++) {
+        send_state_[i].buffer_.resize(RETRANSMIT_BUFFER_NUM);
+        send_state_[i].length_.resize(RETRANSMIT_BUFFER_NUM);
+        send_state_[i].acked_.resize(RETRANSMIT_BUFFER_NUM, 1);
+        send_state_[i].send_time_.resize(RETRANSMIT_BUFFER_NUM);
+        recv_state_[i].received_.resize(RETRANSMIT_BUFFER_NUM, 0);
+    }
+}
+
+inline bool ReliableChannel::hasWindow(const host_id_t& dst) {
+    SendState& state = send_state_[dst];
+    std::lock_guard<std::mutex> lk(state.mtx_);
+    return state.next_seq_ - state.base_ < RETRANSMIT_BUFFER_NUM;
+}
+
+inline char* ReliableChannel::getSlot(const host_id_t& dst) {
+    // next_seq_ の場所は送信スレッドしか触らない (前に使っていたメッセージは hasWindow() の前に ack で返してある)
+    SendState& state = send_state_[dst];
+    BufferRef& buffer = state.buffer_[state.next_seq_ & mask_];
+    if (!buffer) buffer = getPacketBufferPool().acquire();
+    return buffer.data();
+}
+
+inline uint32_t ReliableChannel::getNextSeq(const host_id_t& dst) {
+    return send_state_[dst].next_seq_;
+}
+
+inline void ReliableChannel::commitSlot(const host_id_t& dst, const uint32_t& length) {
+    SendState& state = send_state_[dst];
+    std::lock_guard<std::mutex> lk(state.mtx_);
+    uint32_t slot = state.next_seq_ & mask_;
+    state.length_[slot] = length;
+    state.acked_[slot] = 0;
+    state.send_time_[slot] = nowUs();
+    state.next_seq_++;
+}
+
+template <typename Func>
+inline uint32_t ReliableChannel::forEachExpired(const host_id_t& dst, Func func) {
+    if (!retransmit_) return 0;
+
+    SendState& state = send_state_[dst];
+    std::vector<std::pair<BufferRef, uint32_t>> expired; // (メッセージ, 長さ)
+    {
+        std::lock_guard<std::mutex> lk(state.mtx_);
+        int64_t now = nowUs();
+        for (uint32_t seq = state.base_; seq != state.next_seq_; seq++) {
+            uint32_t slot = seq & mask_;
+            if (state.acked_[slot] || now - state.send_time_[slot] < RETRANSMIT_TIMEOUT_US) continue;
+            state.send_time_[slot] = now;
+            expired.push_back({state.buffer_[slot], state.length_[slot]});
+        }
+    }
+
+    // 参照を持っているので, ロックの外で渡している間に ack されてもバッファは返らない
+    for (const auto& [buffer, length] : expired) {
+        func(buffer.data(), length);
+    }
+    retransmit_count_.fetch_add(expired.size(), std::memory_order_relaxed);
+    return expired.size();
+}
+
+inline void ReliableChannel::fillAck(const host_id_t& peer, MessageHeader& header) {
+    RecvState& state = recv_state_[peer];
+    std::lock_guard<std::mutex> lk(state.mtx_);
+    header.ack_ = state.next_expected_;
+    header.sack_ = 0;
+    for (uint32_t i = 0; i < SACK_BITS && i + 1 < RETRANSMIT_BUFFER_NUM; i++) {
+        if (state.received_[(state.next_expected_ + 1 + i) & mask_]) header.sack_ |= (uint64_t)1 << i;
+    }
+    state.ack_owed_ = 0;
+}
+
+inline uint32_t ReliableChannel::getAckOwed(const host_id_t& peer) {
+    RecvState& state = recv_state_[peer];
+    std::lock_guard<std::mutex> lk(state.mtx_);
+    return state.ack_owed_;
+}
+
+inline bool ReliableChannel::accept(const host_id_t& src, const uint32_t& seq) {
+    if (seq == 0) return true; // ack だけのメッセージ
+
+    RecvState& state = recv_state_[src];
+    std::lock_guard<std::mutex> lk(state.mtx_);
+
+    // 窓の外 (送信側の再送バッファより先) は記録できないので捨てて再送を待つ
+    if (seq >= state.next_expected_ && seq - state.next_expected_ >= RETRANSMIT_BUFFER_NUM) return false;
+
+    // ack が届かずに再送されてきた場合も ack を返す
+    if (state.ack_owed_ == 0) state.first_owed_time_ = nowUs();
+    state.ack_owed_++;
+
+    // 重複
+    if (seq < state.next_expected_ || state.received_[seq & mask_]) return false;
+
+    state.received_[seq & mask_] = 1;
+    while (state.received_[state.next_expected_ & mask_]) {
+        state.received_[state.next_expected_ & mask_] = 0;
+        state.next_expected_++;
+    }
+    return true;
+}
+
+inline void ReliableChannel::processAck(const host_id_t& dst, const uint32_t& ack, const uint64_t& sack) {
+    SendState& state = send_state_[dst];
+    std::lock_guard<std::mutex> lk(state.mtx_);
+
+    // 送っていない seq の ack は無視
+    uint32_t ack_end = std::min(ack, state.next_seq_);
+    for (uint32_t seq = state.base_; seq < ack_end; seq++) {
+        state.acked_[seq & mask_] = 1;
+    }
+    for (uint32_t i = 0; i < SACK_BITS; i++) {
+        if (((sack >> i) & 1) == 0) continue;
+        uint32_t seq = ack + 1 + i;
+        if (seq >= state.base_ && seq < state.next_seq_) state.acked_[seq & mask_] = 1;
+    }
+
+    // 先頭から ack 済みの分を解放 (メッセージはプールに返す)
+    while (state.base_ != state.next_seq_ && state.acked_[state.base_ & mask_]) {
+        state.buffer_[state.base_ & mask_].reset();
+        state.base_++;
+    }
+}
+
+inline bool ReliableChannel::needsService(const host_id_t& peer) {
+    int64_t now = nowUs();
+    {
+        RecvState& state = recv_state_[peer];
+        std::lock_guard<std::mutex> lk(state.mtx_);
+        if (state.ack_owed_ > 0 && now - state.first_owed_time_ >= ACK_DELAY_US) return true;
+    }
+    if (retransmit_) {
+        SendState& state = send_state_[peer];
+        std::lock_guard<std::mutex> lk(state.mtx_);
+        for (uint32_t seq = state.base_; seq != state.next_seq_; seq++) {
+            uint32_t slot = seq & mask_;
+            if (!state.acked_[slot] && now - state.send_time_[slot] >= RETRANSMIT_TIMEOUT_US) return true;
+        }
+    }
+    return false;
+}
+
+inline uint64_t ReliableChannel::getRetransmitCount() {
+    return retransmit_count_.load(std::memory_order_relaxed);
+}
+
+inline int64_t ReliableChannel::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
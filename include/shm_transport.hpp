@@ -0,0 +1,423 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "type.hpp"
+#include "transport.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 同じマシンの worker 間の共有メモリ (/dev/shm) 上の SPSC リング
+// 送信元 1 プロセス (送信スレッド 1 つ) → 送信先 1 プロセス (受信スレッド 1 つ)
+// リング上のメッセージ: [長さ (4Byte)][メッセージ] を 8Byte 境界に揃えて並べる
+// 末尾に 1 メッセージ分の空きがなければ折り返しの印 (長さ WRAP) を書いて先頭に戻る
+// 送信先 (受信側) が作り, 送信元はそれを開く
+// 名前はユーザ毎 (/rwsw_<uid>_ring_<src>_<dst>), 生きているプロセスが作った同じ名前のリングがあれば作り直さずに失敗する
+// (同じマシンで同じユーザが 2 つ目の実行を始めても, 動いている実行のリングを消さない)
+
+class ShmRing {
+
+public :
+
+    // デストラクタ (作った側は名前も消す)
+    ~ShmRing();
+
+    // 受信側: name のリングを作る (前回の実行の残骸は消して作り直す, 生きているプロセスのものがあれば false)
+    bool create(const std::string& name);
+
+    // 送信側: name のリングを開く (受信側がまだ作っていなければ false)
+    bool open(const std::string& name);
+
+    // 送信側: 次のメッセージを書き込むバッファを入手 (空きができるまで待つ, MESSAGE_MAX_LENGTH_SEND Byte)
+    char* reserve();
+
+    // 送信側: reserve() に書き込んだメッセージを受信側に見せる
+    void publish(const uint32_t& length);
+
+    // 受信側: 次のメッセージを読む (なければ false, 読んだメッセージは release() まで有効)
+    bool read(Datagram& datagram);
+
+    // 受信側: read() で読んだ分を送信側に返す
+    void release();
+
+private :
+
+    struct Header {
+        alignas(64) std::atomic<uint64_t> head_; // 書き込み位置 (送信側だけが進める)
+        alignas(64) std::atomic<uint64_t> tail_; // 読み出し位置 (受信側だけが進める)
+        alignas(64) std::atomic<uint32_t> ready_; // 受信側が作り終えたか
+        pid_t owner_pid_; // 作ったプロセス (前回の実行の残骸を開かないように確かめる)
+    };
+
+    static constexpr uint32_t LENGTH_SIZE = sizeof(uint32_t);
+    static constexpr uint32_t WRAP = UINT32_MAX;
+    static constexpr uint64_t MAP_SIZE = 4096 + SHM_RING_SIZE; // ヘッダ (1 ページ) + リング
+    static constexpr uint64_t SLOT_SIZE = (LENGTH_SIZE + MESSAGE_MAX_LENGTH_SEND + 7) & ~7ULL;
+
+    Header* header_ = nullptr;
+    char* data_ = nullptr;
+    std::string name_;
+    bool owner_ = false;
+
+    uint64_t write_pos_ = 0; // 送信側: 次に書く位置 (publish で head_ に反映)
+    uint64_t read_pos_ = 0; // 受信側: 次に読む位置 (release で tail_ に反映)
+    char* reserved_ = nullptr; // 送信側: reserve() 済みで publish していない場所
+
+    bool map(const int& fd);
+
+    // 既にある name のリングを作ったプロセスが生きているか (作りかけ, 残骸なら false)
+    static bool isInUse(const std::string& name);
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 共有メモリのリングに直接書き込む (システムコールなし)
+
+class ShmTransportSender : public TransportSender {
+
+public :
+
+    // コンストラクタ (送信先へのリング, リングは ShmTransport が持っている)
+    ShmTransportSender(ShmRing* ring);
+
+    char* getBuffer() override;
+
+    void commit(const uint32_t& length) override;
+
+    void flush() override;
+
+private :
+
+    ShmRing* ring_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 同じマシンの全ての送信元からのリングを見回る
+// (読んだメッセージはリング上を指し, 次の receive() で送信側に返す)
+
+class ShmTransportReceiver : public TransportReceiver {
+
+public :
+
+    // コンストラクタ (受信するリング, リングは ShmTransport が持っている)
+    ShmTransportReceiver(const std::vector<ShmRing*>& rings);
+
+    uint32_t receive(std::vector<Datagram>& datagrams) override;
+
+private :
+
+    std::vector<ShmRing*> rings_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 同じ IP アドレスの worker へは共有メモリのリングで, それ以外へは base の通信エンジンで送る
+// 受信スレッドは base の受信スレッド + 共有メモリ用 1 つ (同じマシンに他の worker がいる場合)
+
+class ShmTransport : public Transport {
+
+public :
+
+    // コンストラクタ (同じマシン以外との通信エンジン)
+    ShmTransport(std::unique_ptr<Transport> base);
+
+    void init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) override;
+
+    bool isReliable() override;
+
+    std::unique_ptr<TransportSender> createSender(const host_id_t& dst_id) override;
+
+    uint32_t getReceiverNum() override;
+
+    std::unique_ptr<TransportReceiver> createReceiver(const uint32_t& receiver_id) override;
+
+private :
+
+    std::unique_ptr<Transport> base_;
+    host_id_t hostid_;
+    std::vector<bool> colocated_; // 同じマシンの worker か
+
+    std::vector<std::unique_ptr<ShmRing>> recv_rings_; // 自分宛て (自分が作る)
+    std::vector<std::unique_ptr<ShmRing>> send_rings_; // 送信先毎 (送信先が作ったものを開く)
+    std::mutex mtx_; // send_rings_ 用
+
+    // src から dst へのリングの名前
+    std::string getRingName(const host_id_t& src, const host_id_t& dst);
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline ShmRing::~ShmRing() {
+    if (header_ != nullptr) munmap(header_, MAP_SIZE);
+    if (owner_) shm_unlink(name_.c_str());
+}
+
+inline bool ShmRing::create(const std::string& name) {
+    name_ = name;
+
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        if (isInUse(name_)) {
+            std::cerr << "shm ring " << name_ << " is in use by another running worker (remove /dev/shm" << name_ << " if it is stale)" << std::endl;
+            return false;
+        }
+        shm_unlink(name_.c_str()); // 前回の実行の残骸
+        fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        perror("shm_open");
+        return false;
+    }
+    if (ftruncate(fd, MAP_SIZE) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return false;
+    }
+    if (!map(fd)) return false;
+    owner_ = true;
+
+    header_->head_.store(0, std::memory_order_relaxed);
+    header_->tail_.store(0, std::memory_order_relaxed);
+    header_->owner_pid_ = getpid();
+    header_->ready_.store(1, std::memory_order_release);
+    return true;
+}
+
+inline bool ShmRing::open(const std::string& name) {
+    name_ = name;
+    int fd = shm_open(name_.c_str(), O_RDWR, 0600);
+    if (fd < 0) return false;
+
+    // 受信側が ftruncate し終えるまでは小さい
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)MAP_SIZE) {
+        close(fd);
+        return false;
+    }
+    if (!map(fd)) return false;
+
+    // 作りかけ, または前回の実行の残骸なら開き直す
+    if (header_->ready_.load(std::memory_order_acquire) != 1 || kill(header_->owner_pid_, 0) != 0) {
+        munmap(header_, MAP_SIZE);
+        header_ = nullptr;
+        return false;
+    }
+    write_pos_ = header_->head_.load(std::memory_order_relaxed);
+    return true;
+}
+
+inline bool ShmRing::map(const int& fd) {
+    void* addr = mmap(nullptr, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    header_ = (Header*)addr;
+    data_ = (char*)addr + 4096;
+    return true;
+}
+
+inline bool ShmRing::isInUse(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0600);
+    if (fd < 0) return false;
+
+    // ftruncate 前に止まった残骸は小さいまま
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)MAP_SIZE) {
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    Header* header = (Header*)addr;
+    bool in_use = header->ready_.load(std::memory_order_acquire) == 1
+                  && (kill(header->owner_pid_, 0) == 0 || errno == EPERM);
+    munmap(addr, sizeof(Header));
+    return in_use;
+}
+
+inline char* ShmRing::reserve() {
+    if (reserved_ != nullptr) return reserved_ + LENGTH_SIZE;
+
+    // 末尾に 1 メッセージ分の空きがなければ折り返す
+    uint64_t offset = write_pos_ & (SHM_RING_SIZE - 1);
+    uint64_t skip = SHM_RING_SIZE - offset < SLOT_SIZE ? SHM_RING_SIZE - offset : 0;
+
+    // 受信側が読み終わるまで待つ
+    uint32_t spin = 0;
+    while (write_pos_ + skip + SLOT_SIZE - header_->tail_.load(std::memory_order_acquire) > SHM_RING_SIZE) {
+        if (++spin < SHM_POLL_SPIN_COUNT) continue;
+        std::this_thread::sleep_for(std::chrono::microseconds(SHM_POLL_SLEEP_US));
+    }
+
+    if (skip > 0) {
+        memcpy(data_ + offset, &WRAP, LENGTH_SIZE);
+        write_pos_ += skip;
+    }
+    reserved_ = data_ + (write_pos_ & (SHM_RING_SIZE - 1));
+    return reserved_ + LENGTH_SIZE;
+}
+
+inline void ShmRing::publish(const uint32_t& length) {
+    memcpy(reserved_, &length, LENGTH_SIZE);
+    reserved_ = nullptr;
+    write_pos_ += (LENGTH_SIZE + length + 7) & ~7ULL;
+    header_->head_.store(write_pos_, std::memory_order_release);
+}
+
+inline bool ShmRing::read(Datagram& datagram) {
+    uint64_t head = header_->head_.load(std::memory_order_acquire);
+    while (read_pos_ != head) {
+        uint64_t offset = read_pos_ & (SHM_RING_SIZE - 1);
+        uint32_t length;
+        memcpy(&length, data_ + offset, LENGTH_SIZE);
+        if (length == WRAP) { // 先頭に戻る
+            read_pos_ += SHM_RING_SIZE - offset;
+            continue;
+        }
+        datagram = {data_ + offset + LENGTH_SIZE, length};
+        read_pos_ += (LENGTH_SIZE + length + 7) & ~7ULL;
+        return true;
+    }
+    return false;
+}
+
+inline void ShmRing::release() {
+    header_->tail_.store(read_pos_, std::memory_order_release);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline ShmTransportSender::ShmTransportSender(ShmRing* ring) : ring_(ring) {}
+
+inline char* ShmTransportSender::getBuffer() {
+    return ring_->reserve();
+}
+
+inline void ShmTransportSender::commit(const uint32_t& length) {
+    ring_->publish(length);
+}
+
+inline void ShmTransportSender::flush() {
+    // commit 時点で受信側から見えている
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline ShmTransportReceiver::ShmTransportReceiver(const std::vector<ShmRing*>& rings) : rings_(rings) {}
+
+inline uint32_t ShmTransportReceiver::receive(std::vector<Datagram>& datagrams) {
+    // 前回渡したメッセージの場所を送信側に返す
+    for (ShmRing* ring : rings_) ring->release();
+    datagrams.clear();
+
+    uint32_t spin = 0;
+    while (1) {
+        // リング毎に UDP_BATCH_SIZE 個まで
+        for (ShmRing* ring : rings_) {
+            Datagram datagram;
+            for (uint32_t i = 0; i < UDP_BATCH_SIZE && ring->read(datagram); i++) {
+                datagrams.push_back(datagram);
+            }
+        }
+        if (!datagrams.empty()) return datagrams.size();
+
+        if (++spin < SHM_POLL_SPIN_COUNT) continue;
+        std::this_thread::sleep_for(std::chrono::microseconds(SHM_POLL_SLEEP_US));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline ShmTransport::ShmTransport(std::unique_ptr<Transport> base) : base_(std::move(base)) {}
+
+inline void ShmTransport::init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    base_->init(hostid, worker_ip_all);
+    hostid_ = hostid;
+    colocated_.assign(worker_ip_all.size(), false);
+    send_rings_.resize(worker_ip_all.size());
+
+    // 同じマシンの worker からのリングを作る
+    for (host_id_t src = 0; src < worker_ip_all.size(); src++) {
+        if (src == hostid || worker_ip_all[src] != worker_ip_all[hostid]) continue;
+        colocated_[src] = true;
+
+        std::unique_ptr<ShmRing> ring = std::make_unique<ShmRing>();
+        if (!ring->create(getRingName(src, hostid))) exit(1);
+        recv_rings_.push_back(std::move(ring));
+    }
+}
+
+inline bool ShmTransport::isReliable() {
+    // 共有メモリは取りこぼさないが, 他のマシンとは base で送る
+    return base_->isReliable();
+}
+
+inline std::unique_ptr<TransportSender> ShmTransport::createSender(const host_id_t& dst_id) {
+    if (!colocated_[dst_id]) return base_->createSender(dst_id);
+
+    // 送信先がリングを作るまで待つ
+    std::unique_ptr<ShmRing> ring = std::make_unique<ShmRing>();
+    while (!ring->open(getRingName(hostid_, dst_id))) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    send_rings_[dst_id] = std::move(ring);
+    return std::make_unique<ShmTransportSender>(send_rings_[dst_id].get());
+}
+
+inline uint32_t ShmTransport::getReceiverNum() {
+    return base_->getReceiverNum() + (recv_rings_.empty() ? 0 : 1);
+}
+
+inline std::unique_ptr<TransportReceiver> ShmTransport::createReceiver(const uint32_t& receiver_id) {
+    if (receiver_id < base_->getReceiverNum()) return base_->createReceiver(receiver_id);
+
+    std::vector<ShmRing*> rings;
+    for (std::unique_ptr<ShmRing>& ring : recv_rings_) rings.push_back(ring.get());
+    return std::make_unique<ShmTransportReceiver>(rings);
+}
+
+inline std::string ShmTransport::getRingName(const host_id_t& src, const host_id_t& dst) {
+    return "/rwsw_" + std::to_string(getuid()) + "_ring_" + std::to_string(src) + "_" + std::to_string(dst);
+}
@@ -17,6 +17,7 @@
 #include <fstream>
 #include <unordered_map>
 
+#include "transport.hpp"
 #include "../config/param.hpp"
 
 //////////////////////////////////////////////////////////////////////////
@@ -30,6 +31,9 @@ public :
     // コンストラクタ
     StartManager(const uint32_t& split_num);
 
+    // コンストラクタ (1 プロセス内で worker と一緒に動かす場合, config/ を読まずに自分と全 worker の IP アドレスを指定)
+    StartManager(const uint32_t& split_num, const uint32_t& hostip, const std::vector<uint32_t>& worker_ip);
+
     // cache 補充のための RW 実行合図
     void sendStartCache();
     
@@ -39,6 +43,18 @@ public :
     // 実験終了の合図
     void sendEnd(std::ofstream& ofs_time, std::ofstream& ofs_rerun);
 
+    // 直前の sendStartCache で集めた cache 補充用の RWer 数の総和 (0 ならまだ戻っていない RWer を待つ必要はない)
+    uint32_t getCacheRWerNum();
+
+    // 直前の sendEnd で集めた RW 終了数の総和
+    uint32_t getSumEndCount();
+
+    // 直前の sendEnd で集めた実行時間の最大値 (s)
+    double getMaxExecutionTime();
+
+    // 直前の sendEnd で集めた未返却 credit の総和 (0 でなければ credit の返し忘れ)
+    int64_t getSumInFlight();
+
     // IPv4 サーバソケットを作成 (UDP)
     int createUdpServerSocket();
 
@@ -53,6 +69,10 @@ private :
     uint32_t RW_execution_num_ = 0;
     std::vector<uint32_t> worker_ip_; // 実験で使う通信先 IP アドレス
     uint32_t split_num_ = 0;
+    uint32_t sum_end_count_ = 0;
+    uint32_t cache_RWer_num_ = 0;
+    double max_all_execution_time_ = 0;
+    int64_t sum_in_flight_ = 0;
 
     const size_t MESSAGE_LENGTH = 250;
 
@@ -114,6 +134,16 @@ inline StartManager::StartManager(const uint32_t& split_num) {
     split_num_ = split_num;
 }
 
+inline StartManager::StartManager(const uint32_t& split_num, const uint32_t& hostip, const std::vector<uint32_t>& worker_ip) {
+    hostname_ = "localhost";
+    hostip_ = hostip;
+    struct in_addr addr;
+    addr.s_addr = hostip_;
+    hostip_str_ = inet_ntoa(addr);
+    worker_ip_ = worker_ip;
+    split_num_ = split_num;
+}
+
 inline void StartManager::sendStartCache() {
     {
         // ソケットの生成
@@ -130,7 +160,7 @@ inline void StartManager::sendStartCache() {
             struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
             memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
             addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-            addr.sin_port = htons(10000); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
+            addr.sin_port = htons(10000 + getPortOffset(i, worker_ip_)); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
             addr.sin_addr.s_addr = worker_ip_[i]; // IPアドレス, inet_addr()関数はアドレスの翻訳        
 
             // メッセージ生成 (id: 1B, IPアドレス: 4B)
@@ -190,6 +220,7 @@ inline void StartManager::sendStartCache() {
         close(sockfd);
 
         std::cout << "ave_RWer_id: " << RWer_id_all_sum / split_num_ << std::endl;
+        cache_RWer_num_ = RWer_id_all_sum;
     }
 
     // 全てのサーバで終了したことを伝える
@@ -213,7 +244,7 @@ inline void StartManager::sendStartCache() {
             struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
             memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
             addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-            addr.sin_port = htons(9999); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
+            addr.sin_port = htons(9999 + getPortOffset(i, worker_ip_)); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
             addr.sin_addr.s_addr = worker_ip_[i]; // IPアドレス, inet_addr()関数はアドレスの翻訳
 
             // ソケット接続要求
@@ -249,7 +280,7 @@ inline void StartManager::sendStart(std::ofstream& ofs_time, std::ofstream& ofs_
         struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
         memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
         addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-        addr.sin_port = htons(10000); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
+        addr.sin_port = htons(10000 + getPortOffset(i, worker_ip_)); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
         addr.sin_addr.s_addr = worker_ip_[i]; // IPアドレス, inet_addr()関数はアドレスの翻訳        
 
         // メッセージ生成 (id: 1B, IPアドレス: 4B, RW 実行回数: 4B)
@@ -288,7 +319,7 @@ inline void StartManager::sendEnd(std::ofstream& ofs_time, std::ofstream& ofs_re
         struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
         memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
         addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
-        addr.sin_port = htons(10000); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
+        addr.sin_port = htons(10000 + getPortOffset(i, worker_ip_)); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
         addr.sin_addr.s_addr = worker_ip_[i]; // IPアドレス, inet_addr()関数はアドレスの翻訳
 
         // メッセージ生成 (id: 1B)
@@ -314,6 +345,7 @@ inline void StartManager::sendEnd(std::ofstream& ofs_time, std::ofstream& ofs_re
     int count = 0; // 終了の合図が来た回数
     int sum_end_count = 0; // end_count の総和
     double max_all_execution_time = 0; // 最後の RWer が終了するときまでの時間
+    int64_t sum_in_flight = 0; // 未返却 credit の総和
     int sockfd = createTcpServerSocket(); // サーバソケットを生成 (TCP)
 
     while (count < split_num_) {
@@ -328,13 +360,16 @@ inline void StartManager::sendEnd(std::ofstream& ofs_time, std::ofstream& ofs_re
 
         char message[1024]; // 受信バッファ
         memset(message, 0, sizeof(message)); // 受信バッファ初期化
-        recv(connect, message, sizeof(message), 0); // 受信 (hostip: 4B, end_count: 4B, all_execution_time: 8B)
+        recv(connect, message, sizeof(message), 0); // 受信 (hostip: 4B, end_count: 4B, all_execution_time: 8B, re_send_count: 4B, in_flight: 8B)
         
         uint32_t* worker_ip = (uint32_t*)message;
         uint32_t* end_count = (uint32_t*)(message + sizeof(uint32_t));
         double* execution_time = (double*)(message + sizeof(uint32_t) + sizeof(uint32_t));
+        int64_t in_flight;
+        memcpy(&in_flight, message + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(double) + sizeof(uint32_t), sizeof(int64_t));
 
         sum_end_count += *end_count;
+        sum_in_flight += in_flight;
         
         max_all_execution_time = std::max(max_all_execution_time, *execution_time);
 
@@ -347,14 +382,34 @@ inline void StartManager::sendEnd(std::ofstream& ofs_time, std::ofstream& ofs_re
     // std::cout << "drop_UDP : " << drop_UDP << std::endl;
     std::cout << "sum_end_count : " << sum_end_count << std::endl;
     std::cout << "max_all_execution_time : " << max_all_execution_time << std::endl;
+    std::cout << "sum_in_flight : " << sum_in_flight << std::endl;
 
     ofs_time << max_all_execution_time << std::endl; 
+    sum_end_count_ = sum_end_count;
+    max_all_execution_time_ = max_all_execution_time;
+    sum_in_flight_ = sum_in_flight;
     // ofs_rerun << (double)drop_UDP / (split_num_*RW_execution_num_*subgraph_size_) * 100 << std::endl; 
 
     // サーバソケットクローズ
     close(sockfd); 
 }
 
+inline uint32_t StartManager::getCacheRWerNum() {
+    return cache_RWer_num_;
+}
+
+inline uint32_t StartManager::getSumEndCount() {
+    return sum_end_count_;
+}
+
+inline double StartManager::getMaxExecutionTime() {
+    return max_all_execution_time_;
+}
+
+inline int64_t StartManager::getSumInFlight() {
+    return sum_in_flight_;
+}
+
 inline int StartManager::createUdpServerSocket() {
     // ソケットの生成
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
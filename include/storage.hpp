@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <assert.h>
 #include <unistd.h>
+#include <vector>
+#include <algorithm>
 
 #include "type.hpp"
 
@@ -20,4 +22,50 @@ void read_graph(const char* fname, T* &edge, edge_id_t &e_num)
     auto ret = fread(edge, sizeof(T), e_num, f);
     assert(ret == e_num);
     fclose(f);
-}
\ No newline at end of file
+}
+
+// fname があれば read_graph と同じく読み込む (なければ false)
+template<typename T>
+bool read_table_if_exists(const char* fname, T* &data, size_t &num)
+{
+    if (access(fname, R_OK) != 0) return false;
+    edge_id_t e_num;
+    read_graph(fname, data, e_num);
+    num = e_num;
+    return true;
+}
+
+// 分割した辺リスト (edges[HostID]) から各分割の ghost 頂点の表 (頂点 ID 順) を作る
+// 次数は全分割を通した出次数 (隣接リストを持たない頂点は 0)
+inline void build_ghost_table(const std::vector<std::vector<Edge_dstIp>> &edges, std::vector<std::vector<GhostVertex>> &ghosts)
+{
+    std::vector<index_t> degree;
+    for (auto &es : edges) {
+        for (auto &e : es) {
+            if (degree.size() <= e.src) degree.resize(e.src + 1, 0);
+            degree[e.src]++;
+        }
+    }
+
+    ghosts.assign(edges.size(), {});
+    for (host_id_t i = 0; i < edges.size(); i++) {
+        std::vector<vertex_id_t> ghost_vertices;
+        for (auto &e : edges[i]) {
+            if (e.dst_ip != i) ghost_vertices.push_back(e.dst);
+        }
+        std::sort(ghost_vertices.begin(), ghost_vertices.end());
+        ghost_vertices.erase(std::unique(ghost_vertices.begin(), ghost_vertices.end()), ghost_vertices.end());
+
+        // 持ち主は辺の dst_ip を使う
+        std::vector<host_id_t> owner(ghost_vertices.size());
+        for (auto &e : edges[i]) {
+            if (e.dst_ip == i) continue;
+            owner[std::lower_bound(ghost_vertices.begin(), ghost_vertices.end(), e.dst) - ghost_vertices.begin()] = e.dst_ip;
+        }
+
+        for (size_t j = 0; j < ghost_vertices.size(); j++) {
+            vertex_id_t v = ghost_vertices[j];
+            ghosts[i].push_back(GhostVertex(v, v < degree.size() ? degree[v] : 0, owner[j]));
+        }
+    }
+}
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "type.hpp"
+#include "transport.hpp"
+#include "udp_transport.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// TCP 上のメッセージ: [長さ (4Byte)][メッセージ (sendMessage が組み立てたもの)] を繰り返す
+
+// TCP で送信する
+// UDP_BATCH_SIZE 個のメッセージを溜めて 1 回の writev (sendmsg) でまとめて書き込む
+// 書き込みに失敗したら (相手の停止等) 異常終了する
+// (TCP エンジンは再送しないので RWer が黙って失われ, 途中まで書いたメッセージがあると張り直しても続きから送れない)
+
+class TcpTransportSender : public TransportSender {
+
+public :
+
+    // コンストラクタ (送信先との接続済みソケット, 送信先の HostID)
+    TcpTransportSender(const int& sockfd, const host_id_t& dst_id);
+
+    // デストラクタ (接続は TcpTransport が持っているので閉じない)
+    ~TcpTransportSender();
+
+    char* getBuffer() override;
+
+    void commit(const uint32_t& length) override;
+
+    void flush() override;
+
+private :
+
+    int sockfd_;
+    host_id_t dst_id_;
+    uint32_t count_ = 0; // 溜まっているメッセージ数
+
+    std::vector<char> buffer_; // UDP_BATCH_SIZE * SLOT_SIZE
+    std::vector<struct iovec> iovecs_;
+
+    static constexpr uint32_t LENGTH_SIZE = sizeof(uint32_t);
+    static constexpr uint32_t SLOT_SIZE = LENGTH_SIZE + MESSAGE_MAX_LENGTH_SEND;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+class TcpTransport;
+
+// 全ての接続を epoll で待ち, 届いたバイト列をメッセージに切り分ける
+// (切り分けたメッセージは接続毎の受信バッファを指し, 次の receive() で詰め直す)
+
+class TcpTransportReceiver : public TransportReceiver {
+
+public :
+
+    // コンストラクタ (接続を管理する TcpTransport)
+    TcpTransportReceiver(TcpTransport* transport);
+
+    // デストラクタ
+    ~TcpTransportReceiver();
+
+    uint32_t receive(std::vector<Datagram>& datagrams) override;
+
+private :
+
+    // 接続 1 本分の受信バッファ
+    struct Connection {
+        int sockfd_;
+        std::vector<char> buffer_;
+        uint32_t begin_ = 0; // 未処理の先頭
+        uint32_t end_ = 0; // 受信済みの末尾
+    };
+
+    // 新しく確立した接続を epoll に登録
+    void addConnections();
+
+    // 読めるだけ読んで, 揃ったメッセージを datagrams に格納
+    void readConnection(Connection& connection, std::vector<Datagram>& datagrams);
+
+    TcpTransport* transport_;
+    int epoll_fd_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+
+    static constexpr uint32_t LENGTH_SIZE = sizeof(uint32_t);
+    static constexpr int EPOLL_TIMEOUT_MS = 100; // 新しい接続を確認する間隔
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// TCP エンジン
+// ホストの組毎に 1 本の接続を張り続け, 両方向のメッセージを流す
+// (HostID の小さい方から接続し, 最初に自分の HostID を送る)
+// 受信スレッドは 2 つ (0: StartManager からの合図を受ける UDP の 10000 番ポート, 1: 全ての TCP 接続)
+
+class TcpTransport : public Transport {
+
+public :
+
+    // デストラクタ (接続を閉じる)
+    ~TcpTransport();
+
+    void init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) override;
+
+    bool isReliable() override;
+
+    std::unique_ptr<TransportSender> createSender(const host_id_t& dst_id) override;
+
+    uint32_t getReceiverNum() override;
+
+    std::unique_ptr<TransportReceiver> createReceiver(const uint32_t& receiver_id) override;
+
+    // 確立した接続のうち, index 番目以降をまとめて入手 (確立した順)
+    void getConnections(const uint32_t& index, std::vector<int>& sockfds);
+
+private :
+
+    // 全ての相手と接続する (接続スレッド)
+    void connectAll();
+
+    // 相手 peer との接続を登録
+    void addConnection(const host_id_t& peer, const int& sockfd);
+
+    // 送信先 dst との接続が確立するまで待機
+    int waitConnection(const host_id_t& dst);
+
+    host_id_t hostid_;
+    host_id_t hostip_;
+    std::vector<host_id_t> worker_ip_all_;
+
+    int listen_sockfd_ = -1;
+    std::thread connector_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::vector<int> peer_sockfds_; // 相手毎の接続 (未接続なら -1)
+    std::vector<int> connected_sockfds_; // 確立した順の接続
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline TcpTransportSender::TcpTransportSender(const int& sockfd, const host_id_t& dst_id) : sockfd_(sockfd), dst_id_(dst_id) {
+    buffer_.resize((size_t)UDP_BATCH_SIZE * SLOT_SIZE);
+    iovecs_.resize(UDP_BATCH_SIZE);
+}
+
+inline TcpTransportSender::~TcpTransportSender() {
+    flush();
+}
+
+inline char* TcpTransportSender::getBuffer() {
+    return buffer_.data() + (size_t)count_ * SLOT_SIZE + LENGTH_SIZE;
+}
+
+inline void TcpTransportSender::commit(const uint32_t& length) {
+    // 長さを前に付ける
+    char* slot = buffer_.data() + (size_t)count_ * SLOT_SIZE;
+    memcpy(slot, &length, LENGTH_SIZE);
+
+    iovecs_[count_].iov_base = slot;
+    iovecs_[count_].iov_len = LENGTH_SIZE + length;
+    count_++;
+
+    if (count_ == UDP_BATCH_SIZE) flush();
+}
+
+inline void TcpTransportSender::flush() {
+    // 一部だけ書き込まれたら残りを書き込む
+    // (writev と同じだが, 相手が閉じていても SIGPIPE で落ちないように sendmsg を使う)
+    struct iovec* iov = iovecs_.data();
+    int iov_num = count_;
+    while (iov_num > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_num;
+        ssize_t written = sendmsg(sockfd_, &msg, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            perror("sendmsg (tcp)");
+            std::cerr << "tcp send to host " << dst_id_ << " failed, " << iov_num << " of " << count_ << " messages not sent" << std::endl;
+            exit(1); // 異常終了
+        }
+        while (iov_num > 0 && written >= (ssize_t)iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iov_num--;
+        }
+        if (iov_num > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    count_ = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline TcpTransportReceiver::TcpTransportReceiver(TcpTransport* transport) : transport_(transport) {
+    epoll_fd_ = epoll_create1(0);
+    if (epoll_fd_ < 0) {
+        perror("epoll_create1");
+        exit(1);
+    }
+}
+
+inline TcpTransportReceiver::~TcpTransportReceiver() {
+    close(epoll_fd_);
+}
+
+inline uint32_t TcpTransportReceiver::receive(std::vector<Datagram>& datagrams) {
+    datagrams.clear();
+
+    // 前回渡した分を捨てて, 途中までのメッセージを先頭に詰める
+    for (std::unique_ptr<Connection>& connection : connections_) {
+        uint32_t rest = connection->end_ - connection->begin_;
+        if (rest > 0 && connection->begin_ > 0) memmove(connection->buffer_.data(), connection->buffer_.data() + connection->begin_, rest);
+        connection->begin_ = 0;
+        connection->end_ = rest;
+    }
+
+    struct epoll_event events[64];
+    while (datagrams.empty()) {
+        addConnections();
+
+        int event_num = epoll_wait(epoll_fd_, events, 64, EPOLL_TIMEOUT_MS);
+        if (event_num < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return 0;
+        }
+
+        for (int i = 0; i < event_num; i++) {
+            readConnection(*(Connection*)events[i].data.ptr, datagrams);
+        }
+    }
+
+    return datagrams.size();
+}
+
+inline void TcpTransportReceiver::addConnections() {
+    std::vector<int> sockfds;
+    transport_->getConnections(connections_.size(), sockfds);
+
+    for (int sockfd : sockfds) {
+        std::unique_ptr<Connection> connection = std::make_unique<Connection>();
+        connection->sockfd_ = sockfd;
+        connection->buffer_.resize(TCP_RECV_BUFFER_SIZE);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = connection.get();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+            perror("epoll_ctl");
+            exit(1);
+        }
+        connections_.push_back(std::move(connection));
+    }
+}
+
+inline void TcpTransportReceiver::readConnection(Connection& connection, std::vector<Datagram>& datagrams) {
+    // 読めるだけ読む (バッファが埋まったら残りは次回)
+    while (connection.end_ < connection.buffer_.size()) {
+        ssize_t received = recv(connection.sockfd_, connection.buffer_.data() + connection.end_, connection.buffer_.size() - connection.end_, MSG_DONTWAIT);
+        if (received > 0) {
+            connection.end_ += received;
+            continue;
+        }
+        if (received == 0) { // 相手が閉じた
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.sockfd_, nullptr);
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("recv");
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.sockfd_, nullptr);
+        }
+        break;
+    }
+
+    // 揃ったメッセージを切り分ける
+    while (connection.end_ - connection.begin_ >= LENGTH_SIZE) {
+        uint32_t length;
+        memcpy(&length, connection.buffer_.data() + connection.begin_, LENGTH_SIZE);
+        if (connection.end_ - connection.begin_ - LENGTH_SIZE < length) break;
+
+        datagrams.push_back({connection.buffer_.data() + connection.begin_ + LENGTH_SIZE, length});
+        connection.begin_ += LENGTH_SIZE + length;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline TcpTransport::~TcpTransport() {
+    // accept 待ちを起こして接続スレッドを終わらせる
+    if (listen_sockfd_ >= 0) shutdown(listen_sockfd_, SHUT_RDWR);
+    if (connector_.joinable()) connector_.join();
+    if (listen_sockfd_ >= 0) close(listen_sockfd_);
+    for (int sockfd : connected_sockfds_) close(sockfd);
+}
+
+inline void TcpTransport::init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    hostid_ = hostid;
+    hostip_ = worker_ip_all[hostid];
+    worker_ip_all_ = worker_ip_all;
+    peer_sockfds_.assign(worker_ip_all.size(), -1);
+
+    // ソケットの生成
+    listen_sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_sockfd_ < 0) { // エラー処理
+        perror("socket");
+        exit(1); // 異常終了
+    }
+
+    // アドレスの生成
+    struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
+    memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
+    addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
+    addr.sin_port = htons(TCP_DATA_PORT + getPortOffset(hostid_, worker_ip_all_)); // ポート番号
+    addr.sin_addr.s_addr = hostip_; // IPアドレス
+
+    int yes = 1;
+    if (setsockopt(listen_sockfd_, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes)) < 0) {
+        perror("ERROR on setsockopt");
+        exit(1);
+    }
+
+    // ソケット登録
+    if (bind(listen_sockfd_, (struct sockaddr *)&addr, sizeof(addr)) < 0) { // ソケット, アドレスポインタ, アドレスサイズ // エラー処理
+        perror("bind");
+        exit(1); // 異常終了
+    }
+
+    // 受信待ち (先に listen しておけば, accept する前でも相手の connect は成功する)
+    if (listen(listen_sockfd_, SOMAXCONN) < 0) { // ソケット, キューの最大長 // エラー処理
+        perror("listen");
+        exit(1); // 異常終了
+    }
+
+    connector_ = std::thread(&TcpTransport::connectAll, this);
+}
+
+inline bool TcpTransport::isReliable() {
+    return true;
+}
+
+inline std::unique_ptr<TransportSender> TcpTransport::createSender(const host_id_t& dst_id) {
+    return std::make_unique<TcpTransportSender>(waitConnection(dst_id), dst_id);
+}
+
+inline uint32_t TcpTransport::getReceiverNum() {
+    return 2;
+}
+
+inline std::unique_ptr<TransportReceiver> TcpTransport::createReceiver(const uint32_t& receiver_id) {
+    if (receiver_id == 0) return std::make_unique<UdpTransportReceiver>(hostip_, 10000 + getPortOffset(hostid_, worker_ip_all_));
+    return std::make_unique<TcpTransportReceiver>(this);
+}
+
+inline void TcpTransport::getConnections(const uint32_t& index, std::vector<int>& sockfds) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (uint32_t i = index; i < connected_sockfds_.size(); i++) {
+        sockfds.push_back(connected_sockfds_[i]);
+    }
+}
+
+inline void TcpTransport::connectAll() {
+    // HostID の大きい相手には自分から接続 (相手が起動するまで繰り返す)
+    for (host_id_t peer = hostid_ + 1; peer < worker_ip_all_.size(); peer++) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(struct sockaddr_in));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(TCP_DATA_PORT + getPortOffset(peer, worker_ip_all_));
+        addr.sin_addr.s_addr = worker_ip_all_[peer];
+
+        while (1) {
+            int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+            if (sockfd < 0) {
+                perror("socket");
+                exit(1);
+            }
+            if (connect(sockfd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == 0) {
+                uint32_t hostid = hostid_;
+                send(sockfd, &hostid, sizeof(uint32_t), 0);
+                addConnection(peer, sockfd);
+                break;
+            }
+            close(sockfd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    // HostID の小さい相手からの接続を待つ
+    for (host_id_t i = 0; i < hostid_; i++) {
+        int sockfd = accept(listen_sockfd_, nullptr, nullptr);
+        if (sockfd < 0) return; // 終了時 (shutdown)
+
+        uint32_t peer;
+        if (recv(sockfd, &peer, sizeof(uint32_t), MSG_WAITALL) != sizeof(uint32_t) || peer >= hostid_) {
+            close(sockfd);
+            i--;
+            continue;
+        }
+        addConnection(peer, sockfd);
+    }
+}
+
+inline void TcpTransport::addConnection(const host_id_t& peer, const int& sockfd) {
+    // 溜めたメッセージは writev でまとめて書くので, Nagle で待たせない
+    int flag = TCP_NODELAY_FLAG ? 1 : 0;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    peer_sockfds_[peer] = sockfd;
+    connected_sockfds_.push_back(sockfd);
+    cv_.notify_all();
+
+    // debug
+    std::cout << "tcp connected: " << peer << std::endl;
+}
+
+inline int TcpTransport::waitConnection(const host_id_t& dst) {
+    std::unique_lock<std::mutex> lk(mtx_);
+    cv_.wait(lk, [&]{ return peer_sockfds_[dst] >= 0; });
+    return peer_sockfds_[dst];
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstring>
+
+#include "type.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 同じ IP アドレスの worker (1 台に複数置く場合) の中で hostid が何番目か
+uint32_t getColocatedIndex(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all);
+
+// hostid の worker が使うポート番号のずらし幅 (getColocatedIndex * HOST_PORT_STRIDE)
+uint16_t getPortOffset(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all);
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 受信したメッセージ 1 つ (次の receive() まで有効)
+struct Datagram {
+    const char* message_;
+    uint32_t length_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 送信先 1 つ分の送信口 (送信スレッドが 1 つずつ持つ)
+
+class TransportSender {
+
+public :
+
+    virtual ~TransportSender() {}
+
+    // 次のメッセージを書き込むバッファを入手 (MESSAGE_MAX_LENGTH_SEND Byte)
+    virtual char* getBuffer() = 0;
+
+    // getBuffer() に書き込んだメッセージを送信待ちに追加 (溜まりきったら flush)
+    virtual void commit(const uint32_t& length) = 0;
+
+    // 呼び出し側のバッファにあるメッセージを送信待ちに追加 (溜まりきったら flush)
+    // 送り終えるまで (相手に届いて ack が返るまで) message を書き換えない場合に使う
+    // 既定は getBuffer() にコピーして commit, UDP / io_uring はコピーせずに message を指したまま送る
+    virtual void commitExternal(const char* message, const uint32_t& length);
+
+    // 溜まっているメッセージをまとめて送信
+    virtual void flush() = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 受信口 (受信スレッドが 1 つずつ持つ)
+
+class TransportReceiver {
+
+public :
+
+    virtual ~TransportReceiver() {}
+
+    // 1 つ以上届くまで待ってまとめて受信し, datagrams に格納 (格納した数を返す)
+    virtual uint32_t receive(std::vector<Datagram>& datagrams) = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// RWer のメッセージを運ぶ通信エンジン (UDP / io_uring / TCP)
+// 送受信スレッドはエンジンに依存せず TransportSender / TransportReceiver だけを使う
+
+class Transport {
+
+public :
+
+    virtual ~Transport() {}
+
+    // 初期化 (自サーバの HostID, 全 worker の IP アドレス)
+    virtual void init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) = 0;
+
+    // 届いたメッセージが失われない (再送制御が不要) か
+    virtual bool isReliable() = 0;
+
+    // 送信先 dst_id への送信口を生成
+    virtual std::unique_ptr<TransportSender> createSender(const host_id_t& dst_id) = 0;
+
+    // 受信スレッド数
+    virtual uint32_t getReceiverNum() = 0;
+
+    // receiver_id 番目の受信スレッドの受信口を生成
+    virtual std::unique_ptr<TransportReceiver> createReceiver(const uint32_t& receiver_id) = 0;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void TransportSender::commitExternal(const char* message, const uint32_t& length) {
+    memcpy(getBuffer(), message, length);
+    commit(length);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline uint32_t getColocatedIndex(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    uint32_t index = 0;
+    for (host_id_t i = 0; i < hostid; i++) {
+        if (worker_ip_all[i] == worker_ip_all[hostid]) index++;
+    }
+    return index;
+}
+
+inline uint16_t getPortOffset(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    return getColocatedIndex(hostid, worker_ip_all) * HOST_PORT_STRIDE;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <iostream>
+
+#include "transport.hpp"
+#include "udp_transport.hpp"
+#include "io_uring_transport.hpp"
+#include "tcp_transport.hpp"
+#include "shm_transport.hpp"
+#include "loopback_transport.hpp"
+#include "../config/param.hpp"
+
+// engine (UDP_ENGINE / IO_URING_ENGINE / TCP_ENGINE / LOOPBACK_ENGINE) の通信エンジンを生成
+// io_uring が使えない環境では UDP エンジンを返す
+// USE_SHM_TRANSPORT なら同じマシンの worker へは共有メモリで送るように包む (LOOPBACK_ENGINE は包まない)
+std::unique_ptr<Transport> createTransport(const uint32_t& engine);
+
+// 共有メモリで包まない通信エンジンを生成
+std::unique_ptr<Transport> createNetworkTransport(const uint32_t& engine);
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline std::unique_ptr<Transport> createTransport(const uint32_t& engine) {
+    if (USE_SHM_TRANSPORT && engine != LOOPBACK_ENGINE) return std::make_unique<ShmTransport>(createNetworkTransport(engine));
+    return createNetworkTransport(engine);
+}
+
+inline std::unique_ptr<Transport> createNetworkTransport(const uint32_t& engine) {
+    if (engine == LOOPBACK_ENGINE) return std::make_unique<LoopbackTransport>();
+    if (engine == TCP_ENGINE) return std::make_unique<TcpTransport>();
+    if (engine == IO_URING_ENGINE) {
+        if (IoUring::isSupported()) return std::make_unique<IoUringTransport>();
+        std::cout << "io_uring is not supported, fall back to UDP" << std::endl;
+    }
+    return std::make_unique<UdpTransport>();
+}
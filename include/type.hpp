@@ -2,13 +2,25 @@
 
 #include <stdint.h>
 #include <utility>
+#include <type_traits>
 
+// 頂点 ID の幅
+// VERTEX_ID_32 を定義してビルドすると頂点 ID, 隣接リストの index, RWer の経路 (path_) の 1 語が 32bit になる
+// (頂点 ID と次数が INF 未満のグラフ用, 隣接リストと RWer のメッセージが半分になる)
+// グラフファイル (Edge_dstIp) の形式も変わるので, dataset のツールも同じ定義でビルドして分割し直す
+#ifdef VERTEX_ID_32
+typedef uint32_t vertex_id_t;
+typedef uint32_t index_t;
+typedef uint32_t path_word_t;
+#else
 typedef uint64_t vertex_id_t;
+typedef uint64_t index_t;
+typedef uint64_t path_word_t;
+#endif
 typedef uint64_t edge_id_t;
 typedef uint64_t walker_id_t;
 typedef uint32_t host_id_t;
 typedef uint16_t worker_id_t;
-typedef uint64_t index_t;
 
 struct EmptyData
 {
@@ -58,11 +70,13 @@ struct Edge <EmptyData>
     }
 };
 
+// グラフファイルにそのまま書き, チェックサムも取るので, 詰め物も明示して 0 にしておく
 struct Edge_dstIp
 {
     vertex_id_t src;
     vertex_id_t dst;
     uint8_t dst_ip;
+    uint8_t reserved[sizeof(vertex_id_t) - 1] = {};
 
     Edge_dstIp() {}
     Edge_dstIp(vertex_id_t _src, vertex_id_t _dst, uint8_t _dst_ip) : src(_src), dst(_dst), dst_ip(_dst_ip) {}
@@ -78,6 +92,25 @@ struct Edge_dstIp
     }
 };
 
+// 分割したグラフの ghost 頂点 (持ち主が他サーバの隣接頂点) の次数と持ち主 (グラフファイルと同じ名前の .ghost)
+struct GhostVertex
+{
+    vertex_id_t vertex;
+    index_t degree;
+    host_id_t owner;
+
+#ifndef VERTEX_ID_32
+    uint32_t reserved = 0; // 64bit の頂点 ID では末尾が 4 Byte 空くので明示して 0 にする (.ghost とチェックサムに未初期化の値が入らないように)
+#endif
+
+    GhostVertex() {}
+    GhostVertex(vertex_id_t _vertex, index_t _degree, host_id_t _owner) : vertex(_vertex), degree(_degree), owner(_owner) {}
+};
+
+// ファイルに書く構造体に暗黙の詰め物がない
+static_assert(std::has_unique_object_representations_v<Edge_dstIp>);
+static_assert(std::has_unique_object_representations_v<GhostVertex>);
+
 template<typename edge_data_t>
 struct AdjUnit
 {
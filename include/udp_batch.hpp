@@ -0,0 +1,345 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include "../config/param.hpp"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// データグラムを溜めて sendmmsg でまとめて送信する
+// GSO (UDP_SEGMENT) が有効な場合は, 続けて溜まった「同じ宛先で同じ長さ」のデータグラムを 1 つにまとめ, その長さを分割サイズにして送る
+// (まとめたものの最後だけは短くてもよい, 詰め物はしない, まとめられないものはそのまま 1 つずつ, どちらも 1 回の sendmmsg で送る)
+
+class UdpBatchSender {
+
+public :
+
+    // 初期化 (ソケット, GSO を使うか)
+    void init(const int& sockfd, const bool& use_gso);
+
+    // 次のデータグラムを書き込むバッファを入手 (MESSAGE_MAX_LENGTH_SEND Byte)
+    char* getBuffer();
+
+    // getBuffer() に書き込んだデータグラムを送信待ちに追加 (溜まりきったら flush)
+    void commit(const uint32_t& length, const struct sockaddr_in& addr);
+
+    // 呼び出し側のバッファにあるデータグラムを, コピーせずに送信待ちに追加 (flush で送り終えるまで message を書き換えない)
+    void commitExternal(const char* message, const uint32_t& length, const struct sockaddr_in& addr);
+
+    // 溜まっているデータグラムをまとめて送信
+    void flush();
+
+    // GSO を使っているか
+    bool isGso();
+
+    // 送信待ちがないか
+    bool isEmpty();
+
+    // 以降の送信に使うソケットを変える (送信待ちがない時に呼ぶ)
+    void setSocket(const int& sockfd);
+
+private :
+
+    // 同じ宛先で同じ長さのデータグラムを GSO でまとめて送信 (送り終えたデータグラム数を返す, GSO に失敗したらそこで止めて以降は使わない)
+    uint32_t sendGso();
+
+    // first 番目以降のデータグラムを sendmmsg でまとめて送信
+    void sendMmsg(const uint32_t& first);
+
+    // 宛先が同じか
+    static bool isSameAddr(const struct sockaddr_in& a, const struct sockaddr_in& b);
+
+    // GSO 1 回の上限 (Byte, 分割数)
+    static const uint32_t GSO_MAX_BYTES = 65000;
+    static const uint32_t GSO_MAX_SEGMENTS = 64;
+
+    int sockfd_ = -1;
+    bool use_gso_ = false;
+    uint32_t batch_size_ = 0; // 1 回で送るデータグラム数の上限
+    uint32_t count_ = 0; // 溜まっているデータグラム数
+
+    std::vector<char> buffer_; // batch_size_ * MESSAGE_MAX_LENGTH_SEND
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct sockaddr_in> addrs_;
+
+    // GSO 用: まとめたもの毎の mmsghdr, cmsg, 先頭のデータグラムの番号
+    std::vector<struct mmsghdr> gso_msgs_;
+    std::vector<char> gso_control_;
+    std::vector<uint32_t> gso_first_;
+
+    static const uint32_t GSO_CONTROL_SIZE = CMSG_SPACE(sizeof(uint16_t));
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// recvmmsg でまとめて受信する
+// GRO (UDP_GRO) が有効な場合は, 結合されて届いたバッファを cmsg の分割サイズ毎にデータグラムに戻す
+
+class UdpBatchReceiver {
+
+public :
+
+    // 初期化 (ソケット, GRO を使うか)
+    void init(const int& sockfd, const bool& use_gro);
+
+    // 1 つ以上届くまで待ってまとめて受信 (受信したバッファ数を返す)
+    int receive();
+
+    // 受信したデータグラムを 1 つずつ func(message, length) に渡す
+    template <typename Func>
+    void forEachDatagram(Func func);
+
+private :
+
+    int sockfd_ = -1;
+    bool use_gro_ = false;
+    uint32_t slot_size_ = 0; // 受信バッファ 1 つのサイズ
+    int received_num_ = 0;
+
+    std::vector<char> buffer_; // UDP_BATCH_SIZE * slot_size_
+    std::vector<char> control_; // cmsg 用
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<struct iovec> iovecs_;
+
+    static const uint32_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+    static const uint32_t GRO_SLOT_SIZE = 65536;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void UdpBatchSender::init(const int& sockfd, const bool& use_gso) {
+    sockfd_ = sockfd;
+    use_gso_ = use_gso;
+
+    batch_size_ = std::max<uint32_t>(UDP_BATCH_SIZE, 1);
+
+    buffer_.resize(batch_size_ * MESSAGE_MAX_LENGTH_SEND);
+    msgs_.resize(batch_size_);
+    iovecs_.resize(batch_size_);
+    addrs_.resize(batch_size_);
+    gso_msgs_.resize(batch_size_);
+    gso_control_.resize(batch_size_ * GSO_CONTROL_SIZE);
+    gso_first_.resize(batch_size_);
+    memset(msgs_.data(), 0, sizeof(struct mmsghdr) * batch_size_);
+    memset(gso_msgs_.data(), 0, sizeof(struct mmsghdr) * batch_size_);
+    for (uint32_t i = 0; i < batch_size_; i++) {
+        iovecs_[i].iov_base = buffer_.data() + i * MESSAGE_MAX_LENGTH_SEND;
+        msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+        msgs_[i].msg_hdr.msg_name = &addrs_[i];
+        msgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+}
+
+inline char* UdpBatchSender::getBuffer() {
+    return buffer_.data() + count_ * MESSAGE_MAX_LENGTH_SEND;
+}
+
+inline void UdpBatchSender::commit(const uint32_t& length, const struct sockaddr_in& addr) {
+    // 前のバッチで外のバッファを指していたかもしれないので戻す
+    iovecs_[count_].iov_base = getBuffer();
+    iovecs_[count_].iov_len = length;
+    addrs_[count_] = addr;
+    count_++;
+
+    if (count_ == batch_size_) flush();
+}
+
+inline void UdpBatchSender::commitExternal(const char* message, const uint32_t& length, const struct sockaddr_in& addr) {
+    iovecs_[count_].iov_base = const_cast<char*>(message);
+    iovecs_[count_].iov_len = length;
+    addrs_[count_] = addr;
+    count_++;
+
+    if (count_ == batch_size_) flush();
+}
+
+inline void UdpBatchSender::flush() {
+    if (count_ == 0) return;
+
+    uint32_t sent = use_gso_ && count_ > 1 ? sendGso() : 0;
+    if (sent < count_) sendMmsg(sent);
+
+    count_ = 0;
+}
+
+inline bool UdpBatchSender::isGso() {
+    return use_gso_;
+}
+
+inline bool UdpBatchSender::isEmpty() {
+    return count_ == 0;
+}
+
+inline void UdpBatchSender::setSocket(const int& sockfd) {
+    sockfd_ = sockfd;
+}
+
+inline uint32_t UdpBatchSender::sendGso() {
+    // 続けて溜まった同じ宛先のデータグラムのうち, 長さが先頭と同じものをまとめる (最後の 1 つは短くてもよい)
+    uint32_t run_num = 0;
+    uint32_t i = 0;
+    while (i < count_) {
+        uint32_t segment_size = iovecs_[i].iov_len;
+        uint32_t total = segment_size;
+        uint32_t j = i + 1;
+        while (j < count_ && j - i < GSO_MAX_SEGMENTS && isSameAddr(addrs_[j], addrs_[i])
+               && iovecs_[j - 1].iov_len == segment_size && iovecs_[j].iov_len <= segment_size
+               && total + iovecs_[j].iov_len <= GSO_MAX_BYTES) {
+            total += iovecs_[j].iov_len;
+            j++;
+        }
+
+        struct msghdr& msg = gso_msgs_[run_num].msg_hdr;
+        msg.msg_name = &addrs_[i];
+        msg.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_iov = &iovecs_[i];
+        msg.msg_iovlen = j - i;
+        if (j - i > 1) {
+            char* control = gso_control_.data() + run_num * GSO_CONTROL_SIZE;
+            memset(control, 0, GSO_CONTROL_SIZE);
+            msg.msg_control = control;
+            msg.msg_controllen = GSO_CONTROL_SIZE;
+
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = segment_size;
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        } else {
+            msg.msg_control = nullptr;
+            msg.msg_controllen = 0;
+        }
+
+        gso_first_[run_num] = i;
+        run_num++;
+        i = j;
+    }
+
+    uint32_t sent = 0;
+    while (sent < run_num) {
+        int ret = sendmmsg(sockfd_, gso_msgs_.data() + sent, run_num - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (gso_msgs_[sent].msg_hdr.msg_iovlen > 1) {
+                // カーネル / NIC が対応していなければ以降は sendmmsg
+                perror("sendmmsg (UDP_SEGMENT)");
+                use_gso_ = false;
+                return gso_first_[sent];
+            }
+            perror("sendmmsg");
+            return count_;
+        }
+        sent += ret;
+    }
+    return count_;
+}
+
+inline void UdpBatchSender::sendMmsg(const uint32_t& first) {
+    uint32_t sent = first;
+    while (sent < count_) {
+        int ret = sendmmsg(sockfd_, msgs_.data() + sent, count_ - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("sendmmsg");
+            return;
+        }
+        sent += ret;
+    }
+}
+
+inline bool UdpBatchSender::isSameAddr(const struct sockaddr_in& a, const struct sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void UdpBatchReceiver::init(const int& sockfd, const bool& use_gro) {
+    sockfd_ = sockfd;
+    use_gro_ = use_gro;
+
+    if (use_gro_) {
+        int yes = 1;
+        if (setsockopt(sockfd_, SOL_UDP, UDP_GRO, &yes, sizeof(yes)) < 0) {
+            perror("setsockopt (UDP_GRO)");
+            use_gro_ = false;
+        }
+    }
+    slot_size_ = use_gro_ ? GRO_SLOT_SIZE : MESSAGE_MAX_LENGTH_RECV;
+
+    buffer_.resize((size_t)UDP_BATCH_SIZE * slot_size_);
+    control_.resize(UDP_BATCH_SIZE * CONTROL_SIZE);
+    msgs_.resize(UDP_BATCH_SIZE);
+    iovecs_.resize(UDP_BATCH_SIZE);
+    memset(msgs_.data(), 0, sizeof(struct mmsghdr) * UDP_BATCH_SIZE);
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++) {
+        iovecs_[i].iov_base = buffer_.data() + (size_t)i * slot_size_;
+        iovecs_[i].iov_len = slot_size_;
+        msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+inline int UdpBatchReceiver::receive() {
+    for (uint32_t i = 0; i < UDP_BATCH_SIZE; i++) {
+        if (use_gro_) {
+            msgs_[i].msg_hdr.msg_control = control_.data() + i * CONTROL_SIZE;
+            msgs_[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+    }
+
+    received_num_ = recvmmsg(sockfd_, msgs_.data(), UDP_BATCH_SIZE, MSG_WAITFORONE, nullptr);
+    if (received_num_ < 0) {
+        if (errno != EINTR && errno != EAGAIN) perror("recvmmsg");
+        received_num_ = 0;
+    }
+    return received_num_;
+}
+
+template <typename Func>
+inline void UdpBatchReceiver::forEachDatagram(Func func) {
+    for (int i = 0; i < received_num_; i++) {
+        const char* message = buffer_.data() + (size_t)i * slot_size_;
+        uint32_t length = msgs_[i].msg_len;
+
+        // GRO で結合されていれば分割サイズを入手
+        uint32_t segment_size = length;
+        if (use_gro_) {
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs_[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msgs_[i].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int gso_size;
+                    memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(int));
+                    if (gso_size > 0) segment_size = gso_size;
+                }
+            }
+        }
+
+        for (uint32_t offset = 0; offset < length; offset += segment_size) {
+            func(message + offset, std::min(segment_size, length - offset));
+        }
+    }
+}
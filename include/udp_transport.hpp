@@ -0,0 +1,350 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "type.hpp"
+#include "util.hpp"
+#include "transport.hpp"
+#include "udp_batch.hpp"
+#include "../config/param.hpp"
+
+// IPv4 サーバソケットを生成 (UDP, ip:port_num に bind, reuse_port なら SO_REUSEPORT を付ける)
+int createUdpServerSocket(const host_id_t& ip, const uint16_t& port_num, const bool& reuse_port = false);
+
+// SO_REUSEPORT のグループに, パケットを受け取ったコアが cores[i] ならば i 番目のソケットを選ぶ BPF を付ける
+// (どの受信スレッドも固定されていないコアで受け取ったパケットはカーネルのハッシュで選ぶ)
+void attachReuseportCpuSteering(const int& sockfd, const std::vector<uint32_t>& cores);
+
+// 呼び出したスレッドを cpu_id 番のコアに固定する
+void pinCurrentThread(const uint32_t& cpu_id);
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// sendmmsg / GSO で送信先の port_base ~ port_base+port_num-1 番ポートにランダムに振り分けて送る
+// (USE_SO_REUSEPORT なら port_num = 1 で, socket_num 個の送信ソケットをバッチ毎に順に使い, 受信側のカーネルのハッシュで受信ソケットに散らす)
+
+class UdpTransportSender : public TransportSender {
+
+public :
+
+    // コンストラクタ (送信先の IP アドレス, 受信ポートの先頭番号, 受信ポート数, 送信ソケット数)
+    UdpTransportSender(const host_id_t& dst_ip, const uint16_t& port_base, const uint32_t& port_num = RECV_PORT, const uint32_t& socket_num = 1);
+
+    // デストラクタ (ソケットを閉じる)
+    ~UdpTransportSender();
+
+    char* getBuffer() override;
+
+    void commit(const uint32_t& length) override;
+
+    void commitExternal(const char* message, const uint32_t& length) override;
+
+    void flush() override;
+
+private :
+
+    // 次のメッセージの宛先ポートを addr_ に入れ, 新しいバッチなら送信ソケットを替える
+    void setNextAddr();
+
+    std::vector<int> sockfds_;
+    uint32_t socket_idx_ = 0; // 今のバッチを送るソケット
+    UdpBatchSender batch_sender_;
+    struct sockaddr_in addr_;
+    uint16_t port_base_;
+    uint32_t port_num_;
+    StdRandNumGenerator gen_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 1 つのソケットを recvmmsg / GRO で受信する
+
+class UdpTransportReceiver : public TransportReceiver {
+
+public :
+
+    // コンストラクタ (bind する IP アドレス, ポート番号)
+    UdpTransportReceiver(const host_id_t& ip, const uint16_t& port_num);
+
+    // コンストラクタ (bind 済みのソケットを受け取る)
+    UdpTransportReceiver(const int& sockfd);
+
+    // デストラクタ (ソケットを閉じる)
+    ~UdpTransportReceiver();
+
+    uint32_t receive(std::vector<Datagram>& datagrams) override;
+
+private :
+
+    int sockfd_;
+    UdpBatchReceiver batch_receiver_;
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// UDP エンジン
+// USE_SO_REUSEPORT: 1 つのポートに受信スレッド数のソケットを bind する (init で順に作るので, ソケットの順番 = 受信スレッドの番号)
+// そうでなければ RECV_PORT 個のポートに受信スレッドを 1 つずつ
+
+class UdpTransport : public Transport {
+
+public :
+
+    void init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) override;
+
+    bool isReliable() override;
+
+    std::unique_ptr<TransportSender> createSender(const host_id_t& dst_id) override;
+
+    uint32_t getReceiverNum() override;
+
+    std::unique_ptr<TransportReceiver> createReceiver(const uint32_t& receiver_id) override;
+
+private :
+
+    // USE_REUSEPORT_CPU_STEERING で receiver_id 番の受信スレッドを固定するコア (同じマシンの worker とはずらす)
+    uint32_t getReuseportCore(const uint32_t& receiver_id);
+
+    host_id_t hostid_;
+    host_id_t hostip_;
+    std::vector<host_id_t> worker_ip_all_;
+    std::vector<int> reuseport_sockfds_; // USE_SO_REUSEPORT の受信スレッド毎のソケット
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline int createUdpServerSocket(const host_id_t& ip, const uint16_t& port_num, const bool& reuse_port) {
+    // ソケットの生成
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) { // エラー処理
+        perror("socket");
+        exit(1); // 異常終了
+    }
+
+    if (reuse_port) {
+        int yes = 1;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (const char *)&yes, sizeof(yes)) < 0) {
+            perror("setsockopt SO_REUSEPORT");
+            exit(1);
+        }
+    }
+
+    // アドレスの生成
+    struct sockaddr_in addr; // 接続先の情報用の構造体(ipv4)
+    memset(&addr, 0, sizeof(struct sockaddr_in)); // memsetで初期化
+    addr.sin_family = AF_INET; // アドレスファミリ(ipv4)
+    addr.sin_port = htons(port_num); // ポート番号, htons()関数は16bitホストバイトオーダーをネットワークバイトオーダーに変換
+    addr.sin_addr.s_addr = ip; // IPアドレス
+
+    // ソケット登録
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) { // ソケット, アドレスポインタ, アドレスサイズ // エラー処理
+        perror("bind");
+        exit(1); // 異常終了
+    }
+
+    return sockfd;
+}
+
+inline void attachReuseportCpuSteering(const int& sockfd, const std::vector<uint32_t>& cores) {
+    // A = 受け取ったコアの番号, cores[i] と等しければ i を返す
+    // どれとも等しくなければ範囲外の cores.size() を返し, カーネルのハッシュに任せる
+    std::vector<struct sock_filter> code;
+    code.push_back({ BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) });
+    for (uint32_t i = 0; i < cores.size(); i++) {
+        code.push_back({ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, cores[i] });
+        code.push_back({ BPF_RET | BPF_K, 0, 0, i });
+    }
+    code.push_back({ BPF_RET | BPF_K, 0, 0, (uint32_t)cores.size() });
+
+    struct sock_fprog prog = { (unsigned short)code.size(), code.data() };
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        perror("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+    }
+}
+
+inline void pinCurrentThread(const uint32_t& cpu_id) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu_id, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+        perror("pthread_setaffinity_np");
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline UdpTransportSender::UdpTransportSender(const host_id_t& dst_ip, const uint16_t& port_base, const uint32_t& port_num, const uint32_t& socket_num) : port_base_(port_base), port_num_(port_num) {
+    // ソケットの生成 (送信元ポートはそれぞれ別になる)
+    for (uint32_t i = 0; i < std::max<uint32_t>(1, socket_num); i++) {
+        int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd < 0) { // エラー処理
+            perror("socket");
+            exit(1); // 異常終了
+        }
+        sockfds_.push_back(sockfd);
+    }
+
+    batch_sender_.init(sockfds_[0], USE_UDP_GSO);
+
+    // アドレスの生成
+    memset(&addr_, 0, sizeof(struct sockaddr_in));
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = dst_ip;
+}
+
+inline UdpTransportSender::~UdpTransportSender() {
+    batch_sender_.flush();
+    for (int sockfd : sockfds_) close(sockfd);
+}
+
+inline char* UdpTransportSender::getBuffer() {
+    return batch_sender_.getBuffer();
+}
+
+inline void UdpTransportSender::commit(const uint32_t& length) {
+    setNextAddr();
+    batch_sender_.commit(length, addr_);
+}
+
+inline void UdpTransportSender::commitExternal(const char* message, const uint32_t& length) {
+    setNextAddr();
+    batch_sender_.commitExternal(message, length, addr_);
+}
+
+inline void UdpTransportSender::setNextAddr() {
+    // ポート番号指定
+    addr_.sin_port = port_num_ == 1 ? htons(port_base_) : htons(gen_.genRandHostId(port_base_, port_base_+port_num_-1));
+
+    // 新しいバッチは次のソケットから送る
+    if (sockfds_.size() > 1 && batch_sender_.isEmpty()) {
+        socket_idx_ = (socket_idx_ + 1) % sockfds_.size();
+        batch_sender_.setSocket(sockfds_[socket_idx_]);
+    }
+}
+
+inline void UdpTransportSender::flush() {
+    batch_sender_.flush();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline UdpTransportReceiver::UdpTransportReceiver(const host_id_t& ip, const uint16_t& port_num) {
+    sockfd_ = createUdpServerSocket(ip, port_num);
+    batch_receiver_.init(sockfd_, USE_UDP_GRO);
+}
+
+inline UdpTransportReceiver::UdpTransportReceiver(const int& sockfd) : sockfd_(sockfd) {
+    batch_receiver_.init(sockfd_, USE_UDP_GRO);
+}
+
+inline UdpTransportReceiver::~UdpTransportReceiver() {
+    close(sockfd_);
+}
+
+inline uint32_t UdpTransportReceiver::receive(std::vector<Datagram>& datagrams) {
+    datagrams.clear();
+    batch_receiver_.receive();
+
+    batch_receiver_.forEachDatagram([&](const char* message, const uint32_t& length) {
+        datagrams.push_back({message, length});
+    });
+    return datagrams.size();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void UdpTransport::init(const host_id_t& hostid, const std::vector<host_id_t>& worker_ip_all) {
+    hostid_ = hostid;
+    hostip_ = worker_ip_all[hostid];
+    worker_ip_all_ = worker_ip_all;
+
+    if (USE_SO_REUSEPORT) {
+        uint32_t socket_num = REUSEPORT_RECV_THREAD_NUM;
+        if (socket_num == 0) {
+            uint32_t core_num = RUNTIME_CORE_NUM > 0 ? RUNTIME_CORE_NUM : std::thread::hardware_concurrency();
+            socket_num = std::max<uint32_t>(1, core_num / 4);
+        }
+
+        uint16_t port_num = 10000 + getPortOffset(hostid_, worker_ip_all_);
+
+        // 前の worker (止まっていない / 同じ HostID で重複して起動した) のソケットが残っていると, 同じグループに入って黙って受信を分け合ってしまう
+        // 先に SO_REUSEPORT なしで bind してみて, 使われていれば起動しない
+        int probe_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(struct sockaddr_in));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_num);
+        addr.sin_addr.s_addr = hostip_;
+        if (probe_sockfd < 0 || bind(probe_sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind (SO_REUSEPORT group already has members?)");
+            exit(1);
+        }
+        close(probe_sockfd);
+
+        // グループ内のソケットの順番は bind した順なので, ここで順に作る
+        for (uint32_t i = 0; i < socket_num; i++) {
+            reuseport_sockfds_.push_back(createUdpServerSocket(hostip_, port_num, true));
+        }
+        if (USE_REUSEPORT_CPU_STEERING) {
+            std::vector<uint32_t> cores;
+            for (uint32_t i = 0; i < socket_num; i++) cores.push_back(getReuseportCore(i));
+            attachReuseportCpuSteering(reuseport_sockfds_[0], cores);
+        }
+    }
+}
+
+inline bool UdpTransport::isReliable() {
+    return false;
+}
+
+inline std::unique_ptr<TransportSender> UdpTransport::createSender(const host_id_t& dst_id) {
+    return std::make_unique<UdpTransportSender>(worker_ip_all_[dst_id], 10000 + getPortOffset(dst_id, worker_ip_all_), USE_SO_REUSEPORT ? 1 : RECV_PORT, USE_SO_REUSEPORT ? REUSEPORT_SEND_SOCKET_NUM : 1);
+}
+
+inline uint32_t UdpTransport::getReceiverNum() {
+    if (USE_SO_REUSEPORT) return reuseport_sockfds_.size();
+    return RECV_PORT;
+}
+
+inline std::unique_ptr<TransportReceiver> UdpTransport::createReceiver(const uint32_t& receiver_id) {
+    if (USE_SO_REUSEPORT) {
+        // 受信スレッドから呼ばれるので, そのスレッドを BPF がこのソケットを選ぶコアに固定する
+        if (USE_REUSEPORT_CPU_STEERING) pinCurrentThread(getReuseportCore(receiver_id));
+        return std::make_unique<UdpTransportReceiver>(reuseport_sockfds_[receiver_id]);
+    }
+    return std::make_unique<UdpTransportReceiver>(hostip_, 10000 + getPortOffset(hostid_, worker_ip_all_) + receiver_id);
+}
+
+inline uint32_t UdpTransport::getReuseportCore(const uint32_t& receiver_id) {
+    uint32_t core_num = std::thread::hardware_concurrency();
+    return (getColocatedIndex(hostid_, worker_ip_all_) * reuseport_sockfds_.size() + receiver_id) % core_num;
+}
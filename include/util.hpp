@@ -6,6 +6,7 @@
 
 #include <random>
 #include <chrono>
+#include <cstring>
 
 #include "type.hpp"
 
@@ -49,6 +50,22 @@ public:
     }
 };
 
+// バイト列のハッシュ値 (ファイルの中身の確認用, 8 Byte ずつ FNV-1a と同じ形で混ぜる)
+// hash に前のハッシュ値を渡すと続けて計算する
+inline uint64_t hashBytes(const void* data, const size_t& size, uint64_t hash = 14695981039346656037ULL)
+{
+    const char* bytes = (const char*)data;
+    size_t idx = 0;
+    for (; idx + 8 <= size; idx += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + idx, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    for (; idx < size; idx++) hash = (hash ^ (uint8_t)bytes[idx]) * 1099511628211ULL;
+    return hash;
+}
+
 //Timer is used for performance profiling
 class Timer
 {
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "type.hpp"
+#include "random_walker.hpp"
+#include "../config/param.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 終了した RWer の経路 (頂点列) を書き出すファイル (セグメント) の形式
+//
+// ヘッダ (64 Byte):
+// マジック (64bit), 書き込み済みの大きさ (ヘッダ込み, 64bit), 経路数 (64bit), あまり
+//
+// レコード (経路毎, 8 Byte 境界):
+// RWer ID (32bit), 頂点数 (32bit), 頂点 (64bit * 頂点数)
+//
+// ヘッダの大きさと経路数はレコードを書き終えてから更新するので, 書き込み中のファイルを読んでも途中のレコードは見えない
+// 使い切ったセグメントと実験終了の合図 (END_EXP) の時に書き込み中のセグメントは書き込み済みの大きさに切り詰める (それまでは WALK_OUTPUT_SEGMENT_SIZE のまま, 残りは疎)
+
+struct WalkOutputHeader {
+    uint64_t magic_;
+    std::atomic<uint64_t> used_;
+    std::atomic<uint64_t> walk_num_;
+    uint64_t reserved_[5];
+};
+
+const uint64_t WALK_OUTPUT_MAGIC = 0x31304b4c41575752; // "RWWALK01"
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 1 スレッド専用の書き込み先
+// mmap したセグメントに memcpy で追記するだけなので, 書き込みスレッドはシステムコールをしない (セグメントの切り替え時を除く)
+// ロックは持ち主のスレッドと close() (実験終了時) でしか取らないので, RW 実行中は競合しない
+
+class WalkOutputWriter {
+
+public :
+
+    // 初期化 (書き出し先のディレクトリ, HostID, 書き込みスレッドの番号), ファイルは最初の write() で作る
+    void init(const std::string& dir_path, const host_id_t& hostid, const uint32_t& writer_id);
+
+    // RWer の経路を追記する
+    void write(RandomWalker& RWer);
+
+    // 書き込んだ経路数
+    uint64_t getWalkNum();
+
+    // 書き込み中のセグメントを切り詰めて閉じる (次の write() で次のセグメントを作る)
+    void close();
+
+private :
+
+    std::mutex mtx_;
+    std::string dir_path_;
+    host_id_t hostid_;
+    uint32_t writer_id_;
+    uint32_t segment_id_ = 0; // 次に作るセグメントの通し番号
+
+    int fd_ = -1;
+    char* base_ = nullptr; // mmap したセグメント
+    WalkOutputHeader* header_ = nullptr;
+    uint64_t used_ = 0; // 書き込み済みの大きさ (ヘッダ込み)
+    std::atomic<uint64_t> walk_num_ = 0;
+
+    // 次のセグメントを作って mmap する
+    void openSegment();
+
+    // 今のセグメントを書き込み済みの大きさに切り詰めて閉じる
+    void closeSegment();
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+// 全経路が揃った RWer の書き出し (WALK_OUTPUT_FLAG)
+// 書き込むスレッド毎に WalkOutputWriter を 1 つ割り当てる (最初に write() したときに決まる)
+// ファイル: WALK_OUTPUT_DIR/walks_<HostID>_<書き込みスレッド>_<通し番号>.bin
+
+class WalkOutputSink {
+
+public :
+
+    // 初期化 (書き出し先のディレクトリ, HostID)
+    void init(const std::string& dir_path, const host_id_t& hostid);
+
+    // RWer の経路を呼び出したスレッドの書き込み先に追記する
+    void write(RandomWalker& RWer);
+
+    // 全スレッドで書き込んだ経路数
+    uint64_t getWalkNum();
+
+    // 全ての書き込み先の書き込み中のセグメントを切り詰めて閉じる (実験終了の合図で呼ぶ)
+    void close();
+
+private :
+
+    std::vector<std::unique_ptr<WalkOutputWriter>> writers_; // WALK_OUTPUT_MAX_WRITER_NUM
+    std::atomic<uint32_t> writer_num_ = 0; // 割り当て済みの書き込み先の数
+
+    // 呼び出したスレッドの書き込み先を入手
+    WalkOutputWriter& getWriter();
+
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void WalkOutputWriter::init(const std::string& dir_path, const host_id_t& hostid, const uint32_t& writer_id) {
+    dir_path_ = dir_path;
+    hostid_ = hostid;
+    writer_id_ = writer_id;
+}
+
+inline void WalkOutputWriter::write(RandomWalker& RWer) {
+    uint32_t node_num = RWer.getNodeNum();
+    uint64_t record_size = 8 + 8 * (uint64_t)node_num;
+    if (sizeof(WalkOutputHeader) + record_size > WALK_OUTPUT_SEGMENT_SIZE) {
+        std::cerr << "walk is larger than WALK_OUTPUT_SEGMENT_SIZE: " << record_size << " Byte" << std::endl;
+        exit(1);
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+
+    if (base_ == nullptr || used_ + record_size > WALK_OUTPUT_SEGMENT_SIZE) {
+        closeSegment();
+        openSegment();
+    }
+
+    char* record = base_ + used_;
+    uint32_t RWer_id = RWer.getRWerID();
+    memcpy(record, &RWer_id, 4);
+    memcpy(record + 4, &node_num, 4);
+    RWer.writeNodes((uint64_t*)(record + 8));
+    used_ += record_size;
+
+    // レコードを書き終えてから公開
+    header_->used_.store(used_, std::memory_order_release);
+    header_->walk_num_.store(header_->walk_num_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    walk_num_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline uint64_t WalkOutputWriter::getWalkNum() {
+    return walk_num_.load(std::memory_order_relaxed);
+}
+
+inline void WalkOutputWriter::close() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    closeSegment();
+}
+
+inline void WalkOutputWriter::openSegment() {
+    std::string file_path = dir_path_ + "walks_" + std::to_string(hostid_) + "_" + std::to_string(writer_id_) + "_" + std::to_string(segment_id_++) + ".bin";
+    fd_ = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        perror("open");
+        exit(1);
+    }
+    if (ftruncate(fd_, WALK_OUTPUT_SEGMENT_SIZE) < 0) {
+        perror("ftruncate");
+        exit(1);
+    }
+    void* addr = mmap(nullptr, WALK_OUTPUT_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    madvise(addr, WALK_OUTPUT_SEGMENT_SIZE, MADV_SEQUENTIAL);
+
+    base_ = (char*)addr;
+    header_ = (WalkOutputHeader*)base_;
+    header_->magic_ = WALK_OUTPUT_MAGIC;
+    used_ = sizeof(WalkOutputHeader);
+    header_->walk_num_.store(0, std::memory_order_relaxed);
+    header_->used_.store(used_, std::memory_order_release);
+}
+
+inline void WalkOutputWriter::closeSegment() {
+    if (base_ == nullptr) return;
+
+    munmap(base_, WALK_OUTPUT_SEGMENT_SIZE);
+    if (ftruncate(fd_, used_) < 0) perror("ftruncate");
+    ::close(fd_);
+    base_ = nullptr;
+    header_ = nullptr;
+    fd_ = -1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline void WalkOutputSink::init(const std::string& dir_path, const host_id_t& hostid) {
+    std::string dir = dir_path;
+    if (dir.empty() || dir.back() != '/') dir += "/";
+    mkdir(dir.c_str(), 0755);
+
+    writers_.clear();
+    for (uint32_t i = 0; i < WALK_OUTPUT_MAX_WRITER_NUM; i++) {
+        writers_.push_back(std::make_unique<WalkOutputWriter>());
+        writers_.back()->init(dir, hostid, i);
+    }
+    writer_num_ = 0;
+}
+
+inline void WalkOutputSink::write(RandomWalker& RWer) {
+    getWriter().write(RWer);
+}
+
+inline uint64_t WalkOutputSink::getWalkNum() {
+    uint64_t walk_num = 0;
+    uint32_t writer_num = std::min(writer_num_.load(), WALK_OUTPUT_MAX_WRITER_NUM);
+    for (uint32_t i = 0; i < writer_num; i++) walk_num += writers_[i]->getWalkNum();
+    return walk_num;
+}
+
+inline void WalkOutputSink::close() {
+    uint32_t writer_num = std::min(writer_num_.load(), WALK_OUTPUT_MAX_WRITER_NUM);
+    for (uint32_t i = 0; i < writer_num; i++) writers_[i]->close();
+}
+
+inline WalkOutputWriter& WalkOutputSink::getWriter() {
+    // 1 プロセスで複数の worker を動かすこともあるので, どの sink の書き込み先かも覚えておく
+    thread_local WalkOutputSink* owner = nullptr;
+    thread_local WalkOutputWriter* writer = nullptr;
+
+    if (owner != this) {
+        uint32_t writer_id = writer_num_.fetch_add(1);
+        if (writer_id >= WALK_OUTPUT_MAX_WRITER_NUM) {
+            std::cerr << "more writer threads than WALK_OUTPUT_MAX_WRITER_NUM (" << WALK_OUTPUT_MAX_WRITER_NUM << ")" << std::endl;
+            exit(1);
+        }
+        owner = this;
+        writer = writers_[writer_id].get();
+    }
+    return *writer;
+}
@@ -0,0 +1,220 @@
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "../include/random_walk_system_worker.hpp"
+#include "../include/start_manager.hpp"
+
+// 1 台のマシンの 1 プロセスで worker を N 個と StartManager を動かす (LOOPBACK_ENGINE)
+// worker 間のメッセージは疑似ネットワークを通り, 遅延・帯域・ロスを与えられる
+// StartManager との合図は loopback (worker: 127.0.0.1, StartManager: 127.0.0.2) の UDP / TCP
+//
+// ./a.out --source ../dataset/source_graph/karate.txt --workers 4 --rw-num 10 --wait 10
+//         [--directed] [--cache] [--cache-fill walk|prefetch] [--cache-budget 67108864] [--cache-policy none|clock|tinylfu] [--latency-us 50] [--bandwidth-mbps 10000] [--loss 0.01]
+//         [--cores 2] [--path-segment off|gather|local] [--walk-output ../output/]
+//         [--ppr endpoint|visit] [--ppr-table exact|space-saving] [--ppr-output ../output/] [--work-dir /tmp/rwsw_loopback/] [--startup-timeout 600] [--output result.txt]
+
+struct Option {
+    std::string source_path = "../dataset/source_graph/karate.txt"; // 辺リスト (1 行 "src dst")
+    bool directed = false;
+    uint32_t worker_num = 4;
+    int32_t RW_num = 1; // 1 頂点あたりの RW 実行回数
+    uint32_t wait_time = 10; // 開始から終了の合図までの時間 (s)
+    bool cache = false; // cache 補充の実行を先に行うか
+    uint32_t core_num = 0; // worker 1 つあたりのコア数 (0 なら hardware_concurrency / worker 数)
+    std::string work_dir = "/tmp/rwsw_loopback/"; // 分割したグラフの置き場所
+    uint32_t startup_timeout = 600; // worker の起動を待つ時間の上限 (s)
+    std::string output_path = ""; // 結果を追記するファイル
+    std::string ppr_output_dir = PPR_OUTPUT_DIR; // ppr_<HostID>.txt の書き出し先
+};
+
+void usage() {
+    std::cout << "usage: --source <edge list> --workers <N> --rw-num <R> --wait <s> [--directed] [--cache]" << std::endl;
+    std::cout << "       [--cache-fill walk|prefetch] [--cache-budget <bytes>] [--cache-policy none|clock|tinylfu] [--cache-snapshot <dir>] [--cache-learn on|off] [--ghost-table on|off]" << std::endl;
+    std::cout << "       [--latency-us <us>] [--bandwidth-mbps <Mbps>] [--loss <rate>] [--cores <per worker>] [--metrics <port>]" << std::endl;
+    std::cout << "       [--path-segment off|gather|local] [--walk-output <dir>] [--ppr endpoint|visit] [--ppr-table exact|space-saving] [--ppr-output <dir>]" << std::endl;
+    std::cout << "       [--work-dir <dir>] [--startup-timeout <s>] [--output <file>]" << std::endl;
+}
+
+Option parseOption(int argc, char *argv[]) {
+    Option option;
+    for (int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if (key == "--directed") { option.directed = true; continue; }
+        if (key == "--cache") { option.cache = true; continue; }
+        if (i + 1 >= argc) { usage(); exit(1); }
+
+        std::string value = argv[++i];
+        if (key == "--source") option.source_path = value;
+        else if (key == "--workers") option.worker_num = std::stoul(value);
+        else if (key == "--rw-num") option.RW_num = std::stoi(value);
+        else if (key == "--wait") option.wait_time = std::stoul(value);
+        else if (key == "--cache-fill") CACHE_PREFETCH_FLAG = value != "walk";
+        else if (key == "--cache-budget") CACHE_MEMORY_BUDGET = std::stoull(value);
+        else if (key == "--ghost-table") GHOST_TABLE_FLAG = value != "off";
+        else if (key == "--cache-learn") CACHE_LEARN_FLAG = value != "off";
+        else if (key == "--cache-snapshot") { CACHE_SNAPSHOT_FLAG = true; CACHE_SNAPSHOT_DIR = argv[i]; }
+        else if (key == "--cache-policy") CACHE_POLICY = value == "none" ? CACHE_POLICY_NONE : value == "clock" ? CACHE_POLICY_CLOCK : CACHE_POLICY_TINYLFU;
+        else if (key == "--latency-us") LOOPBACK_LATENCY_US = std::stoul(value);
+        else if (key == "--bandwidth-mbps") LOOPBACK_BANDWIDTH_MBPS = std::stoul(value);
+        else if (key == "--loss") LOOPBACK_LOSS_RATE = std::stod(value);
+        else if (key == "--cores") option.core_num = std::stoul(value);
+        else if (key == "--metrics") { METRICS_FLAG = true; METRICS_PORT = std::stoul(value); }
+        else if (key == "--path-segment") PATH_SEGMENT_MODE = value == "gather" ? PATH_SEGMENT_GATHER : value == "local" ? PATH_SEGMENT_LOCAL : PATH_SEGMENT_OFF;
+        else if (key == "--walk-output") { WALK_OUTPUT_FLAG = true; WALK_OUTPUT_DIR = argv[i]; }
+        else if (key == "--ppr") PPR_COUNT_MODE = value == "visit" ? PPR_COUNT_VISIT : value == "endpoint" ? PPR_COUNT_ENDPOINT : PPR_COUNT_OFF;
+        else if (key == "--ppr-table") PPR_TABLE_KIND = value == "space-saving" ? PPR_TABLE_SPACE_SAVING : PPR_TABLE_EXACT;
+        else if (key == "--ppr-output") option.ppr_output_dir = value;
+        else if (key == "--work-dir") option.work_dir = value;
+        else if (key == "--startup-timeout") option.startup_timeout = std::stoul(value);
+        else if (key == "--output") option.output_path = value;
+        else { usage(); exit(1); }
+    }
+    if (option.work_dir.back() != '/') option.work_dir += "/";
+    if (option.ppr_output_dir.back() != '/') option.ppr_output_dir += "/";
+    return option;
+}
+
+// 辺リストを worker 数で分割して work_dir/loopback_<HostID>.data に書く (split_graph と同じく頂点 ID % worker 数)
+// ghost 頂点の表と分割の情報 (OWNERSHIP_HASH) も work_dir/loopback_<HostID>.ghost, .owner に書く
+void splitGraph(const Option& option) {
+    mkdir(option.work_dir.c_str(), 0755);
+
+    std::vector<std::vector<Edge_dstIp>> edges(option.worker_num);
+    FILE *in_f = fopen(option.source_path.c_str(), "r");
+    if (in_f == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    uint64_t src, dst; // VERTEX_ID_32 でも %lu で読む
+    while (2 == fscanf(in_f, "%lu %lu", &src, &dst)) {
+        edges[src%option.worker_num].push_back(Edge_dstIp(src, dst, dst%option.worker_num));
+        if (!option.directed) edges[dst%option.worker_num].push_back(Edge_dstIp(dst, src, src%option.worker_num));
+    }
+    fclose(in_f);
+
+    std::vector<std::vector<GhostVertex>> ghosts;
+    build_ghost_table(edges, ghosts);
+
+    Ownership ownership;
+    ownership.initHash(option.worker_num);
+
+    for (uint32_t i = 0; i < option.worker_num; i++) {
+        std::string output_path = option.work_dir + "loopback_" + std::to_string(i) + ".data";
+        FILE *out_f = fopen(output_path.c_str(), "w");
+        assert(out_f != NULL);
+        auto ret = fwrite(edges[i].data(), sizeof(Edge_dstIp), edges[i].size(), out_f);
+        assert(ret == edges[i].size());
+        fclose(out_f);
+
+        std::string ghost_path = option.work_dir + "loopback_" + std::to_string(i) + ".ghost";
+        FILE *ghost_f = fopen(ghost_path.c_str(), "w");
+        assert(ghost_f != NULL);
+        ret = fwrite(ghosts[i].data(), sizeof(GhostVertex), ghosts[i].size(), ghost_f);
+        assert(ret == ghosts[i].size());
+        fclose(ghost_f);
+
+        ownership.write(option.work_dir + "loopback_" + std::to_string(i) + ".owner");
+    }
+}
+
+// 127.0.0.1:port の UDP ソケットが bind されているか (/proc/net/udp を見る)
+// worker は初期化を終えてから受信スレッドで bind するので, これで起動を待てる
+bool isUdpPortBound(const uint16_t& port) {
+    std::ifstream reading_file("/proc/net/udp");
+    std::string reading_line_buffer;
+    char local_address[32];
+    snprintf(local_address, sizeof(local_address), "0100007F:%04X", port);
+    while (std::getline(reading_file, reading_line_buffer)) {
+        if (reading_line_buffer.find(local_address) != std::string::npos) return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    Option option = parseOption(argc, argv);
+
+    // StartManager と worker の合図は相手が待ち受ける前に書き込むことがあるので, プロセスごと落ちないようにする
+    signal(SIGPIPE, SIG_IGN);
+
+    // 全 worker で共有する設定
+    TRANSPORT_ENGINE = LOOPBACK_ENGINE;
+    SEND_QUEUE_NUM = option.worker_num;
+    RUNTIME_CORE_NUM = option.core_num > 0 ? option.core_num : std::max<uint32_t>(1, std::thread::hardware_concurrency() / option.worker_num);
+    getLoopbackNetwork().init(option.worker_num);
+
+    splitGraph(option);
+
+    if (PPR_COUNT_MODE != PPR_COUNT_OFF) {
+        mkdir(option.ppr_output_dir.c_str(), 0755);
+        PPR_OUTPUT_DIR = option.ppr_output_dir.c_str();
+    }
+
+    // worker は 127.0.0.1 に並べる (ポート番号は HostID 毎にずれる)
+    std::vector<host_id_t> worker_ip_all(option.worker_num, inet_addr("127.0.0.1"));
+    for (uint32_t i = 0; i < option.worker_num; i++) {
+        std::thread([&option, worker_ip_all, i]{
+            RandomWalkSystemWorker rwsw(option.work_dir, i, worker_ip_all, "loopback_" + std::to_string(i));
+        }).detach();
+    }
+
+    // 全 worker の合図用ポートが開くまで待つ
+    Timer timer;
+    for (uint32_t i = 0; i < option.worker_num; i++) {
+        while (!isUdpPortBound(10000 + getPortOffset(i, worker_ip_all))) {
+            if (timer.duration() > option.startup_timeout) {
+                std::cout << "worker " << i << " did not start" << std::endl;
+                _exit(1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    std::cout << "all workers started: " << timer.duration() << " s" << std::endl;
+
+    std::ofstream ofs_time, ofs_rerun; // StartManager の出力 (使わない)
+    StartManager start(option.worker_num, inet_addr("127.0.0.2"), worker_ip_all);
+
+    if (option.cache) {
+        start.sendStartCache();
+        if (start.getCacheRWerNum() > 0) std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    start.sendStart(ofs_time, ofs_rerun, option.RW_num);
+
+    std::this_thread::sleep_for(std::chrono::seconds(option.wait_time));
+
+    start.sendEnd(ofs_time, ofs_rerun);
+
+    // 結果
+    uint32_t sum_end_count = start.getSumEndCount();
+    double execution_time = start.getMaxExecutionTime();
+    double walks_per_sec = execution_time > 0 ? sum_end_count / execution_time : 0;
+    std::cout << "workers: " << option.worker_num
+              << ", latency_us: " << LOOPBACK_LATENCY_US << ", bandwidth_mbps: " << LOOPBACK_BANDWIDTH_MBPS << ", loss: " << LOOPBACK_LOSS_RATE
+              << ", walks: " << sum_end_count << ", execution_time: " << execution_time << ", walks/sec: " << walks_per_sec
+              << ", lost messages: " << getLoopbackNetwork().getLossCount() << std::endl;
+
+    if (option.output_path != "") {
+        std::ofstream ofs(option.output_path, std::ios::app);
+        ofs << option.worker_num << " " << LOOPBACK_LATENCY_US << " " << LOOPBACK_BANDWIDTH_MBPS << " " << LOOPBACK_LOSS_RATE << " "
+            << sum_end_count << " " << execution_time << " " << walks_per_sec << std::endl;
+    }
+
+    // 全 RWer が終わった後に credit が残っていれば返し忘れ (流量制御がいずれ止まる)
+    int64_t sum_in_flight = start.getSumInFlight();
+    if (sum_in_flight != 0) {
+        std::cout << "credit not returned: in_flight " << sum_in_flight << std::endl;
+        _exit(1);
+    }
+
+    // worker のスレッドは常駐しているのでそのまま終了
+    std::cout << std::flush;
+    _exit(0);
+}
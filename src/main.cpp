@@ -7,8 +7,11 @@ int main(int argc, char *argv[]) {
     // char* から string に変換
     std::string dir_path = argv[1]; 
 
+    // 1 台に複数の worker を置く場合は HostID (server.txt の何行目か) を指定
+    int32_t hostid = argc > 2 ? std::stoi(argv[2]) : -1;
+
     // workerを起動 
-    RandomWalkSystemWorker rwsw(dir_path); 
+    RandomWalkSystemWorker rwsw(dir_path, hostid); 
     
     return 0;
 }
\ No newline at end of file
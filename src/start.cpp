@@ -39,7 +39,8 @@ int main(int argc, char *argv[]) {
 
     start.sendStartCache();
 
-    std::this_thread::sleep_for(std::chrono::seconds(15));
+    // cache 補充用の RWer が戻りきるのを待つ (隣接リストの要求やスナップショットで補充した場合は RWer を使わない)
+    if (start.getCacheRWerNum() > 0) std::this_thread::sleep_for(std::chrono::seconds(15));
 
     start.sendStart(ofs_time, ofs_rerun, RW_num);
 
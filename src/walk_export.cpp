@@ -0,0 +1,138 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <charconv>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/walk_output_sink.hpp"
+
+// WalkOutputSink が書き出した walks_*.bin を 1 行 1 経路のテキスト (頂点 ID を空白区切り) にする (DeepWalk などのコーパス)
+// 書き込み中のファイルでもヘッダの書き込み済みの大きさまでを読む
+// (途中で切れた経路 (書き込み中に落ちた等) があれば, そこで読むのをやめる)
+//
+// ./a.out [--id] ../output/walks_*.bin > walks.txt
+// --id: 行頭に RWer ID とタブをつける (HostID はファイル名から分かる)
+
+// 出力バッファ
+class TextWriter {
+
+public :
+
+    TextWriter() { buffer_.resize(1<<20); }
+
+    ~TextWriter() { flush(); }
+
+    void writeUint(const uint64_t& value) {
+        reserve(24);
+        idx_ = std::to_chars(buffer_.data() + idx_, buffer_.data() + buffer_.size(), value).ptr - buffer_.data();
+    }
+
+    void writeChar(const char& c) {
+        reserve(1);
+        buffer_[idx_++] = c;
+    }
+
+    void flush() {
+        if (idx_ > 0 && fwrite(buffer_.data(), 1, idx_, stdout) != idx_) {
+            perror("fwrite");
+            exit(1);
+        }
+        idx_ = 0;
+    }
+
+private :
+
+    std::vector<char> buffer_;
+    size_t idx_ = 0;
+
+    void reserve(const size_t& size) {
+        if (idx_ + size > buffer_.size()) flush();
+    }
+
+};
+
+// 1 ファイル分を出力し, 経路数を返す
+uint64_t exportFile(const std::string& file_path, const bool& print_id, TextWriter& writer) {
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        exit(1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if ((uint64_t)st.st_size < sizeof(WalkOutputHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    const char* base = (const char*)addr;
+    const WalkOutputHeader* header = (const WalkOutputHeader*)base;
+    if (header->magic_ != WALK_OUTPUT_MAGIC) {
+        std::cerr << file_path << ": not a walk output file" << std::endl;
+        exit(1);
+    }
+    uint64_t used = std::min<uint64_t>(header->used_.load(std::memory_order_acquire), st.st_size);
+
+    uint64_t walk_num = 0;
+    uint64_t idx = sizeof(WalkOutputHeader);
+    while (idx < used) {
+        // 経路 1 つ分 ([RWer ID (4Byte)][頂点数 (4Byte)][頂点 (8Byte) * 頂点数]) が揃っているか
+        uint32_t RWer_id = 0, node_num = 0;
+        if (used - idx >= 8) {
+            RWer_id = *(const uint32_t*)(base + idx);
+            node_num = *(const uint32_t*)(base + idx + 4);
+        }
+        uint64_t record_size = 8 + 8 * (uint64_t)node_num;
+        if (record_size > used - idx) {
+            std::cerr << file_path << ": truncated walk at " << idx << " Byte (" << used - idx << " Byte left), stop reading" << std::endl;
+            break;
+        }
+        const uint64_t* nodes = (const uint64_t*)(base + idx + 8);
+        if (print_id) {
+            writer.writeUint(RWer_id);
+            writer.writeChar('\t');
+        }
+        for (uint32_t i = 0; i < node_num; i++) {
+            if (i > 0) writer.writeChar(' ');
+            writer.writeUint(nodes[i]);
+        }
+        writer.writeChar('\n');
+        idx += record_size;
+        walk_num++;
+    }
+
+    munmap(addr, st.st_size);
+    close(fd);
+    return walk_num;
+}
+
+int main(int argc, char *argv[]) {
+    bool print_id = false;
+    std::vector<std::string> file_paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--id") print_id = true;
+        else file_paths.push_back(arg);
+    }
+    if (file_paths.empty()) {
+        std::cerr << "usage: [--id] <walks_*.bin> ..." << std::endl;
+        exit(1);
+    }
+
+    TextWriter writer;
+    uint64_t walk_num = 0;
+    for (const std::string& file_path : file_paths) walk_num += exportFile(file_path, print_id, writer);
+    writer.flush();
+
+    std::cerr << "walks: " << walk_num << std::endl;
+}
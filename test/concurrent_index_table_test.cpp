@@ -0,0 +1,161 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+
+using namespace std;
+
+#include "../include/cache_helper.hpp"
+
+// ConcurrentIndexTable の登録 / 参照 / 追い出し (CACHE_POLICY 毎) と,
+// 参照と登録 (追い出し) を同時に行っても壊れた値を返さないことを確認する
+
+const uint64_t MEMORY_BUDGET = 1<<16;
+const uint32_t THREAD_NUM = 8;
+const double CONCURRENT_TIME = 2; // (s)
+
+// キーに対応する値 (参照した値が正しいかを確かめる)
+vertex_id_t valueOf(const vertex_id_t& node_ID, const index_t& index_num) {
+    return (node_ID * 31 + index_num) % 1000003;
+}
+
+// 容量の何倍かのキーを登録し, 入っているものは正しい値で引けることを確かめる
+bool testInsertFind(const uint32_t& policy) {
+    CACHE_POLICY = policy;
+    ConcurrentIndexTable table;
+    table.init(MEMORY_BUDGET);
+    uint64_t capacity = table.getCapacity();
+
+    uint64_t inserted = 0, rejected = 0, evicted = 0;
+    for (vertex_id_t v = 0; v < 4 * capacity; v++) {
+        index_t evicted_index;
+        ConcurrentIndexTable::InsertResult result = table.insert(v, v % 7, valueOf(v, v % 7), evicted_index);
+        if (result == ConcurrentIndexTable::INSERTED) inserted++;
+        if (result == ConcurrentIndexTable::REJECTED) rejected++;
+        if (evicted_index != INF) evicted++;
+
+        // 入れた直後に同じキーを入れると EXISTS
+        if (result == ConcurrentIndexTable::INSERTED && table.insert(v, v % 7, valueOf(v, v % 7), evicted_index) != ConcurrentIndexTable::EXISTS) {
+            cout << "policy " << policy << ": re-insert of " << v << " is not EXISTS" << endl;
+            return false;
+        }
+    }
+
+    uint64_t found = 0;
+    for (vertex_id_t v = 0; v < 4 * capacity; v++) {
+        vertex_id_t value = table.find(v, v % 7);
+        if (value == INF) continue;
+        if (value != valueOf(v, v % 7) || !table.contains(v, v % 7)) {
+            cout << "policy " << policy << ": vertex " << v << " has " << value << endl;
+            return false;
+        }
+        found++;
+    }
+
+    if (table.getSize() != found || found > capacity || inserted - evicted != found
+        || table.getEvictCount() != evicted || table.getRejectCount() != rejected) {
+        cout << "policy " << policy << ": size " << table.getSize() << ", found " << found << ", inserted " << inserted
+             << ", evicted " << evicted << ", rejected " << rejected << ", capacity " << capacity << endl;
+        return false;
+    }
+    // 追い出さない方針は断るだけ, 追い出す方針は入れ替える
+    if ((policy == CACHE_POLICY_NONE && (evicted != 0 || rejected == 0)) || (policy == CACHE_POLICY_CLOCK && (evicted == 0 || rejected != 0))) {
+        cout << "policy " << policy << ": evicted " << evicted << ", rejected " << rejected << endl;
+        return false;
+    }
+
+    uint64_t count = 0;
+    table.forEach([&](const vertex_id_t& node_ID, const index_t& index_num, const vertex_id_t& value) {
+        if (value == valueOf(node_ID, index_num)) count++;
+    });
+    if (count != found) {
+        cout << "policy " << policy << ": forEach saw " << count << " of " << found << endl;
+        return false;
+    }
+    return true;
+}
+
+// TinyLFU: よく参照されるキーは 1 回ずつしか参照されないキーの流れで追い出されない
+bool testTinyLfuKeepsHotKeys() {
+    CACHE_POLICY = CACHE_POLICY_TINYLFU;
+    ConcurrentIndexTable table;
+    table.init(MEMORY_BUDGET);
+    uint64_t capacity = table.getCapacity();
+
+    // 容量の 1/8 をよく参照されるキーにする (推定のカウンタは 1 行あたり容量の 1/4 個なので, それより十分少なく)
+    uint64_t hot_num = capacity / 8;
+    index_t evicted_index;
+    for (vertex_id_t v = 0; v < hot_num; v++) table.insert(v, 0, valueOf(v, 0), evicted_index);
+    for (uint32_t round = 0; round < 64; round++) {
+        for (vertex_id_t v = 0; v < hot_num; v++) table.find(v, 0);
+    }
+
+    // 1 回ずつ参照されて登録されるキー (容量の 2 倍)
+    for (vertex_id_t v = hot_num; v < hot_num + 2 * capacity; v++) {
+        if (table.find(v, 0) == INF) table.insert(v, 0, valueOf(v, 0), evicted_index);
+    }
+
+    uint64_t hot_found = 0;
+    for (vertex_id_t v = 0; v < hot_num; v++) {
+        if (table.contains(v, 0)) hot_found++;
+    }
+    if (hot_found < hot_num * 9 / 10) {
+        cout << "tinylfu: " << hot_found << " of " << hot_num << " hot keys left" << endl;
+        return false;
+    }
+    return true;
+}
+
+// 半分のスレッドが登録 (追い出し) し続け, 残りが参照し続けても, 参照した値は常にそのキーの値か INF
+bool testConcurrent(const uint32_t& policy) {
+    CACHE_POLICY = policy;
+    ConcurrentIndexTable table;
+    table.init(MEMORY_BUDGET);
+    vertex_id_t key_num = 8 * table.getCapacity();
+
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> wrong = 0, hit = 0;
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < THREAD_NUM; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 mt(t);
+            std::uniform_int_distribution<vertex_id_t> dis(0, key_num - 1);
+            while (!stop.load(std::memory_order_relaxed)) {
+                vertex_id_t v = dis(mt);
+                index_t index_num = v % 5;
+                if (t % 2 == 0) {
+                    index_t evicted_index;
+                    table.insert(v, index_num, valueOf(v, index_num), evicted_index);
+                } else {
+                    vertex_id_t value = table.find(v, index_num);
+                    if (value == INF) continue;
+                    hit.fetch_add(1, std::memory_order_relaxed);
+                    if (value != valueOf(v, index_num)) wrong.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(CONCURRENT_TIME));
+    stop = true;
+    for (std::thread& thread : threads) thread.join();
+
+    if (wrong != 0 || hit == 0 || table.getSize() > table.getCapacity()) {
+        cout << "concurrent policy " << policy << ": wrong " << wrong << ", hit " << hit << ", size " << table.getSize() << endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    ok &= testInsertFind(CACHE_POLICY_NONE);
+    ok &= testInsertFind(CACHE_POLICY_CLOCK);
+    ok &= testInsertFind(CACHE_POLICY_TINYLFU);
+    ok &= testTinyLfuKeepsHotKeys();
+    ok &= testConcurrent(CACHE_POLICY_CLOCK);
+    ok &= testConcurrent(CACHE_POLICY_TINYLFU);
+
+    cout << (ok ? "ok" : "failed") << endl;
+    return ok ? 0 : 1;
+}
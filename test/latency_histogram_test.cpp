@@ -0,0 +1,124 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+#include "../include/latency_histogram.hpp"
+
+// LatencyHistogram のバケットの境界 (getBucketIndex / getBucketMax) と分位点 (getPercentile) を確認する
+
+const uint32_t VALUE_NUM = 200000;
+
+// どの値も, 入るバケットの上端以下で, 1 つ前のバケットの上端より大きく, 上端との差は 1/SUB_BUCKET_NUM 以下
+bool testBucket() {
+    std::vector<uint64_t> values;
+    for (uint64_t v = 0; v < 4096; v++) values.push_back(v);
+    for (uint32_t bit = 12; bit < 32; bit++) {
+        uint64_t base = (uint64_t)1 << bit;
+        values.push_back(base - 1);
+        values.push_back(base);
+        values.push_back(base + 1);
+        values.push_back(base + base / 3);
+    }
+    values.push_back(UINT32_MAX);
+
+    uint32_t prev_idx = 0;
+    for (uint64_t v : values) {
+        uint32_t idx = LatencyHistogram::getBucketIndex(v);
+        uint64_t bucket_max = LatencyHistogram::getBucketMax(idx);
+        if (idx >= LatencyHistogram::BUCKET_NUM || idx < prev_idx) {
+            cout << "bucket: value " << v << " -> index " << idx << " (previous " << prev_idx << ")" << endl;
+            return false;
+        }
+        if (bucket_max < v || (idx > 0 && LatencyHistogram::getBucketMax(idx - 1) >= v)) {
+            cout << "bucket: value " << v << " not in bucket " << idx << " (max " << bucket_max << ")" << endl;
+            return false;
+        }
+        if (bucket_max - v > v / LatencyHistogram::SUB_BUCKET_NUM) {
+            cout << "bucket: value " << v << " bucket max " << bucket_max << " too far" << endl;
+            return false;
+        }
+        prev_idx = idx;
+    }
+
+    // 小さい値は 1 つずつ, 32bit を超える値は最後のバケット
+    for (uint64_t v = 0; v < 2 * LatencyHistogram::SUB_BUCKET_NUM; v++) {
+        if (LatencyHistogram::getBucketIndex(v) != v || LatencyHistogram::getBucketMax(v) != v) {
+            cout << "bucket: small value " << v << " not exact" << endl;
+            return false;
+        }
+    }
+    uint32_t last = LatencyHistogram::getBucketIndex(UINT32_MAX);
+    if (last != LatencyHistogram::BUCKET_NUM - 1 || LatencyHistogram::getBucketIndex((uint64_t)1 << 40) != last
+        || LatencyHistogram::getBucketMax(last) != UINT32_MAX) {
+        cout << "bucket: last bucket " << last << " of " << LatencyHistogram::BUCKET_NUM << endl;
+        return false;
+    }
+    return true;
+}
+
+// 分位点はその順位の値の入ったバケットの上端 (最大値を超えない)
+bool testPercentile() {
+    LatencyHistogram empty;
+    if (empty.getPercentile(0.5) != 0 || empty.getCount() != 0) {
+        cout << "percentile: empty histogram" << endl;
+        return false;
+    }
+
+    std::mt19937_64 mt(1);
+    std::lognormal_distribution<double> dis(8, 2); // µs の latency 風 (裾が長い)
+    std::vector<uint64_t> values;
+    LatencyHistogram histogram[2];
+    for (uint32_t i = 0; i < VALUE_NUM; i++) {
+        uint64_t v = std::min<double>(dis(mt), 1e9);
+        values.push_back(v);
+        histogram[i % 2].record(v); // 2 スレッド分に分けて add でまとめる
+    }
+    LatencyHistogram merged;
+    merged.add(histogram[0]);
+    merged.add(histogram[1]);
+    std::sort(values.begin(), values.end());
+
+    if (merged.getCount() != VALUE_NUM || merged.getMax() != values.back()) {
+        cout << "percentile: count " << merged.getCount() << ", max " << merged.getMax() << endl;
+        return false;
+    }
+
+    for (double q : {0.0, 0.01, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+        uint64_t rank = std::max<uint64_t>(1, std::min<uint64_t>(VALUE_NUM, (uint64_t)std::ceil(q * VALUE_NUM)));
+        uint64_t expected = values[rank - 1];
+        uint64_t got = merged.getPercentile(q);
+        uint64_t bucket_max = std::min(LatencyHistogram::getBucketMax(LatencyHistogram::getBucketIndex(expected)), values.back());
+        if (got != bucket_max) {
+            cout << "percentile: q " << q << " got " << got << ", expected " << bucket_max << " (value " << expected << ")" << endl;
+            return false;
+        }
+    }
+
+    // 32bit を超える値は最後のバケットに入るが, 最大値はそのまま
+    LatencyHistogram large;
+    large.record((uint64_t)1 << 40);
+    if (large.getPercentile(0.5) != UINT32_MAX || large.getMax() != (uint64_t)1 << 40) {
+        cout << "percentile: large value p50 " << large.getPercentile(0.5) << ", max " << large.getMax() << endl;
+        return false;
+    }
+
+    merged.clear();
+    if (merged.getCount() != 0 || merged.getMax() != 0 || merged.getPercentile(0.99) != 0) {
+        cout << "percentile: clear" << endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    ok &= testBucket();
+    ok &= testPercentile();
+
+    cout << (ok ? "ok" : "failed") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+#include "../include/message_queue.hpp"
+#include "../include/util.hpp"
+
+// 比較用: 以前の std::queue + mutex 実装
+template <typename T>
+struct LockedMessageQueue {
+
+    void push(std::unique_ptr<T>&& message) {
+        std::lock_guard<std::mutex> lk(mtx_message_queue_);
+        bool queue_empty = message_queue_.empty();
+        message_queue_.push(std::move(message));
+        if (queue_empty) cv_message_queue_.notify_all();
+    }
+
+    uint32_t pop(std::vector<std::unique_ptr<T>>& ptr_vec) {
+        std::unique_lock<std::mutex> lk(mtx_message_queue_);
+        cv_message_queue_.wait(lk, [&]{ return !message_queue_.empty(); });
+        uint32_t vec_size = message_queue_.size();
+        while (message_queue_.size()) {
+            ptr_vec.push_back(std::move(message_queue_.front()));
+            message_queue_.pop();
+        }
+        return vec_size;
+    }
+
+    uint32_t getSize() {
+        std::lock_guard<std::mutex> lk(mtx_message_queue_);
+        return message_queue_.size();
+    }
+
+    std::queue<std::unique_ptr<T>> message_queue_;
+    std::mutex mtx_message_queue_;
+    std::condition_variable cv_message_queue_;
+};
+
+struct Item {
+    uint64_t value;
+};
+
+// producer_num 個のスレッドが合計 total 個 push し, 1 つの consumer がまとめて pop する
+// (executeRandomWalk -> send_queue_ -> sendMessage の形)
+template <typename Queue>
+double bench(Queue& queue, const uint32_t producer_num, const uint64_t total) {
+    uint64_t per_thread = total / producer_num;
+    uint64_t all = per_thread * producer_num;
+
+    Timer timer;
+    std::thread consumer([&]{
+        uint64_t count = 0;
+        while (count < all) {
+            std::vector<std::unique_ptr<Item>> ptr_vec;
+            count += queue.pop(ptr_vec);
+            queue.getSize(); // sendMessage の getSize() 監視
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producer_num; p++) {
+        producers.emplace_back([&, p]{
+            for (uint64_t i = 0; i < per_thread; i++) {
+                queue.push(std::make_unique<Item>(Item{p * per_thread + i}));
+            }
+        });
+    }
+    for (std::thread& th : producers) th.join();
+    consumer.join();
+
+    return all / timer.duration() / 1e6;
+}
+
+int main() {
+    const uint64_t total = 1<<22;
+
+    cout << "producers, locked (Mops/s), lock-free (Mops/s)" << endl;
+    for (uint32_t producer_num = 1; producer_num <= 64; producer_num *= 2) {
+        LockedMessageQueue<Item> locked_queue;
+        MessageQueue<Item> ring_queue;
+        double locked = bench(locked_queue, producer_num, total);
+        double ring = bench(ring_queue, producer_num, total);
+        cout << producer_num << ", " << locked << ", " << ring << endl;
+    }
+    return 0;
+}
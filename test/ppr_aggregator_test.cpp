@@ -0,0 +1,213 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+#include "../include/ppr_aggregator.hpp"
+
+// PprCounter の上位 k 個 (正確な表 / Space-Saving) と, PprAggregator で複数スレッドのバッファをまとめた結果を確認する
+
+const uint32_t VERTEX_NUM = 10000;
+const uint32_t STREAM_LENGTH = 200000;
+const uint32_t SOURCE_NUM = 100;
+const uint32_t THREAD_NUM = 8;
+const uint32_t PAIR_PER_THREAD = 50000; // PPR_LOCAL_BUFFER_NUM を跨ぐように
+
+// 偏った (Zipf 風の) 頂点の列
+std::vector<vertex_id_t> makeStream(const uint32_t& seed) {
+    std::mt19937 mt(seed);
+    std::vector<double> weight(VERTEX_NUM);
+    for (uint32_t v = 0; v < VERTEX_NUM; v++) weight[v] = 1.0 / (v + 1);
+    std::discrete_distribution<uint32_t> dis(weight.begin(), weight.end());
+
+    std::vector<vertex_id_t> stream(STREAM_LENGTH);
+    for (vertex_id_t& v : stream) v = (dis(mt) * 7919) % VERTEX_NUM; // 頻度と ID の順を揃えない
+    return stream;
+}
+
+// 正確な回数 (回数の多い順, 同じなら ID の小さい順)
+std::vector<std::pair<vertex_id_t, uint64_t>> exactTop(const std::map<vertex_id_t, uint64_t>& truth) {
+    std::vector<std::pair<vertex_id_t, uint64_t>> top(truth.begin(), truth.end());
+    std::sort(top.begin(), top.end(), [](const std::pair<vertex_id_t, uint64_t>& a, const std::pair<vertex_id_t, uint64_t>& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return a.first < b.first;
+    });
+    return top;
+}
+
+bool testExact() {
+    PPR_TABLE_KIND = PPR_TABLE_EXACT;
+    std::vector<vertex_id_t> stream = makeStream(1);
+    std::map<vertex_id_t, uint64_t> truth;
+    PprCounter counter;
+    for (vertex_id_t v : stream) {
+        truth[v]++;
+        counter.add(v, 1);
+    }
+
+    std::vector<std::pair<vertex_id_t, uint64_t>> expected = exactTop(truth);
+    expected.resize(PPR_TOP_K);
+    if (counter.getTotal() != STREAM_LENGTH || counter.getTopK(PPR_TOP_K) != expected) {
+        cout << "exact: top-k mismatch" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool testSpaceSaving() {
+    PPR_TABLE_KIND = PPR_TABLE_SPACE_SAVING;
+    std::vector<vertex_id_t> stream = makeStream(2);
+    std::map<vertex_id_t, uint64_t> truth;
+    PprCounter counter;
+    // 回数をまとめて足す場合も混ぜる (flushBuffer は同じ頂点をまとめて足す)
+    for (uint32_t i = 0; i < stream.size(); i++) {
+        uint64_t count = i % 3 + 1;
+        truth[stream[i]] += count;
+        counter.add(stream[i], count);
+    }
+
+    uint64_t total = 0;
+    for (const auto& [v, count] : truth) total += count;
+    if (counter.getTotal() != total) {
+        cout << "space-saving: total " << counter.getTotal() << " != " << total << endl;
+        return false;
+    }
+
+    // Space-Saving の保証: 推定値は真の値以上で, 多めに出るのは total / PPR_SPACE_SAVING_SIZE まで
+    // 真の値が total / PPR_SPACE_SAVING_SIZE を超える頂点は必ず残る
+    uint64_t max_error = total / PPR_SPACE_SAVING_SIZE;
+    std::vector<std::pair<vertex_id_t, uint64_t>> all = counter.getTopK(PPR_SPACE_SAVING_SIZE);
+    if (all.size() != PPR_SPACE_SAVING_SIZE) {
+        cout << "space-saving: " << all.size() << " counters" << endl;
+        return false;
+    }
+    std::map<vertex_id_t, uint64_t> estimate(all.begin(), all.end());
+    for (const auto& [v, count] : estimate) {
+        if (count < truth[v] || count > truth[v] + max_error) {
+            cout << "space-saving: vertex " << v << " estimate " << count << ", truth " << truth[v] << endl;
+            return false;
+        }
+    }
+    for (const auto& [v, count] : truth) {
+        if (count > max_error && estimate.count(v) == 0) {
+            cout << "space-saving: heavy vertex " << v << " (" << count << ") dropped" << endl;
+            return false;
+        }
+    }
+
+    // 真の値が k+1 番目の真の値より max_error 以上多い頂点は, 推定値でも上位 k 個に入る
+    std::vector<std::pair<vertex_id_t, uint64_t>> expected = exactTop(truth);
+    std::vector<std::pair<vertex_id_t, uint64_t>> top = counter.getTopK(PPR_TOP_K);
+    std::map<vertex_id_t, uint64_t> top_map(top.begin(), top.end());
+    uint32_t sure_num = 0;
+    for (uint32_t i = 0; i < PPR_TOP_K; i++) {
+        if (expected[i].second <= expected[PPR_TOP_K].second + max_error) continue;
+        sure_num++;
+        if (top_map.count(expected[i].first) == 0) {
+            cout << "space-saving: top vertex " << expected[i].first << " (" << expected[i].second << ") not in top-k" << endl;
+            return false;
+        }
+    }
+    if (sure_num == 0) {
+        cout << "space-saving: stream too flat to check top-k" << endl;
+        return false;
+    }
+    return true;
+}
+
+// 書き出したファイルを (起点頂点, 頂点) -> 回数 に読む
+std::map<std::pair<vertex_id_t, vertex_id_t>, uint64_t> readOutput(const std::string& file_path) {
+    std::map<std::pair<vertex_id_t, vertex_id_t>, uint64_t> output;
+    std::ifstream ifs(file_path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        vertex_id_t source, node_id;
+        double ppr;
+        uint64_t count;
+        iss >> source >> node_id >> ppr >> count;
+        output[{source, node_id}] = count;
+    }
+    return output;
+}
+
+bool testMerge(const uint32_t& table_kind) {
+    PPR_TABLE_KIND = table_kind;
+    PprAggregator aggregator;
+    aggregator.init();
+
+    // 各スレッドが (起点頂点, 頂点) を数える (同じ組を複数スレッドが数える)
+    std::vector<std::map<std::pair<vertex_id_t, vertex_id_t>, uint64_t>> thread_truth(THREAD_NUM);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < THREAD_NUM; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 mt(100 + t);
+            std::uniform_int_distribution<vertex_id_t> source_dis(0, SOURCE_NUM - 1);
+            std::geometric_distribution<vertex_id_t> node_dis(0.2);
+            for (uint32_t i = 0; i < PAIR_PER_THREAD; i++) {
+                vertex_id_t source = source_dis(mt);
+                vertex_id_t node_id = source * 1000 + node_dis(mt);
+                aggregator.add(source, node_id);
+                thread_truth[t][{source, node_id}]++;
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    std::map<std::pair<vertex_id_t, vertex_id_t>, uint64_t> truth;
+    for (const auto& counts : thread_truth) {
+        for (const auto& [pair, count] : counts) truth[pair] += count;
+    }
+
+    std::string file_path = "/tmp/ppr_aggregator_test_" + std::to_string(getpid()) + ".txt";
+    aggregator.write(file_path, PPR_TOP_K);
+    std::map<std::pair<vertex_id_t, vertex_id_t>, uint64_t> output = readOutput(file_path);
+    remove(file_path.c_str());
+
+    if (aggregator.getSourceNum() != SOURCE_NUM) {
+        cout << "merge: " << aggregator.getSourceNum() << " sources" << endl;
+        return false;
+    }
+
+    // 起点頂点毎の上位 k 個が, 全スレッド分を足した正確な回数の上位 k 個と一致する
+    for (vertex_id_t source = 0; source < SOURCE_NUM; source++) {
+        std::map<vertex_id_t, uint64_t> source_truth;
+        for (auto it = truth.lower_bound({source, 0}); it != truth.end() && it->first.first == source; it++) source_truth[it->first.second] = it->second;
+        std::vector<std::pair<vertex_id_t, uint64_t>> expected = exactTop(source_truth);
+        expected.resize(std::min<uint64_t>(PPR_TOP_K, expected.size()));
+
+        uint32_t found = 0;
+        for (auto it = output.lower_bound({source, 0}); it != output.end() && it->first.first == source; it++) found++;
+        if (found != expected.size()) {
+            cout << "merge: source " << source << " has " << found << " lines" << endl;
+            return false;
+        }
+        for (const auto& [node_id, count] : expected) {
+            auto it = output.find({source, node_id});
+            // 起点頂点毎の頂点の種類は PPR_SPACE_SAVING_SIZE より十分少ないので, Space-Saving でも置き換えは起きず正確に残る
+            if (it == output.end() || it->second != count) {
+                cout << "merge: source " << source << " vertex " << node_id << " expected " << count << ", got " << (it == output.end() ? 0 : it->second) << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    ok &= testExact();
+    ok &= testSpaceSaving();
+    ok &= testMerge(PPR_TABLE_EXACT);
+    ok &= testMerge(PPR_TABLE_SPACE_SAVING);
+
+    cout << (ok ? "ok" : "failed") << endl;
+    return ok ? 0 : 1;
+}
@@ -18,10 +18,51 @@ int main() {
 
     cout << RWer.getPrevNodeID() << endl;
 
+    // 生成時刻は 64bit のまま運ぶ (32bit を超えても切り捨てない)
+    RWer.setStartTime(5000000000ULL);
+
     char message[1000];
     RWer.writeMessage(message);
 
     RandomWalker RWer2(message);
     RWer2.printRWer();
+    cout << "start time: " << RWer2.getStartTime() << (RWer2.getStartTime() == 5000000000ULL ? " ok" : " NG") << endl;
+
+    // 途中で切れたメッセージは復元しない (ちょうどの長さなら復元できる)
+    uint32_t RWer_size = RWer.getRWerSize();
+    bool valid_ok = RandomWalker::isValidMessage(message, RWer_size) && !RandomWalker::isValidMessage(message, RWer_size - 1)
+        && !RandomWalker::isValidMessage(message, 8);
+    cout << "valid message: " << (valid_ok ? "ok" : "NG") << endl;
+
+    // 経路の切り離し (一歩前と現在の頂点だけが残る)
+    std::vector<std::vector<uint64_t>> segments(1);
+    RWer2.cutSegment(segments[0]);
+    RWer2.printRWer();
+
+    cout << RWer2.getHostID() << " " << RWer2.getPrevNodeID() << " " << RWer2.getCurrentNodeID() << endl;
+
+    RWer2.updateRWer(4, 23456, 300, 555, 666);
+    RWer2.updateRWer(5, 12345, 400, 777, 888);
+    segments.emplace_back();
+    RWer2.cutSegment(segments[1]);
+    RWer2.printRWer();
+
+    // セグメントを戻すと全経路になる
+    RWer2.restorePath(segments);
+    RWer2.printRWer();
+
+    uint16_t path_length = 0;
+    std::vector<uint64_t> path;
+    RWer2.getPath(path_length, path);
+    cout << "path_length: " << path_length << endl;
+    for (int i = 0; i < path_length; i++) cout << path[i*5] << " ";
+    cout << endl;
+
+    // 書き出し用の頂点列 (getPath の頂点と同じになる)
+    std::vector<uint64_t> nodes(RWer2.getNodeNum());
+    RWer2.writeNodes(nodes.data());
+    cout << "node_num: " << nodes.size() << endl;
+    for (uint64_t node : nodes) cout << node << " ";
+    cout << endl;
     return 0;
-}
\ No newline at end of file
+}
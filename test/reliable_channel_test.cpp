@@ -0,0 +1,132 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+#include "../include/reliable_channel.hpp"
+#include "../include/util.hpp"
+
+// パケットロス / 重複 / 順序入れ替えを起こす疑似的な回線の上で,
+// 2 ホストが互いに MESSAGE_NUM 個のメッセージを送り, 全て 1 回ずつ届くことを確認する
+
+const uint32_t MESSAGE_NUM = 20000;
+const double LOSS_RATE = 0.2;
+const double DUPLICATE_RATE = 0.05;
+const uint32_t NEW_MESSAGE_PER_ROUND = 64;
+const double TIME_LIMIT = 60; // (s)
+
+struct Host {
+    host_id_t hostid_;
+    ReliableChannel reliable_;
+    uint32_t sent_ = 0;
+    std::vector<uint32_t> received_count_ = std::vector<uint32_t>(MESSAGE_NUM, 0);
+    uint32_t received_ = 0;
+};
+
+int main() {
+    std::mt19937 mt(12345);
+    std::uniform_real_distribution<double> dis(0, 1);
+
+    Host host[2];
+    for (int h = 0; h < 2; h++) {
+        host[h].hostid_ = h;
+        host[h].reliable_.init(2);
+    }
+    std::vector<std::string> link[2]; // link[h]: h から相手への回線上のメッセージ
+
+    Timer timer;
+    while (host[0].received_ < MESSAGE_NUM || host[1].received_ < MESSAGE_NUM) {
+        if (timer.duration() > TIME_LIMIT) {
+            cout << "timeout: received " << host[0].received_ << ", " << host[1].received_ << endl;
+            return 1;
+        }
+
+        // 送信
+        for (int h = 0; h < 2; h++) {
+            Host& me = host[h];
+            host_id_t peer = 1 - h;
+
+            // 新しいメッセージ (再送バッファに空きがある分だけ)
+            for (int i = 0; i < NEW_MESSAGE_PER_ROUND && me.sent_ < MESSAGE_NUM && me.reliable_.hasWindow(peer); i++) {
+                char* message = me.reliable_.getSlot(peer);
+                MessageHeader header;
+                header.src_host_id_ = me.hostid_;
+                header.seq_ = me.reliable_.getNextSeq(peer);
+                me.reliable_.fillAck(peer, header);
+                header.writeHeader(message);
+                memcpy(message + MessageHeader::LENGTH, &me.sent_, sizeof(uint32_t));
+                uint32_t length = MessageHeader::LENGTH + sizeof(uint32_t);
+                me.reliable_.commitSlot(peer, length);
+                link[h].emplace_back(message, length);
+                me.sent_++;
+            }
+
+            // 再送
+            me.reliable_.forEachExpired(peer, [&](const char* message, const uint32_t& length) {
+                std::string resend_message(message, length);
+                MessageHeader header;
+                header.readHeader(resend_message.data());
+                me.reliable_.fillAck(peer, header);
+                header.writeHeader(resend_message.data());
+                link[h].push_back(resend_message);
+            });
+
+            // ack だけのメッセージ
+            if (me.reliable_.getAckOwed(peer) > 0) {
+                char message[MessageHeader::LENGTH];
+                MessageHeader header;
+                header.src_host_id_ = me.hostid_;
+                me.reliable_.fillAck(peer, header);
+                header.writeHeader(message);
+                link[h].emplace_back(message, MessageHeader::LENGTH);
+            }
+        }
+
+        // 回線 (ロス, 重複, 順序入れ替え)
+        for (int h = 0; h < 2; h++) {
+            std::vector<std::string> delivered;
+            for (std::string& message : link[h]) {
+                if (dis(mt) < LOSS_RATE) continue;
+                delivered.push_back(message);
+                if (dis(mt) < DUPLICATE_RATE) delivered.push_back(message);
+            }
+            link[h].clear();
+            std::shuffle(delivered.begin(), delivered.end(), mt);
+
+            // 受信
+            Host& peer = host[1 - h];
+            for (std::string& message : delivered) {
+                MessageHeader header;
+                header.readHeader(message.data());
+                peer.reliable_.processAck(header.src_host_id_, header.ack_, header.sack_);
+                if (!peer.reliable_.accept(header.src_host_id_, header.seq_)) continue;
+                if (header.seq_ == 0) continue;
+
+                uint32_t id;
+                memcpy(&id, message.data() + MessageHeader::LENGTH, sizeof(uint32_t));
+                if (peer.received_count_[id]++ == 0) peer.received_++;
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    // 全て 1 回ずつ届いたか
+    for (int h = 0; h < 2; h++) {
+        for (uint32_t id = 0; id < MESSAGE_NUM; id++) {
+            if (host[h].received_count_[id] != 1) {
+                cout << "NG: host " << h << ", message " << id << " received " << host[h].received_count_[id] << " times" << endl;
+                return 1;
+            }
+        }
+    }
+
+    cout << "OK: " << MESSAGE_NUM << " messages each way, loss rate " << LOSS_RATE
+         << ", retransmit " << host[0].reliable_.getRetransmitCount() << " / " << host[1].reliable_.getRetransmitCount()
+         << ", time " << timer.duration() << " s" << endl;
+    return 0;
+}
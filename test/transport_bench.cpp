@@ -0,0 +1,118 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+#include "../include/transport_factory.hpp"
+#include "../include/util.hpp"
+
+// loopback 上で通信エンジン (UDP / io_uring / TCP / 共有メモリ) を Transport 経由で比較する
+// HostID 1 (127.0.0.2) から HostID 0 (127.0.0.1) へ送る
+// (共有メモリは 2 つとも 127.0.0.1 に置き, 同じマシンの worker として扱う)
+// packets/sec と 1 パケットあたりの CPU 時間 (送信 + 受信スレッド) を出力
+
+const uint64_t PACKET_NUM = 200000;
+const uint32_t PACKET_LENGTH = 8900; // sendMessage はメッセージをほぼ満杯まで詰める
+const uint32_t END_LENGTH = 1; // 終了の合図
+
+// スレッドの CPU 時間 (s)
+double threadCpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void bench(const uint32_t engine, const bool colocated) {
+    std::vector<host_id_t> worker_ip_all = {inet_addr("127.0.0.1"), inet_addr(colocated ? "127.0.0.1" : "127.0.0.2")};
+    std::unique_ptr<Transport> transport = createTransport(engine);
+    transport->init(0, worker_ip_all);
+    std::unique_ptr<Transport> src_transport = createTransport(engine);
+    src_transport->init(1, worker_ip_all);
+
+    // 受信スレッド
+    uint32_t receiver_num = transport->getReceiverNum();
+    std::atomic<uint64_t> received = 0;
+    std::atomic<uint32_t> finished = 0;
+    std::atomic<uint32_t> ready = 0;
+    std::vector<double> recv_cpu(receiver_num, 0);
+    std::vector<std::thread> receivers;
+    for (uint32_t i = 0; i < receiver_num; i++) {
+        receivers.emplace_back([&, i]{
+            std::unique_ptr<TransportReceiver> receiver = transport->createReceiver(i);
+            ready++;
+            double start = 0;
+            std::vector<Datagram> datagrams;
+            bool end = false;
+            while (!end) {
+                uint32_t datagram_num = receiver->receive(datagrams);
+                if (start == 0) start = threadCpuTime();
+                for (uint32_t j = 0; j < datagram_num; j++) {
+                    if (datagrams[j].length_ == END_LENGTH) end = true;
+                    else received++;
+                }
+            }
+            recv_cpu[i] = threadCpuTime() - start;
+            finished++;
+        });
+    }
+    while (ready < receiver_num) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // 送信スレッド
+    Timer timer;
+    double send_cpu = 0;
+    double send_time = 0;
+    std::thread sender_thread([&]{
+        std::unique_ptr<TransportSender> sender = src_transport->createSender(0);
+        double start = threadCpuTime();
+        for (uint64_t i = 0; i < PACKET_NUM; i++) {
+            memset(sender->getBuffer(), 0, PACKET_LENGTH);
+            sender->commit(PACKET_LENGTH);
+        }
+        sender->flush();
+        send_cpu = threadCpuTime() - start;
+        send_time = timer.duration();
+
+        // 全受信スレッドが終わるまで終了の合図を送る (ポートはランダムに選ばれる)
+        // TCP エンジンの UDP 受信スレッドにも届くように UDP でも送る
+        // (SO_REUSEPORT では送信元ポートで受信ソケットが決まるので, 毎回新しいソケットから送る)
+        while (finished < receiver_num) {
+            UdpTransportSender udp_sender(worker_ip_all[0], 10000);
+            sender->getBuffer()[0] = 0;
+            sender->commit(END_LENGTH);
+            sender->flush();
+            udp_sender.getBuffer()[0] = 0;
+            udp_sender.commit(END_LENGTH);
+            udp_sender.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    sender_thread.join();
+    for (std::thread& th : receivers) th.join();
+
+    double all_recv_cpu = 0;
+    for (double cpu : recv_cpu) all_recv_cpu += cpu;
+
+    const char* name[] = {USE_SO_REUSEPORT ? "UDP SO_REUSEPORT" : "UDP", "io_uring", "TCP"};
+    cout << (colocated ? "shm" : name[engine]) << " (receiver threads: " << receiver_num << "): sent " << PACKET_NUM << ", received " << received
+         << ", send pps " << PACKET_NUM / send_time
+         << ", send cpu/packet (us) " << send_cpu / PACKET_NUM * 1e6
+         << ", recv cpu/packet (us) " << all_recv_cpu / std::max<uint64_t>(received, 1) * 1e6 << endl;
+}
+
+int main() {
+    // UDP: RECV_PORT 個のポート / SO_REUSEPORT で 1 つのポートに RECV_PORT 個のソケット
+    USE_SO_REUSEPORT = false;
+    bench(UDP_ENGINE, false);
+    USE_SO_REUSEPORT = true;
+    REUSEPORT_RECV_THREAD_NUM = RECV_PORT;
+    bench(UDP_ENGINE, false);
+    bench(IO_URING_ENGINE, false);
+    bench(TCP_ENGINE, false);
+    bench(UDP_ENGINE, true);
+    return 0;
+}
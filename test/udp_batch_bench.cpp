@@ -0,0 +1,113 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+#include "../include/udp_batch.hpp"
+#include "../include/util.hpp"
+
+// loopback 上で 1 データグラム 1 システムコール (sendto / recv) と
+// sendmmsg / recvmmsg, GSO / GRO の packets/sec を比較する
+
+const uint16_t PORT = 19000;
+const uint64_t PACKET_NUM = 200000;
+const uint32_t PACKET_LENGTH = 8900; // sendMessage はデータグラムをほぼ満杯まで詰める
+
+// スレッドの CPU 時間 (s)
+double threadCpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int createSocket(const uint16_t port) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 64 << 20;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = {0, 300000}; // 300ms 来なければ終了
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (port != 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            exit(1);
+        }
+    }
+    return sockfd;
+}
+
+// mode 0: sendto / recv, 1: sendmmsg / recvmmsg, 2: GSO / GRO
+void bench(const int mode) {
+    int recv_sockfd = createSocket(PORT + mode);
+    int send_sockfd = createSocket(0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT + mode);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    uint64_t received = 0;
+    double recv_cpu = 0;
+    std::thread receiver([&]{
+        double start = threadCpuTime();
+        if (mode == 0) {
+            char message[MESSAGE_MAX_LENGTH_RECV];
+            while (recv(recv_sockfd, message, MESSAGE_MAX_LENGTH_RECV, 0) > 0) received++;
+        } else {
+            UdpBatchReceiver batch_receiver;
+            batch_receiver.init(recv_sockfd, mode == 2);
+            while (batch_receiver.receive() > 0) {
+                batch_receiver.forEachDatagram([&](const char*, const uint32_t&) { received++; });
+            }
+        }
+        recv_cpu = threadCpuTime() - start;
+    });
+
+    Timer timer;
+    double send_cpu = 0;
+    std::thread sender([&]{
+        double start = threadCpuTime();
+        if (mode == 0) {
+            char message[MESSAGE_MAX_LENGTH_SEND];
+            memset(message, 0, sizeof(message));
+            for (uint64_t i = 0; i < PACKET_NUM; i++) {
+                sendto(send_sockfd, message, PACKET_LENGTH, 0, (struct sockaddr *)&addr, sizeof(addr));
+            }
+        } else {
+            UdpBatchSender batch_sender;
+            batch_sender.init(send_sockfd, mode == 2);
+            for (uint64_t i = 0; i < PACKET_NUM; i++) {
+                memset(batch_sender.getBuffer(), 0, PACKET_LENGTH);
+                batch_sender.commit(PACKET_LENGTH, addr);
+            }
+            batch_sender.flush();
+        }
+        send_cpu = threadCpuTime() - start;
+    });
+    sender.join();
+    double send_time = timer.duration();
+    receiver.join();
+
+    const char* name[] = {"sendto/recv", "sendmmsg/recvmmsg", "GSO/GRO"};
+    cout << name[mode] << ": sent " << PACKET_NUM << ", received " << received
+         << ", send pps " << PACKET_NUM / send_time
+         << ", send pps/core " << PACKET_NUM / send_cpu
+         << ", recv pps/core " << received / recv_cpu << endl;
+
+    close(recv_sockfd);
+    close(send_sockfd);
+}
+
+int main() {
+    for (int mode = 0; mode < 3; mode++) bench(mode);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#include "../include/type.hpp"
+#include "../include/util.hpp"
+#include "../include/random_walker.hpp"
+
+// 頂点 ID の幅 (type.hpp の VERTEX_ID_32) による違いを測る
+// g++ -O2 vertex_id_bench.cpp と g++ -O2 -DVERTEX_ID_32 vertex_id_bench.cpp の出力を比べる
+// 隣接リストのメモリ量, 隣接リストを辿る歩数/s, RWer のメッセージの大きさと 1 メッセージに入る RWer 数を出力
+
+const vertex_id_t VERTEX_NUM = 1<<21;
+const uint32_t AVERAGE_DEGREE = 16;
+const uint64_t STEP_NUM = 1<<25;
+const uint32_t RWER_STEP_NUM = 20; // 1 つの RWer が同じサーバで進む歩数 (RWer のメッセージの大きさ用)
+
+int main() {
+    StdRandNumGenerator gen;
+
+    // 隣接リスト (Graph の adjacency_list_ と同じ形)
+    std::vector<std::vector<vertex_id_t>> adjacency_list(VERTEX_NUM);
+    for (vertex_id_t v = 0; v < VERTEX_NUM; v++) {
+        adjacency_list[v].resize(gen.gen(AVERAGE_DEGREE * 2) + 1);
+        for (vertex_id_t& w : adjacency_list[v]) w = gen.gen(VERTEX_NUM);
+    }
+    uint64_t adjacency_bytes = 0;
+    for (const std::vector<vertex_id_t>& neighbors : adjacency_list) adjacency_bytes += neighbors.capacity() * sizeof(vertex_id_t);
+
+    // 隣接リストを辿る
+    Timer timer;
+    vertex_id_t current_node = 0;
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < STEP_NUM; i++) {
+        const std::vector<vertex_id_t>& neighbors = adjacency_list[current_node];
+        current_node = neighbors[gen.gen(neighbors.size())];
+        checksum += current_node;
+    }
+    double step_time = timer.duration();
+
+    // RWer のメッセージの大きさ
+    RandomWalker RWer(0, adjacency_list[0].size(), 0, 0, RWER_STEP_NUM + 1);
+    current_node = 0;
+    for (uint32_t i = 0; i < RWER_STEP_NUM; i++) {
+        index_t next_index = gen.gen(adjacency_list[current_node].size());
+        current_node = adjacency_list[current_node][next_index];
+        RWer.updateRWer(current_node, 0, adjacency_list[current_node].size(), next_index, INF);
+    }
+
+    cout << "vertex_id_t: " << sizeof(vertex_id_t) * 8 << " bit" << endl;
+    cout << "adjacency list: " << adjacency_bytes / (1<<20) << " MB (" << VERTEX_NUM << " vertices)" << endl;
+    cout << "steps/s: " << STEP_NUM / step_time / 1e6 << " M (checksum " << checksum << ")" << endl;
+    cout << "RWer message after " << RWER_STEP_NUM << " steps: " << RWer.getRWerSize() << " Byte, "
+         << MESSAGE_MAX_LENGTH_SEND / RWer.getRWerSize() << " RWers per message" << endl;
+    return 0;
+}